@@ -6,38 +6,86 @@
 CU_SRCS += \
 ../src/linearSolverFactorizedSLUutils.cu \
 ../src/set_pointer.cu \
+../src/slsb.cu \
 ../src/strsv_batched.cu \
+../src/testing_sgesv_fused_batched.cu \
 ../src/tinySLUfactorization_batched.cu 
 
 CPP_SRCS += \
+../src/aio_batched.cpp \
+../src/archive_batched.cpp \
+../src/capture_batched.cpp \
+../src/instrument_batched.cpp \
+../src/latency_batched.cpp \
 ../src/linearDecompSLU_batched.cpp \
+../src/linearSolverCPU_batched.cpp \
+../src/linearSolverCPUperf_batched.cpp \
+../src/linearSolverCPUtune_batched.cpp \
 ../src/linearSolverFactorizedSLU_batched.cpp \
 ../src/linearSolverLU_batched.cpp \
+../src/matgen_batched.cpp \
+../src/metrics_batched.cpp \
+../src/npy_batched.cpp \
+../src/random_batched.cpp \
+../src/stream_batched.cpp \
 ../src/testing_sgesv_batched.cpp \
+../src/trace_batched.cpp \
 ../src/utils.cpp 
 
 OBJS += \
+./src/aio_batched.o \
+./src/archive_batched.o \
+./src/capture_batched.o \
+./src/instrument_batched.o \
+./src/latency_batched.o \
 ./src/linearDecompSLU_batched.o \
+./src/linearSolverCPU_batched.o \
+./src/linearSolverCPUperf_batched.o \
+./src/linearSolverCPUtune_batched.o \
 ./src/linearSolverFactorizedSLU_batched.o \
 ./src/linearSolverFactorizedSLUutils.o \
 ./src/linearSolverLU_batched.o \
+./src/matgen_batched.o \
+./src/metrics_batched.o \
+./src/npy_batched.o \
+./src/random_batched.o \
 ./src/set_pointer.o \
+./src/slsb.o \
+./src/stream_batched.o \
 ./src/strsv_batched.o \
 ./src/testing_sgesv_batched.o \
+./src/testing_sgesv_fused_batched.o \
+./src/trace_batched.o \
 ./src/tinySLUfactorization_batched.o \
 ./src/utils.o 
 
 CU_DEPS += \
 ./src/linearSolverFactorizedSLUutils.d \
 ./src/set_pointer.d \
+./src/slsb.d \
 ./src/strsv_batched.d \
+./src/testing_sgesv_fused_batched.d \
 ./src/tinySLUfactorization_batched.d 
 
 CPP_DEPS += \
+./src/aio_batched.d \
+./src/archive_batched.d \
+./src/capture_batched.d \
+./src/instrument_batched.d \
+./src/latency_batched.d \
 ./src/linearDecompSLU_batched.d \
+./src/linearSolverCPU_batched.d \
+./src/linearSolverCPUperf_batched.d \
+./src/linearSolverCPUtune_batched.d \
 ./src/linearSolverFactorizedSLU_batched.d \
 ./src/linearSolverLU_batched.d \
+./src/matgen_batched.d \
+./src/metrics_batched.d \
+./src/npy_batched.d \
+./src/random_batched.d \
+./src/stream_batched.d \
 ./src/testing_sgesv_batched.d \
+./src/trace_batched.d \
 ./src/utils.d 
 
 
@@ -4,7 +4,7 @@
 
 USER_OBJS :=
 
-LIBS := -lcublas_static -lculibos -lcurand  -L /cineca/prod/opt/libraries/lapack/3.8.0/intel--pe-xe-2018--binary/lib/ -L /cineca/prod/opt/libraries/blas/3.8.0/intel--pe-xe-2018--binary/lib/ -L /cineca/prod/opt/compilers/intel/pe-xe-2018/binary/lib/intel64/ -lgfortran -lifcore -lblas -llapack
+LIBS := -lcublas_static -lculibos -L /cineca/prod/opt/libraries/lapack/3.8.0/intel--pe-xe-2018--binary/lib/ -L /cineca/prod/opt/libraries/blas/3.8.0/intel--pe-xe-2018--binary/lib/ -L /cineca/prod/opt/compilers/intel/pe-xe-2018/binary/lib/intel64/ -lgfortran -lifcore -lblas -llapack
 
 #lapack
 #-L /cineca/prod/opt/libraries/lapack/3.8.0/intel--pe-xe-2018--binary/lib/ -L /cineca/prod/opt/libraries/blas/3.8.0/intel--pe-xe-2018--binary/lib/ -L /cineca/prod/opt/compilers/intel/pe-xe-2018/binary/lib/intel64/ -lgfortran -lifcore -lblas -llapack
\ No newline at end of file
@@ -0,0 +1,525 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "aio_batched.h"
+
+/*
+    Reads and writes that proceed while the caller solves: the caller queues
+    the transfers of the next chunks into buffers it is not using, solves
+    the chunk that has arrived, and waits for the next completion, so that
+    the disk and the cores are busy at the same time.
+
+    io_uring is driven through its system calls and the shared rings
+    directly, so that no library is needed. The buffers are registered with
+    the ring, so their pages are pinned once instead of at every transfer,
+    and transfers use the fixed-buffer operations; if registration fails
+    (RLIMIT_MEMLOCK on older kernels) the plain operations are used. Files
+    are also opened with O_DIRECT, which moves the data between the device
+    and the buffers without the page cache: streaming a file larger than
+    memory through the cache would only evict everything else. O_DIRECT
+    needs aligned offsets, sizes and addresses, so each transfer goes
+    through the O_DIRECT descriptor when it is aligned and through the
+    cached one otherwise (the tail of a region, or file systems without
+    O_DIRECT).
+
+    Without io_uring (kernels before 5.6, or a seccomp filter that forbids
+    it, as in some containers) a few worker threads do the same transfers
+    with pread and pwrite. Short transfers are continued in both cases, so
+    a completion is short only at the end of the file.
+
+    A queue is used from one thread.
+*/
+
+#define AIO_MAX_THREADS  8
+
+#define AIO_URING    0
+#define AIO_THREADS  1
+
+struct aio_request
+{
+    int fd;
+    int direct;
+    int write;
+    char* data;
+    uint64_t offset;
+    size_t bytes;
+    size_t done;
+    int buffer;
+    uint64_t tag;
+};
+
+struct aio_queue
+{
+    int backend;
+    int buffers;
+    size_t bufferBytes;
+    char* memory;
+    int depth;
+    int pending;
+    std::vector<aio_request> slot;      // requests in flight, by slot
+    std::vector<int> freeSlots;
+
+    // io_uring
+    int ring;
+    int fixed;                          // buffers registered
+    void* sqMap;
+    size_t sqMapBytes;
+    void* cqMap;
+    size_t cqMapBytes;
+    io_uring_sqe* sqes;
+    size_t sqesBytes;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    io_uring_cqe* cqes;
+
+    // threads
+    std::mutex mutex;
+    std::condition_variable work;
+    std::condition_variable done;
+    std::deque<int> requests;           // slots
+    std::deque<std::pair<int, long long> > completions;     // slot, result
+    std::vector<std::thread> workers;
+    int stop;
+};
+
+static int aio_aligned(const char* data, uint64_t offset, size_t bytes)
+{
+    return ((uintptr_t)data % AIO_ALIGN) == 0 && offset % AIO_ALIGN == 0 && bytes % AIO_ALIGN == 0;
+}
+
+// Descriptor for the rest of r: O_DIRECT when it is aligned.
+static int aio_fd(const aio_request* r)
+{
+    return r->direct >= 0 && aio_aligned(r->data + r->done, r->offset + r->done, r->bytes - r->done) ? r->direct
+                                                                                                   : r->fd;
+}
+
+int aio_batched_open_file(const char* path, int writable, aio_file* f)
+{
+    f->fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (f->fd < 0) {
+        printf("Error in: aio_batched_open_file, cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    f->direct = open(path, (writable ? O_RDWR : O_RDONLY) | O_DIRECT);
+    return 0;
+}
+
+void aio_batched_close_file(aio_file* f)
+{
+    if (f->direct >= 0) {
+        close(f->direct);
+    }
+    if (f->fd >= 0) {
+        close(f->fd);
+    }
+    f->fd = f->direct = -1;
+}
+
+/***************************************************************************//**
+    io_uring
+ *******************************************************************************/
+static int aio_uring_enter(int ring, unsigned submit, unsigned wait)
+{
+    for (;;) {
+        const long k = syscall(__NR_io_uring_enter, ring, submit, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0,
+                               NULL, 0);
+        if (k >= 0 || errno != EINTR) {
+            return (int)k;
+        }
+    }
+}
+
+// Maps the rings of a new ring of depth entries. 0, or -1 (and the caller
+// falls back to the threads).
+static int aio_uring_setup(aio_queue* q)
+{
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    q->ring = (int)syscall(__NR_io_uring_setup, q->depth, &p);
+    if (q->ring < 0) {
+        return -1;
+    }
+
+    q->sqMapBytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    q->cqMapBytes = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        q->sqMapBytes = q->cqMapBytes = q->sqMapBytes > q->cqMapBytes ? q->sqMapBytes : q->cqMapBytes;
+    }
+    q->sqMap = mmap(NULL, q->sqMapBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, q->ring,
+                    IORING_OFF_SQ_RING);
+    if (q->sqMap == MAP_FAILED) {
+        q->sqMap = NULL;
+        return -1;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        q->cqMap = q->sqMap;
+    }
+    else {
+        q->cqMap = mmap(NULL, q->cqMapBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, q->ring,
+                        IORING_OFF_CQ_RING);
+        if (q->cqMap == MAP_FAILED) {
+            q->cqMap = NULL;
+            return -1;
+        }
+    }
+    q->sqesBytes = p.sq_entries * sizeof(io_uring_sqe);
+    q->sqes = (io_uring_sqe*)mmap(NULL, q->sqesBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, q->ring,
+                                  IORING_OFF_SQES);
+    if (q->sqes == MAP_FAILED) {
+        q->sqes = NULL;
+        return -1;
+    }
+
+    char* sq = (char*)q->sqMap;
+    char* cq = (char*)q->cqMap;
+    q->sqTail  = (unsigned*)(sq + p.sq_off.tail);
+    q->sqMask  = (unsigned*)(sq + p.sq_off.ring_mask);
+    q->sqArray = (unsigned*)(sq + p.sq_off.array);
+    q->cqHead  = (unsigned*)(cq + p.cq_off.head);
+    q->cqTail  = (unsigned*)(cq + p.cq_off.tail);
+    q->cqMask  = (unsigned*)(cq + p.cq_off.ring_mask);
+    q->cqes    = (io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    std::vector<iovec> iov(q->buffers);
+    for (int k = 0; k < q->buffers; k++) {
+        iov[k].iov_base = q->memory + k * q->bufferBytes;
+        iov[k].iov_len  = q->bufferBytes;
+    }
+    q->fixed = syscall(__NR_io_uring_register, q->ring, IORING_REGISTER_BUFFERS, iov.data(), q->buffers) == 0;
+    return 0;
+}
+
+static void aio_uring_teardown(aio_queue* q)
+{
+    if (q->sqes != NULL) {
+        munmap(q->sqes, q->sqesBytes);
+    }
+    if (q->cqMap != NULL && q->cqMap != q->sqMap) {
+        munmap(q->cqMap, q->cqMapBytes);
+    }
+    if (q->sqMap != NULL) {
+        munmap(q->sqMap, q->sqMapBytes);
+    }
+    if (q->ring >= 0) {
+        close(q->ring);     // unregisters the buffers
+    }
+    q->sqes = NULL;
+    q->sqMap = q->cqMap = NULL;
+    q->ring = -1;
+}
+
+// Submits the rest of the request in slot s.
+static int aio_uring_submit(aio_queue* q, int s)
+{
+    const aio_request* r = &q->slot[s];
+    const unsigned tail = *q->sqTail;
+    const unsigned index = tail & *q->sqMask;
+    io_uring_sqe* sqe = &q->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    if (q->fixed) {
+        sqe->opcode = r->write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = (unsigned short)r->buffer;
+    }
+    else {
+        sqe->opcode = r->write ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    sqe->fd = aio_fd(r);
+    sqe->off = r->offset + r->done;
+    sqe->addr = (uint64_t)(uintptr_t)(r->data + r->done);
+    sqe->len = (unsigned)(r->bytes - r->done);
+    sqe->user_data = (uint64_t)s;
+    q->sqArray[index] = index;
+    __atomic_store_n(q->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    if (aio_uring_enter(q->ring, 1, 0) < 0) {
+        printf("Error in: aio_batched, io_uring_enter: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Next completion of the ring, continuing short transfers: 0, 1 if block
+// is 0 and none is there yet, -1 on an error.
+static int aio_uring_wait(aio_queue* q, int block, int* s, long long* result)
+{
+    for (;;) {
+        const unsigned head = *q->cqHead;
+        if (head == __atomic_load_n(q->cqTail, __ATOMIC_ACQUIRE)) {
+            if (!block) {
+                return 1;
+            }
+            if (aio_uring_enter(q->ring, 0, 1) < 0) {
+                printf("Error in: aio_batched, io_uring_enter: %s\n", strerror(errno));
+                return -1;
+            }
+            continue;
+        }
+        const io_uring_cqe* cqe = &q->cqes[head & *q->cqMask];
+        const int slot = (int)cqe->user_data;
+        const int res = cqe->res;
+        __atomic_store_n(q->cqHead, head + 1, __ATOMIC_RELEASE);
+
+        aio_request* r = &q->slot[slot];
+        if (res > 0 && r->done + res < r->bytes) {
+            r->done += res;
+            if (aio_uring_submit(q, slot) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        *s = slot;
+        *result = res < 0 ? res : (long long)(r->done + res);
+        return 0;
+    }
+}
+
+/***************************************************************************//**
+    Worker threads
+ *******************************************************************************/
+static long long aio_transfer(aio_request* r)
+{
+    while (r->done < r->bytes) {
+        const int fd = aio_fd(r);
+        const ssize_t k = r->write ? pwrite(fd, r->data + r->done, r->bytes - r->done, r->offset + r->done)
+                                   : pread(fd, r->data + r->done, r->bytes - r->done, r->offset + r->done);
+        if (k < 0 && errno == EINTR) {
+            continue;
+        }
+        if (k < 0) {
+            return -errno;
+        }
+        if (k == 0) {
+            break;
+        }
+        r->done += k;
+    }
+    return (long long)r->done;
+}
+
+static void aio_worker(aio_queue* q)
+{
+    std::unique_lock<std::mutex> lock(q->mutex);
+    for (;;) {
+        q->work.wait(lock, [q] { return q->stop || !q->requests.empty(); });
+        if (q->requests.empty()) {
+            return;
+        }
+        const int s = q->requests.front();
+        q->requests.pop_front();
+        aio_request r = q->slot[s];
+        lock.unlock();
+        const long long result = aio_transfer(&r);
+        lock.lock();
+        q->completions.push_back(std::make_pair(s, result));
+        q->done.notify_one();
+    }
+}
+
+/***************************************************************************//**
+    Queue
+ *******************************************************************************/
+int aio_batched_create(int buffers, size_t bufferBytes, int depth, aio_queue** q)
+{
+    const char* backend = getenv("SLSB_AIO");
+    aio_queue* r;
+
+    *q = NULL;
+    if (buffers < 1 || depth < 1 || bufferBytes == 0) {
+        printf("Error in: aio_batched_create, %d buffers of %zu bytes, depth %d\n", buffers, bufferBytes, depth);
+        return -1;
+    }
+    r = new aio_queue();
+    r->buffers = buffers;
+    r->bufferBytes = (bufferBytes + AIO_ALIGN - 1) / AIO_ALIGN * AIO_ALIGN;
+    r->depth = depth;
+    r->pending = 0;
+    r->ring = -1;
+    r->fixed = 0;
+    r->sqMap = r->cqMap = NULL;
+    r->sqes = NULL;
+    r->stop = 0;
+    r->slot.resize(depth);
+    for (int s = depth - 1; s >= 0; s--) {
+        r->freeSlots.push_back(s);
+    }
+    if (posix_memalign((void**)&r->memory, AIO_ALIGN, r->bufferBytes * buffers) != 0) {
+        printf("Error in: aio_batched_create, %d buffers of %zu bytes\n", buffers, r->bufferBytes);
+        delete r;
+        return -1;
+    }
+
+    r->backend = AIO_THREADS;
+    if (backend == NULL || strcmp(backend, "threads") != 0) {
+        if (aio_uring_setup(r) == 0) {
+            r->backend = AIO_URING;
+        }
+        else {
+            aio_uring_teardown(r);
+        }
+    }
+    if (r->backend == AIO_THREADS) {
+        const int threads = depth < AIO_MAX_THREADS ? depth : AIO_MAX_THREADS;
+        for (int k = 0; k < threads; k++) {
+            r->workers.push_back(std::thread(aio_worker, r));
+        }
+    }
+    *q = r;
+    return 0;
+}
+
+void aio_batched_destroy(aio_queue* q)
+{
+    if (q == NULL) {
+        return;
+    }
+    // The transfers in flight still use the buffers.
+    while (q->pending > 0) {
+        uint64_t tag;
+        long long result;
+        if (aio_batched_wait(q, &tag, &result) != 0) {
+            break;
+        }
+    }
+    if (q->backend == AIO_URING) {
+        aio_uring_teardown(q);
+    }
+    else {
+        {
+            std::lock_guard<std::mutex> lock(q->mutex);
+            q->stop = 1;
+        }
+        q->work.notify_all();
+        for (size_t k = 0; k < q->workers.size(); k++) {
+            q->workers[k].join();
+        }
+    }
+    free(q->memory);
+    delete q;
+}
+
+void* aio_batched_buffer(aio_queue* q, int buffer)
+{
+    return q->memory + buffer * q->bufferBytes;
+}
+
+const char* aio_batched_backend(const aio_queue* q)
+{
+    return q->backend == AIO_URING ? "io_uring" : "threads";
+}
+
+int aio_batched_pending(const aio_queue* q)
+{
+    return q->pending;
+}
+
+static int aio_queue_request(aio_queue* q, const aio_file* f, int write, int buffer, size_t position,
+                             uint64_t offset, size_t bytes, uint64_t tag)
+{
+    if (buffer < 0 || buffer >= q->buffers || position > q->bufferBytes || bytes > q->bufferBytes - position
+        || bytes > AIO_MAX_REQUEST) {
+        printf("Error in: aio_batched_%s, %zu bytes at %zu of buffer %d\n", write ? "write" : "read", bytes,
+               position, buffer);
+        return -1;
+    }
+    if (q->freeSlots.empty()) {
+        printf("Error in: aio_batched_%s, %d requests already in flight\n", write ? "write" : "read", q->depth);
+        return -1;
+    }
+
+    const int s = q->freeSlots.back();
+    aio_request* r = &q->slot[s];
+    r->fd = f->fd;
+    r->direct = f->direct;
+    r->write = write;
+    r->data = q->memory + buffer * q->bufferBytes + position;
+    r->offset = offset;
+    r->bytes = bytes;
+    r->done = 0;
+    r->buffer = buffer;
+    r->tag = tag;
+
+    if (q->backend == AIO_URING) {
+        if (aio_uring_submit(q, s) != 0) {
+            return -1;
+        }
+    }
+    else {
+        std::lock_guard<std::mutex> lock(q->mutex);
+        q->requests.push_back(s);
+        q->work.notify_one();
+    }
+    q->freeSlots.pop_back();
+    q->pending++;
+    return 0;
+}
+
+int aio_batched_read(aio_queue* q, const aio_file* f, int buffer, size_t position, uint64_t offset, size_t bytes,
+                     uint64_t tag)
+{
+    return aio_queue_request(q, f, 0, buffer, position, offset, bytes, tag);
+}
+
+int aio_batched_write(aio_queue* q, const aio_file* f, int buffer, size_t position, uint64_t offset, size_t bytes,
+                      uint64_t tag)
+{
+    return aio_queue_request(q, f, 1, buffer, position, offset, bytes, tag);
+}
+
+static int aio_complete(aio_queue* q, int block, uint64_t* tag, long long* result)
+{
+    int s;
+
+    if (q->pending == 0) {
+        return -1;
+    }
+    if (q->backend == AIO_URING) {
+        const int got = aio_uring_wait(q, block, &s, result);
+        if (got != 0) {
+            return got;
+        }
+    }
+    else {
+        std::unique_lock<std::mutex> lock(q->mutex);
+        if (block) {
+            q->done.wait(lock, [q] { return !q->completions.empty(); });
+        }
+        else if (q->completions.empty()) {
+            return 1;
+        }
+        s = q->completions.front().first;
+        *result = q->completions.front().second;
+        q->completions.pop_front();
+    }
+    *tag = q->slot[s].tag;
+    q->freeSlots.push_back(s);
+    q->pending--;
+    return 0;
+}
+
+int aio_batched_wait(aio_queue* q, uint64_t* tag, long long* result)
+{
+    return aio_complete(q, 1, tag, result) == 0 ? 0 : -1;
+}
+
+int aio_batched_poll(aio_queue* q, uint64_t* tag, long long* result)
+{
+    return aio_complete(q, 0, tag, result);
+}
@@ -0,0 +1,64 @@
+#ifndef AIO_BATCHED_H
+#define AIO_BATCHED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Asynchronous file reads and writes for streaming batches from and to
+    fast storage while the solver runs, see aio_batched.cpp. io_uring
+    through raw system calls (no liburing) on registered, page aligned
+    buffers, with O_DIRECT where the file system allows it; worker threads
+    doing pread and pwrite where io_uring is not available.
+
+    Environment:
+        SLSB_AIO    uring (default) or threads, to force the fallback
+*/
+
+#define AIO_ALIGN  4096     // of O_DIRECT offsets, sizes and buffers
+#define AIO_MAX_REQUEST  ((size_t)1 << 30)  // bytes per transfer, for the 32-bit length of io_uring
+
+// A file opened for the queue: fd, and direct the same file with O_DIRECT,
+// or -1 if the file system refuses it.
+struct aio_file
+{
+    int fd;
+    int direct;
+};
+
+// Opens path read only, or read-write (created if needed, not truncated).
+// 0, or -1 with a message.
+int aio_batched_open_file(const char* path, int writable, aio_file* f);
+void aio_batched_close_file(aio_file* f);
+
+struct aio_queue;
+
+// Queue of up to depth requests in flight, and buffers aligned buffers of
+// bufferBytes each (rounded up to AIO_ALIGN). 0, or -1 with a message.
+int aio_batched_create(int buffers, size_t bufferBytes, int depth, aio_queue** q);
+void aio_batched_destroy(aio_queue* q);
+
+void* aio_batched_buffer(aio_queue* q, int buffer);
+const char* aio_batched_backend(const aio_queue* q);    // "io_uring" or "threads"
+int aio_batched_pending(const aio_queue* q);            // requests in flight
+
+/***************************************************************************//**
+    Queue the transfer of bytes between offset in f and position in buffer.
+    O_DIRECT is used when offset, position and bytes are multiples of
+    AIO_ALIGN, the page cache otherwise. tag is returned by the completion.
+    0, or -1 with a message if the queue is full or the request is invalid.
+ *******************************************************************************/
+int aio_batched_read(aio_queue* q, const aio_file* f, int buffer, size_t position, uint64_t offset, size_t bytes,
+                     uint64_t tag);
+int aio_batched_write(aio_queue* q, const aio_file* f, int buffer, size_t position, uint64_t offset, size_t bytes,
+                      uint64_t tag);
+
+// Waits for a completion, in any order: its tag and result (bytes
+// transferred, or -errno). 0, or -1 if nothing is in flight.
+int aio_batched_wait(aio_queue* q, uint64_t* tag, long long* result);
+
+// aio_batched_wait without waiting: 0 with a completion, 1 if none is
+// there yet, -1 if nothing is in flight.
+int aio_batched_poll(aio_queue* q, uint64_t* tag, long long* result);
+
+#endif //AIO_BATCHED_H
@@ -0,0 +1,435 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
+#include "operation_batched.h"
+#include "archive_batched.h"
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+/*
+    Archives of batches too large for one array: systems of every order in
+    one file, grouped by order, found by ID, and solved from the mapped file
+    with no parsing or copying on the hot path (see archive_batched.h for
+    the layout).
+
+    The writer lays the whole file out when it is created, from the number
+    of systems per order, so that an append is a pwrite of its systems at
+    their final place, in any order of the orders, and the file is never
+    rewritten. Each segment holds one order, A and B as
+    cpuLinearSolverBatched takes them, and room for X and info, so that a
+    solve writes its results next to its inputs and any later reader finds
+    them by ID too. Unused capacity is left as holes of a sparse file.
+
+    The index is a sorted table of runs, a run being consecutive IDs stored
+    in consecutive slots of a segment: an append of a batch is one run
+    (merged with the previous one when it continues it), so the index stays
+    small whatever the number of systems, and an ID is found by binary
+    search. A range of IDs is solved run by run, each run being a batch.
+
+    Checksums are CRC-32C (the SSE4.2 crc32 instruction when compiled for
+    it): one over the header, segment table and index, checked at every
+    open, and one per segment over its A and B, checked on demand by
+    archive_batched_verify since it reads the whole file.
+*/
+
+#define ARCHIVE_TABLE_OFFSET  64
+#define ARCHIVE_SOLVE_CHUNK   ((long long)1 << 22)    // systems per solver call
+
+static_assert(sizeof(archive_header) <= ARCHIVE_TABLE_OFFSET, "the header overlaps the segment table");
+static_assert(ARCHIVE_TABLE_OFFSET + ARCHIVE_MAX_SEGMENTS * sizeof(archive_segment) <= ARCHIVE_ALIGN,
+              "the segment table does not fit in the first block");
+static_assert(sizeof(int) == sizeof(int32_t), "info is stored as int32");
+
+struct archive_writer
+{
+    int fd;
+    archive_header header;
+    archive_segment segment[ARCHIVE_MAX_SEGMENTS];
+    int segmentOf[33];          // segment of order n, -1 if none
+    uint64_t dataEnd;           // end of the last segment
+    std::vector<archive_run> runs;
+};
+
+static uint64_t archive_align(uint64_t offset)
+{
+    return (offset + ARCHIVE_ALIGN - 1) / ARCHIVE_ALIGN * ARCHIVE_ALIGN;
+}
+
+// Byte table of the CRC-32C without SSE4.2, reflected polynomial 0x82F63B78.
+struct archive_crc_table
+{
+    uint32_t value[256];
+
+    archive_crc_table()
+    {
+        for (uint32_t k = 0; k < 256; k++) {
+            uint32_t r = k;
+            for (int b = 0; b < 8; b++) {
+                r = (r >> 1) ^ (0x82F63B78u & (0u - (r & 1)));
+            }
+            value[k] = r;
+        }
+    }
+};
+
+/***************************************************************************//**
+ Purpose
+ -------
+ CRC-32C (Castagnoli) of data, continuing crc (0 for a new one), as
+ crc32c(A + B) = archive_crc32c(archive_crc32c(0, A), B).
+ *******************************************************************************/
+static uint32_t archive_crc32c(uint32_t crc, const void* data, size_t bytes)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    crc = ~crc;
+#if defined(__SSE4_2__)
+    uint64_t c = crc;
+    for (; bytes >= 8; bytes -= 8, p += 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+    crc = (uint32_t)c;
+    for (; bytes > 0; bytes--, p++) {
+        crc = _mm_crc32_u8(crc, *p);
+    }
+#else
+    static const archive_crc_table table;
+    for (; bytes > 0; bytes--, p++) {
+        crc = table.value[(crc ^ *p) & 0xff] ^ (crc >> 8);
+    }
+#endif
+    return ~crc;
+}
+
+static int archive_pwrite(int fd, const void* data, size_t bytes, uint64_t offset)
+{
+    const char* p = (const char*)data;
+    while (bytes > 0) {
+        const ssize_t done = pwrite(fd, p, bytes, (off_t)offset);
+        if (done <= 0) {
+            return -1;
+        }
+        p += done;
+        bytes -= (size_t)done;
+        offset += (uint64_t)done;
+    }
+    return 0;
+}
+
+// Checksum of the header (crc 0), the segment table and the index.
+static uint32_t archive_meta_crc(const archive_header* header, const archive_segment* segment,
+                                 const archive_run* runs)
+{
+    archive_header h = *header;
+    uint32_t crc;
+    h.crc = 0;
+    crc = archive_crc32c(0, &h, sizeof(h));
+    crc = archive_crc32c(crc, segment, header->segments * sizeof(archive_segment));
+    return archive_crc32c(crc, runs, header->index_runs * sizeof(archive_run));
+}
+
+int archive_batched_create(const char* path, const long long* capacity, archive_writer** w)
+{
+    archive_writer* a = new archive_writer();
+    uint64_t offset = ARCHIVE_ALIGN;
+
+    *w = NULL;
+    memcpy(a->header.magic, ARCHIVE_MAGIC, 8);
+    a->header.version = ARCHIVE_VERSION;
+    for (int n = 1; n <= 32; n++) {
+        a->segmentOf[n] = -1;
+        if (capacity[n] < 0) {
+            printf("Error in: archive_batched_create, capacity %lld for n = %d\n", capacity[n], n);
+            delete a;
+            return -1;
+        }
+        if (capacity[n] == 0) {
+            continue;
+        }
+        archive_segment* s = &a->segment[a->header.segments];
+        const uint64_t count = (uint64_t)capacity[n];
+        s->n = (uint32_t)n;
+        s->capacity = count;
+        s->offset_a = offset;
+        s->offset_b = archive_align(s->offset_a + count * n * n * sizeof(float));
+        s->offset_x = archive_align(s->offset_b + count * n * sizeof(float));
+        s->offset_info = archive_align(s->offset_x + count * n * sizeof(float));
+        offset = archive_align(s->offset_info + count * sizeof(int32_t));
+        a->segmentOf[n] = (int)a->header.segments++;
+    }
+    a->dataEnd = offset;
+
+    a->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (a->fd < 0) {
+        printf("Error in: archive_batched_create, cannot create %s\n", path);
+        delete a;
+        return -1;
+    }
+    // the header is written by archive_batched_finish, a file without it is not an archive
+    if (ftruncate(a->fd, (off_t)a->dataEnd) != 0) {
+        printf("Error in: archive_batched_create, cannot size %s\n", path);
+        close(a->fd);
+        delete a;
+        return -1;
+    }
+    *w = a;
+    return 0;
+}
+
+int archive_batched_append(archive_writer* w, int n, const float* A, const float* B, long long count,
+                           unsigned long long firstId)
+{
+    const int seg = (n >= 1 && n <= 32) ? w->segmentOf[n] : -1;
+    archive_segment* s;
+    size_t bytesA, bytesB;
+
+    if (seg < 0 || count < 0 || w->segment[seg].count + (uint64_t)count > w->segment[seg].capacity) {
+        printf("Error in: archive_batched_append, %lld systems of order %d do not fit\n", count, n);
+        return -1;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    s = &w->segment[seg];
+    bytesA = (size_t)count * n * n * sizeof(float);
+    bytesB = (size_t)count * n * sizeof(float);
+    if (archive_pwrite(w->fd, A, bytesA, s->offset_a + s->count * n * n * sizeof(float)) != 0
+        || archive_pwrite(w->fd, B, bytesB, s->offset_b + s->count * n * sizeof(float)) != 0) {
+        printf("Error in: archive_batched_append, write failed\n");
+        return -1;
+    }
+    s->crc_a = archive_crc32c(s->crc_a, A, bytesA);
+    s->crc_b = archive_crc32c(s->crc_b, B, bytesB);
+
+    archive_run* last = w->runs.empty() ? NULL : &w->runs.back();
+    if (last != NULL && last->segment == (uint32_t)seg && last->first_slot + last->count == s->count
+        && last->first_id + last->count == firstId) {
+        last->count += (uint64_t)count;
+    }
+    else {
+        archive_run r;
+        memset(&r, 0, sizeof(r));
+        r.first_id = firstId;
+        r.count = (uint64_t)count;
+        r.segment = (uint32_t)seg;
+        r.first_slot = s->count;
+        w->runs.push_back(r);
+    }
+    s->count += (uint64_t)count;
+    w->header.systems += (uint64_t)count;
+    return 0;
+}
+
+int archive_batched_finish(archive_writer* w)
+{
+    std::vector<archive_run>& runs = w->runs;
+    int resCode = -1;
+
+    std::sort(runs.begin(), runs.end(),
+              [](const archive_run& a, const archive_run& b) { return a.first_id < b.first_id; });
+    for (size_t k = 1; k < runs.size(); k++) {
+        if (runs[k].first_id < runs[k - 1].first_id + runs[k - 1].count) {
+            printf("Error in: archive_batched_finish, ID %llu is used twice\n",
+                   (unsigned long long)runs[k].first_id);
+            goto cleanup;
+        }
+    }
+
+    w->header.index_offset = w->dataEnd;
+    w->header.index_runs = runs.size();
+    w->header.file_bytes = w->dataEnd + runs.size() * sizeof(archive_run);
+    w->header.crc = archive_meta_crc(&w->header, w->segment, runs.data());
+    if (archive_pwrite(w->fd, runs.data(), runs.size() * sizeof(archive_run), w->header.index_offset) != 0
+        || ftruncate(w->fd, (off_t)w->header.file_bytes) != 0
+        || archive_pwrite(w->fd, w->segment, w->header.segments * sizeof(archive_segment), ARCHIVE_TABLE_OFFSET) != 0
+        || fdatasync(w->fd) != 0
+        || archive_pwrite(w->fd, &w->header, sizeof(w->header), 0) != 0
+        || fdatasync(w->fd) != 0) {
+        printf("Error in: archive_batched_finish, write failed\n");
+        goto cleanup;
+    }
+    resCode = 0;
+
+cleanup:
+    close(w->fd);
+    delete w;
+    return resCode;
+}
+
+void archive_batched_abort(archive_writer* w)
+{
+    close(w->fd);
+    delete w;
+}
+
+int archive_batched_open(const char* path, int writable, archive_batched* ar)
+{
+    struct stat st;
+    const archive_header* h;
+    int resCode = -1;
+
+    memset(ar, 0, sizeof(*ar));
+    ar->fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (ar->fd < 0) {
+        printf("Error in: archive_batched_open, cannot open %s\n", path);
+        return -1;
+    }
+    if (fstat(ar->fd, &st) != 0 || st.st_size < ARCHIVE_ALIGN) {
+        printf("Error in: archive_batched_open, %s is not an archive\n", path);
+        goto cleanup;
+    }
+    ar->bytes = (uint64_t)st.st_size;
+    ar->map = mmap(NULL, ar->bytes, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, ar->fd, 0);
+    if (ar->map == MAP_FAILED) {
+        ar->map = NULL;
+        printf("Error in: archive_batched_open, cannot map %s\n", path);
+        goto cleanup;
+    }
+    h = ar->header = (const archive_header*)ar->map;
+    ar->segment = (archive_segment*)((char*)ar->map + ARCHIVE_TABLE_OFFSET);
+
+    if (memcmp(h->magic, ARCHIVE_MAGIC, 8) != 0 || h->version != ARCHIVE_VERSION) {
+        printf("Error in: archive_batched_open, %s is not an archive (or of an unknown version)\n", path);
+        goto cleanup;
+    }
+    if (h->file_bytes != ar->bytes || h->segments > ARCHIVE_MAX_SEGMENTS || h->index_offset % ARCHIVE_ALIGN != 0
+        || h->index_offset + h->index_runs * sizeof(archive_run) != h->file_bytes) {
+        printf("Error in: archive_batched_open, %s is truncated or corrupted\n", path);
+        goto cleanup;
+    }
+    ar->runs = (const archive_run*)((const char*)ar->map + h->index_offset);
+    if (archive_meta_crc(h, ar->segment, ar->runs) != h->crc) {
+        printf("Error in: archive_batched_open, checksum mismatch in the header or index of %s\n", path);
+        goto cleanup;
+    }
+    for (uint32_t k = 0; k < h->segments; k++) {
+        const archive_segment* s = &ar->segment[k];
+        const uint64_t n = s->n;
+        if (n < 1 || n > 32 || s->count > s->capacity || s->offset_a < ARCHIVE_ALIGN
+            || s->offset_b < s->offset_a + s->capacity * n * n * sizeof(float)
+            || s->offset_x < s->offset_b + s->capacity * n * sizeof(float)
+            || s->offset_info < s->offset_x + s->capacity * n * sizeof(float)
+            || s->offset_info + s->capacity * sizeof(int32_t) > h->index_offset) {
+            printf("Error in: archive_batched_open, segment %u of %s is invalid\n", k, path);
+            goto cleanup;
+        }
+    }
+    for (uint64_t k = 0; k < h->index_runs; k++) {
+        const archive_run* r = &ar->runs[k];
+        if (r->segment >= h->segments || r->first_slot + r->count > ar->segment[r->segment].count) {
+            printf("Error in: archive_batched_open, run %llu of %s is invalid\n", (unsigned long long)k, path);
+            goto cleanup;
+        }
+    }
+    madvise(ar->map, ar->bytes, MADV_SEQUENTIAL);
+    resCode = 0;
+
+cleanup:
+    if (resCode != 0) {
+        archive_batched_close(ar);
+    }
+    return resCode;
+}
+
+void archive_batched_close(archive_batched* ar)
+{
+    if (ar->map != NULL) {
+        munmap(ar->map, ar->bytes);
+    }
+    if (ar->fd >= 0) {
+        close(ar->fd);
+    }
+    memset(ar, 0, sizeof(*ar));
+    ar->fd = -1;
+}
+
+int archive_batched_verify(const archive_batched* ar)
+{
+    int resCode = 0;
+    for (uint32_t k = 0; k < ar->header->segments; k++) {
+        const archive_segment* s = &ar->segment[k];
+        const char* base = (const char*)ar->map;
+        const uint32_t crcA = archive_crc32c(0, base + s->offset_a, s->count * s->n * s->n * sizeof(float));
+        const uint32_t crcB = archive_crc32c(0, base + s->offset_b, s->count * s->n * sizeof(float));
+        if (crcA != s->crc_a || crcB != s->crc_b) {
+            printf("Error in: archive_batched_verify, checksum mismatch in the %s of segment %u (n = %u)\n",
+                   crcA != s->crc_a ? "matrices" : "right hand sides", k, s->n);
+            resCode = -1;
+        }
+    }
+    return resCode;
+}
+
+int archive_batched_find(const archive_batched* ar, unsigned long long id, int* segment, unsigned long long* slot)
+{
+    const archive_run* first = ar->runs;
+    const archive_run* last  = ar->runs + ar->header->index_runs;
+    const archive_run* r = std::upper_bound(first, last, id,
+        [](unsigned long long v, const archive_run& x) { return v < x.first_id; });
+
+    if (r == first || id - (r - 1)->first_id >= (r - 1)->count) {
+        return -1;
+    }
+    r--;
+    *segment = (int)r->segment;
+    *slot = r->first_slot + (id - r->first_id);
+    return 0;
+}
+
+int archive_batched_solve(archive_batched* ar, unsigned long long firstId, unsigned long long lastId,
+                          unsigned long long nmask, long long* solved, long long* singular)
+{
+    char* base = (char*)ar->map;
+    int resCode = 0;
+
+    if (solved != NULL) {
+        *solved = 0;
+    }
+    if (singular != NULL) {
+        *singular = 0;
+    }
+    for (uint64_t k = 0; k < ar->header->index_runs && resCode == 0; k++) {
+        const archive_run* r = &ar->runs[k];
+        const archive_segment* s = &ar->segment[r->segment];
+        const int n = (int)s->n;
+        if (r->first_id > lastId) {
+            break;
+        }
+        if (r->first_id + r->count - 1 < firstId || !((nmask >> n) & 1)) {
+            continue;
+        }
+        const uint64_t lo = std::max<uint64_t>(r->first_id, firstId) - r->first_id;
+        const uint64_t hi = std::min<uint64_t>(r->first_id + r->count - 1, lastId) - r->first_id;
+
+        for (uint64_t at = lo; at <= hi; at += ARCHIVE_SOLVE_CHUNK) {
+            const uint64_t slot = r->first_slot + at;
+            const int count = (int)std::min<uint64_t>(hi + 1 - at, ARCHIVE_SOLVE_CHUNK);
+            float* A = (float*)(base + s->offset_a) + slot * n * n;
+            float* B = (float*)(base + s->offset_b) + slot * n;
+            float* X = (float*)(base + s->offset_x) + slot * n;
+            int* info = (int*)(base + s->offset_info) + slot;
+
+            if (cpuLinearSolverBatched(n, A, B, &X, info, count) < 0) {
+                printf("Error in: archive_batched_solve, solver failed for n = %d\n", n);
+                resCode = -1;
+                break;
+            }
+            if (solved != NULL) {
+                *solved += count;
+            }
+            for (int i = 0; singular != NULL && i < count; i++) {
+                *singular += info[i] > 0;
+            }
+        }
+    }
+    return resCode;
+}
@@ -0,0 +1,116 @@
+#ifndef ARCHIVE_BATCHED_H
+#define ARCHIVE_BATCHED_H
+
+#include <stdint.h>
+
+/*
+    Indexed archive of mixed-size systems, see archive_batched.cpp.
+
+    File, native (little endian) byte order, every region aligned to
+    ARCHIVE_ALIGN bytes so that it can be mapped and used directly:
+        archive_header, then the archive_segment table   (first ARCHIVE_ALIGN bytes)
+        per segment (one per N):
+            A     capacity column-major n-by-n matrices, packed
+            B     capacity vectors of n
+            X     capacity solutions, written by archive_batched_solve
+            info  capacity int32, the getrf info of each solved system
+        the index: runs of consecutive system IDs, sorted by ID
+
+    A system is located by its ID through the index, and a run of systems
+    of one segment is a contiguous batch in the layout of
+    cpuLinearSolverBatched, solved where it is mapped.
+*/
+
+#define ARCHIVE_MAGIC    "SLSBARC1"
+#define ARCHIVE_VERSION  1
+#define ARCHIVE_ALIGN    4096
+#define ARCHIVE_MAX_SEGMENTS  32
+
+struct archive_header
+{
+    char magic[8];              // ARCHIVE_MAGIC, not terminated
+    uint32_t version;
+    uint32_t segments;          // archive_segment entries after the header
+    uint64_t systems;           // written, over all the segments
+    uint64_t index_offset;      // of the archive_run table
+    uint64_t index_runs;
+    uint64_t file_bytes;
+    uint32_t crc;               // CRC-32C of the header (this field 0), the segment table and the index
+    uint32_t reserved;
+};
+
+struct archive_segment
+{
+    uint32_t n;
+    uint32_t reserved;
+    uint64_t capacity;          // systems the regions are sized for
+    uint64_t count;             // systems written, slots 0 to count - 1
+    uint64_t offset_a;          // regions, from the start of the file
+    uint64_t offset_b;
+    uint64_t offset_x;
+    uint64_t offset_info;
+    uint32_t crc_a;             // CRC-32C of the count matrices
+    uint32_t crc_b;             // and right hand sides
+};
+
+// IDs first_id to first_id + count - 1 are the slots first_slot onwards of segment.
+struct archive_run
+{
+    uint64_t first_id;
+    uint64_t count;
+    uint32_t segment;
+    uint32_t reserved;
+    uint64_t first_slot;
+};
+
+/***************************************************************************//**
+    Writing. archive_batched_create lays out the file for capacity[n]
+    systems of order n (n in [1, 32], capacity[0] unused), appends write
+    count systems of one order, packed as for cpuLinearSolverBatched, with
+    the IDs firstId onwards, and archive_batched_finish writes the index,
+    the checksums and the header, and frees the writer. IDs must be unique.
+    All return 0, or -1 with a message. archive_batched_abort frees the
+    writer of a failed packing without writing the header, so that the file
+    is not an archive; the caller removes it.
+ *******************************************************************************/
+struct archive_writer;
+
+int archive_batched_create(const char* path, const long long* capacity, archive_writer** w);
+int archive_batched_append(archive_writer* w, int n, const float* A, const float* B, long long count,
+                           unsigned long long firstId);
+int archive_batched_finish(archive_writer* w);
+void archive_batched_abort(archive_writer* w);
+
+// Reading, of a mapped archive.
+struct archive_batched
+{
+    void* map;
+    uint64_t bytes;
+    int fd;
+    const archive_header* header;
+    archive_segment* segment;
+    const archive_run* runs;
+};
+
+// Maps path (writable to solve into it) and checks the header, segment
+// table and index. 0, or -1 with a message.
+int archive_batched_open(const char* path, int writable, archive_batched* ar);
+void archive_batched_close(archive_batched* ar);
+
+// Checks the checksums of the data of every segment. 0, or -1 with a message.
+int archive_batched_verify(const archive_batched* ar);
+
+// System id: its segment and slot. 0, or -1 if there is no such ID.
+int archive_batched_find(const archive_batched* ar, unsigned long long id, int* segment, unsigned long long* slot);
+
+/***************************************************************************//**
+    Solves, with the CPU solver and in the mapping, the systems with an ID
+    in [firstId, lastId] and an order n with bit n of nmask set, writing
+    their X and info. The runs of the index are solved in place, as
+    batches. *solved and *singular, if not NULL, count the systems.
+    Returns 0, -1 on an error.
+ *******************************************************************************/
+int archive_batched_solve(archive_batched* ar, unsigned long long firstId, unsigned long long lastId,
+                          unsigned long long nmask, long long* solved, long long* singular);
+
+#endif //ARCHIVE_BATCHED_H
@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "capture_batched.h"
+
+/*
+    Capture of real batches, so that optimizations can be measured on the
+    matrices a deployment actually solves (their pivoting, conditioning and
+    singular rate) rather than on random normal ones.
+
+    Environment:
+        SLSB_CAPTURE          output file; capture is off when it is not set
+        SLSB_CAPTURE_EVERY    one solver call in this many is sampled,
+                              default 100 (the first call always is)
+        SLSB_CAPTURE_SYSTEMS  systems kept per sampled batch, default 256,
+                              evenly strided over the batch with an offset
+                              that moves from sample to sample
+        SLSB_CAPTURE_MB       size of the file at which capture stops,
+                              default 1024
+
+    A sampled call copies its systems into one buffer and queues it; a
+    writer thread appends the buffers to the file, so the solver never waits
+    for the disk. When more than CAPTURE_QUEUE_BYTES are waiting, samples
+    are dropped instead, and their number is printed at exit. Calls that
+    are not sampled cost one atomic increment.
+*/
+
+#define CAPTURE_DEFAULT_EVERY    100
+#define CAPTURE_DEFAULT_SYSTEMS  256
+#define CAPTURE_DEFAULT_MB       1024
+#define CAPTURE_QUEUE_BYTES      ((size_t)64 << 20)
+
+struct capture_item
+{
+    capture_record_header header;
+    size_t bytes;           // of data
+    float* data;            // A then B
+};
+
+static std::atomic<int> capture_state(-1);     // -1 environment not read yet, 0 off, 1 on
+static std::atomic<unsigned long long> capture_sequence(0);
+static std::mutex capture_mutex;
+static std::condition_variable capture_wake;    // writer: work or stop
+static std::condition_variable capture_idle;    // capture_batched_flush: queue drained
+static std::deque<capture_item> capture_queue;
+static std::thread* capture_writer = NULL;
+static FILE* capture_file = NULL;
+static const char* capture_path = NULL;
+static unsigned long long capture_every = CAPTURE_DEFAULT_EVERY;
+static int capture_systems = CAPTURE_DEFAULT_SYSTEMS;
+static size_t capture_max_bytes = (size_t)CAPTURE_DEFAULT_MB << 20;
+static size_t capture_queued = 0;       // bytes waiting in the queue
+static size_t capture_written = 0;      // bytes of the file
+static int capture_busy = 0;            // the writer holds an item
+static int capture_stop = 0;
+static int capture_error = 0;
+static unsigned long long capture_dropped = 0;
+
+static void capture_write_loop()
+{
+    std::unique_lock<std::mutex> lock(capture_mutex);
+    for (;;) {
+        capture_wake.wait(lock, [] { return capture_stop || !capture_queue.empty(); });
+        if (capture_queue.empty()) {
+            return;
+        }
+        capture_item item = capture_queue.front();
+        capture_queue.pop_front();
+        capture_busy = 1;
+        lock.unlock();
+
+        const int ok = fwrite(&item.header, sizeof(item.header), 1, capture_file) == 1
+                    && fwrite(item.data, 1, item.bytes, capture_file) == item.bytes;
+        free(item.data);
+
+        lock.lock();
+        capture_busy = 0;
+        capture_queued -= item.bytes;
+        if (!ok && !capture_error) {
+            printf("Error in: cannot write the capture to %s\n", capture_path);
+            capture_error = 1;
+        }
+        if (capture_queue.empty()) {
+            capture_idle.notify_all();
+        }
+    }
+}
+
+static void capture_atexit()
+{
+    {
+        std::lock_guard<std::mutex> lock(capture_mutex);
+        capture_stop = 1;
+    }
+    capture_wake.notify_all();
+    if (capture_writer != NULL) {
+        capture_writer->join();
+        delete capture_writer;
+        capture_writer = NULL;
+    }
+    if (capture_file != NULL) {
+        fclose(capture_file);
+        capture_file = NULL;
+    }
+    if (capture_dropped > 0) {
+        printf("capture: %llu samples dropped, the writer could not keep up\n", capture_dropped);
+    }
+}
+
+static void capture_init()
+{
+    std::lock_guard<std::mutex> lock(capture_mutex);
+    if (capture_state.load() >= 0) {
+        return;
+    }
+    const char* path    = getenv("SLSB_CAPTURE");
+    const char* every   = getenv("SLSB_CAPTURE_EVERY");
+    const char* systems = getenv("SLSB_CAPTURE_SYSTEMS");
+    const char* mb      = getenv("SLSB_CAPTURE_MB");
+    capture_file_header header;
+
+    if (path == NULL || path[0] == '\0') {
+        capture_state.store(0);
+        return;
+    }
+    if (every != NULL && atoll(every) > 0) {
+        capture_every = (unsigned long long)atoll(every);
+    }
+    if (systems != NULL && atoi(systems) > 0) {
+        capture_systems = atoi(systems);
+    }
+    if (mb != NULL && atol(mb) > 0) {
+        capture_max_bytes = (size_t)atol(mb) << 20;
+    }
+
+    capture_file = fopen(path, "wb");
+    if (capture_file == NULL) {
+        printf("Error in: cannot open the capture file %s\n", path);
+        capture_state.store(0);
+        return;
+    }
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+    header.version      = CAPTURE_VERSION;
+    header.record_bytes = sizeof(capture_record_header);
+    if (fwrite(&header, sizeof(header), 1, capture_file) != 1) {
+        printf("Error in: cannot write the capture file %s\n", path);
+        fclose(capture_file);
+        capture_file = NULL;
+        capture_state.store(0);
+        return;
+    }
+    capture_path = path;
+    capture_written = sizeof(header);
+    capture_writer = new std::thread(capture_write_loop);
+    atexit(capture_atexit);
+    capture_state.store(1);
+}
+
+int capture_batched_enabled()
+{
+    int state = capture_state.load(std::memory_order_relaxed);
+    if (state < 0) {
+        capture_init();
+        state = capture_state.load();
+    }
+    return state;
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Samples a solver call, see the header: one call in SLSB_CAPTURE_EVERY
+ has up to SLSB_CAPTURE_SYSTEMS of its systems copied, packed, and queued
+ for the writer thread.
+ *******************************************************************************/
+void capture_batched_sample(int backend, int n, int W, const float* A, const float* B, int batchCount)
+{
+    if (!capture_batched_enabled() || n < 1 || batchCount < 1) {
+        return;
+    }
+    const unsigned long long sequence = capture_sequence.fetch_add(1, std::memory_order_relaxed);
+    if (sequence % capture_every != 0) {
+        return;
+    }
+
+    capture_item item;
+    const int systems = batchCount < capture_systems ? batchCount : capture_systems;
+    const size_t stride = (size_t)batchCount / systems;
+    const size_t first = (size_t)(sequence / capture_every) % stride;
+    const size_t nn = (size_t)n * n;
+
+    item.bytes = (size_t)systems * (nn + n) * sizeof(float);
+    {
+        std::lock_guard<std::mutex> lock(capture_mutex);
+        if (capture_error || capture_written + sizeof(capture_record_header) + item.bytes > capture_max_bytes) {
+            return;
+        }
+        if (capture_queued + item.bytes > CAPTURE_QUEUE_BYTES) {
+            capture_dropped++;
+            return;
+        }
+        // reserved now, so that concurrent samples respect the limits
+        capture_queued  += item.bytes;
+        capture_written += sizeof(capture_record_header) + item.bytes;
+    }
+
+    item.data = (float*)malloc(item.bytes);
+    if (item.data != NULL) {
+        float* dA = item.data;
+        float* dB = item.data + (size_t)systems * nn;
+        for (int k = 0; k < systems; k++) {
+            const size_t s = first + (size_t)k * stride;
+            if (W == 0) {
+                memcpy(dA + k * nn, A + s * nn, nn * sizeof(float));
+                memcpy(dB + (size_t)k * n, B + s * n, n * sizeof(float));
+                continue;
+            }
+            if (W == CAPTURE_ROW_MAJOR) {
+                for (int i = 0; i < n; i++) {
+                    for (int j = 0; j < n; j++) {
+                        dA[k * nn + i + (size_t)j * n] = A[s * nn + (size_t)i * n + j];
+                    }
+                }
+                memcpy(dB + (size_t)k * n, B + s * n, n * sizeof(float));
+                continue;
+            }
+            // interleaved: element e of system s is at ((s / W) * count + e) * W + s % W
+            const float* gA = A + (s / W) * nn * W + s % W;
+            const float* gB = B + (s / W) * n * W + s % W;
+            for (size_t e = 0; e < nn; e++) {
+                dA[k * nn + e] = gA[e * W];
+            }
+            for (int e = 0; e < n; e++) {
+                dB[(size_t)k * n + e] = gB[(size_t)e * W];
+            }
+        }
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    item.header.magic       = CAPTURE_RECORD_MAGIC;
+    item.header.n           = (uint32_t)n;
+    item.header.systems     = (uint32_t)systems;
+    item.header.backend     = (uint32_t)backend;
+    item.header.batch_count = (uint64_t)batchCount;
+    item.header.sequence    = sequence;
+    item.header.first       = first;
+    item.header.stride      = stride;
+    item.header.time        = (double)now.tv_sec + 1e-9 * (double)now.tv_nsec;
+
+    std::lock_guard<std::mutex> lock(capture_mutex);
+    if (item.data == NULL) {
+        printf("Error in: capture buffer malloc, sample dropped\n");
+        capture_queued  -= item.bytes;
+        capture_written -= sizeof(capture_record_header) + item.bytes;
+        capture_dropped++;
+        return;
+    }
+    capture_queue.push_back(item);
+    capture_wake.notify_one();
+}
+
+int capture_batched_flush()
+{
+    std::unique_lock<std::mutex> lock(capture_mutex);
+    if (capture_file == NULL) {
+        return 0;
+    }
+    capture_idle.wait(lock, [] { return capture_queue.empty() && !capture_busy; });
+    fflush(capture_file);
+    return capture_error ? -1 : 0;
+}
+
+FILE* capture_batched_open(const char* path)
+{
+    capture_file_header header;
+    FILE* f = fopen(path, "rb");
+
+    if (f == NULL) {
+        printf("Error in: cannot open the capture file %s\n", path);
+        return NULL;
+    }
+    if (fread(&header, sizeof(header), 1, f) != 1
+        || memcmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != CAPTURE_VERSION
+        || header.record_bytes != sizeof(capture_record_header)) {
+        printf("Error in: %s is not a capture file of this version\n", path);
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+int capture_batched_read(FILE* f, capture_record_header* h, float** A, float** B)
+{
+    *A = NULL;
+    *B = NULL;
+    const size_t got = fread(h, 1, sizeof(*h), f);
+    if (got == 0 && feof(f)) {
+        return 0;
+    }
+    if (got != sizeof(*h) || h->magic != CAPTURE_RECORD_MAGIC || h->n < 1 || h->n > 32 || h->systems < 1) {
+        printf("Error in: corrupted capture record\n");
+        return -1;
+    }
+    const size_t sizeA = (size_t)h->systems * h->n * h->n;
+    const size_t sizeB = (size_t)h->systems * h->n;
+    *A = (float*)malloc(sizeA * sizeof(float));
+    *B = (float*)malloc(sizeB * sizeof(float));
+    if (*A == NULL || *B == NULL
+        || fread(*A, sizeof(float), sizeA, f) != sizeA
+        || fread(*B, sizeof(float), sizeB, f) != sizeB) {
+        printf("Error in: truncated capture record\n");
+        free(*A);
+        free(*B);
+        *A = NULL;
+        *B = NULL;
+        return -1;
+    }
+    return 1;
+}
@@ -0,0 +1,63 @@
+#ifndef CAPTURE_BATCHED_H
+#define CAPTURE_BATCHED_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+    Capture of sampled production batches to a binary file, for replay by
+    the benchmark suite (benchSgesv --replay), see capture_batched.cpp.
+
+    File: a capture_file_header, then records, each a capture_record_header
+    followed by systems column major N-by-N matrices A and systems vectors
+    B, packed, in native (little endian) byte order.
+*/
+
+#define CAPTURE_MAGIC        "SLSBCAP1"
+#define CAPTURE_VERSION      1
+#define CAPTURE_RECORD_MAGIC 0x43455253u   // "SREC"
+
+// Where a batch was captured
+#define CAPTURE_BACKEND_CPU  0
+#define CAPTURE_BACKEND_GPU  1
+
+struct capture_file_header
+{
+    char magic[8];          // CAPTURE_MAGIC, not terminated
+    uint32_t version;
+    uint32_t record_bytes;  // sizeof(capture_record_header) of the writer
+};
+
+struct capture_record_header
+{
+    uint32_t magic;         // CAPTURE_RECORD_MAGIC
+    uint32_t n;
+    uint32_t systems;       // systems in the record
+    uint32_t backend;
+    uint64_t batch_count;   // systems of the batch they were sampled from
+    uint64_t sequence;      // call of the solver, counted from 0
+    uint64_t first;         // index in the batch of the first system kept
+    uint64_t stride;        // and of the next ones
+    double   time;          // seconds since the epoch
+};
+
+// Nonzero if SLSB_CAPTURE is set; the environment is read on the first call.
+int capture_batched_enabled();
+
+// Called by a solver with its input batch before it solves it, copies the
+// sampled systems and queues them for the writer thread. W is 0 for packed
+// systems, CAPTURE_ROW_MAJOR for packed row-major A (transposed into the
+// record), else the width of the interleaved groups.
+#define CAPTURE_ROW_MAJOR  -1
+void capture_batched_sample(int backend, int n, int W, const float* A, const float* B, int batchCount);
+
+// Waits until every queued record is written. Returns 0, or -1 on a write error.
+int capture_batched_flush();
+
+// Reading. capture_batched_open checks the file header, capture_batched_read
+// returns 1 and the next record in A and B (malloc'ed, freed by the caller),
+// 0 at the end of the file and -1 on a truncated or corrupted record.
+FILE* capture_batched_open(const char* path);
+int capture_batched_read(FILE* f, capture_record_header* h, float** A, float** B);
+
+#endif //CAPTURE_BATCHED_H
@@ -0,0 +1,34 @@
+#ifndef CPU_PERF_BATCHED_H
+#define CPU_PERF_BATCHED_H
+
+/*
+    Internal interface between the CPU engine and its hardware counters,
+    see linearSolverCPUperf_batched.cpp. The public API is in
+    operation_batched.h.
+
+    A thread that solves a tile of systems phase by phase does
+
+        cpu_perf_thread* t = cpu_perf_thread_get();
+        cpu_perf_mark(t, -1);
+        ... factor ...    cpu_perf_mark(t, CPU_PERF_FACTOR);
+        ... permute ...   cpu_perf_mark(t, CPU_PERF_PERMUTE);
+        ...
+        cpu_perf_add_systems(t, count);
+
+    Each mark reads the counter groups of the thread and adds what was
+    counted since the previous mark to the given phase. t is NULL when the
+    counters of the thread could not be opened; every call accepts it.
+*/
+
+struct cpu_perf_thread;
+
+// Nonzero while the engine must take its instrumented path.
+int cpu_perf_active();
+
+// Counters of the calling thread, opened on first use; NULL if unavailable.
+cpu_perf_thread* cpu_perf_thread_get();
+
+void cpu_perf_mark(cpu_perf_thread* t, int phase);
+void cpu_perf_add_systems(cpu_perf_thread* t, int count);
+
+#endif //CPU_PERF_BATCHED_H
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include "instrument_batched.h"
+#include "capture_batched.h"
+#include "latency_batched.h"
+#include "metrics_batched.h"
+#include "trace_batched.h"
+
+/*
+    The capture, trace, metrics and latency hooks of the solvers, in one
+    place so that the CPU engine, its layouts and gpuLinearSolverBatched
+    cannot record different things. Each hook costs a test of its enabled
+    flag when it is off; the clocks are only read for the hooks that are on.
+*/
+
+static int instrument_timed(const instrument_batched* s)
+{
+    return s->metrics || latency_batched_enabled();
+}
+
+double instrument_batched_now()
+{
+    return latency_batched_enabled() || metrics_batched_enabled() ? latency_batched_now() : 0.0;
+}
+
+void instrument_batched_begin(instrument_batched* s, const char* name, int backend, int n, int batchCount,
+                              const float* h_A, const float* h_B, int W, double l0)
+{
+    s->name       = name;
+    s->backend    = backend;
+    s->n          = n;
+    s->batchCount = batchCount;
+    s->metrics    = metrics_batched_enabled();
+    s->staged     = 0;
+    s->solved     = 0;
+    s->ended      = 0;
+
+    if (capture_batched_enabled()) {
+        capture_batched_sample(backend == METRICS_BACKEND_GPU ? CAPTURE_BACKEND_GPU : CAPTURE_BACKEND_CPU,
+                               n, W, h_A, h_B, batchCount);
+    }
+    if (s->metrics) {
+        metrics_batched_in_flight(backend, 1);
+    }
+    s->t0 = trace_batched_enabled() ? trace_batched_now() : 0.0;
+    s->l1 = instrument_timed(s) ? latency_batched_now() : 0.0;
+    s->l0 = (l0 != 0.0) ? l0 : s->l1;
+    s->l2 = s->l1;
+}
+
+void instrument_batched_solve_begin(instrument_batched* s)
+{
+    s->staged = 1;
+    s->l1 = instrument_timed(s) ? latency_batched_now() : 0.0;
+}
+
+void instrument_batched_solve_end(instrument_batched* s)
+{
+    s->solved = 1;
+    s->l2 = instrument_timed(s) ? latency_batched_now() : 0.0;
+}
+
+void instrument_batched_end(instrument_batched* s, const int* h_info)
+{
+    if (s->ended) {
+        return;
+    }
+    s->ended = 1;
+    if (!s->solved && h_info != NULL) {
+        instrument_batched_solve_end(s);
+    }
+    if (h_info != NULL && s->name != NULL && trace_batched_enabled()) {
+        trace_batched_event(s->name, "api", s->t0, -1, s->n, s->batchCount);
+    }
+    if (s->metrics) {
+        if (h_info != NULL) {
+            int singular = 0;
+            for (int i = 0; i < s->batchCount; i++) {
+                singular += h_info[i] > 0;
+            }
+            metrics_batched_solved(s->backend, s->n, s->batchCount, singular, s->l2 - s->l1);
+        }
+        metrics_batched_in_flight(s->backend, -1);
+    }
+    if (h_info != NULL && latency_batched_enabled()) {
+        if (s->staged) {
+            latency_batched_record(LATENCY_QUEUE, s->n, s->batchCount, s->l1 - s->l0);
+        }
+        latency_batched_record(LATENCY_SOLVE, s->n, s->batchCount, s->l2 - s->l1);
+        latency_batched_record(LATENCY_TOTAL, s->n, s->batchCount, latency_batched_now() - s->l0);
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef INSTRUMENT_BATCHED_H
+#define INSTRUMENT_BATCHED_H
+
+/*
+    Instrumentation of the public solvers: capture, trace, metrics and
+    latency of one call, see instrument_batched.cpp. A solver brackets its
+    work with
+
+        instrument_batched inst;
+        instrument_batched_begin(&inst, "cpuLinearSolverBatched", METRICS_BACKEND_CPU,
+                                 n, batchCount, h_A, h_B, 0, l0);
+        ... solve ...
+        instrument_batched_end(&inst, h_info);
+
+    so that every entry point records the same things the same way. Internal
+    entries (cpu_solve_batched, for the tuners) call the solvers below this
+    layer and record nothing.
+*/
+
+struct instrument_batched
+{
+    const char* name;   // traced as an "api" event, NULL for none
+    int backend;        // METRICS_BACKEND_*
+    int n;
+    int batchCount;
+    int metrics;        // metrics_batched_enabled() at begin
+    int staged;         // instrument_batched_solve_begin was called
+    int solved;         // instrument_batched_solve_end was called
+    int ended;
+    double t0;          // trace clock at begin
+    double l0;          // latency clock at the call
+    double l1;          // start of the solve
+    double l2;          // end of the solve
+};
+
+// Latency clock at the entry of a solver, 0 when nothing records it.
+double instrument_batched_now();
+
+// Starts the instrumentation of a call: captures the batch (W as in
+// capture_batched_sample), counts the solve in
+// flight, starts the trace event and the solve time. l0 is the
+// instrument_batched_now() of the entry, 0 to start the call here.
+void instrument_batched_begin(instrument_batched* s, const char* name, int backend, int n, int batchCount,
+                              const float* h_A, const float* h_B, int W, double l0);
+
+// For solvers that stage the batch first (gpuLinearSolverBatched): the solve
+// proper, the time from begin to it being recorded as queue time. Without
+// them the solve is everything between begin and end.
+void instrument_batched_solve_begin(instrument_batched* s);
+void instrument_batched_solve_end(instrument_batched* s);
+
+// Ends the call: trace event, solved systems and singular ones (h_info > 0),
+// latencies. h_info is NULL when the call failed, which records nothing but
+// the end of the solve in flight. Does nothing the second time, so that
+// error paths can call it again.
+void instrument_batched_end(instrument_batched* s, const int* h_info);
+
+#endif //INSTRUMENT_BATCHED_H
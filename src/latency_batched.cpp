@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include "latency_batched.h"
+
+/*
+    Tail latency of the solvers: one HDR style histogram per kind
+    (LATENCY_QUEUE, LATENCY_SOLVE, LATENCY_TOTAL), N and batch size class.
+
+    Recording is lock free: the histogram of a (kind, N, class) is allocated
+    on its first value and published with a compare and swap, then every
+    value is a relaxed atomic increment of its bucket, of the count and of
+    the sum, plus compare and swap loops for the min and max. Threads share
+    the histograms, so there is nothing to merge inside a process; snapshots
+    (latency_batched_get) of several processes or runs are merged with
+    latency_batched_merge, bucket by bucket.
+
+    Bucket of a value v in ns, with S = LATENCY_SUB:
+        v < 2S:  v itself
+        else:    shift = msb(v) - LATENCY_SUB_BITS, bucket = (shift + 1) * S + (v >> shift) - S
+    so a bucket spans 1/S of its value at most. Percentiles are the upper
+    end of the bucket they fall in, the largest value it may hold.
+
+    Environment:
+        SLSB_LATENCY  enables recording; the histograms are dumped at exit to
+                      this file, or to the standard output if it is "-"
+
+    A snapshot taken while solves run may be off by the values in flight.
+    latency_batched_reset must be called between solves.
+*/
+
+struct latency_live
+{
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> min;
+    std::atomic<uint64_t> max;
+    std::atomic<uint64_t> buckets[LATENCY_BUCKETS];
+};
+
+static std::atomic<latency_live*> latency_table[LATENCY_NKINDS][LATENCY_MAX_N + 1][LATENCY_BATCH_CLASSES];
+static std::atomic<int> latency_state(-1);      // -1 environment not read yet, 0 off, 1 on
+static std::mutex latency_mutex;
+static const char* latency_path = NULL;
+
+static const char* latency_kind_names[LATENCY_NKINDS] = { "queue", "solve", "total" };
+
+static void latency_atexit()
+{
+    if (latency_path == NULL) {
+        return;
+    }
+    if (strcmp(latency_path, "-") == 0) {
+        latency_batched_dump(stdout);
+        return;
+    }
+    FILE* f = fopen(latency_path, "w");
+    if (f == NULL) {
+        printf("Error in: cannot write the latency histograms to %s\n", latency_path);
+        return;
+    }
+    latency_batched_dump(f);
+    fclose(f);
+}
+
+int latency_batched_enabled()
+{
+    int state = latency_state.load(std::memory_order_relaxed);
+    if (state < 0) {
+        std::lock_guard<std::mutex> lock(latency_mutex);
+        if (latency_state.load() < 0) {
+            const char* path = getenv("SLSB_LATENCY");
+            if (path != NULL && path[0] != '\0') {
+                latency_path = path;
+                atexit(latency_atexit);
+            }
+            latency_state.store(latency_path != NULL);
+        }
+        state = latency_state.load();
+    }
+    return state;
+}
+
+void latency_batched_enable(int enable)
+{
+    latency_batched_enabled();
+    latency_state.store(enable != 0);
+}
+
+double latency_batched_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + 1e-9 * (double)now.tv_nsec;
+}
+
+int latency_batched_batch_class(int batchCount)
+{
+    int c = 0;
+    while (c < LATENCY_BATCH_CLASSES - 1 && batchCount >= (2 << c)) {
+        c++;
+    }
+    return c;
+}
+
+static int latency_bucket(uint64_t v)
+{
+    if (v < 2 * LATENCY_SUB) {
+        return (int)v;
+    }
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - LATENCY_SUB_BITS;
+    if (shift > LATENCY_MAX_SHIFT) {
+        return LATENCY_BUCKETS - 1;
+    }
+    return (shift + 1) * LATENCY_SUB + (int)(v >> shift) - LATENCY_SUB;
+}
+
+// Largest value of bucket b.
+static uint64_t latency_bucket_high(int b)
+{
+    if (b < 2 * LATENCY_SUB) {
+        return (uint64_t)b;
+    }
+    const int shift = b / LATENCY_SUB - 1;
+    const uint64_t sub = (uint64_t)(b % LATENCY_SUB + LATENCY_SUB);
+    return ((sub + 1) << shift) - 1;
+}
+
+void latency_batched_record(int kind, int n, int batchCount, double seconds)
+{
+    if (kind < 0 || kind >= LATENCY_NKINDS || n < 0 || n > LATENCY_MAX_N || seconds < 0) {
+        return;
+    }
+    std::atomic<latency_live*>& slot = latency_table[kind][n][latency_batched_batch_class(batchCount)];
+    latency_live* h = slot.load(std::memory_order_acquire);
+    if (h == NULL) {
+        latency_live* fresh = new latency_live();
+        fresh->min.store(UINT64_MAX);
+        if (slot.compare_exchange_strong(h, fresh, std::memory_order_acq_rel)) {
+            h = fresh;
+        }
+        else {
+            delete fresh;
+        }
+    }
+
+    const uint64_t v = (uint64_t)(seconds * 1e9 + 0.5);
+    h->buckets[latency_bucket(v)].fetch_add(1, std::memory_order_relaxed);
+    h->count.fetch_add(1, std::memory_order_relaxed);
+    h->sum.fetch_add(v, std::memory_order_relaxed);
+    uint64_t seen = h->min.load(std::memory_order_relaxed);
+    while (v < seen && !h->min.compare_exchange_weak(seen, v, std::memory_order_relaxed)) {
+    }
+    seen = h->max.load(std::memory_order_relaxed);
+    while (v > seen && !h->max.compare_exchange_weak(seen, v, std::memory_order_relaxed)) {
+    }
+}
+
+unsigned long long latency_batched_get(int kind, int n, int batchClass, latency_histogram* h)
+{
+    memset(h, 0, sizeof(*h));
+    if (kind < 0 || kind >= LATENCY_NKINDS || n < 0 || n > LATENCY_MAX_N
+        || batchClass < 0 || batchClass >= LATENCY_BATCH_CLASSES) {
+        return 0;
+    }
+    const latency_live* live = latency_table[kind][n][batchClass].load(std::memory_order_acquire);
+    if (live == NULL) {
+        return 0;
+    }
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        h->buckets[b] = live->buckets[b].load(std::memory_order_relaxed);
+        h->count += h->buckets[b];
+    }
+    h->sum = live->sum.load(std::memory_order_relaxed);
+    h->min = h->count > 0 ? live->min.load(std::memory_order_relaxed) : 0;
+    h->max = live->max.load(std::memory_order_relaxed);
+    return h->count;
+}
+
+void latency_batched_merge(latency_histogram* into, const latency_histogram* from)
+{
+    if (from->count == 0) {
+        return;
+    }
+    if (into->count == 0 || from->min < into->min) {
+        into->min = from->min;
+    }
+    if (from->max > into->max) {
+        into->max = from->max;
+    }
+    into->count += from->count;
+    into->sum   += from->sum;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        into->buckets[b] += from->buckets[b];
+    }
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Latency below which percentile percent of the values of h fall, in
+ seconds, within the 1/32 resolution of the buckets and never above the
+ largest value recorded. 0 for an empty histogram.
+ *******************************************************************************/
+double latency_batched_percentile(const latency_histogram* h, double percentile)
+{
+    if (h->count == 0) {
+        return 0.0;
+    }
+    unsigned long long rank = (unsigned long long)(percentile / 100.0 * (double)h->count + 0.5);
+    unsigned long long seen = 0;
+    if (rank < 1) {
+        rank = 1;
+    }
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= rank) {
+            const uint64_t high = latency_bucket_high(b);
+            return 1e-9 * (double)(high < h->max ? high : h->max);
+        }
+    }
+    return 1e-9 * (double)h->max;
+}
+
+void latency_batched_reset()
+{
+    for (int k = 0; k < LATENCY_NKINDS; k++)
+    for (int n = 0; n <= LATENCY_MAX_N; n++)
+    for (int c = 0; c < LATENCY_BATCH_CLASSES; c++) {
+        latency_live* live = latency_table[k][n][c].load(std::memory_order_acquire);
+        if (live == NULL) {
+            continue;
+        }
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            live->buckets[b].store(0, std::memory_order_relaxed);
+        }
+        live->count.store(0, std::memory_order_relaxed);
+        live->sum.store(0, std::memory_order_relaxed);
+        live->min.store(UINT64_MAX, std::memory_order_relaxed);
+        live->max.store(0, std::memory_order_relaxed);
+    }
+}
+
+int latency_batched_dump(FILE* f)
+{
+    latency_histogram h;
+    int status = 0;
+
+    fprintf(f, "# latency histograms, microseconds\n");
+    fprintf(f, "%-6s %3s %-17s %10s %12s %12s %12s %12s %12s %12s %12s\n",
+            "kind", "n", "batch", "count", "mean", "min", "p50", "p90", "p99", "p99.9", "max");
+    for (int k = 0; k < LATENCY_NKINDS; k++)
+    for (int n = 0; n <= LATENCY_MAX_N; n++)
+    for (int c = 0; c < LATENCY_BATCH_CLASSES; c++) {
+        char batch[32];
+        if (latency_batched_get(k, n, c, &h) == 0) {
+            continue;
+        }
+        if (c == LATENCY_BATCH_CLASSES - 1) {
+            snprintf(batch, sizeof(batch), "%d+", 1 << c);
+        }
+        else {
+            snprintf(batch, sizeof(batch), "%d-%d", 1 << c, (2 << c) - 1);
+        }
+        if (fprintf(f, "%-6s %3d %-17s %10llu %12.3f %12.3f %12.3f %12.3f %12.3f %12.3f %12.3f\n",
+                    latency_kind_names[k], n, batch, h.count, 1e-3 * (double)h.sum / (double)h.count,
+                    1e-3 * (double)h.min,
+                    1e6 * latency_batched_percentile(&h, 50.0),
+                    1e6 * latency_batched_percentile(&h, 90.0),
+                    1e6 * latency_batched_percentile(&h, 99.0),
+                    1e6 * latency_batched_percentile(&h, 99.9),
+                    1e-3 * (double)h.max) < 0) {
+            status = -1;
+        }
+    }
+    fflush(f);
+    return status;
+}
@@ -0,0 +1,64 @@
+#ifndef LATENCY_BATCHED_H
+#define LATENCY_BATCHED_H
+
+#include <stdio.h>
+
+/*
+    Latency histograms of the solvers per (N, batch size class), see
+    latency_batched.cpp.
+
+    Recording is off unless SLSB_LATENCY is set or latency_batched_enable(1)
+    is called. The CPU engine records its solve and total times, and
+    gpuLinearSolverBatched also the time before its solve (allocations and
+    uploads) as queue time. A service that queues requests before batching
+    them records its own queue wait and end to end times:
+
+        latency_batched_record(LATENCY_QUEUE, n, batchCount, seconds);
+*/
+
+// What is timed
+#define LATENCY_QUEUE   0   // from arrival to the start of the solve (staging, transfers, queues)
+#define LATENCY_SOLVE   1   // the solve itself
+#define LATENCY_TOTAL   2   // from the call (or arrival) to the results
+#define LATENCY_NKINDS  3
+
+#define LATENCY_MAX_N          32
+// Class c holds the batch counts in [2^c, 2^(c+1)), the last one all the larger ones.
+#define LATENCY_BATCH_CLASSES  24
+
+// Log bucketed with 2^LATENCY_SUB_BITS buckets per power of two: values are
+// in nanoseconds, kept within 1/32 of their value, up to 2^43 ns (2.4 hours).
+#define LATENCY_SUB_BITS  5
+#define LATENCY_SUB       (1 << LATENCY_SUB_BITS)
+#define LATENCY_MAX_SHIFT 37
+#define LATENCY_BUCKETS   ((LATENCY_MAX_SHIFT + 2) * LATENCY_SUB)
+
+// Snapshot of a histogram, merged with latency_batched_merge.
+struct latency_histogram
+{
+    unsigned long long count;
+    unsigned long long sum;         // ns
+    unsigned long long min;         // ns, 0 if empty
+    unsigned long long max;         // ns
+    unsigned long long buckets[LATENCY_BUCKETS];
+};
+
+int  latency_batched_enabled();
+void latency_batched_enable(int enable);
+
+// Seconds on a monotonic clock, for the differences given to latency_batched_record.
+double latency_batched_now();
+
+int  latency_batched_batch_class(int batchCount);
+void latency_batched_record(int kind, int n, int batchCount, double seconds);
+
+// Copies a histogram; returns its count, 0 for one that was never recorded.
+unsigned long long latency_batched_get(int kind, int n, int batchClass, latency_histogram* h);
+void   latency_batched_merge(latency_histogram* into, const latency_histogram* from);
+double latency_batched_percentile(const latency_histogram* h, double percentile);
+void   latency_batched_reset();
+
+// Writes every non empty histogram with its percentiles; -1 on a write error.
+int latency_batched_dump(FILE* f);
+
+#endif //LATENCY_BATCHED_H
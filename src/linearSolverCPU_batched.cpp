@@ -0,0 +1,752 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "utils.h"
+#include "operation_batched.h"
+#include "sgesv_smallsq_inline.h"
+#include "smallsq_dispatch.h"
+#include "cpu_perf_batched.h"
+#include "trace_batched.h"
+#include "instrument_batched.h"
+#include "capture_batched.h"
+#include "metrics_batched.h"
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+// Number of threads that will run the next parallel region.
+static int cpu_num_threads()
+{
+#if defined(_OPENMP)
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+// Element e = i + j*N of the column-major A of a system stored at sA, which
+// is row-major (A transposed, e.g. a C order NumPy array) when T: the
+// transposition is done by the copy to the stack every path makes anyway.
+template<int N, bool T>
+static inline float cpu_load_a(const float* sA, int e)
+{
+    return T ? sA[(e % N) * N + e / N] : sA[e];
+}
+
+// Solves every system of the batch with the inline templates.
+// A and B are copied to the stack, h_A and h_B are left untouched.
+// chunk is the number of systems given to a thread at a time, 0 splits
+// the batch evenly between the threads. The chunks are dealt round robin,
+// as schedule(static, chunk) would, and each is one event of the trace.
+// T: the matrices are stored row-major, see cpu_load_a.
+template<int N, bool T>
+static void
+cpu_sgesv_batched_smallsq(const float* h_A, const float* h_B,
+        float* h_X, int* h_info, int batchCount, int chunk)
+{
+    if (chunk <= 0) {
+        chunk = (batchCount + cpu_num_threads() - 1) / cpu_num_threads();
+    }
+    const int nchunks = (batchCount + chunk - 1) / chunk;
+    const int traced  = trace_batched_enabled();
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static, 1)
+#endif
+    for (int c = 0; c < nchunks; c++) {
+        const double t0 = traced ? trace_batched_now() : 0.0;
+        const int end = (batchCount - c * chunk < chunk) ? batchCount : (c + 1) * chunk;
+        for (int s = c * chunk; s < end; s++) {
+            float rA[N*N];
+            float rb[N];
+            if (T) {
+                for (int e = 0; e < N*N; e++) {
+                    rA[e] = cpu_load_a<N, T>(h_A + (size_t)s * N * N, e);
+                }
+            }
+            else {
+                memcpy(rA, h_A + (size_t)s * N * N, sizeof(rA));
+            }
+            memcpy(rb, h_B + (size_t)s * N, sizeof(rb));
+            h_info[s] = sgesv_smallsq<N>(rA, rb);
+            memcpy(h_X + (size_t)s * N, rb, sizeof(rb));
+        }
+        if (traced) {
+            trace_batched_event("solve", "cpu", t0, c, N, end - c * chunk);
+        }
+    }
+}
+
+// Same result as cpu_sgesv_batched_smallsq, but W packed systems at a time
+// are gathered into an interleaved stack buffer and solved together by
+// sgesv_smallsq_interleaved, one per SIMD lane. Missing lanes of the last
+// group are identity systems. chunk is still counted in systems, and the
+// chunks of groups are dealt as in cpu_sgesv_batched_smallsq.
+template<int N, int W, bool T>
+static void
+cpu_sgesv_batched_smallsq_gather(const float* h_A, const float* h_B,
+        float* h_X, int* h_info, int batchCount, int chunk)
+{
+    const int ngroups = (batchCount + W - 1) / W;
+    int gchunk = (chunk <= 0) ? (ngroups + cpu_num_threads() - 1) / cpu_num_threads()
+                              : (chunk + W - 1) / W;
+    const int nchunks = (ngroups + gchunk - 1) / gchunk;
+    const int traced  = trace_batched_enabled();
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static, 1)
+#endif
+    for (int c = 0; c < nchunks; c++) {
+        const double t0 = traced ? trace_batched_now() : 0.0;
+        const int gend = (ngroups - c * gchunk < gchunk) ? ngroups : (c + 1) * gchunk;
+        for (int g = c * gchunk; g < gend; g++) {
+            float rA[N*N*W];
+            float rb[N*W];
+            int   linfo[W];
+            const int nlanes = (batchCount - g*W < W) ? batchCount - g*W : W;
+
+            for (int l = 0; l < nlanes; l++) {
+                const float* sA = h_A + (size_t)(g*W + l) * N * N;
+                const float* sB = h_B + (size_t)(g*W + l) * N;
+                for (int e = 0; e < N*N; e++) {
+                    rA[e*W + l] = cpu_load_a<N, T>(sA, e);
+                }
+                for (int i = 0; i < N; i++) {
+                    rb[i*W + l] = sB[i];
+                }
+            }
+            for (int l = nlanes; l < W; l++) {
+                for (int e = 0; e < N*N; e++) {
+                    rA[e*W + l] = (e % (N+1) == 0) ? 1.0f : 0.0f;
+                }
+                for (int i = 0; i < N; i++) {
+                    rb[i*W + l] = 0.0f;
+                }
+            }
+
+            sgesv_smallsq_interleaved<N, W>(rA, rb, linfo);
+
+            for (int l = 0; l < nlanes; l++) {
+                float* sX = h_X + (size_t)(g*W + l) * N;
+                for (int i = 0; i < N; i++) {
+                    sX[i] = rb[i*W + l];
+                }
+                h_info[g*W + l] = linfo[l];
+            }
+        }
+        if (traced) {
+            const int send = (gend * W < batchCount) ? gend * W : batchCount;
+            trace_batched_event("solve", "cpu", t0, c, N, send - c * gchunk * W);
+        }
+    }
+}
+
+typedef void (*cpu_smallsq_fn)(const float* h_A, const float* h_B,
+        float* h_X, int* h_info, int batchCount, int chunk);
+
+// Instrumented path, taken while the hardware counters are enabled (see
+// linearSolverCPUperf_batched.cpp) or the trace asks for phases (see
+// trace_batched.cpp). Each thread copies CPU_PERF_TILE systems
+// at a time to its buffers, as groups of W interleaved systems (W = 1 for
+// the scalar variant), and runs every phase over the tile before the next.
+#define CPU_PERF_TILE  64
+
+static_assert(CPU_PERF_TILE % 16 == 0, "a tile must hold whole groups of every W");
+
+template<int N, int W>
+struct cpu_perf_phases
+{
+    static void factor(float* A, int* ipiv, int* info)  { sgetrf_smallsq_interleaved<N, W>(A, ipiv, info); }
+    static void permute(const int* ipiv, float* b)      { slaswp_smallsq_interleaved<N, W>(ipiv, b); }
+    static void forward(const float* LU, float* b)      { strsv_lower_smallsq_interleaved<N, W>(LU, b); }
+    static void backward(const float* LU, float* b)     { strsv_upper_smallsq_interleaved<N, W>(LU, b); }
+};
+
+template<int N>
+struct cpu_perf_phases<N, 1>
+{
+    static void factor(float* A, int* ipiv, int* info)  { *info = sgetrf_smallsq<N>(A, ipiv); }
+    static void permute(const int* ipiv, float* b)      { slaswp_smallsq<N>(ipiv, b); }
+    static void forward(const float* LU, float* b)      { strsv_lower_smallsq<N>(LU, b); }
+    static void backward(const float* LU, float* b)     { strsv_upper_smallsq<N>(LU, b); }
+};
+
+static int cpu_phased()
+{
+    return cpu_perf_active() || trace_batched_phases();
+}
+
+// Ends a phase of a tile: counters, and trace event if traced.
+static void cpu_phase_end(cpu_perf_thread* t, int phase, int traced, double* t0,
+                          int tile, int n, int count)
+{
+    cpu_perf_mark(t, phase);
+    if (traced) {
+        trace_batched_event(cpuLinearSolverBatchedPerfPhaseName(phase), "cpu", *t0, tile, n, count);
+        *t0 = trace_batched_now();
+    }
+}
+
+// Solves the ngroups groups of tile phase by phase, count of them being real systems.
+template<int N, int W>
+static void
+cpu_perf_solve_tile(float* A, float* b, int* ipiv, int* info, int ngroups, int count, int tile)
+{
+    typedef cpu_perf_phases<N, W> phases;
+    cpu_perf_thread* t = cpu_perf_active() ? cpu_perf_thread_get() : NULL;
+    const int traced = trace_batched_enabled();
+    double t0 = traced ? trace_batched_now() : 0.0;
+
+    cpu_perf_mark(t, -1);
+    for (int g = 0; g < ngroups; g++) {
+        phases::factor(A + (size_t)g * N * N * W, ipiv + g * N * W, info + g * W);
+    }
+    cpu_phase_end(t, CPU_PERF_FACTOR, traced, &t0, tile, N, count);
+    for (int g = 0; g < ngroups; g++) {
+        phases::permute(ipiv + g * N * W, b + g * N * W);
+    }
+    cpu_phase_end(t, CPU_PERF_PERMUTE, traced, &t0, tile, N, count);
+    for (int g = 0; g < ngroups; g++) {
+        phases::forward(A + (size_t)g * N * N * W, b + g * N * W);
+    }
+    cpu_phase_end(t, CPU_PERF_FORWARD, traced, &t0, tile, N, count);
+    for (int g = 0; g < ngroups; g++) {
+        phases::backward(A + (size_t)g * N * N * W, b + g * N * W);
+    }
+    cpu_phase_end(t, CPU_PERF_BACKWARD, traced, &t0, tile, N, count);
+    cpu_perf_add_systems(t, count);
+}
+
+// Instrumented counterpart of cpu_sgesv_batched_smallsq (W = 1) and of
+// cpu_sgesv_batched_smallsq_gather<N, W, T>, with the same results. chunk is
+// rounded up to whole tiles.
+template<int N, int W, bool T>
+static void
+cpu_sgesv_batched_smallsq_perf(const float* h_A, const float* h_B,
+        float* h_X, int* h_info, int batchCount, int chunk)
+{
+    const int ntiles = (batchCount + CPU_PERF_TILE - 1) / CPU_PERF_TILE;
+    int tchunk = (chunk <= 0) ? (ntiles + cpu_num_threads() - 1) / cpu_num_threads()
+                              : (chunk + CPU_PERF_TILE - 1) / CPU_PERF_TILE;
+#if defined(_OPENMP)
+#pragma omp parallel
+#endif
+    {
+        std::vector<float> tA((size_t)CPU_PERF_TILE * N * N), tb(CPU_PERF_TILE * N);
+        std::vector<int>   tipiv(CPU_PERF_TILE * N), tinfo(CPU_PERF_TILE);
+
+#if defined(_OPENMP)
+#pragma omp for schedule(static, tchunk)
+#endif
+        for (int tile = 0; tile < ntiles; tile++) {
+            const int first   = tile * CPU_PERF_TILE;
+            const int count   = (batchCount - first < CPU_PERF_TILE) ? batchCount - first : CPU_PERF_TILE;
+            const int ngroups = (count + W - 1) / W;
+
+            for (int s = 0; s < ngroups * W; s++) {
+                float* gA = tA.data() + (size_t)(s / W) * N * N * W + s % W;
+                float* gb = tb.data() + (s / W) * N * W + s % W;
+                if (s < count) {
+                    const float* sA = h_A + (size_t)(first + s) * N * N;
+                    const float* sB = h_B + (size_t)(first + s) * N;
+                    for (int e = 0; e < N*N; e++) {
+                        gA[e*W] = cpu_load_a<N, T>(sA, e);
+                    }
+                    for (int i = 0; i < N; i++) {
+                        gb[i*W] = sB[i];
+                    }
+                }
+                else {
+                    for (int e = 0; e < N*N; e++) {
+                        gA[e*W] = (e % (N+1) == 0) ? 1.0f : 0.0f;
+                    }
+                    for (int i = 0; i < N; i++) {
+                        gb[i*W] = 0.0f;
+                    }
+                }
+            }
+
+            cpu_perf_solve_tile<N, W>(tA.data(), tb.data(), tipiv.data(), tinfo.data(), ngroups, count, tile);
+
+            for (int s = 0; s < count; s++) {
+                const float* gb = tb.data() + (s / W) * N * W + s % W;
+                float* sX = h_X + (size_t)(first + s) * N;
+                for (int i = 0; i < N; i++) {
+                    sX[i] = gb[i*W];
+                }
+                h_info[first + s] = tinfo[s];
+            }
+        }
+    }
+}
+
+// Width of the groups of a CPU_VARIANT_*, 1 for the scalar one.
+static constexpr int cpu_variant_width(int variant)
+{
+    return variant == CPU_VARIANT_GATHER4  ?  4 :
+           variant == CPU_VARIANT_GATHER8  ?  8 :
+           variant == CPU_VARIANT_GATHER16 ? 16 : 1;
+}
+
+// Kernel of the groups of W systems, W = 1 being the scalar one.
+template<int N, int W, bool T>
+struct cpu_smallsq_kernel
+{
+    static void run(const float* h_A, const float* h_B,
+            float* h_X, int* h_info, int batchCount, int chunk)
+    {
+        cpu_sgesv_batched_smallsq_gather<N, W, T>(h_A, h_B, h_X, h_info, batchCount, chunk);
+    }
+};
+
+template<int N, bool T>
+struct cpu_smallsq_kernel<N, 1, T>
+{
+    static void run(const float* h_A, const float* h_B,
+            float* h_X, int* h_info, int batchCount, int chunk)
+    {
+        cpu_sgesv_batched_smallsq<N, T>(h_A, h_B, h_X, h_info, batchCount, chunk);
+    }
+};
+
+// Entries of the dispatch tables of cpuLinearSolverBatchedVariant, one row
+// per CPU_VARIANT_*, see smallsq_dispatch.h; T for row-major matrices.
+template<bool T>
+struct cpu_smallsq_variant
+{
+    template<int V, int N>
+    struct entry
+    {
+        static void run(const float* h_A, const float* h_B,
+                float* h_X, int* h_info, int batchCount, int chunk)
+        {
+            cpu_smallsq_kernel<N, cpu_variant_width(V), T>::run(h_A, h_B, h_X, h_info, batchCount, chunk);
+        }
+    };
+
+    template<int V, int N>
+    struct entry_perf
+    {
+        static void run(const float* h_A, const float* h_B,
+                float* h_X, int* h_info, int batchCount, int chunk)
+        {
+            cpu_sgesv_batched_smallsq_perf<N, cpu_variant_width(V), T>(h_A, h_B, h_X, h_info, batchCount, chunk);
+        }
+    };
+};
+
+// Solve of cpuLinearSolverBatchedVariant (T = false) and of
+// cpuLinearSolverBatchedRowMajor (T = true) once the arguments are checked,
+// without instrumentation.
+template<bool T>
+static int cpu_solve_variant(int n, int variant, int chunk, float* h_A, float* h_B,
+        float* h_X, int* h_info, int batchCount)
+{
+    int info = 0;
+    static constexpr smallsq_table<cpu_smallsq_fn, CPU_VARIANT_GATHER16 + 1> table =
+        make_smallsq_table<cpu_smallsq_fn, cpu_smallsq_variant<T>::template entry, CPU_VARIANT_GATHER16 + 1>();
+    static constexpr smallsq_table<cpu_smallsq_fn, CPU_VARIANT_GATHER16 + 1> perf_table =
+        make_smallsq_table<cpu_smallsq_fn, cpu_smallsq_variant<T>::template entry_perf, CPU_VARIANT_GATHER16 + 1>();
+    cpu_smallsq_fn run = cpu_phased() ? perf_table.get(variant, n) : table.get(variant, n);
+    if (run == NULL) {
+        printf("error: size %lld is not instantiated, see SLSB_SMALLSQ_SIZES\n", (long long) n);
+        return -1;
+    }
+    run(h_A, h_B, h_X, h_info, batchCount, chunk);
+
+    for (int i = 0; i < batchCount; i++) {
+        if (h_info[i] != 0) {
+            info = h_info[i];
+            break;
+        }
+    }
+    return info;
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ CPU counterpart of gpuLinearSolverBatched, same arguments and same layout.
+ Solves batchCount N-by-N systems A * X = B with the header only templates of
+ sgesv_smallsq_inline.h (one instantiation per N, with compile time trip
+ counts; on the host only the inner loops are left to the optimizer to unroll
+ or vectorize, the elimination loop stays rolled), using OpenMP threads over
+ the systems when available.
+
+ The kernel variant and the OpenMP chunk size used for each N come from
+ the CPU tuning table, see linearSolverCPUtune_batched.cpp.
+
+ Arguments
+ ---------
+ @param[in]
+ n       INTEGER
+ The order of the matrix A.  0 <= N <= 32.
+
+ @param[in]
+ h_A     Sequential host allocated memory containing the A matrices,
+ of length n*n*batchCount*sizeof(float), stored in column-major format.
+
+ @param[in]
+ h_B     Sequential host allocated memory containing the right hand sides,
+ of length n*batchCount*sizeof(float).
+
+ @param[out]
+ h_Xptr  Pointer to host memory of length n*batchCount*sizeof(float),
+ already allocated upon entry. On exit, contains the solutions.
+
+ @param[out]
+ h_info  Array of integers, dimension (batchCount), already allocated
+ upon entry. On exit, the getrf info of each system.
+
+ @param[in]
+ batchCount  INTEGER
+ The number of systems to solve.
+
+ @return 0 on success, the first nonzero h_info otherwise, or -i if the
+         i-th argument had an illegal value.
+
+ *******************************************************************************/
+int cpuLinearSolverBatched(int n, float* h_A, float* h_B,
+        float** h_Xptr, int* h_info, int batchCount)
+{
+    int info = 0;
+    int variant = CPU_VARIANT_SCALAR;
+    int chunk   = 0;
+    if (n < 0 || n > 32) {
+        info = -1;
+    }
+    else if (batchCount < 0) {
+        info = -6;
+    }
+    if (info != 0) {
+        utils_reportError(__func__, -(info));
+        return info;
+    }
+
+    if (n == 0 || batchCount == 0) {
+        return info;
+    }
+
+    cpuLinearSolverBatchedGetTuning(n, &variant, &chunk);
+    return cpuLinearSolverBatchedVariant(n, variant, chunk, h_A, h_B, h_Xptr, h_info, batchCount);
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ cpuLinearSolverBatchedVariant is cpuLinearSolverBatched with an explicit
+ kernel variant and OpenMP chunk size, bypassing the tuning table.
+
+ Arguments
+ ---------
+ @param[in]
+ variant INTEGER
+ CPU_VARIANT_SCALAR solves one system at a time, CPU_VARIANT_GATHER4/8/16
+ gather 4, 8 or 16 systems in an interleaved buffer and solve them one per
+ SIMD lane. All variants give bitwise identical results.
+
+ @param[in]
+ chunk   INTEGER
+ Number of systems handed to a thread at a time, 0 to split the batch
+ evenly between the threads.
+
+ The other arguments are those of cpuLinearSolverBatched.
+
+ *******************************************************************************/
+int cpuLinearSolverBatchedVariant(int n, int variant, int chunk, float* h_A, float* h_B,
+        float** h_Xptr, int* h_info, int batchCount)
+{
+    const double l0 = instrument_batched_now();
+    instrument_batched inst;
+    int info = 0;
+    if (n < 0 || n > 32) {
+        info = -1;
+    }
+    else if (variant < CPU_VARIANT_SCALAR || variant > CPU_VARIANT_GATHER16) {
+        info = -2;
+    }
+    else if (chunk < 0) {
+        info = -3;
+    }
+    else if (batchCount < 0) {
+        info = -8;
+    }
+    if (info != 0) {
+        utils_reportError(__func__, -(info));
+        return info;
+    }
+
+    if (n == 0 || batchCount == 0) {
+        return info;
+    }
+    instrument_batched_begin(&inst, "cpuLinearSolverBatched", METRICS_BACKEND_CPU, n, batchCount,
+                             h_A, h_B, 0, l0);
+    info = cpu_solve_variant<false>(n, variant, chunk, h_A, h_B, *h_Xptr, h_info, batchCount);
+    instrument_batched_end(&inst, info >= 0 ? h_info : NULL);
+    return info;
+}
+
+// cpuLinearSolverBatchedVariant without the argument checks nor the
+// instrumentation, what the tuners time: their synthetic batches must not
+// be captured, nor counted in the metrics and latencies of the solves.
+int cpu_solve_batched(int n, int variant, int chunk, float* h_A, float* h_B,
+        float* h_X, int* h_info, int batchCount)
+{
+    return cpu_solve_variant<false>(n, variant, chunk, h_A, h_B, h_X, h_info, batchCount);
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ cpuLinearSolverBatchedRowMajor is cpuLinearSolverBatched for matrices stored
+ row-major, A(i,j) of system s being h_A[s*n*n + i*n + j]: the layout of a C
+ order NumPy array of shape (batchCount, n, n), see npy_batched.h. The
+ transposition is folded into the copy of each system to the stack, so it
+ costs no extra pass over the batch. B and X are as in cpuLinearSolverBatched
+ and the variant and chunk come from the same tuning table.
+
+ Arguments
+ ---------
+ Same as cpuLinearSolverBatched.
+
+ *******************************************************************************/
+int cpuLinearSolverBatchedRowMajor(int n, float* h_A, float* h_B,
+        float** h_Xptr, int* h_info, int batchCount)
+{
+    const double l0 = instrument_batched_now();
+    instrument_batched inst;
+    int info = 0;
+    int variant = CPU_VARIANT_SCALAR;
+    int chunk   = 0;
+    if (n < 0 || n > 32) {
+        info = -1;
+    }
+    else if (batchCount < 0) {
+        info = -6;
+    }
+    if (info != 0) {
+        utils_reportError(__func__, -(info));
+        return info;
+    }
+
+    if (n == 0 || batchCount == 0) {
+        return info;
+    }
+
+    cpuLinearSolverBatchedGetTuning(n, &variant, &chunk);
+    // captured too, transposed: the records are column-major and replay as such
+    instrument_batched_begin(&inst, "cpuLinearSolverBatchedRowMajor", METRICS_BACKEND_CPU, n, batchCount,
+                             h_A, h_B, CAPTURE_ROW_MAJOR, l0);
+    info = cpu_solve_variant<true>(n, variant, chunk, h_A, h_B, *h_Xptr, h_info, batchCount);
+    instrument_batched_end(&inst, info >= 0 ? h_info : NULL);
+    return info;
+}
+
+// Same as cpu_sgesv_batched_smallsq, for batches interleaved by groups of W
+// systems, split evenly between the threads. The last group may be partial:
+// its missing lanes are replaced by identity systems in the stack copy, so
+// they are solved but never stored.
+template<int N, int W>
+static void
+cpu_sgesv_batched_smallsq_interleaved(const float* h_A, const float* h_B,
+        float* h_X, int* h_info, int batchCount)
+{
+    const int ngroups = (batchCount + W - 1) / W;
+    const int gchunk  = (ngroups + cpu_num_threads() - 1) / cpu_num_threads();
+    const int nchunks = (ngroups + gchunk - 1) / gchunk;
+    const int traced  = trace_batched_enabled();
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static, 1)
+#endif
+    for (int c = 0; c < nchunks; c++) {
+        const double t0 = traced ? trace_batched_now() : 0.0;
+        const int gend = (ngroups - c * gchunk < gchunk) ? ngroups : (c + 1) * gchunk;
+        for (int g = c * gchunk; g < gend; g++) {
+            float rA[N*N*W];
+            float rb[N*W];
+            int   linfo[W];
+            const int nlanes = (batchCount - g*W < W) ? batchCount - g*W : W;
+
+            memcpy(rA, h_A + (size_t)g * N * N * W, sizeof(rA));
+            memcpy(rb, h_B + (size_t)g * N * W, sizeof(rb));
+            for (int l = nlanes; l < W; l++) {
+                for (int j = 0; j < N; j++) {
+                    for (int i = 0; i < N; i++) {
+                        rA[(i + j*N)*W + l] = (i == j) ? 1.0f : 0.0f;
+                    }
+                    rb[j*W + l] = 0.0f;
+                }
+            }
+
+            sgesv_smallsq_interleaved<N, W>(rA, rb, linfo);
+
+            float* gX = h_X + (size_t)g * N * W;
+            for (int i = 0; i < N; i++) {
+                for (int l = 0; l < nlanes; l++) {
+                    gX[i*W + l] = rb[i*W + l];
+                }
+            }
+            for (int l = 0; l < nlanes; l++) {
+                h_info[g*W + l] = linfo[l];
+            }
+        }
+        if (traced) {
+            const int send = (gend * W < batchCount) ? gend * W : batchCount;
+            trace_batched_event("solve", "cpu", t0, c, N, send - c * gchunk * W);
+        }
+    }
+}
+
+// Instrumented counterpart of cpu_sgesv_batched_smallsq_interleaved, see
+// cpu_sgesv_batched_smallsq_perf. Tiles hold whole groups.
+template<int N, int W>
+static void
+cpu_sgesv_batched_smallsq_interleaved_perf(const float* h_A, const float* h_B,
+        float* h_X, int* h_info, int batchCount)
+{
+    const int ntiles = (batchCount + CPU_PERF_TILE - 1) / CPU_PERF_TILE;
+#if defined(_OPENMP)
+#pragma omp parallel
+#endif
+    {
+        std::vector<float> tA((size_t)CPU_PERF_TILE * N * N), tb(CPU_PERF_TILE * N);
+        std::vector<int>   tipiv(CPU_PERF_TILE * N), tinfo(CPU_PERF_TILE);
+
+#if defined(_OPENMP)
+#pragma omp for schedule(static)
+#endif
+        for (int tile = 0; tile < ntiles; tile++) {
+            const int first   = tile * CPU_PERF_TILE;
+            const int count   = (batchCount - first < CPU_PERF_TILE) ? batchCount - first : CPU_PERF_TILE;
+            const int ngroups = (count + W - 1) / W;
+            float* A = tA.data();
+            float* b = tb.data();
+
+            memcpy(A, h_A + (size_t)first * N * N, sizeof(float) * ngroups * N * N * W);
+            memcpy(b, h_B + (size_t)first * N, sizeof(float) * ngroups * N * W);
+            for (int s = count; s < ngroups * W; s++) {
+                float* gA = A + (size_t)(s / W) * N * N * W + s % W;
+                float* gb = b + (s / W) * N * W + s % W;
+                for (int e = 0; e < N*N; e++) {
+                    gA[e*W] = (e % (N+1) == 0) ? 1.0f : 0.0f;
+                }
+                for (int i = 0; i < N; i++) {
+                    gb[i*W] = 0.0f;
+                }
+            }
+
+            cpu_perf_solve_tile<N, W>(A, b, tipiv.data(), tinfo.data(), ngroups, count, tile);
+
+            for (int s = 0; s < count; s++) {
+                const int g = s / W, l = s % W;
+                float* gX = h_X + (size_t)(first / W + g) * N * W;
+                for (int i = 0; i < N; i++) {
+                    gX[i*W + l] = b[g*N*W + i*W + l];
+                }
+                h_info[first + s] = tinfo[s];
+            }
+        }
+    }
+}
+
+typedef void (*cpu_smallsq_interleaved_fn)(const float* h_A, const float* h_B,
+        float* h_X, int* h_info, int batchCount);
+
+// Entries of the dispatch table of cpuLinearSolverBatchedInterleaved<W>,
+// a single variant.
+template<int W>
+struct cpu_smallsq_interleaved
+{
+    template<int V, int N>
+    struct entry
+    {
+        static void run(const float* h_A, const float* h_B,
+                float* h_X, int* h_info, int batchCount)
+        {
+            cpu_sgesv_batched_smallsq_interleaved<N, W>(h_A, h_B, h_X, h_info, batchCount);
+        }
+    };
+
+    template<int V, int N>
+    struct entry_perf
+    {
+        static void run(const float* h_A, const float* h_B,
+                float* h_X, int* h_info, int batchCount)
+        {
+            cpu_sgesv_batched_smallsq_interleaved_perf<N, W>(h_A, h_B, h_X, h_info, batchCount);
+        }
+    };
+};
+
+/***************************************************************************//**
+ Purpose
+ -------
+ cpuLinearSolverBatchedInterleaved is cpuLinearSolverBatched for batches stored
+ interleaved by groups of W systems, W being the SIMD width the caller targets
+ (4 for SSE/NEON, 8 for AVX, 16 for AVX-512). Within a group the systems are
+ the fastest running index, so the W systems are solved at once, one per lane,
+ with sgesv_smallsq_interleaved.
+
+ System s belongs to group g = s/W, lane l = s%W, and
+     A(i,j) of system s is h_A[ (g*n*n + i + j*n)*W + l ]
+     B(i)   of system s is h_B[ (g*n + i)*W + l ]
+ X uses the layout of B. Arrays must be allocated for ceil(batchCount/W)*W
+ systems: the last group is copied whole, so its lanes beyond batchCount are
+ read, but their values are ignored (replaced by identity systems) and they
+ are never written.
+
+ Only W = 4, 8 and 16 are instantiated.
+
+ Arguments
+ ---------
+ Same as cpuLinearSolverBatched.
+
+ *******************************************************************************/
+template<int W>
+int cpuLinearSolverBatchedInterleaved(int n, float* h_A, float* h_B,
+        float** h_Xptr, int* h_info, int batchCount)
+{
+    const double l0 = instrument_batched_now();
+    instrument_batched inst;
+    int info = 0;
+    if (n < 0 || n > 32) {
+        info = -1;
+    }
+    else if (batchCount < 0) {
+        info = -6;
+    }
+    if (info != 0) {
+        utils_reportError(__func__, -(info));
+        return info;
+    }
+
+    if (n == 0 || batchCount == 0) {
+        return info;
+    }
+
+    float* h_X = *h_Xptr;
+    static constexpr smallsq_table<cpu_smallsq_interleaved_fn, 1> table =
+        make_smallsq_table<cpu_smallsq_interleaved_fn, cpu_smallsq_interleaved<W>::template entry, 1>();
+    static constexpr smallsq_table<cpu_smallsq_interleaved_fn, 1> perf_table =
+        make_smallsq_table<cpu_smallsq_interleaved_fn, cpu_smallsq_interleaved<W>::template entry_perf, 1>();
+    cpu_smallsq_interleaved_fn run = cpu_phased() ? perf_table.get(0, n) : table.get(0, n);
+    if (run == NULL) {
+        printf("error: size %lld is not instantiated, see SLSB_SMALLSQ_SIZES\n", (long long) n);
+        return -1;
+    }
+    instrument_batched_begin(&inst, "cpuLinearSolverBatchedInterleaved", METRICS_BACKEND_CPU, n, batchCount,
+                             h_A, h_B, W, l0);
+    run(h_A, h_B, h_X, h_info, batchCount);
+
+    for (int i = 0; i < batchCount; i++) {
+        if (h_info[i] != 0) {
+            info = h_info[i];
+            break;
+        }
+    }
+    instrument_batched_end(&inst, h_info);
+    return info;
+}
+
+template int cpuLinearSolverBatchedInterleaved< 4>(int, float*, float*, float**, int*, int);
+template int cpuLinearSolverBatchedInterleaved< 8>(int, float*, float*, float**, int*, int);
+template int cpuLinearSolverBatchedInterleaved<16>(int, float*, float*, float**, int*, int);
@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "utils.h"
+#include "operation_batched.h"
+#include "cpu_perf_batched.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/*
+    Hardware counters of the CPU engine, per solve phase.
+
+    While enabled (cpuLinearSolverBatchedPerfEnable), the engine solves its
+    batches by tiles of CPU_PERF_TILE systems and runs each phase over the
+    whole tile before the next one: factor, permute, forward, backward.
+    Every thread reads its counter groups between the phases, so each phase
+    gets its own counts; the copies of the tile in and out of the thread
+    buffers are not counted. The results are bitwise those of the normal
+    path, but the times are not: compare times with the counters disabled.
+
+    The counters of a thread are opened with perf_event_open the first time
+    it solves a tile, in two groups scheduled together on the PMU:
+        cycles, instructions, cache references, cache misses
+        L1D load misses, dTLB load misses, vector event
+    They count user space only, so the reads themselves are barely counted.
+    When the kernel multiplexes the groups, counts are scaled by the time
+    the group was enabled over the time it ran.
+
+    The vector instructions have no generic event: the raw event code is
+    taken from SLSB_CPU_PERF_VECTOR_EVENT (umask << 8 | event, e.g. 0x20c7
+    for FP_ARITH_INST_RETIRED.256B_PACKED_SINGLE on Intel cores since
+    Skylake), the counter is unavailable otherwise.
+
+    Counters that cannot be opened (no PMU in a VM, perf_event_paranoid,
+    seccomp, another OS) are left out of cpu_perf_counters::available. If
+    none can be opened, enabling fails with a single warning and the engine
+    keeps its normal path.
+
+    The counters of a thread stay open until the process exits. Reset and
+    Get must be called between solves.
+*/
+
+#define CPU_PERF_NGROUPS  2
+
+struct cpu_perf_group
+{
+    int fd;                                 // leader, -1 if the group could not be opened
+    int ncounters;
+    int counter[CPU_PERF_NCOUNTERS];        // CPU_PERF_* of each value of a read
+    int primed;                             // last holds a read
+    uint64_t last[3 + CPU_PERF_NCOUNTERS];  // nr, time enabled, time running, values
+};
+
+struct cpu_perf_thread
+{
+    cpu_perf_group group[CPU_PERF_NGROUPS];
+    double value[CPU_PERF_NPHASES][CPU_PERF_NCOUNTERS];
+    double seconds[CPU_PERF_NPHASES];
+    long long systems;
+    unsigned available;
+};
+
+static std::mutex cpu_perf_mutex;
+static std::vector<cpu_perf_thread*> cpu_perf_threads;
+static std::atomic<int> cpu_perf_enabled(0);
+static unsigned cpu_perf_mask = 0;
+static std::atomic<int> cpu_perf_errno(0);   // why the first counter failed to open
+static int cpu_perf_warned = 0;
+
+static thread_local cpu_perf_thread* cpu_perf_self = NULL;
+static thread_local bool cpu_perf_opened = false;
+
+static const char* cpu_perf_phase_names[CPU_PERF_NPHASES] = {
+    "factor", "permute", "forward", "backward"
+};
+
+static const char* cpu_perf_counter_names[CPU_PERF_NCOUNTERS] = {
+    "cycles", "instructions", "cache_refs", "cache_misses", "l1d_misses", "dtlb_misses", "vector"
+};
+
+static const int cpu_perf_counter_group[CPU_PERF_NCOUNTERS] = { 0, 0, 0, 0, 1, 1, 1 };
+
+#if defined(__linux__)
+// perf_event_attr type and config of counter c, 0 if it has no event here.
+static int cpu_perf_event(int c, uint32_t* type, uint64_t* config)
+{
+    const uint64_t read_miss = (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                             | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    const char* raw;
+
+    switch (c) {
+        case CPU_PERF_CYCLES:
+            *type = PERF_TYPE_HARDWARE; *config = PERF_COUNT_HW_CPU_CYCLES;       return 1;
+        case CPU_PERF_INSTRUCTIONS:
+            *type = PERF_TYPE_HARDWARE; *config = PERF_COUNT_HW_INSTRUCTIONS;     return 1;
+        case CPU_PERF_CACHE_REFS:
+            *type = PERF_TYPE_HARDWARE; *config = PERF_COUNT_HW_CACHE_REFERENCES; return 1;
+        case CPU_PERF_CACHE_MISSES:
+            *type = PERF_TYPE_HARDWARE; *config = PERF_COUNT_HW_CACHE_MISSES;     return 1;
+        case CPU_PERF_L1D_MISSES:
+            *type = PERF_TYPE_HW_CACHE; *config = PERF_COUNT_HW_CACHE_L1D | read_miss;  return 1;
+        case CPU_PERF_DTLB_MISSES:
+            *type = PERF_TYPE_HW_CACHE; *config = PERF_COUNT_HW_CACHE_DTLB | read_miss; return 1;
+        case CPU_PERF_VECTOR:
+            raw = getenv("SLSB_CPU_PERF_VECTOR_EVENT");
+            if (raw == NULL || raw[0] == '\0') {
+                return 0;
+            }
+            *type = PERF_TYPE_RAW; *config = strtoull(raw, NULL, 0);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Opens counter c for the calling thread, in the group of leader (-1 for a new group).
+static int cpu_perf_open_event(int c, int leader)
+{
+    struct perf_event_attr attr;
+    uint32_t type;
+    uint64_t config;
+
+    if (!cpu_perf_event(c, &type, &config)) {
+        return -1;
+    }
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = type;
+    attr.config         = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                        | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0) {
+        int none = 0;
+        cpu_perf_errno.compare_exchange_strong(none, errno);
+    }
+    return fd;
+}
+#endif
+
+// Counters of the calling thread, NULL if none of them could be opened.
+static cpu_perf_thread* cpu_perf_open()
+{
+#if defined(__linux__)
+    cpu_perf_thread* t = new cpu_perf_thread;
+    memset(t, 0, sizeof(*t));
+
+    for (int g = 0; g < CPU_PERF_NGROUPS; g++) {
+        cpu_perf_group* group = &t->group[g];
+        group->fd = -1;
+        for (int c = 0; c < CPU_PERF_NCOUNTERS; c++) {
+            if (cpu_perf_counter_group[c] != g) {
+                continue;
+            }
+            int fd = cpu_perf_open_event(c, group->fd);
+            if (fd < 0) {
+                continue;
+            }
+            if (group->fd < 0) {
+                group->fd = fd;
+            }
+            group->counter[group->ncounters++] = c;
+            t->available |= 1u << c;
+        }
+    }
+    if (t->available != 0) {
+        return t;
+    }
+    delete t;
+#else
+    cpu_perf_errno.store(ENOSYS);
+#endif
+    return NULL;
+}
+
+int cpu_perf_active()
+{
+    return cpu_perf_enabled.load(std::memory_order_relaxed);
+}
+
+cpu_perf_thread* cpu_perf_thread_get()
+{
+    if (!cpu_perf_opened) {
+        cpu_perf_opened = true;
+        cpu_perf_self = cpu_perf_open();
+        if (cpu_perf_self != NULL) {
+            std::lock_guard<std::mutex> lock(cpu_perf_mutex);
+            cpu_perf_threads.push_back(cpu_perf_self);
+            cpu_perf_mask |= cpu_perf_self->available;
+        }
+    }
+    return cpu_perf_self;
+}
+
+void cpu_perf_mark(cpu_perf_thread* t, int phase)
+{
+#if defined(__linux__)
+    uint64_t buf[3 + CPU_PERF_NCOUNTERS];
+    int timed = 0;
+
+    if (t == NULL) {
+        return;
+    }
+    for (int g = 0; g < CPU_PERF_NGROUPS; g++) {
+        cpu_perf_group* group = &t->group[g];
+        const ssize_t len = (ssize_t)((3 + group->ncounters) * sizeof(uint64_t));
+        if (group->fd < 0 || read(group->fd, buf, len) != len) {
+            continue;
+        }
+        if (phase >= 0 && group->primed) {
+            const uint64_t enabled = buf[1] - group->last[1];
+            const uint64_t running = buf[2] - group->last[2];
+            if (running > 0) {
+                const double scale = (double)enabled / (double)running;
+                for (int i = 0; i < group->ncounters; i++) {
+                    t->value[phase][group->counter[i]] += scale * (double)(buf[3 + i] - group->last[3 + i]);
+                }
+            }
+            if (!timed) {
+                t->seconds[phase] += 1e-9 * (double)enabled;
+                timed = 1;
+            }
+        }
+        memcpy(group->last, buf, len);
+        group->primed = 1;
+    }
+#else
+    MAGMA_UNUSED(t);
+    MAGMA_UNUSED(phase);
+#endif
+}
+
+void cpu_perf_add_systems(cpu_perf_thread* t, int count)
+{
+    if (t != NULL) {
+        t->systems += count;
+    }
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Turns the per phase hardware counters of the CPU engine on or off. While
+ they are on, cpuLinearSolverBatched and its variants take an instrumented
+ path that counts every phase separately, see the top of this file.
+
+ The counters of the calling thread are opened to check that the platform
+ allows them; the other threads open theirs on their first tile.
+
+ Arguments
+ ---------
+ @param[in]
+ enable  INTEGER
+ Nonzero turns the counters on, 0 turns them off. The counts gathered so
+ far are kept either way.
+
+ @return when enabling, the mask of the counters that could be opened (bit
+         c for CPU_PERF_* counter c), 0 if none could: a warning is printed
+         once and the engine keeps its normal path. 0 when disabling.
+
+ *******************************************************************************/
+int cpuLinearSolverBatchedPerfEnable(int enable)
+{
+    if (!enable) {
+        cpu_perf_enabled.store(0);
+        return 0;
+    }
+    if (cpu_perf_thread_get() == NULL) {
+        std::lock_guard<std::mutex> lock(cpu_perf_mutex);
+        if (!cpu_perf_warned) {
+            fprintf(stderr, "warning: hardware counters unavailable (perf_event_open: %s), "
+                    "see /proc/sys/kernel/perf_event_paranoid\n", strerror(cpu_perf_errno.load()));
+            cpu_perf_warned = 1;
+        }
+        return 0;
+    }
+    cpu_perf_enabled.store(1);
+    std::lock_guard<std::mutex> lock(cpu_perf_mutex);
+    return (int)cpu_perf_mask;
+}
+
+// Clears the counts of every thread.
+void cpuLinearSolverBatchedPerfReset()
+{
+    std::lock_guard<std::mutex> lock(cpu_perf_mutex);
+    for (size_t i = 0; i < cpu_perf_threads.size(); i++) {
+        cpu_perf_thread* t = cpu_perf_threads[i];
+        memset(t->value, 0, sizeof(t->value));
+        memset(t->seconds, 0, sizeof(t->seconds));
+        t->systems = 0;
+    }
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Counts gathered since the last cpuLinearSolverBatchedPerfReset, summed over
+ the threads. Counters whose bit is not set in counters->available read 0.
+
+ @return 0, or -1 if counters is NULL.
+ *******************************************************************************/
+int cpuLinearSolverBatchedPerfGet(cpu_perf_counters* counters)
+{
+    if (counters == NULL) {
+        utils_reportError(__func__, 1);
+        return -1;
+    }
+    memset(counters, 0, sizeof(*counters));
+
+    std::lock_guard<std::mutex> lock(cpu_perf_mutex);
+    for (size_t i = 0; i < cpu_perf_threads.size(); i++) {
+        const cpu_perf_thread* t = cpu_perf_threads[i];
+        for (int p = 0; p < CPU_PERF_NPHASES; p++) {
+            for (int c = 0; c < CPU_PERF_NCOUNTERS; c++) {
+                counters->value[p][c] += t->value[p][c];
+            }
+            counters->seconds[p] += t->seconds[p];
+        }
+        counters->systems += t->systems;
+    }
+    counters->available = cpu_perf_mask;
+    return 0;
+}
+
+const char* cpuLinearSolverBatchedPerfPhaseName(int phase)
+{
+    return (phase >= 0 && phase < CPU_PERF_NPHASES) ? cpu_perf_phase_names[phase] : "unknown";
+}
+
+const char* cpuLinearSolverBatchedPerfCounterName(int counter)
+{
+    return (counter >= 0 && counter < CPU_PERF_NCOUNTERS) ? cpu_perf_counter_names[counter] : "unknown";
+}
@@ -0,0 +1,448 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <mutex>
+#include "utils.h"
+#include "operation_batched.h"
+#include "slsb.h"
+#include "tunedTables_batched.h"
+#include "smallsq_dispatch.h"
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+/*
+    Autotuner of the CPU engine, the CPU counterpart of the ntcol tables of
+    magma_get_sgetrf_batched_ntcol.
+
+    For every N the best kernel variant (CPU_VARIANT_*) and OpenMP chunk size
+    depend on the microarchitecture, so they are measured instead of hard
+    coded: every candidate solves a synthetic batch, the fastest one wins.
+    Winners are kept in a table and persisted to a small text file
+
+        # CPU engine tuning
+        cpu <model name from /proc/cpuinfo>
+        version <SLSB_VERSION_MAJOR.MINOR.PATCH>
+        threads <OpenMP threads>
+        <n> <variant> <chunk>
+        ...
+
+    which is read by the next processes, so they pay no tuning cost. A file
+    written on another CPU model, library version or thread count is ignored
+    and rewritten. Tables generated offline by tools/tuneTables.cpp for this
+    CPU model (tunedTables_batched.h) are used before any tuning, the file
+    overriding them.
+
+    Candidates are timed like tools/tuneTables.cpp does, fastest of several
+    runs on a batch of CPU_TUNE_LLC_MULTIPLE times the last level cache
+    (cpu_tune_batch_count), so that it streams from memory as the batches of
+    a real solve; its bytes are bounded by CPU_TUNE_MIN_BYTES and
+    CPU_TUNE_MAX_BYTES whatever n.
+
+    A tuning on first use blocks the solve, so it gets a budget of
+    SLSB_CPU_TUNE_BUDGET seconds per size: the candidates start with the
+    default (scalar, even split) and the ones left when the budget is spent
+    are skipped, the fastest so far being kept. cpuLinearSolverBatchedTune
+    and tools/tuneTables.cpp time every candidate, for offline tuning.
+
+    Environment:
+        SLSB_CPU_TUNING_FILE  path of the file, default slsb/cpu_tuning.txt in
+                              $XDG_CACHE_HOME or ~/.cache (never the working
+                              directory); without either the tuning is only
+                              kept in memory
+        SLSB_CPU_AUTOTUNE     0 disables tuning on first use; untuned sizes
+                              then use CPU_VARIANT_SCALAR with an even split.
+        SLSB_CPU_TUNE_BUDGET  seconds a tuning on first use may take per
+                              size, default CPU_TUNE_BUDGET; 0 for no limit
+*/
+
+#define CPU_TUNE_CACHE_DIR     "slsb"
+#define CPU_TUNE_CACHE_FILE    "cpu_tuning.txt"
+
+struct cpu_tune_entry
+{
+    int tuned;
+    int variant;
+    int chunk;
+};
+
+static cpu_tune_entry cpu_tune_table[33];
+static bool cpu_tune_loaded = false;
+static std::mutex cpu_tune_mutex;
+
+// Candidate chunk sizes, in systems; 0 splits the batch evenly.
+const int cpu_tune_chunks[CPU_TUNE_NCHUNKS] = { 0, 1, 8, 64, 512 };
+
+// Path of the tuning file into path. With create, the directories of the
+// default path are created if needed. 0, or -1 if there is no place for it.
+static int cpu_tune_file(char* path, size_t len, int create)
+{
+    const char* file  = getenv("SLSB_CPU_TUNING_FILE");
+    const char* cache = getenv("XDG_CACHE_HOME");
+    const char* home  = getenv("HOME");
+    char dir[1024];
+    int written;
+
+    if (file != NULL && file[0] != '\0') {
+        written = snprintf(path, len, "%s", file);
+        return (written < 0 || (size_t)written >= len) ? -1 : 0;
+    }
+    if (cache != NULL && cache[0] != '\0') {
+        written = snprintf(dir, sizeof(dir), "%s", cache);
+    }
+    else if (home != NULL && home[0] != '\0') {
+        written = snprintf(dir, sizeof(dir), "%s/.cache", home);
+    }
+    else {
+        return -1;
+    }
+    if (written < 0 || (size_t)written >= sizeof(dir) - sizeof(CPU_TUNE_CACHE_DIR)) {
+        return -1;
+    }
+    if (create && mkdir(dir, 0700) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    strcat(dir, "/" CPU_TUNE_CACHE_DIR);
+    if (create && mkdir(dir, 0700) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    written = snprintf(path, len, "%s/%s", dir, CPU_TUNE_CACHE_FILE);
+    return (written < 0 || (size_t)written >= len) ? -1 : 0;
+}
+
+// Size of the largest cache of cpu0, 0 if unknown.
+static size_t cpu_tune_llc_bytes()
+{
+    size_t largest = 0;
+    for (int index = 0; index < 8; index++) {
+        char path[128];
+        unsigned long size = 0;
+        char unit = 'K';
+        FILE* f;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+        f = fopen(path, "r");
+        if (f == NULL) {
+            continue;
+        }
+        if (fscanf(f, "%lu%c", &size, &unit) >= 1) {
+            size *= (unit == 'M') ? 1024 * 1024 : (unit == 'K') ? 1024 : 1;
+            largest = size > largest ? size : largest;
+        }
+        fclose(f);
+    }
+    return largest;
+}
+
+// Systems of size n timed per candidate: CPU_TUNE_LLC_MULTIPLE last level
+// caches of A, B, X and info, within [CPU_TUNE_MIN_BYTES, CPU_TUNE_MAX_BYTES].
+int cpu_tune_batch_count(int n)
+{
+    size_t bytes = CPU_TUNE_LLC_MULTIPLE * cpu_tune_llc_bytes();
+    size_t system = sizeof(float) * ((size_t)n * n + 2 * n) + sizeof(int);
+
+    bytes = bytes < CPU_TUNE_MIN_BYTES ? CPU_TUNE_MIN_BYTES : bytes;
+    bytes = bytes > CPU_TUNE_MAX_BYTES ? CPU_TUNE_MAX_BYTES : bytes;
+    return (int)(bytes / (system > 0 ? system : 1));
+}
+
+static int cpu_tune_threads()
+{
+#if defined(_OPENMP)
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+// Model name of the CPU, "unknown" if it cannot be read.
+void cpu_tune_model(char* model, size_t len)
+{
+    char line[256];
+    FILE* f = fopen("/proc/cpuinfo", "r");
+
+    snprintf(model, len, "unknown");
+    if (f == NULL) {
+        return;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        // x86 reports "model name", most ARM kernels only "CPU part"
+        if (strncmp(line, "model name", 10) == 0 || strncmp(line, "CPU part", 8) == 0) {
+            char* value = strchr(line, ':');
+            if (value != NULL) {
+                value++;
+                while (*value == ' ' || *value == '\t') value++;
+                value[strcspn(value, "\r\n")] = '\0';
+                snprintf(model, len, "%s", value);
+            }
+            break;
+        }
+    }
+    fclose(f);
+}
+
+// Diagonally dominant systems, so that every variant does the same work.
+// A local generator: the caller's rand() sequence is left alone.
+void cpu_tune_fill(float* h_A, float* h_B, int n, int batchCount)
+{
+    unsigned int seed = 1;
+    for (size_t s = 0; s < (size_t)batchCount; s++) {
+        for (int j = 0; j < n; j++) {
+            for (int i = 0; i < n; i++) {
+                seed = seed * 1664525u + 1013904223u;
+                h_A[(s * n + j) * n + i] = (float)(seed >> 8) / (1 << 24) + (i == j ? n : 0);
+            }
+            seed = seed * 1664525u + 1013904223u;
+            h_B[s * n + j] = (float)(seed >> 8) / (1 << 24);
+        }
+    }
+}
+
+static void cpu_tune_version(char* version, size_t len)
+{
+    snprintf(version, len, "%d.%d.%d", SLSB_VERSION_MAJOR, SLSB_VERSION_MINOR, SLSB_VERSION_PATCH);
+}
+
+// Takes the tables shipped in tunedTables_batched.h if they were generated
+// on this CPU model with the same number of threads.
+static void cpu_tune_load_shipped(const char* model)
+{
+    if (TUNED_CPU_MODEL[0] == '\0' || strcmp(TUNED_CPU_MODEL, model) != 0
+        || TUNED_CPU_THREADS != cpu_tune_threads()) {
+        return;
+    }
+    for (int n = 1; n <= 32; n++) {
+        cpu_tune_table[n].tuned   = 1;
+        cpu_tune_table[n].variant = tuned_cpu_variant[n-1];
+        cpu_tune_table[n].chunk   = tuned_cpu_chunk[n-1];
+    }
+}
+
+// Reads the shipped tables, then the tuning file if it matches this machine.
+// Called with the lock held.
+static void cpu_tune_load()
+{
+    char line[512], model[256], version[32], path[1024];
+    char fmodel[256] = "", fversion[32] = "";
+    int fthreads = -1;
+    int n, variant, chunk;
+    FILE* f;
+
+    cpu_tune_loaded = true;
+    cpu_tune_model(model, sizeof(model));
+    cpu_tune_version(version, sizeof(version));
+    cpu_tune_load_shipped(model);
+
+    if (cpu_tune_file(path, sizeof(path), 0) != 0) {
+        return;
+    }
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#' || line[0] == '\0') {
+            continue;
+        }
+        if (strncmp(line, "cpu ", 4) == 0) {
+            snprintf(fmodel, sizeof(fmodel), "%.*s", (int)sizeof(fmodel) - 1, line + 4);
+        }
+        else if (strncmp(line, "version ", 8) == 0) {
+            snprintf(fversion, sizeof(fversion), "%.*s", (int)sizeof(fversion) - 1, line + 8);
+        }
+        else if (strncmp(line, "threads ", 8) == 0) {
+            fthreads = atoi(line + 8);
+        }
+        else if (sscanf(line, "%d %d %d", &n, &variant, &chunk) == 3) {
+            if (strcmp(fmodel, model) != 0 || strcmp(fversion, version) != 0
+                || fthreads != cpu_tune_threads()) {
+                break;  // tuned elsewhere, keep the defaults
+            }
+            if (n >= 1 && n <= 32 && variant >= CPU_VARIANT_SCALAR
+                && variant <= CPU_VARIANT_GATHER16 && chunk >= 0) {
+                cpu_tune_table[n].tuned   = 1;
+                cpu_tune_table[n].variant = variant;
+                cpu_tune_table[n].chunk   = chunk;
+            }
+        }
+    }
+    fclose(f);
+}
+
+// Writes every tuned entry, through a temporary file of a unique name so that
+// a concurrent reader never sees a partial table and concurrent writers do not
+// write into the same one. Called with the lock held.
+static void cpu_tune_save()
+{
+    char model[256], version[32], path[1024], tmp[1040];
+    FILE* f = NULL;
+    int fd;
+
+    if (cpu_tune_file(path, sizeof(path), 1) != 0) {
+        return;     // nowhere to keep it, the tuning stays in memory
+    }
+    cpu_tune_model(model, sizeof(model));
+    cpu_tune_version(version, sizeof(version));
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+
+    fd = mkstemp(tmp);
+    if (fd >= 0) {
+        fchmod(fd, 0644);
+        f = fdopen(fd, "w");
+        if (f == NULL) {
+            close(fd);
+            remove(tmp);
+        }
+    }
+    if (f == NULL) {
+        printf("warning: cannot write the CPU tuning file %s\n", path);
+        return;
+    }
+    fprintf(f, "# CPU engine tuning, written by cpuLinearSolverBatchedTune\n");
+    fprintf(f, "cpu %s\n", model);
+    fprintf(f, "version %s\n", version);
+    fprintf(f, "threads %d\n", cpu_tune_threads());
+    for (int n = 1; n <= 32; n++) {
+        if (cpu_tune_table[n].tuned) {
+            fprintf(f, "%d %d %d\n", n, cpu_tune_table[n].variant, cpu_tune_table[n].chunk);
+        }
+    }
+    fclose(f);
+    if (rename(tmp, path) != 0) {
+        printf("warning: cannot write the CPU tuning file %s\n", path);
+        remove(tmp);
+    }
+}
+
+// Times the variants and chunk sizes for n, the default first, until budget
+// seconds are spent (no limit if budget <= 0). Called with the lock held.
+static int cpu_tune_size(int n, double budget)
+{
+    float *h_A = NULL, *h_B = NULL, *h_X = NULL;
+    int *h_info = NULL;
+    const int batchCount = cpu_tune_batch_count(n);
+    double best = -1.0, start = magma_wtime();
+    int resCode = 0;
+
+    resCode = magma_smalloc_cpu(&h_A, (size_t)n * n * batchCount);
+    if (resCode != 0) {printf("Error in: h_A malloc\n"); goto cleanup;}
+    resCode = magma_smalloc_cpu(&h_B, (size_t)n * batchCount);
+    if (resCode != 0) {printf("Error in: h_B malloc\n"); goto cleanup;}
+    resCode = magma_smalloc_cpu(&h_X, (size_t)n * batchCount);
+    if (resCode != 0) {printf("Error in: h_X malloc\n"); goto cleanup;}
+    resCode = magma_malloc_cpu((void**)&h_info, sizeof(int) * batchCount);
+    if (resCode != 0) {printf("Error in: h_info malloc\n"); goto cleanup;}
+
+    cpu_tune_fill(h_A, h_B, n, batchCount);
+
+    // warm up once (first touch of X), the candidates share the buffers
+    cpu_solve_batched(n, CPU_VARIANT_SCALAR, 0, h_A, h_B, h_X, h_info, batchCount);
+
+    // cpu_tune_chunks[0] is the even split, so the default comes first
+    for (int c = 0; c < CPU_TUNE_NCHUNKS; c++) {
+        for (int variant = CPU_VARIANT_SCALAR; variant <= CPU_VARIANT_GATHER16; variant++) {
+            double time = -1.0;
+            if (budget > 0 && best >= 0 && magma_wtime() - start > budget) {
+                goto cleanup;
+            }
+            // fastest run, at least one even past the budget
+            for (int r = 0; r < CPU_TUNE_REPS; r++) {
+                double t = magma_wtime();
+                cpu_solve_batched(n, variant, cpu_tune_chunks[c], h_A, h_B, h_X, h_info, batchCount);
+                t = magma_wtime() - t;
+                if (time < 0 || t < time) {
+                    time = t;
+                }
+                if (budget > 0 && magma_wtime() - start > budget) {
+                    break;
+                }
+            }
+            if (best < 0 || time < best) {
+                best = time;
+                cpu_tune_table[n].tuned   = 1;
+                cpu_tune_table[n].variant = variant;
+                cpu_tune_table[n].chunk   = cpu_tune_chunks[c];
+            }
+        }
+    }
+
+cleanup:
+    magma_free_cpu(h_A);
+    magma_free_cpu(h_B);
+    magma_free_cpu(h_X);
+    magma_free_cpu(h_info);
+    return resCode;
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Returns the kernel variant and chunk size cpuLinearSolverBatched uses for n.
+ The first call reads the tuning file; a size found neither there nor in a
+ previous tuning is tuned now (unless SLSB_CPU_AUTOTUNE=0), within the
+ SLSB_CPU_TUNE_BUDGET time budget, and the file is updated. Thread safe.
+
+ @return 1 if the values come from a tuning, 0 if they are the defaults.
+ *******************************************************************************/
+int cpuLinearSolverBatchedGetTuning(int n, int* variant, int* chunk)
+{
+    std::lock_guard<std::mutex> lock(cpu_tune_mutex);
+    const char* autotune = getenv("SLSB_CPU_AUTOTUNE");
+    const char* budget   = getenv("SLSB_CPU_TUNE_BUDGET");
+
+    *variant = CPU_VARIANT_SCALAR;
+    *chunk   = 0;
+    if (n < 1 || n > 32 || !smallsq_size_instantiated(n)) {
+        return 0;
+    }
+    if (!cpu_tune_loaded) {
+        cpu_tune_load();
+    }
+    if (!cpu_tune_table[n].tuned && !(autotune != NULL && strcmp(autotune, "0") == 0)) {
+        if (cpu_tune_size(n, (budget != NULL && budget[0] != '\0') ? atof(budget) : CPU_TUNE_BUDGET) == 0) {
+            cpu_tune_save();
+        }
+    }
+    if (!cpu_tune_table[n].tuned) {
+        return 0;
+    }
+    *variant = cpu_tune_table[n].variant;
+    *chunk   = cpu_tune_table[n].chunk;
+    return 1;
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Tunes the CPU engine on demand, for size n or, if n = 0, for every size from
+ 1 to 32 built in SLSB_SMALLSQ_SIZES, overwriting previous results, and saves
+ the tuning file. Every candidate is timed, without the budget of a tuning
+ on first use.
+
+ @return 0 on success, -1 if n is invalid, the allocation error otherwise.
+ *******************************************************************************/
+int cpuLinearSolverBatchedTune(int n)
+{
+    std::lock_guard<std::mutex> lock(cpu_tune_mutex);
+    int resCode = 0;
+
+    if (n < 0 || n > 32) {
+        utils_reportError(__func__, 1);
+        return -1;
+    }
+    if (!cpu_tune_loaded) {
+        cpu_tune_load();
+    }
+    for (int k = (n == 0 ? 1 : n); k <= (n == 0 ? 32 : n) && resCode == 0; k++) {
+        if (smallsq_size_instantiated(k)) {
+            resCode = cpu_tune_size(k, 0);
+        }
+    }
+    cpu_tune_save();
+    return resCode;
+}
@@ -0,0 +1,681 @@
+#ifndef LINEARSOLVERFUSEDSLU_BATCHED_CUH
+#define LINEARSOLVERFUSEDSLU_BATCHED_CUH
+
+#ifdef __CDT_PARSER__
+#undef __CUDA_RUNTIME_H__
+#include <cuda_runtime.h>
+#endif
+
+#include <stdio.h>
+#include <cuda_runtime.h>
+#include <cublas_v2.h>
+#include "utils.h"
+#include "utilscu.cuh"
+#include "magma_types.h"
+#include "operation_batched.h"
+#include "smallsq_dispatch.h"
+
+/*
+    Fused solver for tiny square systems whose A and B are produced on the fly.
+
+    The caller supplies a generator functor instead of h_A / h_B. Every thread
+    of the kernel evaluates the row of its own system directly into registers,
+    so the batch is never materialized in host or device memory. The
+    factorization follows sgetrf_batched_smallsq_noshfl_kernel (registers for
+    storage, shared mem. for communication, lazy swap); the right hand side
+    travels with its row, so the pivoting is applied without an explicit laswp,
+    and the two triangular solves are done in the same kernel.
+
+    A generator is any copyable type with the two device members
+
+        __device__ float a(int batchid, int i, int j) const;  // A(i,j) of system batchid
+        __device__ float b(int batchid, int i) const;         // B(i)   of system batchid
+
+    Members are called with 0 <= i, j < n and are inlined in the kernel, so
+    they should be cheap and side effect free. Since the functor is passed by
+    value to the kernel, it must not hold host pointers.
+
+    Symmetrically, the solution can be handed to a consumer functor instead of
+    being written to an X array, which is useful when the caller only reduces
+    the solutions (dot products, norms, ...). A consumer is any copyable type with
+
+        __device__ void operator()(int batchid, const float* x, int info) const;
+
+    It is called once per system by a single thread, right after the solve,
+    with x pointing to the N solution entries still in shared memory and info
+    the getrf result of that system (x is not valid if info > 0). Results
+    have to be accumulated by the consumer itself, e.g. with atomicAdd on
+    device memory it points to.
+*/
+
+// Generator reading systems already stored on the GPU, packed in column-major
+// order like h_A and h_B (lda = ldb = n), see gpuLinearSolverBatchedConsumed.
+struct sgesv_batched_packed_generator
+{
+    const float* dA;
+    const float* dB;
+    int n;
+
+    __device__ float a(int batchid, int i, int j) const
+    {
+        return dA[ ((size_t)batchid * n + j) * n + i ];
+    }
+
+    __device__ float b(int batchid, int i) const
+    {
+        return dB[ (size_t)batchid * n + i ];
+    }
+};
+
+// Generator of reproducible, diagonally dominant systems: every entry is a
+// hash of (seed, batchid, i, j). The members are host functions too, so the
+// same batch can be materialized and solved the usual way, see
+// testing_sgesv_fused_batched.cu.
+struct sgesv_batched_hash_generator
+{
+    unsigned int seed;
+    int n;
+
+    // uniform in [-0.5, 0.5)
+    __host__ __device__ static float hash(unsigned int k)
+    {
+        k ^= k >> 16;
+        k *= 0x7feb352dU;
+        k ^= k >> 15;
+        k *= 0x846ca68bU;
+        k ^= k >> 16;
+        return (float)(k >> 8) / (1 << 24) - 0.5f;
+    }
+
+    __host__ __device__ float a(int batchid, int i, int j) const
+    {
+        return hash(seed * 0x9e3779b9U + (((unsigned int)batchid * 32U + i) * 32U + j) * 2U)
+               + (i == j ? (float)n : 0.0f);
+    }
+
+    __host__ __device__ float b(int batchid, int i) const
+    {
+        return hash(seed * 0x9e3779b9U + ((unsigned int)batchid * 32U + i) * 2U + 1U);
+    }
+};
+
+// Factorizes and solves the system batchid of gen, one row per thread.
+// On exit rb holds x(rowid), linfo the getrf info and sx[0:N] the whole x.
+template<int N, int NPOW2, typename Generator>
+__device__ __forceinline__ void
+sgesv_batched_smallsq_fused_device( const Generator& gen, int batchid,
+                                float* sx, float* dsx,
+                                float& rb, int& rowid, int& linfo)
+{
+    const int tx = threadIdx.x;
+
+    float rA[N] = {MAGMA_S_ZERO};
+    float reg = MAGMA_S_ZERO;
+
+    int max_id;
+    float rx_abs_max = MAGMA_S_ZERO;
+
+    rb = MAGMA_S_ZERO;
+    rowid = tx;
+    linfo = 0;
+
+    // generate
+    if( tx < N ){
+        #pragma unroll
+        for(int j = 0; j < N; j++){
+            rA[j] = gen.a(batchid, tx, j);
+        }
+        rb = gen.b(batchid, tx);
+    }
+
+    #pragma unroll
+    for(int i = 0; i < N; i++){
+        // isamax and find pivot
+        dsx[ rowid ] = fabs(MAGMA_S_REAL( rA[i] )) + fabs(MAGMA_S_IMAG( rA[i] ));
+        magmablas_syncwarp();
+        rx_abs_max = dsx[i];
+        max_id = i;
+        #pragma unroll
+        for(int j = i+1; j < N; j++){
+            if( dsx[j] > rx_abs_max){
+                max_id = j;
+                rx_abs_max = dsx[j];
+            }
+        }
+        linfo = ( rx_abs_max == MAGMA_S_ZERO && linfo == 0) ? (i+1) : linfo;
+
+        if(rowid == max_id){
+            rowid = i;
+            #pragma unroll
+            for(int j = i; j < N; j++){
+                sx[j] = rA[j];
+            }
+        }
+        else if(rowid == i){
+            rowid = max_id;
+        }
+        magmablas_syncwarp();
+
+        reg = MAGMA_S_DIV(MAGMA_S_ONE, sx[i] );
+        // scal and ger
+        if( rowid > i ){
+            rA[i] *= reg;
+            #pragma unroll
+            for(int j = i+1; j < N; j++){
+                rA[j] -= rA[i] * sx[j];
+            }
+        }
+        magmablas_syncwarp();
+    }
+
+    // solve L * y = P * b, each thread owns y(rowid)
+    #pragma unroll
+    for(int i = 0; i < N; i++){
+        if(rowid == i){
+            sx[i] = rb;
+        }
+        magmablas_syncwarp();
+        if(rowid > i){
+            rb -= rA[i] * sx[i];
+        }
+    }
+    magmablas_syncwarp();
+
+    // solve U * x = y, each thread owns x(rowid)
+    #pragma unroll
+    for(int i = N-1; i >= 0; i--){
+        if(rowid == i){
+            rb = MAGMA_S_DIV(rb, rA[i]);
+            sx[i] = rb;
+        }
+        magmablas_syncwarp();
+        if(rowid < i){
+            rb -= rA[i] * sx[i];
+        }
+    }
+    magmablas_syncwarp();
+}
+
+extern __shared__ float fused_sdata[];
+template<int N, int NPOW2, typename Generator>
+__global__ void
+sgesv_batched_smallsq_generated_kernel( Generator gen,
+                                float* dX, int lddx,
+                                magma_int_t *info_array, int batchCount)
+{
+    const int tx = threadIdx.x;
+    const int ty = threadIdx.y;
+    const int batchid = blockIdx.x * blockDim.y + ty;
+    if(batchid >= batchCount) return;
+
+    float rb;
+    int rowid, linfo;
+
+    float *sx = (float*)(fused_sdata);
+    float* dsx = (float*)(sx + blockDim.y * NPOW2);
+    sx    += ty * NPOW2;
+    dsx   += ty * NPOW2;
+
+    sgesv_batched_smallsq_fused_device<N, NPOW2>(gen, batchid, sx, dsx, rb, rowid, linfo);
+
+    // write
+    if(tx == 0){
+        info_array[batchid] = (magma_int_t)( linfo );
+    }
+    if(tx < N){
+        dX[ batchid * lddx + rowid ] = rb;
+    }
+}
+
+// Same as sgesv_batched_smallsq_generated_kernel, but instead of writing the
+// solution it hands it to cons while it is still in shared memory.
+template<int N, int NPOW2, typename Generator, typename Consumer>
+__global__ void
+sgesv_batched_smallsq_consumed_kernel( Generator gen, Consumer cons, int batchCount)
+{
+    const int tx = threadIdx.x;
+    const int ty = threadIdx.y;
+    const int batchid = blockIdx.x * blockDim.y + ty;
+    if(batchid >= batchCount) return;
+
+    float rb;
+    int rowid, linfo;
+
+    float *sx = (float*)(fused_sdata);
+    float* dsx = (float*)(sx + blockDim.y * NPOW2);
+    sx    += ty * NPOW2;
+    dsx   += ty * NPOW2;
+
+    sgesv_batched_smallsq_fused_device<N, NPOW2>(gen, batchid, sx, dsx, rb, rowid, linfo);
+
+    if(tx == 0){
+        cons(batchid, (const float*)sx, linfo);
+    }
+}
+
+// Launchers of the fused kernels for the size dispatch tables of
+// smallsq_dispatch.h. There is a single variant, V is always 0.
+template<typename Generator>
+struct sgesv_smallsq_generated_launch
+{
+    typedef void (*fn)( dim3 grid, dim3 threads, magma_int_t shmem, cudaStream_t queue,
+                        Generator gen, float* dX, int lddx,
+                        magma_int_t* dinfo_array, int batchCount );
+
+    template<int V, int N>
+    struct entry
+    {
+        static void run( dim3 grid, dim3 threads, magma_int_t shmem, cudaStream_t queue,
+                         Generator gen, float* dX, int lddx,
+                         magma_int_t* dinfo_array, int batchCount )
+        {
+            sgesv_batched_smallsq_generated_kernel<N, magma_ceilpow2(N), Generator><<<grid, threads, shmem, queue >>>(gen, dX, lddx, dinfo_array, batchCount);
+        }
+    };
+
+    static fn get(magma_int_t m)
+    {
+        static constexpr smallsq_table<fn, 1> table = make_smallsq_table<fn, entry, 1>();
+        return table.get(0, (int)m);
+    }
+};
+
+template<typename Generator, typename Consumer>
+struct sgesv_smallsq_consumed_launch
+{
+    typedef void (*fn)( dim3 grid, dim3 threads, magma_int_t shmem, cudaStream_t queue,
+                        Generator gen, Consumer cons, int batchCount );
+
+    template<int V, int N>
+    struct entry
+    {
+        static void run( dim3 grid, dim3 threads, magma_int_t shmem, cudaStream_t queue,
+                         Generator gen, Consumer cons, int batchCount )
+        {
+            sgesv_batched_smallsq_consumed_kernel<N, magma_ceilpow2(N), Generator, Consumer><<<grid, threads, shmem, queue >>>(gen, cons, batchCount);
+        }
+    };
+
+    static fn get(magma_int_t m)
+    {
+        static constexpr smallsq_table<fn, 1> table = make_smallsq_table<fn, entry, 1>();
+        return table.get(0, (int)m);
+    }
+};
+
+/***************************************************************************//**
+    Purpose
+    -------
+    magma_sgesv_batched_smallsq_generated solves batchCount square N-by-N systems
+        A * X = B
+    where A and B of every system are produced on the fly by a generator functor.
+    This routine can deal only with square matrices of size up to 32.
+
+    The LU factorization with partial pivoting and the forward and backward
+    substitutions are fused in one kernel, see sgesv_batched_smallsq_generated_kernel.
+
+    Arguments
+    ---------
+    @param[in]
+    n       INTEGER
+            The size of each matrix A.  0 <= N <= 32.
+
+    @param[in]
+    gen     Generator
+            Device functor producing A(i,j) and B(i) of each system,
+            see the description at the top of this file.
+
+    @param[out]
+    dX      REAL array on the GPU, dimension (LDDX, batchCount).
+            On exit, column i is the solution of system i.
+
+    @param[in]
+    lddx    INTEGER
+            The leading dimension of dX.  LDDX >= max(1,N).
+
+    @param[out]
+    dinfo_array  Array of INTEGERs on the GPU, dimension (batchCount).
+      -     = 0:  successful exit
+      -     > 0:  if INFO = i, U(i,i) is exactly zero and the solution
+                  of the corresponding system is not valid.
+
+    @param[in]
+    batchCount  INTEGER
+                The number of systems to solve.
+
+    @param[in]
+    queue   cudaStream_t
+            Stream to execute in.
+*******************************************************************************/
+template<typename Generator>
+magma_int_t
+magma_sgesv_batched_smallsq_generated(
+    magma_int_t n, Generator gen,
+    float* dX, magma_int_t lddx,
+    magma_int_t* dinfo_array,
+    magma_int_t batchCount, cudaStream_t queue )
+{
+    magma_int_t arginfo = 0;
+    magma_int_t m = n;
+
+    if( (m < 0) || ( m > 32 ) ){
+        arginfo = -1;
+    }
+    else if( lddx < m ){
+        arginfo = -4;
+    }
+    else if( batchCount < 0 ){
+        arginfo = -6;
+    }
+
+    if (arginfo != 0) {
+        magma_xerbla( __func__, -(arginfo) );
+        return arginfo;
+    }
+
+    if( m == 0 || batchCount == 0) return 0;
+
+    const magma_int_t ntcol = magma_get_sgetrf_batched_ntcol(m, n);
+    magma_int_t shmem  = ntcol * magma_ceilpow2(m) * sizeof(float);
+                shmem += ntcol * magma_ceilpow2(m) * sizeof(float);
+    dim3 threads(magma_ceilpow2(m), ntcol, 1);
+    const magma_int_t gridx = magma_ceildiv(batchCount, ntcol);
+    dim3 grid(gridx, 1, 1);
+    typename sgesv_smallsq_generated_launch<Generator>::fn launch =
+        sgesv_smallsq_generated_launch<Generator>::get(m);
+    if (launch == NULL) {
+        printf("error: size %lld is not instantiated, see SLSB_SMALLSQ_SIZES\n", (long long) m);
+        return MAGMA_ERR_NOT_SUPPORTED;
+    }
+    launch(grid, threads, shmem, queue, gen, dX, lddx, dinfo_array, batchCount);
+    return arginfo;
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Host side counterpart of gpuLinearSolverBatched for generated systems.
+ Solves batchCount N-by-N systems A * X = B whose A and B are produced on
+ the GPU by gen, so that neither h_A nor h_B have to exist. Only the
+ solutions and the info array are allocated on the device.
+
+ Arguments
+ ---------
+ @param[in]
+ n       INTEGER
+ The order of the matrix A.  0 <= N <= 32.
+
+ @param[in]
+ gen     Generator
+ Device functor producing A(i,j) and B(i) of each system.
+
+ @param[out]
+ h_Xptr  Pointer to host memory of length n*batchCount*sizeof(float),
+ already allocated upon entry. On exit, solution i is stored at
+ (*h_Xptr) + i*n.
+
+ @param[out]
+ h_info  Array of integers, dimension (batchCount).
+ This is expected to be already allocated upon entry.
+ upon exit this contains the success/failure result
+ of decomposition for each linear system.
+
+ @param[in]
+ batchCount  INTEGER
+ The number of systems to solve.
+
+ *******************************************************************************/
+template<typename Generator>
+int gpuLinearSolverBatchedGenerated(int n, Generator gen,
+        float** h_Xptr, int* h_info, int batchCount)
+{
+    magma_int_t N, lddx, info;
+    magmaFloat_ptr d_X = NULL;
+    magma_int_t* dinfo_array = NULL;
+    cudaStream_t cuda_stream;
+    magma_int_t resCode = 0;
+
+    N = n;
+    lddx = N;
+
+    magma_init();
+    cudaStreamCreate(&cuda_stream);
+
+    resCode = magma_smalloc( &d_X, lddx*batchCount);
+    if (resCode != 0) {printf("Error in: d_X malloc\n"); goto cleanup;}
+    resCode = magma_imalloc( &dinfo_array, batchCount);
+    if (resCode != 0) {printf("Error in: dinfo_array malloc\n"); goto cleanup;}
+
+    info = magma_sgesv_batched_smallsq_generated(N, gen, d_X, lddx,
+                                                 dinfo_array, batchCount, cuda_stream);
+    if (info != 0) {
+        resCode = info;
+        printf("Error in: magma_sgesv_batched_smallsq_generated\n");
+        goto cleanup;
+    }
+
+    resCode = cublasGetVectorAsync(
+                int(batchCount), sizeof(int),
+                dinfo_array, 1,
+                h_info, 1, cuda_stream);
+    if (resCode != 0) {printf("Error in: cublasGetVectorAsync dinfo_array\n"); goto cleanup;}
+
+    resCode = cublasGetMatrixAsync(
+                int(N), int(batchCount), sizeof(float),
+                d_X, int(lddx),
+                *h_Xptr, int(N), cuda_stream);
+    if (resCode != 0) {printf("Error in: cublasGetMatrixAsync d_X\n"); goto cleanup;}
+
+    resCode = cudaStreamSynchronize(cuda_stream);
+    if (resCode != 0) {printf("Error in: cudaStreamSynchronize\n"); goto cleanup;}
+
+    for (int i=0; i < batchCount; i++)
+    {
+        if (h_info[i] != 0 ) {
+            resCode = h_info[i];
+            printf("Error in: h_info[%d]: %d\n", i, resCode);
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    magma_free( d_X );
+    magma_free( dinfo_array );
+    cudaStreamDestroy(cuda_stream);
+
+    magma_finalize();
+
+    return resCode;
+}
+
+/***************************************************************************//**
+    Purpose
+    -------
+    magma_sgesv_batched_smallsq_consumed solves batchCount square N-by-N systems
+        A * X = B
+    where A and B are produced by a generator functor, and passes every
+    solution to a consumer functor instead of storing it.
+    This routine can deal only with square matrices of size up to 32.
+
+    Arguments
+    ---------
+    @param[in]
+    n       INTEGER
+            The size of each matrix A.  0 <= N <= 32.
+
+    @param[in]
+    gen     Generator
+            Device functor producing A(i,j) and B(i) of each system,
+            see the description at the top of this file.
+
+    @param[in]
+    cons    Consumer
+            Device functor called with (batchid, x, info) for each system,
+            see the description at the top of this file.
+
+    @param[in]
+    batchCount  INTEGER
+                The number of systems to solve.
+
+    @param[in]
+    queue   cudaStream_t
+            Stream to execute in.
+*******************************************************************************/
+template<typename Generator, typename Consumer>
+magma_int_t
+magma_sgesv_batched_smallsq_consumed(
+    magma_int_t n, Generator gen, Consumer cons,
+    magma_int_t batchCount, cudaStream_t queue )
+{
+    magma_int_t arginfo = 0;
+    magma_int_t m = n;
+
+    if( (m < 0) || ( m > 32 ) ){
+        arginfo = -1;
+    }
+    else if( batchCount < 0 ){
+        arginfo = -4;
+    }
+
+    if (arginfo != 0) {
+        magma_xerbla( __func__, -(arginfo) );
+        return arginfo;
+    }
+
+    if( m == 0 || batchCount == 0) return 0;
+
+    const magma_int_t ntcol = magma_get_sgetrf_batched_ntcol(m, n);
+    magma_int_t shmem  = ntcol * magma_ceilpow2(m) * sizeof(float);
+                shmem += ntcol * magma_ceilpow2(m) * sizeof(float);
+    dim3 threads(magma_ceilpow2(m), ntcol, 1);
+    const magma_int_t gridx = magma_ceildiv(batchCount, ntcol);
+    dim3 grid(gridx, 1, 1);
+    typename sgesv_smallsq_consumed_launch<Generator, Consumer>::fn launch =
+        sgesv_smallsq_consumed_launch<Generator, Consumer>::get(m);
+    if (launch == NULL) {
+        printf("error: size %lld is not instantiated, see SLSB_SMALLSQ_SIZES\n", (long long) m);
+        return MAGMA_ERR_NOT_SUPPORTED;
+    }
+    launch(grid, threads, shmem, queue, gen, cons, batchCount);
+    return arginfo;
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Variant of gpuLinearSolverBatched that streams the solutions to a consumer
+ functor instead of copying them back to an X array. A and B are copied to the
+ device as usual, but no solution nor info buffer is allocated.
+
+ Arguments
+ ---------
+ @param[in]
+ n       INTEGER
+ The order of the matrix A.  0 <= N <= 32.
+
+ @param[in]
+ h_A     Sequential host allocated memory containing the A matrices,
+ of length n*n*batchCount*sizeof(float), stored in column-major format.
+
+ @param[in]
+ h_B     Sequential host allocated memory containing the right hand sides,
+ of length n*batchCount*sizeof(float).
+
+ @param[in]
+ cons    Consumer
+ Device functor called with (batchid, x, info) for each system.
+
+ @param[in]
+ batchCount  INTEGER
+ The number of systems to solve.
+
+ *******************************************************************************/
+template<typename Consumer>
+int gpuLinearSolverBatchedConsumed(int n, float* h_A, float* h_B,
+        Consumer cons, int batchCount)
+{
+    magma_int_t N, info;
+    magmaFloat_ptr d_A = NULL, d_B = NULL;
+    sgesv_batched_packed_generator gen;
+    cudaStream_t cuda_stream;
+    magma_int_t resCode = 0;
+
+    N = n;
+
+    magma_init();
+    cudaStreamCreate(&cuda_stream);
+
+    resCode = magma_smalloc( &d_A, N*N*batchCount);
+    if (resCode != 0) {printf("Error in: d_A malloc\n"); goto cleanup;}
+    resCode = magma_smalloc( &d_B, N*batchCount);
+    if (resCode != 0) {printf("Error in: d_B malloc\n"); goto cleanup;}
+
+    resCode = cudaMemcpyAsync(d_A, h_A, sizeof(float)*N*N*batchCount,
+                              cudaMemcpyHostToDevice, cuda_stream);
+    if (resCode != 0) {printf("Error in: A copy\n"); goto cleanup;}
+    resCode = cudaMemcpyAsync(d_B, h_B, sizeof(float)*N*batchCount,
+                              cudaMemcpyHostToDevice, cuda_stream);
+    if (resCode != 0) {printf("Error in: B copy\n"); goto cleanup;}
+
+    gen.dA = d_A;
+    gen.dB = d_B;
+    gen.n  = N;
+    info = magma_sgesv_batched_smallsq_consumed(N, gen, cons, batchCount, cuda_stream);
+    if (info != 0) {
+        resCode = info;
+        printf("Error in: magma_sgesv_batched_smallsq_consumed\n");
+        goto cleanup;
+    }
+
+    resCode = cudaStreamSynchronize(cuda_stream);
+    if (resCode != 0) {printf("Error in: cudaStreamSynchronize\n"); goto cleanup;}
+
+cleanup:
+    magma_free( d_A );
+    magma_free( d_B );
+    cudaStreamDestroy(cuda_stream);
+
+    magma_finalize();
+
+    return resCode;
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Generated input and consumed output combined: the systems are produced by gen
+ and their solutions handed to cons, so the batch never exists in memory at
+ all. Nothing but the kernel launch is done, the call returns once the
+ consumer has seen every system.
+
+ *******************************************************************************/
+template<typename Generator, typename Consumer>
+int gpuLinearSolverBatchedGeneratedConsumed(int n, Generator gen,
+        Consumer cons, int batchCount)
+{
+    magma_int_t info;
+    cudaStream_t cuda_stream;
+    magma_int_t resCode = 0;
+
+    magma_init();
+    cudaStreamCreate(&cuda_stream);
+
+    info = magma_sgesv_batched_smallsq_consumed(n, gen, cons, batchCount, cuda_stream);
+    if (info != 0) {
+        resCode = info;
+        printf("Error in: magma_sgesv_batched_smallsq_consumed\n");
+        goto cleanup;
+    }
+
+    resCode = cudaStreamSynchronize(cuda_stream);
+    if (resCode != 0) {printf("Error in: cudaStreamSynchronize\n"); goto cleanup;}
+
+cleanup:
+    cudaStreamDestroy(cuda_stream);
+
+    magma_finalize();
+
+    return resCode;
+}
+
+#endif //LINEARSOLVERFUSEDSLU_BATCHED_CUH
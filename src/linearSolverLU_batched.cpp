@@ -5,6 +5,9 @@
 #include "utils.h"
 #include "testings.h"
 #include "operation_batched.h"
+#include "trace_batched.h"
+#include "instrument_batched.h"
+#include "metrics_batched.h"
 
 
 #ifndef ERR_SUCCESS
@@ -82,8 +85,14 @@ int gpuLinearSolverBatched(int n, float *h_A, float *h_B,
 	const int numStreams = 3;
     cudaStream_t cuda_stream[numStreams];
 	magma_int_t resCode = ERR_SUCCESS;
+	const int traced = trace_batched_enabled();
+	double t0 = traced ? trace_batched_now() : 0.0;
+	instrument_batched inst;
 	//cublasHandle_t cublasHandle;
 
+	// allocations and uploads are queue time, the phases are traced below
+	instrument_batched_begin(&inst, NULL, METRICS_BACKEND_GPU, n, batchCount, h_A, h_B, 0, 0.0);
+
 	N = n;
 	//number of right hand sides columns, for this case 1.
 	nrhs = 1;
@@ -124,6 +133,10 @@ int gpuLinearSolverBatched(int n, float *h_A, float *h_B,
 	if (resCode != ERR_SUCCESS) {printf("Error in: db_array malloc\n"); goto cleanup;}
     resCode = magma_malloc( (void**) &dipiv_array, batchCount * sizeof(magma_int_t*) );
 	if (resCode != ERR_SUCCESS) {printf("Error in: dipiv_array malloc\n"); goto cleanup;}
+	if (traced) {
+		trace_batched_event("alloc", "gpu", t0, -1, n, batchCount);
+		t0 = trace_batched_now();
+	}
 
 	//Copy matrices A to device using stream[0]
 	/*resCode = cudaMemcpy2DAsync(d_A, int(ldda * sizeof(float)),
@@ -167,6 +180,12 @@ int gpuLinearSolverBatched(int n, float *h_A, float *h_B,
 	if (resCode != ERR_SUCCESS) {printf("Error in: cudaStreamSynchronize\n"); goto cleanup;}
     resCode = cudaStreamSynchronize(cuda_stream[2]);
 	if (resCode != ERR_SUCCESS) {printf("Error in: cudaStreamSynchronize\n"); goto cleanup;}
+	if (traced) {
+		trace_batched_event("upload", "gpu", t0, -1, n, batchCount);
+		t0 = trace_batched_now();
+	}
+
+	instrument_batched_solve_begin(&inst);
 
 	//Perform solution on Device
 	info = linearSolverSLU_batched(N, nrhs, dA_array, ldda, 
@@ -175,6 +194,11 @@ int gpuLinearSolverBatched(int n, float *h_A, float *h_B,
 
 	//Make sure operation completed
 	cudaStreamSynchronize(cuda_stream[0]);
+	instrument_batched_solve_end(&inst);
+	if (traced) {
+		trace_batched_event("solve", "gpu", t0, -1, n, batchCount);
+		t0 = trace_batched_now();
+	}
 
 	//Copy success result to host
 	//resCode = cudaMemcpyAsync(h_info,dinfo_array,sizeof(int)*batchCount,cudaMemcpyDeviceToHost, cuda_stream[0]);
@@ -198,9 +222,17 @@ int gpuLinearSolverBatched(int n, float *h_A, float *h_B,
                 *h_Xptr, int(ldb), cuda_stream[1]);
 	if (resCode != ERR_SUCCESS) {printf("Error in: cublasGetMatrixAsync d_X\n"); goto cleanup;}
 
-	//Check for reported errors
+	//Wait for info and the solutions, the call is recorded whatever info holds
     resCode = cudaStreamSynchronize(cuda_stream[0]);
 	if (resCode != ERR_SUCCESS) {printf("Error in: cudaStreamSynchronize\n"); goto cleanup;}
+    resCode = cudaStreamSynchronize(cuda_stream[1]);
+	if (resCode != ERR_SUCCESS) {printf("Error in: cudaStreamSynchronize\n"); goto cleanup;}
+	if (traced) {
+		trace_batched_event("download", "gpu", t0, -1, n, batchCount);
+	}
+	instrument_batched_end(&inst, h_info);
+
+	//Check for reported errors
     for (int i=0; i < batchCount; i++)
     {
     	if (h_info[i] != 0 ) {
@@ -215,12 +247,10 @@ int gpuLinearSolverBatched(int n, float *h_A, float *h_B,
         goto cleanup;
     }
 
-	//Verify copy finished before cleanup.
-    resCode = cudaStreamSynchronize(cuda_stream[1]);
-	if (resCode != ERR_SUCCESS) {printf("Error in: cudaStreamSynchronize\n"); goto cleanup;}
-
 
 cleanup:
+	// no-op if the call was recorded above
+	instrument_batched_end(&inst, NULL);
 	magma_free( d_A );
 	magma_free( d_B );
 	magma_free( dipiv );
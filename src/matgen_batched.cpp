@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "random_batched.h"
+#include "matgen_batched.h"
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+/*
+    Structured test matrices for the batched solvers, so that pivoting,
+    accuracy and the fast paths meant for a structure are exercised on it
+    rather than on normal matrices only.
+
+    Orthogonal factors are Haar distributed: the Q of the QR factorization
+    of a normal matrix with a positive diagonal R, computed in double by
+    modified Gram-Schmidt applied twice. The products are formed in double
+    and rounded once to float, so the condition numbers hold up to float
+    rounding (within a few ulps relative to 1/param for the cond and
+    nearsingular types).
+
+    Random values: a normal system s uses the values s * (n*n + n) onwards
+    of the stream (A then B, as benchSgesv always did), the other types the
+    MATGEN_STRIDE values from s * MATGEN_STRIDE, enough for two orthogonal
+    factors, one normal matrix, B and the stencil coefficients at n = 32.
+*/
+
+#define MATGEN_MAX_N   32
+#define MATGEN_STRIDE  (3 * MATGEN_MAX_N * MATGEN_MAX_N + 2 * MATGEN_MAX_N)
+
+const char* matgen_batched_name(int type)
+{
+    switch (type) {
+        case MATGEN_NORMAL:       return "normal";
+        case MATGEN_COND:         return "cond";
+        case MATGEN_DIAGDOM:      return "diagdom";
+        case MATGEN_SPD:          return "spd";
+        case MATGEN_BANDED:       return "banded";
+        case MATGEN_NEARSINGULAR: return "nearsingular";
+        case MATGEN_STENCIL:      return "stencil";
+        default:                  return "unknown";
+    }
+}
+
+double matgen_batched_default_param(int type)
+{
+    switch (type) {
+        case MATGEN_COND:         return 1e4;
+        case MATGEN_DIAGDOM:      return 1.0;
+        case MATGEN_SPD:          return 1e2;
+        case MATGEN_BANDED:       return 2.0;
+        case MATGEN_NEARSINGULAR: return 1e-6;
+        case MATGEN_STENCIL:      return 0.5;
+        default:                  return 0.0;
+    }
+}
+
+// Haar orthogonal Q (column major, double) from the n*n normal values g.
+static void matgen_orthogonal(int n, const float* g, double* Q)
+{
+    for (int k = 0; k < n * n; k++) {
+        Q[k] = g[k];
+    }
+    for (int j = 0; j < n; j++) {
+        double* qj = Q + (size_t)j * n;
+        for (int pass = 0; pass < 2; pass++) {
+            for (int k = 0; k < j; k++) {
+                const double* qk = Q + (size_t)k * n;
+                double r = 0.0;
+                for (int i = 0; i < n; i++) {
+                    r += qk[i] * qj[i];
+                }
+                for (int i = 0; i < n; i++) {
+                    qj[i] -= r * qk[i];
+                }
+            }
+        }
+        double norm = 0.0;
+        for (int i = 0; i < n; i++) {
+            norm += qj[i] * qj[i];
+        }
+        norm = sqrt(norm);
+        for (int i = 0; i < n; i++) {
+            qj[i] /= norm;
+        }
+    }
+}
+
+// A = U diag(s) V^T
+static void matgen_usv(int n, const double* U, const double* s, const double* V, float* A)
+{
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            double a = 0.0;
+            for (int k = 0; k < n; k++) {
+                a += U[i + (size_t)k * n] * s[k] * V[j + (size_t)k * n];
+            }
+            A[i + (size_t)j * n] = (float)a;
+        }
+    }
+}
+
+// Singular values from 1 down to 1 / cond, geometrically.
+static void matgen_geometric(int n, double cond, double* s)
+{
+    for (int k = 0; k < n; k++) {
+        s[k] = n > 1 ? pow(cond, -(double)k / (n - 1)) : 1.0;
+    }
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Variable coefficient diffusion: node p has the coefficient c[p], an edge
+ the mean of the coefficients of its ends, the boundary (Dirichlet) the
+ coefficient of its node, so A is a symmetric positive definite M-matrix.
+ *******************************************************************************/
+static void matgen_stencil(int n, const float* u, double param, float* A)
+{
+    double c[MATGEN_MAX_N];
+    int k = 1;
+
+    while ((k + 1) * (k + 1) <= n) {
+        k++;
+    }
+    const int grid = k > 1 && k * k == n;
+    const int neighbors = grid ? 4 : 2;
+
+    memset(A, 0, (size_t)n * n * sizeof(float));
+    for (int p = 0; p < n; p++) {
+        c[p] = 1.0 + param * u[p];
+    }
+    for (int p = 0; p < n; p++) {
+        const int x = grid ? p % k : p;
+        const int y = grid ? p / k : 0;
+        const int width = grid ? k : n;
+        const int height = grid ? k : 1;
+        const int dx[4] = { -1, 1, 0, 0 };
+        const int dy[4] = { 0, 0, -1, 1 };
+        double diag = 0.0;
+        for (int e = 0; e < neighbors; e++) {
+            const int nx = x + dx[e], ny = y + dy[e];
+            if (nx < 0 || nx >= width || ny < 0 || ny >= height) {
+                diag += c[p];
+                continue;
+            }
+            const int q = nx + ny * width;
+            const double w = 0.5 * (c[p] + c[q]);
+            A[p + (size_t)q * n] = (float)-w;
+            diag += w;
+        }
+        A[p + (size_t)p * n] = (float)diag;
+    }
+}
+
+int matgen_batched_system(int type, double param, int n, float* A, float* B, long long s,
+                          unsigned long long seed)
+{
+    float r[MATGEN_STRIDE];
+    double U[MATGEN_MAX_N * MATGEN_MAX_N], V[MATGEN_MAX_N * MATGEN_MAX_N], sigma[MATGEN_MAX_N];
+    const int nn = n * n;
+
+    if (n < 1 || n > MATGEN_MAX_N || type < 0 || type >= MATGEN_NTYPES) {
+        return -1;
+    }
+    if (param <= 0) {
+        param = matgen_batched_default_param(type);
+    }
+    if (type == MATGEN_NORMAL) {
+        random_batched_normal(r, (size_t)(nn + n), seed, (unsigned long long)s * (nn + n));
+        memcpy(A, r, nn * sizeof(float));
+        memcpy(B, r + nn, n * sizeof(float));
+        return 0;
+    }
+
+    // normal values: two orthogonal factors or one matrix, then B; uniform ones for the stencil
+    random_batched_normal(r, (size_t)(2 * nn + n), seed, (unsigned long long)s * MATGEN_STRIDE);
+    memcpy(B, r + 2 * nn, n * sizeof(float));
+
+    switch (type) {
+        case MATGEN_COND:
+        case MATGEN_NEARSINGULAR:
+            matgen_orthogonal(n, r, U);
+            matgen_orthogonal(n, r + nn, V);
+            if (type == MATGEN_COND) {
+                matgen_geometric(n, param, sigma);
+            }
+            else {
+                for (int k = 0; k < n; k++) {
+                    sigma[k] = k == n - 1 ? param : 1.0;
+                }
+            }
+            matgen_usv(n, U, sigma, V, A);
+            break;
+
+        case MATGEN_SPD:
+            matgen_orthogonal(n, r, U);
+            matgen_geometric(n, param, sigma);
+            matgen_usv(n, U, sigma, U, A);
+            break;
+
+        case MATGEN_DIAGDOM:
+            memcpy(A, r, nn * sizeof(float));
+            for (int i = 0; i < n; i++) {
+                double sum = 0.0;
+                for (int j = 0; j < n; j++) {
+                    sum += j != i ? fabs((double)A[i + (size_t)j * n]) : 0.0;
+                }
+                A[i + (size_t)i * n] = (float)(A[i + (size_t)i * n] >= 0 ? sum + param : -(sum + param));
+            }
+            break;
+
+        case MATGEN_BANDED:
+            for (int j = 0; j < n; j++) {
+                for (int i = 0; i < n; i++) {
+                    A[i + (size_t)j * n] = abs(i - j) <= (int)param ? r[i + j * n] : 0.0f;
+                }
+            }
+            break;
+
+        case MATGEN_STENCIL:
+            random_batched_uniform(r, (size_t)n, seed, (unsigned long long)s * MATGEN_STRIDE + 3 * nn + n);
+            matgen_stencil(n, r, param, A);
+            break;
+    }
+    return 0;
+}
+
+int matgen_batched(int type, double param, int n, float* A, float* B, int batchCount,
+                   unsigned long long seed)
+{
+    if (n < 1 || n > MATGEN_MAX_N || type < 0 || type >= MATGEN_NTYPES) {
+        printf("Error in: matgen_batched, type %d, n %d\n", type, n);
+        return -1;
+    }
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
+    for (int s = 0; s < batchCount; s++) {
+        matgen_batched_system(type, param, n, A + (size_t)s * n * n, B + (size_t)s * n, s, seed);
+    }
+    return 0;
+}
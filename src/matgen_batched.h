@@ -0,0 +1,36 @@
+#ifndef MATGEN_BATCHED_H
+#define MATGEN_BATCHED_H
+
+/*
+    Structured test batches, see matgen_batched.cpp. Every system is drawn
+    from the counter based stream of random_batched.h at its own offset, so
+    a batch only depends on the seed, not on the number of threads.
+*/
+
+// Matrix types, param <= 0 selects the default in brackets
+#define MATGEN_NORMAL         0   // i.i.d. standard normal entries
+#define MATGEN_COND           1   // U diag(s) V^T, U and V Haar orthogonal, s geometric from 1 to 1/param [1e4]
+#define MATGEN_DIAGDOM        2   // normal, |a_ii| = sum_j!=i |a_ij| + param: strictly diagonally dominant by rows [1]
+#define MATGEN_SPD            3   // Q diag(s) Q^T, Q Haar orthogonal, s geometric from 1 to 1/param [1e2]
+#define MATGEN_BANDED         4   // normal within param diagonals above and below the main one, zero outside [2]
+#define MATGEN_NEARSINGULAR   5   // U diag(1, ..., 1, param) V^T [1e-6]
+#define MATGEN_STENCIL        6   // variable coefficient diffusion: 5 point 2D Laplacian on a k-by-k grid when
+                                  // n = k*k (k > 1), 3 point 1D otherwise, coefficients 1 + param * U(0, 1) [0.5]
+#define MATGEN_NTYPES         7
+
+const char* matgen_batched_name(int type);
+double matgen_batched_default_param(int type);
+
+/***************************************************************************//**
+    Fills the batchCount column major n-by-n matrices of A (packed, n*n
+    apart) with matrices of type and B (n apart) with standard normal right
+    hand sides. Returns 0, -1 for an unknown type or n outside [1, 32].
+ *******************************************************************************/
+int matgen_batched(int type, double param, int n, float* A, float* B, int batchCount,
+                   unsigned long long seed);
+
+// System s alone, for generators that write other layouts.
+int matgen_batched_system(int type, double param, int n, float* A, float* B, long long s,
+                          unsigned long long seed);
+
+#endif //MATGEN_BATCHED_H
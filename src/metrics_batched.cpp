@@ -0,0 +1,565 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <string>
+#include <vector>
+#include "metrics_batched.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+/*
+    Metrics of the solvers for Prometheus or any scraper of its text
+    exposition format (version 0.0.4).
+
+    Counters and histograms are accumulated per thread: every thread owns a
+    block of slots, registered once under a mutex, and adds to its own slots
+    with a relaxed load and store, so the hot paths neither lock nor share
+    cache lines. Rendering sums the blocks of all the threads. Gauges are
+    single atomics shared by all the threads.
+
+    Built in metrics, each with a backend="cpu" or backend="gpu" label:
+        slsb_systems_solved_total           systems solved
+        slsb_singular_systems_total         systems with a zero pivot (info > 0)
+        slsb_batches_total                  batches solved
+        slsb_solve_seconds_total            time spent solving
+        slsb_bytes_total                    bytes of A, b and x moved by the solves
+        slsb_batches_in_flight              batches inside a solver, the queue depth
+        slsb_batch_duration_seconds         histogram of the batch solve times
+    so that, in PromQL, rate(slsb_systems_solved_total[1m]) is the systems
+    solved per second, rate(slsb_singular_systems_total[1m]) /
+    rate(slsb_systems_solved_total[1m]) the singular rate and
+    rate(slsb_bytes_total[1m]) / rate(slsb_solve_seconds_total[1m]) the
+    bandwidth of the solves.
+
+    Environment (either one enables recording):
+        SLSB_METRICS_FILE   file written at exit, and every
+                            SLSB_METRICS_INTERVAL seconds if that is set
+        SLSB_METRICS_PORT   port of the endpoint served on 127.0.0.1
+*/
+
+#define METRICS_MAX_METRICS  128
+#define METRICS_MAX_SLOTS    1024
+#define METRICS_NAME_LEN     96
+#define METRICS_HELP_LEN     160
+#define METRICS_LABELS_LEN   96
+#define METRICS_IO_TIMEOUT   5      // seconds a scraper has to send its request and read the reply
+
+struct metrics_desc
+{
+    char name[METRICS_NAME_LEN];
+    char help[METRICS_HELP_LEN];
+    char labels[METRICS_LABELS_LEN];
+    int type;
+    int slot;           // first slot, in the thread blocks or metrics_gauges
+    int nbounds;        // histogram: nbounds + 1 buckets (the last one +Inf) then the sum
+    double* bounds;
+};
+
+struct metrics_block
+{
+    std::atomic<double> slots[METRICS_MAX_SLOTS];
+};
+
+static std::mutex metrics_mutex;
+static metrics_desc metrics_descs[METRICS_MAX_METRICS];
+static std::atomic<int> metrics_count(0);
+static int metrics_slots_used = 0;
+static std::atomic<double> metrics_gauges[METRICS_MAX_METRICS];
+static int metrics_gauges_used = 0;
+static std::vector<metrics_block*> metrics_blocks;
+static std::atomic<int> metrics_state(-1);      // -1 environment not read yet, 0 off, 1 on
+static const char* metrics_path = NULL;
+static std::mutex metrics_write_mutex;          // the periodic writer and the one at exit share path.tmp
+
+static thread_local metrics_block* metrics_self = NULL;
+
+// Built in metrics per backend
+struct metrics_builtin
+{
+    int solved;
+    int singular;
+    int batches;
+    int seconds;
+    int bytes;
+    int in_flight;
+    int duration;
+};
+
+static metrics_builtin metrics_builtins[2];
+static std::once_flag metrics_builtins_once;
+
+static const double metrics_duration_bounds[] = {
+    1e-6, 4e-6, 1.6e-5, 6.4e-5, 2.56e-4, 1.024e-3, 4.096e-3, 1.6384e-2, 6.5536e-2, 0.262144, 1.048576, 4.194304
+};
+
+static void metrics_atexit()
+{
+    if (metrics_path != NULL) {
+        metrics_batched_write(metrics_path);
+    }
+}
+
+static void metrics_periodic(double interval)
+{
+    for (;;) {
+        std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+        metrics_batched_write(metrics_path);
+    }
+}
+
+static void metrics_init()
+{
+    const char* path;
+    const char* port;
+    const char* interval;
+    {
+        std::lock_guard<std::mutex> lock(metrics_mutex);
+        if (metrics_state.load() >= 0) {
+            return;
+        }
+        path     = getenv("SLSB_METRICS_FILE");
+        port     = getenv("SLSB_METRICS_PORT");
+        interval = getenv("SLSB_METRICS_INTERVAL");
+        if (path != NULL && path[0] != '\0') {
+            metrics_path = path;
+            atexit(metrics_atexit);
+        }
+        metrics_state.store(metrics_path != NULL || (port != NULL && atoi(port) > 0));
+    }
+    if (metrics_path != NULL && interval != NULL && atof(interval) > 0) {
+        std::thread(metrics_periodic, atof(interval)).detach();
+    }
+    if (port != NULL && atoi(port) > 0) {
+        metrics_batched_serve(atoi(port));
+    }
+}
+
+int metrics_batched_enabled()
+{
+    int state = metrics_state.load(std::memory_order_relaxed);
+    if (state < 0) {
+        metrics_init();
+        state = metrics_state.load();
+    }
+    return state;
+}
+
+void metrics_batched_enable(int enable)
+{
+    metrics_batched_enabled();
+    metrics_state.store(enable != 0);
+}
+
+static int metrics_valid_name(const char* name)
+{
+    if (name == NULL || name[0] == '\0' || strlen(name) >= METRICS_NAME_LEN
+        || (name[0] >= '0' && name[0] <= '9')) {
+        return 0;
+    }
+    for (const char* c = name; *c != '\0'; c++) {
+        if (!((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9')
+              || *c == '_' || *c == ':')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int metrics_batched_register(const char* name, const char* help, int type,
+                             const char* labels, const double* bounds, int nbounds)
+{
+    std::lock_guard<std::mutex> lock(metrics_mutex);
+    const int count = metrics_count.load();
+
+    if (labels == NULL) {
+        labels = "";
+    }
+    if (!metrics_valid_name(name) || strlen(labels) >= METRICS_LABELS_LEN
+        || type < METRICS_COUNTER || type > METRICS_HISTOGRAM
+        || (type == METRICS_HISTOGRAM && (bounds == NULL || nbounds < 1))) {
+        printf("Error in: metrics_batched_register, invalid metric %s\n", name != NULL ? name : "(null)");
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (strcmp(metrics_descs[i].name, name) == 0 && strcmp(metrics_descs[i].labels, labels) == 0) {
+            return metrics_descs[i].type == type ? i : -1;
+        }
+    }
+    for (int b = 1; type == METRICS_HISTOGRAM && b < nbounds; b++) {
+        if (!(bounds[b] > bounds[b - 1])) {
+            printf("Error in: metrics_batched_register, bounds of %s not increasing\n", name);
+            return -1;
+        }
+    }
+
+    const int nslots = type == METRICS_COUNTER ? 1 : type == METRICS_HISTOGRAM ? nbounds + 2 : 0;
+    if (count >= METRICS_MAX_METRICS || metrics_slots_used + nslots > METRICS_MAX_SLOTS) {
+        printf("Error in: metrics_batched_register, registry full, %s dropped\n", name);
+        return -1;
+    }
+    metrics_desc* d = &metrics_descs[count];
+    snprintf(d->name, sizeof(d->name), "%s", name);
+    snprintf(d->help, sizeof(d->help), "%s", help != NULL ? help : "");
+    snprintf(d->labels, sizeof(d->labels), "%s", labels);
+    d->type    = type;
+    d->nbounds = type == METRICS_HISTOGRAM ? nbounds : 0;
+    d->bounds  = NULL;
+    if (type == METRICS_HISTOGRAM) {
+        d->bounds = (double*)malloc(nbounds * sizeof(double));
+        if (d->bounds == NULL) {
+            printf("Error in: metrics_batched_register, malloc\n");
+            return -1;
+        }
+        memcpy(d->bounds, bounds, nbounds * sizeof(double));
+    }
+    if (type == METRICS_GAUGE) {
+        d->slot = metrics_gauges_used++;
+        metrics_gauges[d->slot].store(0.0);
+    }
+    else {
+        d->slot = metrics_slots_used;
+        metrics_slots_used += nslots;
+    }
+    metrics_count.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+// Block of the calling thread, NULL if it could not be allocated.
+static metrics_block* metrics_thread_block()
+{
+    if (metrics_self != NULL) {
+        return metrics_self;
+    }
+    metrics_block* block = new (std::nothrow) metrics_block();
+    if (block == NULL) {
+        return NULL;
+    }
+    for (int s = 0; s < METRICS_MAX_SLOTS; s++) {
+        block->slots[s].store(0.0, std::memory_order_relaxed);
+    }
+    // Blocks outlive their threads: the counts of a finished thread stay in the totals.
+    std::lock_guard<std::mutex> lock(metrics_mutex);
+    metrics_blocks.push_back(block);
+    metrics_self = block;
+    return block;
+}
+
+static inline void metrics_slot_add(metrics_block* block, int slot, double value)
+{
+    std::atomic<double>& s = block->slots[slot];
+    s.store(s.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static inline const metrics_desc* metrics_get(int id, int type)
+{
+    if (id < 0 || id >= metrics_count.load(std::memory_order_acquire)
+        || metrics_descs[id].type != type) {
+        return NULL;
+    }
+    return &metrics_descs[id];
+}
+
+void metrics_batched_add(int id, double value)
+{
+    if (id >= 0 && id < metrics_count.load(std::memory_order_acquire)
+        && metrics_descs[id].type == METRICS_GAUGE) {
+        std::atomic<double>& g = metrics_gauges[metrics_descs[id].slot];
+        double seen = g.load(std::memory_order_relaxed);
+        while (!g.compare_exchange_weak(seen, seen + value, std::memory_order_relaxed)) {
+        }
+        return;
+    }
+    const metrics_desc* d = metrics_get(id, METRICS_COUNTER);
+    metrics_block* block;
+    if (d == NULL || value < 0 || (block = metrics_thread_block()) == NULL) {
+        return;
+    }
+    metrics_slot_add(block, d->slot, value);
+}
+
+void metrics_batched_set(int id, double value)
+{
+    const metrics_desc* d = metrics_get(id, METRICS_GAUGE);
+    if (d != NULL) {
+        metrics_gauges[d->slot].store(value, std::memory_order_relaxed);
+    }
+}
+
+void metrics_batched_observe(int id, double value)
+{
+    const metrics_desc* d = metrics_get(id, METRICS_HISTOGRAM);
+    metrics_block* block;
+    if (d == NULL || (block = metrics_thread_block()) == NULL) {
+        return;
+    }
+    int b = 0;
+    while (b < d->nbounds && value > d->bounds[b]) {
+        b++;
+    }
+    metrics_slot_add(block, d->slot + b, 1.0);
+    metrics_slot_add(block, d->slot + d->nbounds + 1, value);
+}
+
+static void metrics_builtins_register()
+{
+    static const char* labels[2] = { "backend=\"cpu\"", "backend=\"gpu\"" };
+    const int nbounds = (int)(sizeof(metrics_duration_bounds) / sizeof(metrics_duration_bounds[0]));
+
+    for (int k = 0; k < 2; k++) {
+        metrics_builtin* m = &metrics_builtins[k];
+        m->solved    = metrics_batched_register("slsb_systems_solved_total", "Linear systems solved.",
+                                                METRICS_COUNTER, labels[k], NULL, 0);
+        m->singular  = metrics_batched_register("slsb_singular_systems_total", "Systems with a zero pivot (info > 0).",
+                                                METRICS_COUNTER, labels[k], NULL, 0);
+        m->batches   = metrics_batched_register("slsb_batches_total", "Batches solved.",
+                                                METRICS_COUNTER, labels[k], NULL, 0);
+        m->seconds   = metrics_batched_register("slsb_solve_seconds_total", "Time spent solving batches.",
+                                                METRICS_COUNTER, labels[k], NULL, 0);
+        m->bytes     = metrics_batched_register("slsb_bytes_total", "Bytes of A, b and x moved by the solves.",
+                                                METRICS_COUNTER, labels[k], NULL, 0);
+        m->in_flight = metrics_batched_register("slsb_batches_in_flight", "Batches inside a solver.",
+                                                METRICS_GAUGE, labels[k], NULL, 0);
+        m->duration  = metrics_batched_register("slsb_batch_duration_seconds", "Solve time of a batch.",
+                                                METRICS_HISTOGRAM, labels[k], metrics_duration_bounds, nbounds);
+    }
+}
+
+void metrics_batched_solved(int backend, int n, int batchCount, int singular, double seconds)
+{
+    if (backend < METRICS_BACKEND_CPU || backend > METRICS_BACKEND_GPU || batchCount <= 0) {
+        return;
+    }
+    std::call_once(metrics_builtins_once, metrics_builtins_register);
+    const metrics_builtin* m = &metrics_builtins[backend];
+    metrics_batched_add(m->solved, (double)batchCount);
+    metrics_batched_add(m->singular, (double)singular);
+    metrics_batched_add(m->batches, 1.0);
+    metrics_batched_add(m->seconds, seconds);
+    metrics_batched_add(m->bytes, (double)batchCount * (double)(n * n + 2 * n) * sizeof(float));
+    metrics_batched_observe(m->duration, seconds);
+}
+
+void metrics_batched_in_flight(int backend, int delta)
+{
+    if (backend < METRICS_BACKEND_CPU || backend > METRICS_BACKEND_GPU) {
+        return;
+    }
+    std::call_once(metrics_builtins_once, metrics_builtins_register);
+    metrics_batched_add(metrics_builtins[backend].in_flight, (double)delta);
+}
+
+// Sum of slot over the blocks of all the threads; the caller holds metrics_mutex.
+static double metrics_sum(int slot)
+{
+    double sum = 0.0;
+    for (size_t t = 0; t < metrics_blocks.size(); t++) {
+        sum += metrics_blocks[t]->slots[slot].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+static void metrics_render_one(std::string& out, const metrics_desc* d)
+{
+    char line[512];
+    const char* sep = d->labels[0] != '\0' ? "," : "";
+
+    if (d->type != METRICS_HISTOGRAM) {
+        const double value = d->type == METRICS_GAUGE
+                           ? metrics_gauges[d->slot].load(std::memory_order_relaxed)
+                           : metrics_sum(d->slot);
+        if (d->labels[0] != '\0') {
+            snprintf(line, sizeof(line), "%s{%s} %.17g\n", d->name, d->labels, value);
+        }
+        else {
+            snprintf(line, sizeof(line), "%s %.17g\n", d->name, value);
+        }
+        out += line;
+        return;
+    }
+    double cumulative = 0.0;
+    for (int b = 0; b <= d->nbounds; b++) {
+        char le[32];
+        cumulative += metrics_sum(d->slot + b);
+        if (b < d->nbounds) {
+            snprintf(le, sizeof(le), "%.9g", d->bounds[b]);
+        }
+        else {
+            snprintf(le, sizeof(le), "+Inf");
+        }
+        snprintf(line, sizeof(line), "%s_bucket{%s%sle=\"%s\"} %.17g\n", d->name, d->labels, sep, le, cumulative);
+        out += line;
+    }
+    const char* open  = d->labels[0] != '\0' ? "{" : "";
+    const char* close = d->labels[0] != '\0' ? "}" : "";
+    snprintf(line, sizeof(line), "%s_sum%s%s%s %.17g\n%s_count%s%s%s %.17g\n",
+             d->name, open, d->labels, close, metrics_sum(d->slot + d->nbounds + 1),
+             d->name, open, d->labels, close, cumulative);
+    out += line;
+}
+
+// Text exposition of every metric: HELP and TYPE once per name, then its series.
+static std::string metrics_render_string()
+{
+    static const char* types[3] = { "counter", "gauge", "histogram" };
+    std::lock_guard<std::mutex> lock(metrics_mutex);
+    const int count = metrics_count.load();
+    std::string out;
+
+    for (int i = 0; i < count; i++) {
+        int seen = 0;
+        for (int j = 0; j < i && !seen; j++) {
+            seen = strcmp(metrics_descs[j].name, metrics_descs[i].name) == 0;
+        }
+        if (seen) {
+            continue;
+        }
+        out += "# HELP ";
+        out += metrics_descs[i].name;
+        out += " ";
+        out += metrics_descs[i].help;
+        out += "\n# TYPE ";
+        out += metrics_descs[i].name;
+        out += " ";
+        out += types[metrics_descs[i].type];
+        out += "\n";
+        for (int j = i; j < count; j++) {
+            if (strcmp(metrics_descs[j].name, metrics_descs[i].name) == 0) {
+                metrics_render_one(out, &metrics_descs[j]);
+            }
+        }
+    }
+    return out;
+}
+
+int metrics_batched_render(FILE* f)
+{
+    const std::string text = metrics_render_string();
+    if (fwrite(text.data(), 1, text.size(), f) != text.size()) {
+        return -1;
+    }
+    fflush(f);
+    return 0;
+}
+
+int metrics_batched_write(const char* path)
+{
+    std::lock_guard<std::mutex> lock(metrics_write_mutex);
+    std::string tmp;
+    FILE* f;
+    int status = 0;
+
+    if (path == NULL) {
+        return -1;
+    }
+    tmp = std::string(path) + ".tmp";
+    f = fopen(tmp.c_str(), "w");
+    if (f == NULL) {
+        printf("Error in: cannot write the metrics to %s\n", tmp.c_str());
+        return -1;
+    }
+    status = metrics_batched_render(f);
+    if (fclose(f) != 0 || status != 0 || rename(tmp.c_str(), path) != 0) {
+        printf("Error in: cannot write the metrics to %s\n", path);
+        remove(tmp.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+#if defined(__linux__)
+static void metrics_reply(int fd)
+{
+    char request[1024];
+    std::string reply;
+    struct timeval timeout = { METRICS_IO_TIMEOUT, 0 };
+    ssize_t got;
+
+    // a client that connects and sends nothing must not block the endpoint
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    got = recv(fd, request, sizeof(request) - 1, 0);
+    if (got <= 0) {
+        return;
+    }
+    request[got] = '\0';
+    if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0) {
+        const std::string body = metrics_render_string();
+        char header[160];
+        snprintf(header, sizeof(header),
+                 "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n",
+                 body.size());
+        reply = std::string(header) + body;
+    }
+    else {
+        reply = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+    }
+    for (size_t sent = 0; sent < reply.size(); ) {
+        ssize_t k = send(fd, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+        if (k <= 0) {
+            return;
+        }
+        sent += (size_t)k;
+    }
+}
+
+static void metrics_listen(int server)
+{
+    for (;;) {
+        int fd = accept(server, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        metrics_reply(fd);
+        close(fd);
+    }
+}
+#endif
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Starts a thread serving the metrics over HTTP on 127.0.0.1:port, one
+ request per connection (Prometheus scrapes GET /metrics). Recording is
+ enabled. Returns 0, or -1 if the port cannot be bound.
+ *******************************************************************************/
+int metrics_batched_serve(int port)
+{
+#if defined(__linux__)
+    struct sockaddr_in addr;
+    int one = 1;
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (server < 0) {
+        printf("Error in: metrics endpoint socket\n");
+        return -1;
+    }
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons((unsigned short)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(server, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(server, 8) != 0) {
+        printf("Error in: cannot serve the metrics on 127.0.0.1:%d\n", port);
+        close(server);
+        return -1;
+    }
+    metrics_state.store(1);
+    std::thread(metrics_listen, server).detach();
+    return 0;
+#else
+    (void)port;
+    printf("Error in: metrics endpoint not supported on this platform\n");
+    return -1;
+#endif
+}
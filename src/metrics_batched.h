@@ -0,0 +1,52 @@
+#ifndef METRICS_BATCHED_H
+#define METRICS_BATCHED_H
+
+#include <stdio.h>
+
+/*
+    Metrics registry of the solvers in Prometheus text format, see
+    metrics_batched.cpp.
+
+    The solvers feed the built in metrics (metrics_batched_solved and
+    metrics_batched_in_flight); an application can register its own:
+
+        static int id = metrics_batched_register("app_requests_total", "Requests.",
+                                                  METRICS_COUNTER, NULL, NULL, 0);
+        metrics_batched_add(id, 1.0);
+*/
+
+#define METRICS_COUNTER    0
+#define METRICS_GAUGE      1
+#define METRICS_HISTOGRAM  2
+
+#define METRICS_BACKEND_CPU  0
+#define METRICS_BACKEND_GPU  1
+
+int  metrics_batched_enabled();
+void metrics_batched_enable(int enable);
+
+// Returns the id of the metric, -1 if the registry is full or the arguments
+// are invalid. labels is a Prometheus label list without braces, e.g.
+// backend="cpu", or NULL; bounds are the increasing upper bounds of the
+// buckets of a histogram. Registering the same name and labels twice
+// returns the same id.
+int metrics_batched_register(const char* name, const char* help, int type,
+                             const char* labels, const double* bounds, int nbounds);
+
+void metrics_batched_add(int id, double value);        // counter or gauge
+void metrics_batched_set(int id, double value);        // gauge
+void metrics_batched_observe(int id, double value);    // histogram
+
+// Built in metrics: one batch of batchCount N-by-N systems solved in
+// seconds, singular of them with a zero pivot; delta batches entering (+1)
+// or leaving (-1) a solver.
+void metrics_batched_solved(int backend, int n, int batchCount, int singular, double seconds);
+void metrics_batched_in_flight(int backend, int delta);
+
+int metrics_batched_render(FILE* f);
+// Writes path atomically (a temporary file renamed), for textfile collectors.
+int metrics_batched_write(const char* path);
+// Serves GET /metrics on 127.0.0.1:port from a background thread.
+int metrics_batched_serve(int port);
+
+#endif //METRICS_BATCHED_H
@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "operation_batched.h"
+#include "npy_batched.h"
+
+/*
+    .npy format (numpy.lib.format): the magic "\x93NUMPY", a major and a
+    minor version byte, the length of the header (uint16 for 1.0, uint32
+    for 2.0 and 3.0, little endian), then the header, a Python dict literal
+    such as
+        {'descr': '<f4', 'fortran_order': False, 'shape': (1000, 8, 8), }
+    padded with spaces and a newline so that the data is aligned, then the
+    data. The header written here pads the data to NPY_ALIGN bytes, as
+    NumPy does, so that the mapped array is aligned for vector loads.
+
+    The file is mapped with mmap, shared, so that the solver reads the
+    matrices straight from the page cache and writes the solutions into the
+    pages of the output file: no buffer holds a copy of the batch, and a
+    file larger than the free memory is paged in and out by the kernel as
+    the solve moves along (MADV_SEQUENTIAL tells it to read ahead). Only
+    little endian hosts are supported, as elsewhere in the library.
+*/
+
+#define NPY_MAGIC      "\x93NUMPY"
+#define NPY_MAGIC_LEN  6
+#define NPY_ALIGN      64
+
+static size_t npy_itemsize(int dtype)
+{
+    return dtype == NPY_FLOAT64 ? 8 : 4;
+}
+
+static const char* npy_descr(int dtype)
+{
+    return dtype == NPY_FLOAT64 ? "<f8" : "<f4";
+}
+
+// Value of key in the header dict, NULL if it is missing.
+static const char* npy_header_value(const char* header, const char* key)
+{
+    const char* p = strstr(header, key);
+    if (p == NULL) {
+        return NULL;
+    }
+    p += strlen(key);
+    p += strspn(p, " ");
+    if (*p != ':') {
+        return NULL;
+    }
+    p++;
+    return p + strspn(p, " ");
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Parses the header dict into a. Returns 0, -1 if a key is missing or
+ malformed.
+ *******************************************************************************/
+static int npy_parse_header(const char* header, npy_array* a)
+{
+    const char* descr = npy_header_value(header, "'descr'");
+    const char* order = npy_header_value(header, "'fortran_order'");
+    const char* shape = npy_header_value(header, "'shape'");
+    size_t len;
+
+    if (descr == NULL || order == NULL || shape == NULL || (*descr != '\'' && *descr != '"')) {
+        return -1;
+    }
+    len = strcspn(descr + 1, "'\"");
+    if (len == 0 || len >= sizeof(a->descr)) {
+        return -1;
+    }
+    memcpy(a->descr, descr + 1, len);
+    a->descr[len] = '\0';
+    // '=' is the native order, '<' on a little endian host
+    if (strcmp(a->descr, "<f4") == 0 || strcmp(a->descr, "=f4") == 0) {
+        a->dtype = NPY_FLOAT32;
+    }
+    else if (strcmp(a->descr, "<f8") == 0 || strcmp(a->descr, "=f8") == 0) {
+        a->dtype = NPY_FLOAT64;
+    }
+    else {
+        a->dtype = NPY_OTHER;
+    }
+
+    if (strncmp(order, "True", 4) == 0) {
+        a->fortran = 1;
+    }
+    else if (strncmp(order, "False", 5) == 0) {
+        a->fortran = 0;
+    }
+    else {
+        return -1;
+    }
+
+    if (*shape != '(') {
+        return -1;
+    }
+    shape++;
+    a->ndim = 0;
+    for (;;) {
+        char* end;
+        shape += strspn(shape, " ");
+        if (*shape == ')') {
+            break;
+        }
+        const long long d = strtoll(shape, &end, 10);
+        if (end == shape || d < 0 || a->ndim == NPY_MAX_DIMS) {
+            return -1;
+        }
+        a->shape[a->ndim++] = d;
+        shape = end + strspn(end, " ");
+        if (*shape == ',') {
+            shape++;
+        }
+        else if (*shape != ')') {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static size_t npy_elements(const npy_array* a)
+{
+    size_t count = 1;
+    for (int d = 0; d < a->ndim; d++) {
+        count *= (size_t)a->shape[d];
+    }
+    return count;
+}
+
+int npy_batched_open(const char* path, int writable, npy_array* a)
+{
+    struct stat st;
+    const unsigned char* p;
+    size_t headerLen, offset;
+    char* header = NULL;
+    int resCode = -1;
+
+    memset(a, 0, sizeof(*a));
+    a->fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (a->fd < 0) {
+        printf("Error in: npy_batched_open, cannot open %s\n", path);
+        return -1;
+    }
+    if (fstat(a->fd, &st) != 0 || st.st_size < NPY_MAGIC_LEN + 4) {
+        printf("Error in: npy_batched_open, %s is not a .npy file\n", path);
+        goto cleanup;
+    }
+    a->mapBytes = (size_t)st.st_size;
+    a->map = mmap(NULL, a->mapBytes, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, a->fd, 0);
+    if (a->map == MAP_FAILED) {
+        a->map = NULL;
+        printf("Error in: npy_batched_open, cannot map %s\n", path);
+        goto cleanup;
+    }
+
+    p = (const unsigned char*)a->map;
+    if (memcmp(p, NPY_MAGIC, NPY_MAGIC_LEN) != 0 || p[6] < 1 || p[6] > 3) {
+        printf("Error in: npy_batched_open, %s is not a .npy file (or of an unknown version)\n", path);
+        goto cleanup;
+    }
+    if (p[6] == 1) {
+        headerLen = p[8] | (size_t)p[9] << 8;
+        offset = 10;
+    }
+    else {
+        headerLen = p[8] | (size_t)p[9] << 8 | (size_t)p[10] << 16 | (size_t)p[11] << 24;
+        offset = 12;
+    }
+    if (offset + headerLen > a->mapBytes) {
+        printf("Error in: npy_batched_open, %s has a truncated header\n", path);
+        goto cleanup;
+    }
+    header = (char*)malloc(headerLen + 1);
+    if (header == NULL) {
+        printf("Error in: npy_batched_open, header malloc\n");
+        goto cleanup;
+    }
+    memcpy(header, p + offset, headerLen);
+    header[headerLen] = '\0';
+    if (npy_parse_header(header, a) != 0) {
+        printf("Error in: npy_batched_open, %s has an invalid header: %s\n", path, header);
+        goto cleanup;
+    }
+
+    offset += headerLen;
+    a->data  = (char*)a->map + offset;
+    a->bytes = a->dtype == NPY_OTHER ? a->mapBytes - offset : npy_elements(a) * npy_itemsize(a->dtype);
+    if (offset + a->bytes > a->mapBytes) {
+        printf("Error in: npy_batched_open, %s is truncated\n", path);
+        goto cleanup;
+    }
+    madvise(a->map, a->mapBytes, MADV_SEQUENTIAL);
+    resCode = 0;
+
+cleanup:
+    free(header);
+    if (resCode != 0) {
+        npy_batched_close(a);
+    }
+    return resCode;
+}
+
+int npy_batched_create(const char* path, int dtype, int fortran, int ndim, const long long* shape,
+                       npy_array* a)
+{
+    char header[512];
+    unsigned char prefix[10];
+    const size_t prefixLen = sizeof(prefix);
+    size_t len, offset;
+    int resCode = -1;
+
+    memset(a, 0, sizeof(*a));
+    a->fd = -1;
+    if ((dtype != NPY_FLOAT32 && dtype != NPY_FLOAT64) || ndim < 0 || ndim > NPY_MAX_DIMS) {
+        printf("Error in: npy_batched_create, invalid type or shape\n");
+        return -1;
+    }
+    a->dtype = dtype;
+    a->fortran = fortran;
+    a->ndim = ndim;
+    snprintf(a->descr, sizeof(a->descr), "%s", npy_descr(dtype));
+    len = snprintf(header, sizeof(header), "{'descr': '%s', 'fortran_order': %s, 'shape': (",
+                   a->descr, fortran ? "True" : "False");
+    for (int d = 0; d < ndim; d++) {
+        a->shape[d] = shape[d];
+        len += snprintf(header + len, sizeof(header) - len, d == 0 ? "%lld" : ", %lld", shape[d]);
+    }
+    len += snprintf(header + len, sizeof(header) - len, ndim == 1 ? ",), }" : "), }");
+
+    // version 1.0: the header, at most NPY_MAX_DIMS dimensions, fits its 16 bit length
+    offset = (prefixLen + len + 1 + NPY_ALIGN - 1) / NPY_ALIGN * NPY_ALIGN;
+    memset(header + len, ' ', offset - prefixLen - len - 1);
+    header[offset - prefixLen - 1] = '\n';
+    len = offset - prefixLen;
+
+    memcpy(prefix, NPY_MAGIC, NPY_MAGIC_LEN);
+    prefix[6] = 1;
+    prefix[7] = 0;
+    prefix[8] = (unsigned char)len;
+    prefix[9] = (unsigned char)(len >> 8);
+
+    a->bytes = npy_elements(a) * npy_itemsize(dtype);
+    a->mapBytes = offset + a->bytes;
+    a->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (a->fd < 0) {
+        printf("Error in: npy_batched_create, cannot create %s\n", path);
+        return -1;
+    }
+    if (pwrite(a->fd, prefix, prefixLen, 0) != (ssize_t)prefixLen
+        || pwrite(a->fd, header, len, prefixLen) != (ssize_t)len
+        || ftruncate(a->fd, (off_t)a->mapBytes) != 0) {
+        printf("Error in: npy_batched_create, cannot write %s\n", path);
+        goto cleanup;
+    }
+    a->map = mmap(NULL, a->mapBytes, PROT_READ | PROT_WRITE, MAP_SHARED, a->fd, 0);
+    if (a->map == MAP_FAILED) {
+        a->map = NULL;
+        printf("Error in: npy_batched_create, cannot map %s\n", path);
+        goto cleanup;
+    }
+    a->data = (char*)a->map + offset;
+    resCode = 0;
+
+cleanup:
+    if (resCode != 0) {
+        npy_batched_close(a);
+    }
+    return resCode;
+}
+
+void npy_batched_close(npy_array* a)
+{
+    if (a->map != NULL) {
+        munmap(a->map, a->mapBytes);
+    }
+    if (a->fd >= 0) {
+        close(a->fd);
+    }
+    memset(a, 0, sizeof(*a));
+    a->fd = -1;
+}
+
+int npy_batched_same_file(const char* path1, const char* path2)
+{
+    struct stat s1, s2;
+    if (stat(path1, &s1) != 0 || stat(path2, &s2) != 0) {
+        return 0;
+    }
+    return s1.st_dev == s2.st_dev && s1.st_ino == s2.st_ino;
+}
+
+int npy_batched_temp_file(const char* path, char* tmp, size_t len)
+{
+    int fd;
+    if ((size_t)snprintf(tmp, len, "%s.XXXXXX", path) >= len) {
+        printf("Error in: npy_batched_temp_file, path too long: %s\n", path);
+        tmp[0] = '\0';
+        return -1;
+    }
+    fd = mkstemp(tmp);
+    if (fd < 0) {
+        printf("Error in: npy_batched_temp_file, cannot create a file next to %s\n", path);
+        tmp[0] = '\0';
+        return -1;
+    }
+    // mkstemp creates it 0600, the outputs are 0644 as with npy_batched_create
+    fchmod(fd, 0644);
+    close(fd);
+    return 0;
+}
+
+int npy_batched_shape(const npy_array* A, const npy_array* B, int* n, long long* batch, int* rowMajor)
+{
+    long long an = 0, ab = 0, bn = -1, bb = -1;
+
+    *rowMajor = 0;
+    if (A->dtype != NPY_FLOAT32 || B->dtype != NPY_FLOAT32) {
+        printf("Error in: npy_batched_shape, the arrays must be float32 ('<f4'), not '%s' and '%s'\n",
+               A->descr, B->descr);
+        return -1;
+    }
+    if (A->ndim == 3 && !A->fortran && A->shape[1] == A->shape[2]) {
+        ab = A->shape[0];
+        an = A->shape[1];
+        *rowMajor = 1;
+    }
+    else if (A->ndim == 3 && A->fortran && A->shape[0] == A->shape[1]) {
+        ab = A->shape[2];
+        an = A->shape[0];
+    }
+    else if (A->ndim == 2 && A->shape[0] == A->shape[1]) {
+        ab = 1;
+        an = A->shape[0];
+        *rowMajor = !A->fortran;
+    }
+    else {
+        printf("Error in: npy_batched_shape, A must be (batch, N, N) in C order or (N, N, batch) in Fortran order\n");
+        return -1;
+    }
+    if (B->ndim == 2) {
+        bb = B->fortran ? B->shape[1] : B->shape[0];
+        bn = B->fortran ? B->shape[0] : B->shape[1];
+    }
+    else if (B->ndim == 1) {
+        bb = 1;
+        bn = B->shape[0];
+    }
+    if (bn != an || bb != ab) {
+        printf("Error in: npy_batched_shape, B must be (%lld, %lld) in C order or (%lld, %lld) in Fortran order\n",
+               ab, an, an, ab);
+        return -1;
+    }
+    if (an < 1 || an > 32 || ab > 0x7fffffff) {
+        printf("Error in: npy_batched_shape, N = %lld and batch = %lld, N must be in [1, 32]\n", an, ab);
+        return -1;
+    }
+    *n = (int)an;
+    *batch = ab;
+    return 0;
+}
+
+int npy_batched_solve(const char* pathA, const char* pathB, const char* pathX, long long* singular)
+{
+    npy_array A, B, X;
+    const int inPlace = pathX == NULL || npy_batched_same_file(pathX, pathB);
+    char tmpX[1024] = "";
+    long long batch = 0;
+    int n = 0, rowMajor = 0;
+    int* info = NULL;
+    float* h_X;
+    int resCode = -1;
+
+    memset(&A, 0, sizeof(A));
+    memset(&B, 0, sizeof(B));
+    memset(&X, 0, sizeof(X));
+    A.fd = B.fd = X.fd = -1;
+    if (singular != NULL) {
+        *singular = 0;
+    }
+
+    // an output over an input would truncate it, or write A while it is read
+    if ((pathX != NULL && npy_batched_same_file(pathX, pathA)) || (inPlace && npy_batched_same_file(pathB, pathA))) {
+        printf("Error in: npy_batched_solve, the output %s is the matrix file %s\n", inPlace ? pathB : pathX, pathA);
+        goto cleanup;
+    }
+    if (npy_batched_open(pathA, 0, &A) != 0 || npy_batched_open(pathB, inPlace, &B) != 0) {
+        goto cleanup;
+    }
+    if (npy_batched_shape(&A, &B, &n, &batch, &rowMajor) != 0) {
+        goto cleanup;
+    }
+
+    if (inPlace) {
+        h_X = (float*)B.data;
+    }
+    else {
+        if (npy_batched_temp_file(pathX, tmpX, sizeof(tmpX)) != 0
+            || npy_batched_create(tmpX, NPY_FLOAT32, B.fortran, B.ndim, B.shape, &X) != 0) {
+            goto cleanup;
+        }
+        h_X = (float*)X.data;
+    }
+    info = (int*)malloc((size_t)(batch > 0 ? batch : 1) * sizeof(int));
+    if (info == NULL) {
+        printf("Error in: npy_batched_solve, info malloc\n");
+        goto cleanup;
+    }
+
+    // X may be B: every path reads the B of a system before writing its X
+    resCode = rowMajor
+            ? cpuLinearSolverBatchedRowMajor(n, (float*)A.data, (float*)B.data, &h_X, info, (int)batch)
+            : cpuLinearSolverBatched(n, (float*)A.data, (float*)B.data, &h_X, info, (int)batch);
+    // on an argument error info was never written
+    if (singular != NULL && resCode >= 0) {
+        for (long long s = 0; s < batch; s++) {
+            *singular += info[s] > 0;
+        }
+    }
+
+cleanup:
+    free(info);
+    npy_batched_close(&X);
+    npy_batched_close(&B);
+    npy_batched_close(&A);
+    if (tmpX[0] != '\0') {
+        if (resCode >= 0 && rename(tmpX, pathX) != 0) {
+            printf("Error in: npy_batched_solve, cannot rename %s to %s\n", tmpX, pathX);
+            resCode = -1;
+        }
+        if (resCode < 0) {
+            unlink(tmpX);
+        }
+    }
+    return resCode;
+}
@@ -0,0 +1,79 @@
+#ifndef NPY_BATCHED_H
+#define NPY_BATCHED_H
+
+#include <stddef.h>
+
+/*
+    NumPy .npy files mapped in memory, so that batches produced in Python
+    are solved where they lie, without conversion scripts or copies, see
+    npy_batched.cpp. Format 1.0, 2.0 and 3.0 headers are read, 1.0 written;
+    the data is in native (little endian) byte order.
+*/
+
+#define NPY_MAX_DIMS  8
+
+// Element types
+#define NPY_FLOAT32   0   // '<f4'
+#define NPY_FLOAT64   1   // '<f8'
+#define NPY_OTHER    -1   // anything else, descr tells which
+
+struct npy_array
+{
+    char* data;                     // first element, in the mapping
+    size_t bytes;                   // of data
+    int dtype;                      // NPY_*
+    char descr[16];                 // as in the header, e.g. "<f4"
+    int fortran;                    // fortran_order: the first index runs fastest
+    int ndim;
+    long long shape[NPY_MAX_DIMS];
+    void* map;                      // whole file
+    size_t mapBytes;
+    int fd;
+};
+
+// Maps path, read only or writable (shared: stores go to the file). 0, or
+// -1 with a message if the file cannot be mapped or is not a .npy file.
+int npy_batched_open(const char* path, int writable, npy_array* a);
+
+// Creates path with the given header, sized for the data, and maps it writable.
+int npy_batched_create(const char* path, int dtype, int fortran, int ndim, const long long* shape,
+                       npy_array* a);
+
+// Unmaps, the changes of a writable mapping are written back by the kernel.
+void npy_batched_close(npy_array* a);
+
+// 1 if path1 and path2 are the same file (device and inode, whatever the
+// links to it), 0 if not or if one of them does not exist.
+int npy_batched_same_file(const char* path1, const char* path2);
+
+// Creates an empty file of a unique name next to path, "<path>.XXXXXX", into
+// tmp (len bytes), for an output written there and then renamed over path,
+// so that a failed solve leaves no truncated file. 0, or -1 with a message.
+int npy_batched_temp_file(const char* path, char* tmp, size_t len);
+
+// Order n and batch count of the systems A and B, and whether A is
+// row-major, for the shapes npy_batched_solve accepts. 0, or -1 with a message.
+int npy_batched_shape(const npy_array* A, const npy_array* B, int* n, long long* batch, int* rowMajor);
+
+/***************************************************************************//**
+    Solves the batch of pathA and pathB with the CPU solver and writes X to
+    pathX, or over B in pathB when pathX is NULL or pathB.
+
+    A is float32 of shape (batch, N, N) in C order (row-major systems,
+    solved through cpuLinearSolverBatchedRowMajor) or (N, N, batch) in
+    Fortran order (the column-major packed layout of cpuLinearSolverBatched),
+    or (N, N) for a single system. B is float32 (batch, N) in C order or
+    (N, batch) in Fortran order, which are both the packed layout, or (N,).
+    X has the shape and order of B. Other shapes, orders or types would need
+    a copy and are rejected. pathX is compared with the inputs as files, not
+    names: X being B (through any link) is the in-place solve, X being A is
+    rejected. A new X is written to a temporary file renamed to pathX once
+    solved, so that pathX is left as it was when the solve fails.
+
+    Returns the return code of the solver (0, or the first nonzero info), -1
+    if the files cannot be used. *singular, if not NULL, is the number of
+    singular systems.
+ *******************************************************************************/
+int npy_batched_solve(const char* pathA, const char* pathB, const char* pathX, long long* singular);
+
+#endif //NPY_BATCHED_H
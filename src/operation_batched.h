@@ -8,6 +8,90 @@ int gpuLinearSolverBatched(int n, float *h_A, float *h_B,
                            float **h_X,
                            int *h_info, int batchCount);
 
+//linearSolverCPU_batched.cpp
+int cpuLinearSolverBatched(int n, float *h_A, float *h_B,
+                           float **h_X,
+                           int *h_info, int batchCount);
+
+//linearSolverCPU_batched.cpp, kernel variants of the CPU engine
+#define CPU_VARIANT_SCALAR    0
+#define CPU_VARIANT_GATHER4   1
+#define CPU_VARIANT_GATHER8   2
+#define CPU_VARIANT_GATHER16  3
+
+int cpuLinearSolverBatchedVariant(int n, int variant, int chunk,
+                           float *h_A, float *h_B,
+                           float **h_X,
+                           int *h_info, int batchCount);
+
+//linearSolverCPU_batched.cpp, cpuLinearSolverBatchedVariant for the tuners:
+//no argument checks, no capture, trace, metrics or latency
+int cpu_solve_batched(int n, int variant, int chunk,
+                           float *h_A, float *h_B, float *h_X,
+                           int *h_info, int batchCount);
+
+//linearSolverCPU_batched.cpp, A(i,j) of system s at h_A[s*n*n + i*n + j]
+int cpuLinearSolverBatchedRowMajor(int n, float *h_A, float *h_B,
+                           float **h_X,
+                           int *h_info, int batchCount);
+
+//linearSolverCPUtune_batched.cpp
+int cpuLinearSolverBatchedGetTuning(int n, int *variant, int *chunk);
+int cpuLinearSolverBatchedTune(int n);
+
+//linearSolverCPUtune_batched.cpp, measurement setup shared with tools/tuneTables.cpp
+#define CPU_TUNE_LLC_MULTIPLE  2                   // batch timed per candidate, in last level caches
+#define CPU_TUNE_MIN_BYTES     ((size_t)8 << 20)    // batch bytes, bounds
+#define CPU_TUNE_MAX_BYTES     ((size_t)64 << 20)
+#define CPU_TUNE_REPS          5                    // timed runs per candidate, the fastest is kept
+#define CPU_TUNE_BUDGET        1.0                  // seconds per size of a tuning on first use
+#define CPU_TUNE_NCHUNKS       5
+
+extern const int cpu_tune_chunks[CPU_TUNE_NCHUNKS];    // candidate chunk sizes, 0 splits evenly
+int cpu_tune_batch_count(int n);
+void cpu_tune_fill(float *h_A, float *h_B, int n, int batchCount);
+void cpu_tune_model(char *model, size_t len);
+
+//linearSolverCPUperf_batched.cpp, hardware counters of the CPU engine
+#define CPU_PERF_FACTOR       0   // sgetrf
+#define CPU_PERF_PERMUTE      1   // row interchanges of B
+#define CPU_PERF_FORWARD      2   // L * y = P * B
+#define CPU_PERF_BACKWARD     3   // U * X = y
+#define CPU_PERF_NPHASES      4
+
+#define CPU_PERF_CYCLES        0
+#define CPU_PERF_INSTRUCTIONS  1
+#define CPU_PERF_CACHE_REFS    2   // last level cache
+#define CPU_PERF_CACHE_MISSES  3   // last level cache
+#define CPU_PERF_L1D_MISSES    4   // L1 data cache load misses
+#define CPU_PERF_DTLB_MISSES   5   // data TLB load misses
+#define CPU_PERF_VECTOR        6   // raw event of SLSB_CPU_PERF_VECTOR_EVENT
+#define CPU_PERF_NCOUNTERS     7
+
+struct cpu_perf_counters
+{
+    double value[CPU_PERF_NPHASES][CPU_PERF_NCOUNTERS];  // summed over the threads
+    double seconds[CPU_PERF_NPHASES];                    // thread time, summed over the threads
+    long long systems;      // systems solved while counting
+    unsigned available;     // bit c is set if counter c could be opened
+};
+
+int  cpuLinearSolverBatchedPerfEnable(int enable);
+void cpuLinearSolverBatchedPerfReset();
+int  cpuLinearSolverBatchedPerfGet(cpu_perf_counters* counters);
+const char* cpuLinearSolverBatchedPerfPhaseName(int phase);
+const char* cpuLinearSolverBatchedPerfCounterName(int counter);
+
+//linearSolverCPU_batched.cpp, instantiated for W = 4, 8, 16
+template<int W>
+int cpuLinearSolverBatchedInterleaved(int n, float *h_A, float *h_B,
+                           float **h_X,
+                           int *h_info, int batchCount);
+
+//tinySLUfactorization_batched.cu
+magma_int_t magma_get_sgetrf_batched_ntcol(magma_int_t m, magma_int_t n);
+void magma_set_sgetrf_batched_ntcol(magma_int_t ntcol);
+
 #if __cplusplus
 extern "C" {
 #endif
@@ -0,0 +1,146 @@
+#include <stdint.h>
+#include <math.h>
+#include "random_batched.h"
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+/*
+    Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2,
+    3", SC11), the generator of curand's CURAND_RNG_PSEUDO_PHILOX4_32_10:
+    block b of the stream of a seed is ten rounds of multiplications and
+    xors of the counter (b, 0) under the key seed, four 32 bit values.
+
+    Value i of the stream is lane i % 4 of block i / 4; normal values are
+    Box-Muller transforms of the lane pairs (0, 1) and (2, 3), on 24 bit
+    uniforms in (0, 1), so the tails stop near 5.8 standard deviations.
+
+    Blocks are independent: the threads share them statically, and within
+    a thread the block loop has no dependency, for the compiler to
+    vectorize (the 32x32 -> 64 multiplications map to vector multiplies;
+    the transcendental functions need a vector math library, e.g. glibc's
+    libmvec with -ffast-math).
+*/
+
+#define RANDOM_M0  0xD2511F53u
+#define RANDOM_M1  0xCD9E8D57u
+#define RANDOM_W0  0x9E3779B9u
+#define RANDOM_W1  0xBB67AE85u
+
+// Below this many values a call stays on the calling thread.
+#define RANDOM_PARALLEL_MIN  65536
+
+static inline void random_philox(uint64_t block, uint64_t seed, uint32_t* r0, uint32_t* r1, uint32_t* r2, uint32_t* r3)
+{
+    uint32_t c0 = (uint32_t)block, c1 = (uint32_t)(block >> 32), c2 = 0, c3 = 0;
+    uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+
+    for (int round = 0; round < 10; round++) {
+        const uint64_t p0 = (uint64_t)RANDOM_M0 * c0;
+        const uint64_t p1 = (uint64_t)RANDOM_M1 * c2;
+        const uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        const uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += RANDOM_W0;
+        k1 += RANDOM_W1;
+    }
+    *r0 = c0;
+    *r1 = c1;
+    *r2 = c2;
+    *r3 = c3;
+}
+
+// Uniform in (0, 1) from the 24 high bits, never 0 for the logarithm.
+static inline float random_open01(uint32_t x)
+{
+    return ((float)(x >> 8) + 0.5f) * (1.0f / 16777216.0f);
+}
+
+// Uniform in [0, 1).
+static inline float random_01(uint32_t x)
+{
+    return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+static inline void random_block_normal(uint64_t block, uint64_t seed, float* v)
+{
+    uint32_t r0, r1, r2, r3;
+    random_philox(block, seed, &r0, &r1, &r2, &r3);
+    const float a = sqrtf(-2.0f * logf(random_open01(r0)));
+    const float b = sqrtf(-2.0f * logf(random_open01(r2)));
+    const float ta = 6.283185307f * random_01(r1);
+    const float tb = 6.283185307f * random_01(r3);
+    v[0] = a * cosf(ta);
+    v[1] = a * sinf(ta);
+    v[2] = b * cosf(tb);
+    v[3] = b * sinf(tb);
+}
+
+static inline void random_block_uniform(uint64_t block, uint64_t seed, float* v)
+{
+    uint32_t r0, r1, r2, r3;
+    random_philox(block, seed, &r0, &r1, &r2, &r3);
+    v[0] = random_01(r0);
+    v[1] = random_01(r1);
+    v[2] = random_01(r2);
+    v[3] = random_01(r3);
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Fills x with the values offset to offset + count - 1 of the stream of
+ seed, generated by block with block_fn. The partial blocks at both ends
+ go through a copy, the full ones are written in place.
+ *******************************************************************************/
+template<void (*block_fn)(uint64_t, uint64_t, float*)>
+static void random_fill(float* x, size_t count, unsigned long long seed, unsigned long long offset)
+{
+    const uint64_t first = offset / 4;                  // block of x[0]
+    const uint64_t last  = (offset + count + 3) / 4;    // one past the block of x[count - 1]
+    const long long full_first = (long long)((offset + 3) / 4);
+    const long long full_last  = (long long)((offset + count) / 4);
+    float v[4];
+
+    if (count == 0) {
+        return;
+    }
+    // partial blocks at the ends
+    for (uint64_t b = first; b < last; b = (b + 1 < last - 1) ? last - 1 : b + 1) {
+        if ((long long)b >= full_first && (long long)b < full_last) {
+            continue;
+        }
+        block_fn(b, seed, v);
+        for (int l = 0; l < 4; l++) {
+            const uint64_t i = 4 * b + l;
+            if (i >= offset && i < offset + count) {
+                x[i - offset] = v[l];
+            }
+        }
+    }
+
+    if (full_first >= full_last) {
+        return;
+    }
+    float* base = x + (4 * (uint64_t)full_first - offset);
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static) if(count >= RANDOM_PARALLEL_MIN)
+#endif
+    for (long long b = full_first; b < full_last; b++) {
+        block_fn((uint64_t)b, seed, base + 4 * (b - full_first));
+    }
+}
+
+void random_batched_normal(float* x, size_t count, unsigned long long seed, unsigned long long offset)
+{
+    random_fill<random_block_normal>(x, count, seed, offset);
+}
+
+void random_batched_uniform(float* x, size_t count, unsigned long long seed, unsigned long long offset)
+{
+    random_fill<random_block_uniform>(x, count, seed, offset);
+}
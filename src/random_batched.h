@@ -0,0 +1,20 @@
+#ifndef RANDOM_BATCHED_H
+#define RANDOM_BATCHED_H
+
+#include <stddef.h>
+
+/*
+    Counter based random numbers for the test batches (Philox4x32-10), see
+    random_batched.cpp. No CUDA dependency.
+
+    Value i of the stream of a seed only depends on (seed, i): a batch is
+    the same whatever the number of threads filling it, and any part of it
+    can be generated alone, e.g. system s of order n is the values
+    s * (n*n + n) to (s + 1) * (n*n + n) - 1 of its stream.
+*/
+
+// x[k] = value offset + k of the stream of seed, for k < count.
+void random_batched_normal(float* x, size_t count, unsigned long long seed, unsigned long long offset);
+void random_batched_uniform(float* x, size_t count, unsigned long long seed, unsigned long long offset);  // [0, 1)
+
+#endif //RANDOM_BATCHED_H
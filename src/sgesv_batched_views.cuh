@@ -0,0 +1,95 @@
+#ifndef SGESV_BATCHED_VIEWS_CUH
+#define SGESV_BATCHED_VIEWS_CUH
+
+#include "sgesv_batched_views.h"
+#include "linearSolverFusedSLU_batched.cuh"
+
+/*
+    Device side of sgesv_batched_views.h, to be included from a .cu file.
+
+    Batches already on the GPU are solved by the fused kernels of
+    linearSolverFusedSLU_batched.cuh: the generator reads A and B through the
+    layout of the views, so padded and interleaved batches are solved in place,
+    without repacking. Packed and padded solutions are written by the kernel
+    directly (lddx = ld); interleaved ones through a consumer.
+*/
+
+namespace slsb {
+
+// Generator reading A and B of device views of the given layout.
+template<typename Layout>
+struct view_generator
+{
+    const float* dA;
+    const float* dB;
+    int n;
+    int ldda;
+    int lddb;
+
+    __device__ float a(int batchid, int i, int j) const
+    {
+        return dA[ layout_traits<Layout>::a(n, ldda, batchid, i, j) ];
+    }
+
+    __device__ float b(int batchid, int i) const
+    {
+        return dB[ layout_traits<Layout>::b(n, lddb, batchid, i) ];
+    }
+};
+
+// Consumer storing x in an interleaved X and the getrf result in dinfo.
+template<int W>
+struct interleaved_store
+{
+    float* dX;
+    magma_int_t* dinfo;
+    int n;
+
+    __device__ void operator()(int batchid, const float* x, int info) const
+    {
+        for (int i = 0; i < n; i++) {
+            dX[ layout_traits< layout_interleaved<W> >::b(n, 0, batchid, i) ] = x[i];
+        }
+        dinfo[batchid] = (magma_int_t)info;
+    }
+};
+
+template<typename Layout>
+inline view_generator<Layout>
+make_view_generator(const matrix_batch<device_memory, Layout>& A,
+                    const vector_batch<device_memory, Layout>& B)
+{
+    view_generator<Layout> gen = { A.data, B.data, A.n, A.ld, B.ld };
+    return gen;
+}
+
+template<typename Layout>
+struct sgesv_dispatch<exec_gpu, device_memory, Layout>
+{
+    static int run(exec_gpu exec, const matrix_batch<device_memory, Layout>& A,
+                   const vector_batch<device_memory, Layout>& B,
+                   const vector_batch<device_memory, Layout>& X, magma_int_t* dinfo)
+    {
+        return (int)magma_sgesv_batched_smallsq_generated(
+                    A.n, make_view_generator(A, B), X.data, X.ld,
+                    dinfo, A.batchCount, exec.stream);
+    }
+};
+
+template<int W>
+struct sgesv_dispatch<exec_gpu, device_memory, layout_interleaved<W> >
+{
+    static int run(exec_gpu exec, const matrix_batch<device_memory, layout_interleaved<W> >& A,
+                   const vector_batch<device_memory, layout_interleaved<W> >& B,
+                   const vector_batch<device_memory, layout_interleaved<W> >& X, magma_int_t* dinfo)
+    {
+        interleaved_store<W> cons = { X.data, dinfo, X.n };
+        return (int)magma_sgesv_batched_smallsq_consumed(
+                    A.n, make_view_generator(A, B), cons,
+                    A.batchCount, exec.stream);
+    }
+};
+
+} // namespace slsb
+
+#endif //SGESV_BATCHED_VIEWS_CUH
@@ -0,0 +1,289 @@
+#ifndef SGESV_BATCHED_VIEWS_H
+#define SGESV_BATCHED_VIEWS_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <cuda_runtime.h>
+#include "magma_types.h"
+#include "operation_batched.h"
+
+/*
+    Typed front end of the batched solvers.
+
+    Instead of a raw float* with separate n, ld and batchCount, the batch is
+    described by a view whose type carries where the data lives and how it is
+    laid out:
+
+        slsb::matrix_batch<Space, Layout>   the A matrices
+        slsb::vector_batch<Space, Layout>   the B and X vectors
+
+    Space is slsb::host_memory or slsb::device_memory, Layout one of
+
+        layout_packed          column-major, ld = n, systems back to back
+                               (the layout of gpuLinearSolverBatched)
+        layout_padded          column-major with a leading dimension ld >= n,
+                               system s at data + s*ld*n (A) or data + s*ld (B, X)
+        layout_interleaved<W>  groups of W systems, element-wise interleaved,
+                               see cpuLinearSolverBatchedInterleaved
+
+    The sizes are checked once, when the view is made (make_matrix_batch,
+    make_vector_batch, which mark a view with invalid sizes as such), and
+    slsb::sgesv picks the kernel from the view types only, so it is a plain
+    inline call to the C entry point:
+
+        exec_cpu, host,   packed          cpuLinearSolverBatched
+        exec_cpu, host,   interleaved<W>  cpuLinearSolverBatchedInterleaved<W>
+        exec_gpu, host,   packed          gpuLinearSolverBatched
+        exec_gpu, device, any layout      fused kernel of linearSolverFusedSLU_batched.cuh,
+                                          needs sgesv_batched_views.cuh (nvcc)
+
+    Any other combination, or A, B and X not sharing the same space and
+    layout, does not compile. For the device path info must be a
+    magma_int_t array on the GPU, for the host paths an int array on the host.
+*/
+
+#if defined(__CUDACC__)
+#define SLSB_HOSTDEVICE  __host__ __device__
+#else
+#define SLSB_HOSTDEVICE
+#endif
+
+namespace slsb {
+
+struct host_memory   {};
+struct device_memory {};
+
+struct layout_packed {};
+struct layout_padded {};
+template<int W>
+struct layout_interleaved
+{
+    static const int width = W;
+};
+
+struct exec_cpu {};
+struct exec_gpu
+{
+    cudaStream_t stream;
+};
+
+template<typename T>
+struct dependent_false
+{
+    static const bool value = false;
+};
+
+// Offsets of A(i,j) and B(i) of system s, n the order and ld the leading
+// dimension, which only layout_padded takes from the caller.
+template<typename Layout>
+struct layout_traits;
+
+template<>
+struct layout_traits<layout_packed>
+{
+    static const bool has_ld = false;
+    SLSB_HOSTDEVICE static size_t a(int n, int,  int s, int i, int j) { return ((size_t)s * n + j) * n + i; }
+    SLSB_HOSTDEVICE static size_t b(int n, int,  int s, int i)        { return (size_t)s * n + i; }
+};
+
+template<>
+struct layout_traits<layout_padded>
+{
+    static const bool has_ld = true;
+    SLSB_HOSTDEVICE static size_t a(int n, int ld, int s, int i, int j) { return ((size_t)s * n + j) * ld + i; }
+    SLSB_HOSTDEVICE static size_t b(int,   int ld, int s, int i)        { return (size_t)s * ld + i; }
+};
+
+template<int W>
+struct layout_traits< layout_interleaved<W> >
+{
+    static const bool has_ld = false;
+    SLSB_HOSTDEVICE static size_t a(int n, int, int s, int i, int j)
+    {
+        return (((size_t)(s / W) * n * n) + i + (size_t)j * n) * W + s % W;
+    }
+    SLSB_HOSTDEVICE static size_t b(int n, int, int s, int i)
+    {
+        return ((size_t)(s / W) * n + i) * W + s % W;
+    }
+};
+
+template<typename Space, typename Layout>
+struct matrix_batch
+{
+    typedef Space  space_type;
+    typedef Layout layout_type;
+
+    float* data;
+    int n;
+    int ld;
+    int batchCount;
+    int valid;      // 0 if make_matrix_batch rejected the sizes
+
+    /// Index of A(i,j) of system s in data.
+    size_t index(int s, int i, int j) const
+    {
+        return layout_traits<Layout>::a(n, ld, s, i, j);
+    }
+};
+
+template<typename Space, typename Layout>
+struct vector_batch
+{
+    typedef Space  space_type;
+    typedef Layout layout_type;
+
+    float* data;
+    int n;
+    int ld;
+    int batchCount;
+    int valid;      // 0 if make_vector_batch rejected the sizes
+
+    /// Index of B(i) of system s in data.
+    size_t index(int s, int i) const
+    {
+        return layout_traits<Layout>::b(n, ld, s, i);
+    }
+};
+
+/// Makes a view of batchCount n-by-n matrices. ld is only used by layout_padded
+/// (it is n otherwise). Reports invalid sizes and returns an empty view with
+/// valid = 0, which slsb::sgesv rejects.
+template<typename Space, typename Layout>
+inline matrix_batch<Space, Layout>
+make_matrix_batch(float* data, int n, int batchCount, int ld = 0)
+{
+    matrix_batch<Space, Layout> v = { data, n, n, batchCount, 1 };
+    if (layout_traits<Layout>::has_ld) {
+        v.ld = ld;
+    }
+    if (n < 0 || n > 32 || v.ld < n || batchCount < 0) {
+        printf("error: invalid batch view, n = %d, ld = %d, batchCount = %d\n",
+               n, v.ld, batchCount);
+        v.n = v.ld = v.batchCount = v.valid = 0;
+    }
+    return v;
+}
+
+/// Same as make_matrix_batch, for right hand sides and solutions.
+template<typename Space, typename Layout>
+inline vector_batch<Space, Layout>
+make_vector_batch(float* data, int n, int batchCount, int ld = 0)
+{
+    vector_batch<Space, Layout> v = { data, n, n, batchCount, 1 };
+    if (layout_traits<Layout>::has_ld) {
+        v.ld = ld;
+    }
+    if (n < 0 || n > 32 || v.ld < n || batchCount < 0) {
+        printf("error: invalid batch view, n = %d, ld = %d, batchCount = %d\n",
+               n, v.ld, batchCount);
+        v.n = v.ld = v.batchCount = v.valid = 0;
+    }
+    return v;
+}
+
+/// Checks the views of a solve: 0, or as the magma routines the negative
+/// position of the first invalid argument of slsb::sgesv (-2 for A, -3 for
+/// B, -4 for X), for a view made with invalid sizes or of another size than A.
+template<typename Space, typename Layout>
+inline int
+sgesv_check(const matrix_batch<Space, Layout>& A, const vector_batch<Space, Layout>& B,
+            const vector_batch<Space, Layout>& X)
+{
+    if (!A.valid) {
+        return -2;
+    }
+    if (!B.valid || B.n != A.n || B.batchCount != A.batchCount) {
+        return -3;
+    }
+    if (!X.valid || X.n != A.n || X.batchCount != A.batchCount) {
+        return -4;
+    }
+    return 0;
+}
+
+// Kernel selection. The primary template is only instantiated for the
+// combinations without a kernel.
+template<typename Exec, typename Space, typename Layout>
+struct sgesv_dispatch
+{
+    static_assert(dependent_false<Layout>::value,
+        "slsb::sgesv: no kernel for this execution / memory space / layout "
+        "combination (device views need sgesv_batched_views.cuh)");
+};
+
+template<>
+struct sgesv_dispatch<exec_cpu, host_memory, layout_packed>
+{
+    template<typename Info>
+    static int run(exec_cpu, const matrix_batch<host_memory, layout_packed>& A,
+                   const vector_batch<host_memory, layout_packed>& B,
+                   const vector_batch<host_memory, layout_packed>& X, Info* info)
+    {
+        float* h_X = X.data;
+        return cpuLinearSolverBatched(A.n, A.data, B.data, &h_X, info, A.batchCount);
+    }
+};
+
+template<int W>
+struct sgesv_dispatch<exec_cpu, host_memory, layout_interleaved<W> >
+{
+    static_assert(W == 4 || W == 8 || W == 16,
+        "slsb::sgesv: interleaved batches are only built for W = 4, 8 and 16");
+
+    template<typename Info>
+    static int run(exec_cpu, const matrix_batch<host_memory, layout_interleaved<W> >& A,
+                   const vector_batch<host_memory, layout_interleaved<W> >& B,
+                   const vector_batch<host_memory, layout_interleaved<W> >& X, Info* info)
+    {
+        float* h_X = X.data;
+        return cpuLinearSolverBatchedInterleaved<W>(A.n, A.data, B.data, &h_X, info, A.batchCount);
+    }
+};
+
+template<>
+struct sgesv_dispatch<exec_gpu, host_memory, layout_packed>
+{
+    template<typename Info>
+    static int run(exec_gpu, const matrix_batch<host_memory, layout_packed>& A,
+                   const vector_batch<host_memory, layout_packed>& B,
+                   const vector_batch<host_memory, layout_packed>& X, Info* info)
+    {
+        float* h_X = X.data;
+        return gpuLinearSolverBatched(A.n, A.data, B.data, &h_X, info, A.batchCount);
+    }
+};
+
+/// Solves A * X = B for every system of the batch with the kernel matching
+/// the views, see the top of this file. A and B are left untouched.
+/// @return the return code of the selected solver, or the negative code of
+/// sgesv_check if a view is invalid, without solving anything.
+template<typename Exec, typename Space, typename Layout, typename Info>
+inline int
+sgesv(Exec exec, const matrix_batch<Space, Layout>& A,
+      const vector_batch<Space, Layout>& B,
+      const vector_batch<Space, Layout>& X, Info* info)
+{
+    const int check = sgesv_check(A, B, X);
+    if (check != 0) {
+        printf("error: slsb::sgesv, argument %d is an invalid view or of another size than A\n", -check);
+        return check;
+    }
+    return sgesv_dispatch<Exec, Space, Layout>::run(exec, A, B, X, info);
+}
+
+// Catches the calls mixing memory spaces or layouts, for a readable error.
+template<typename Exec, typename SA, typename LA, typename SB, typename LB,
+         typename SX, typename LX, typename Info>
+inline int
+sgesv(Exec, const matrix_batch<SA, LA>&, const vector_batch<SB, LB>&,
+      const vector_batch<SX, LX>&, Info*)
+{
+    static_assert(dependent_false<LA>::value,
+        "slsb::sgesv: A, B and X must have the same memory space and layout");
+    return -1;
+}
+
+} // namespace slsb
+
+#endif //SGESV_BATCHED_VIEWS_H
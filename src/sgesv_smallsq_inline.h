@@ -0,0 +1,370 @@
+#ifndef SGESV_SMALLSQ_INLINE_H
+#define SGESV_SMALLSQ_INLINE_H
+
+/*
+    Header only LU solver for a single tiny square system, N known at compile time.
+
+    Meant to be called from a hot loop (host or device code) where a batched
+    call would be far too heavy. Matrices are plain column-major arrays,
+    A(i,j) = A[i + j*N], typically on the stack. Every loop has a compile time
+    trip count, so it can be unrolled, and the functions are constexpr so they
+    can also be evaluated at compile time.
+
+    The operations are done in the same order as the batched kernels
+    (sgetrf_batched_smallsq_noshfl_kernel and the fused solver in
+    linearSolverFusedSLU_batched.cuh), and cpuLinearSolverBatched is built on
+    these templates, so inline and batched results agree:
+      - the pivot is the first row holding the largest |A(i,k)|,
+      - the column below the pivot is scaled by the reciprocal of the pivot,
+      - a zero pivot is reported in info but the factorization goes on,
+      - the triangular solves are column oriented.
+    Results can still differ in the last bits from the GPU, which contracts
+    a*b+c into fma by default.
+
+    Pivots are stored in Fortran indexing like LAPACK and MAGMA: row i was
+    interchanged with row ipiv[i]-1.
+*/
+
+#if defined(__CUDACC__)
+#define SMALLSQ_INLINE  __host__ __device__ inline
+#else
+#define SMALLSQ_INLINE  inline
+#endif
+
+// On the device every loop is fully unrolled so that A stays in registers,
+// like in the batched kernels. On the host the inner loops are left to the
+// optimizer (their trip counts are known at compile time, so they are
+// unrolled or vectorized), but the outer elimination loop is kept rolled:
+// unrolling the whole nest for every N up to 32 makes gcc compile time explode.
+#if defined(__CUDA_ARCH__)
+#define SMALLSQ_UNROLL        _Pragma("unroll")
+#define SMALLSQ_UNROLL_OUTER  _Pragma("unroll")
+#elif defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 8
+#define SMALLSQ_UNROLL
+#define SMALLSQ_UNROLL_OUTER  _Pragma("GCC unroll 1")
+#else
+#define SMALLSQ_UNROLL
+#define SMALLSQ_UNROLL_OUTER
+#endif
+
+/// LU factorization with partial pivoting of the N-by-N matrix A, in place.
+/// @return 0 on success, i > 0 if U(i-1,i-1) is exactly zero.
+template<int N>
+SMALLSQ_INLINE constexpr int
+sgetrf_smallsq(float* A, int* ipiv)
+{
+    int info = 0;
+    SMALLSQ_UNROLL_OUTER
+    for (int k = 0; k < N; k++) {
+        // isamax
+        int   piv = k;
+        float amax = A[k + k*N] > 0 ? A[k + k*N] : -A[k + k*N];
+        SMALLSQ_UNROLL
+        for (int i = k+1; i < N; i++) {
+            float a = A[i + k*N] > 0 ? A[i + k*N] : -A[i + k*N];
+            if (a > amax) {
+                piv  = i;
+                amax = a;
+            }
+        }
+        ipiv[k] = piv + 1;
+        if (amax == 0.0f && info == 0) {
+            info = k + 1;
+        }
+
+        // swap the whole rows, the L part included, as the lazy swap of the kernels does
+        if (piv != k) {
+            SMALLSQ_UNROLL
+            for (int j = 0; j < N; j++) {
+                float tmp      = A[k   + j*N];
+                A[k   + j*N]   = A[piv + j*N];
+                A[piv + j*N]   = tmp;
+            }
+        }
+
+        // scal and ger
+        const float reg = 1.0f / A[k + k*N];
+        SMALLSQ_UNROLL
+        for (int i = k+1; i < N; i++) {
+            A[i + k*N] *= reg;
+            SMALLSQ_UNROLL
+            for (int j = k+1; j < N; j++) {
+                A[i + j*N] -= A[i + k*N] * A[k + j*N];
+            }
+        }
+    }
+    return info;
+}
+
+/// Applies the row interchanges of sgetrf_smallsq to the vector b.
+template<int N>
+SMALLSQ_INLINE constexpr void
+slaswp_smallsq(const int* ipiv, float* b)
+{
+    SMALLSQ_UNROLL_OUTER
+    for (int k = 0; k < N; k++) {
+        const int piv = ipiv[k] - 1;
+        if (piv != k) {
+            float tmp = b[k];
+            b[k]      = b[piv];
+            b[piv]    = tmp;
+        }
+    }
+}
+
+/// Solves L * x = b in place, L unit lower triangular stored below the diagonal of LU.
+template<int N>
+SMALLSQ_INLINE constexpr void
+strsv_lower_smallsq(const float* LU, float* b)
+{
+    SMALLSQ_UNROLL_OUTER
+    for (int k = 0; k < N; k++) {
+        SMALLSQ_UNROLL
+        for (int i = k+1; i < N; i++) {
+            b[i] -= LU[i + k*N] * b[k];
+        }
+    }
+}
+
+/// Solves U * x = b in place, U upper triangular stored on and above the diagonal of LU.
+template<int N>
+SMALLSQ_INLINE constexpr void
+strsv_upper_smallsq(const float* LU, float* b)
+{
+    SMALLSQ_UNROLL_OUTER
+    for (int k = N-1; k >= 0; k--) {
+        b[k] = b[k] / LU[k + k*N];
+        SMALLSQ_UNROLL
+        for (int i = 0; i < k; i++) {
+            b[i] -= LU[i + k*N] * b[k];
+        }
+    }
+}
+
+/// Solves A * x = b using the factorization computed by sgetrf_smallsq; x overwrites b.
+template<int N>
+SMALLSQ_INLINE constexpr void
+sgetrs_smallsq(const float* LU, const int* ipiv, float* b)
+{
+    slaswp_smallsq<N>(ipiv, b);
+    strsv_lower_smallsq<N>(LU, b);
+    strsv_upper_smallsq<N>(LU, b);
+}
+
+/// Solves A * x = b. A is overwritten by its LU factors and b by x.
+/// @return the sgetrf_smallsq info; x is not valid if it is > 0.
+template<int N>
+SMALLSQ_INLINE constexpr int
+sgesv_smallsq(float* A, float* b)
+{
+    int ipiv[N] = {0};
+    const int info = sgetrf_smallsq<N>(A, ipiv);
+    sgetrs_smallsq<N>(A, ipiv, b);
+    return info;
+}
+
+/*
+    Interleaved variant, W systems solved at once, one per SIMD lane.
+    Element (i,j) of system l is A[(i + j*N)*W + l] and b(i) is b[i*W + l],
+    so every innermost loop runs over the lanes with unit stride and is
+    vectorized by the compiler. Each lane goes through exactly the operations
+    of sgesv_smallsq<N>, only the row interchanges are done lane by lane.
+*/
+template<int N, int W>
+SMALLSQ_INLINE constexpr void
+sgesv_smallsq_interleaved(float* A, float* b, int* info)
+{
+    int   piv[W]  = {0};
+    float amax[W] = {0};
+    float reg[W]  = {0};
+
+    for (int l = 0; l < W; l++) {
+        info[l] = 0;
+    }
+
+    SMALLSQ_UNROLL_OUTER
+    for (int k = 0; k < N; k++) {
+        // isamax, per lane
+        for (int l = 0; l < W; l++) {
+            piv[l]  = k;
+            amax[l] = A[(k + k*N)*W + l] > 0 ? A[(k + k*N)*W + l] : -A[(k + k*N)*W + l];
+        }
+        for (int i = k+1; i < N; i++) {
+            for (int l = 0; l < W; l++) {
+                float a = A[(i + k*N)*W + l] > 0 ? A[(i + k*N)*W + l] : -A[(i + k*N)*W + l];
+                piv[l]  = (a > amax[l]) ? i : piv[l];
+                amax[l] = (a > amax[l]) ? a : amax[l];
+            }
+        }
+
+        // swap the whole rows of A and b, lane by lane
+        for (int l = 0; l < W; l++) {
+            if (amax[l] == 0.0f && info[l] == 0) {
+                info[l] = k + 1;
+            }
+            const int p = piv[l];
+            if (p != k) {
+                for (int j = 0; j < N; j++) {
+                    float tmp             = A[(k + j*N)*W + l];
+                    A[(k + j*N)*W + l]    = A[(p + j*N)*W + l];
+                    A[(p + j*N)*W + l]    = tmp;
+                }
+                float tmp      = b[k*W + l];
+                b[k*W + l]     = b[p*W + l];
+                b[p*W + l]     = tmp;
+            }
+        }
+
+        // scal and ger
+        for (int l = 0; l < W; l++) {
+            reg[l] = 1.0f / A[(k + k*N)*W + l];
+        }
+        for (int i = k+1; i < N; i++) {
+            for (int l = 0; l < W; l++) {
+                A[(i + k*N)*W + l] *= reg[l];
+            }
+            for (int j = k+1; j < N; j++) {
+                for (int l = 0; l < W; l++) {
+                    A[(i + j*N)*W + l] -= A[(i + k*N)*W + l] * A[(k + j*N)*W + l];
+                }
+            }
+        }
+    }
+
+    // solve L * y = P * b
+    SMALLSQ_UNROLL_OUTER
+    for (int k = 0; k < N; k++) {
+        for (int i = k+1; i < N; i++) {
+            for (int l = 0; l < W; l++) {
+                b[i*W + l] -= A[(i + k*N)*W + l] * b[k*W + l];
+            }
+        }
+    }
+
+    // solve U * x = y
+    SMALLSQ_UNROLL_OUTER
+    for (int k = N-1; k >= 0; k--) {
+        for (int l = 0; l < W; l++) {
+            b[k*W + l] = b[k*W + l] / A[(k + k*N)*W + l];
+        }
+        for (int i = 0; i < k; i++) {
+            for (int l = 0; l < W; l++) {
+                b[i*W + l] -= A[(i + k*N)*W + l] * b[k*W + l];
+            }
+        }
+    }
+}
+
+/*
+    The phases of sgesv_smallsq_interleaved as separate functions, for the
+    instrumented path of the CPU engine that counts each phase on its own
+    (see linearSolverCPUperf_batched.cpp). The pivots are kept in ipiv,
+    ipiv[k*W + l] for system l, and applied to b afterwards; the results
+    are bitwise those of sgesv_smallsq_interleaved.
+*/
+template<int N, int W>
+SMALLSQ_INLINE constexpr void
+sgetrf_smallsq_interleaved(float* A, int* ipiv, int* info)
+{
+    float amax[W] = {0};
+    float reg[W]  = {0};
+
+    for (int l = 0; l < W; l++) {
+        info[l] = 0;
+    }
+
+    SMALLSQ_UNROLL_OUTER
+    for (int k = 0; k < N; k++) {
+        int* piv = ipiv + k*W;
+        for (int l = 0; l < W; l++) {
+            piv[l]  = k;
+            amax[l] = A[(k + k*N)*W + l] > 0 ? A[(k + k*N)*W + l] : -A[(k + k*N)*W + l];
+        }
+        for (int i = k+1; i < N; i++) {
+            for (int l = 0; l < W; l++) {
+                float a = A[(i + k*N)*W + l] > 0 ? A[(i + k*N)*W + l] : -A[(i + k*N)*W + l];
+                piv[l]  = (a > amax[l]) ? i : piv[l];
+                amax[l] = (a > amax[l]) ? a : amax[l];
+            }
+        }
+
+        for (int l = 0; l < W; l++) {
+            if (amax[l] == 0.0f && info[l] == 0) {
+                info[l] = k + 1;
+            }
+            const int p = piv[l];
+            if (p != k) {
+                for (int j = 0; j < N; j++) {
+                    float tmp             = A[(k + j*N)*W + l];
+                    A[(k + j*N)*W + l]    = A[(p + j*N)*W + l];
+                    A[(p + j*N)*W + l]    = tmp;
+                }
+            }
+            piv[l] = p + 1;
+        }
+
+        for (int l = 0; l < W; l++) {
+            reg[l] = 1.0f / A[(k + k*N)*W + l];
+        }
+        for (int i = k+1; i < N; i++) {
+            for (int l = 0; l < W; l++) {
+                A[(i + k*N)*W + l] *= reg[l];
+            }
+            for (int j = k+1; j < N; j++) {
+                for (int l = 0; l < W; l++) {
+                    A[(i + j*N)*W + l] -= A[(i + k*N)*W + l] * A[(k + j*N)*W + l];
+                }
+            }
+        }
+    }
+}
+
+template<int N, int W>
+SMALLSQ_INLINE constexpr void
+slaswp_smallsq_interleaved(const int* ipiv, float* b)
+{
+    SMALLSQ_UNROLL_OUTER
+    for (int k = 0; k < N; k++) {
+        for (int l = 0; l < W; l++) {
+            const int p = ipiv[k*W + l] - 1;
+            if (p != k) {
+                float tmp  = b[k*W + l];
+                b[k*W + l] = b[p*W + l];
+                b[p*W + l] = tmp;
+            }
+        }
+    }
+}
+
+template<int N, int W>
+SMALLSQ_INLINE constexpr void
+strsv_lower_smallsq_interleaved(const float* LU, float* b)
+{
+    SMALLSQ_UNROLL_OUTER
+    for (int k = 0; k < N; k++) {
+        for (int i = k+1; i < N; i++) {
+            for (int l = 0; l < W; l++) {
+                b[i*W + l] -= LU[(i + k*N)*W + l] * b[k*W + l];
+            }
+        }
+    }
+}
+
+template<int N, int W>
+SMALLSQ_INLINE constexpr void
+strsv_upper_smallsq_interleaved(const float* LU, float* b)
+{
+    SMALLSQ_UNROLL_OUTER
+    for (int k = N-1; k >= 0; k--) {
+        for (int l = 0; l < W; l++) {
+            b[k*W + l] = b[k*W + l] / LU[(k + k*N)*W + l];
+        }
+        for (int i = 0; i < k; i++) {
+            for (int l = 0; l < W; l++) {
+                b[i*W + l] -= LU[(i + k*N)*W + l] * b[k*W + l];
+            }
+        }
+    }
+}
+
+#endif //SGESV_SMALLSQ_INLINE_H
@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <cuda_runtime.h>
+#include "slsb.h"
+#include "sgesv_batched_views.cuh"
+#include "smallsq_dispatch.h"
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+// Systems per call of the underlying solvers. The kernels and
+// gpuLinearSolverBatched index with int, so larger batches are split in
+// chunks of at most SLSB_CHUNK systems and SLSB_CHUNK_ELEMENTS elements of
+// A, see slsb_chunk. Multiples of every interleave width, so chunks start on
+// a group boundary.
+#define SLSB_CHUNK           (1 << 20)
+#define SLSB_CHUNK_ELEMENTS  (1 << 30)
+
+// Systems per chunk of n-by-n matrices with leading dimension ld: ld*n*chunk
+// is at most SLSB_CHUNK_ELEMENTS (2^15 systems for n = 32, ld = 1024).
+static int slsb_chunk(int64_t n, int64_t ld)
+{
+    const int64_t chunk = n > 0 ? (SLSB_CHUNK_ELEMENTS / (ld * n)) & ~31LL : SLSB_CHUNK;
+    return (int)(chunk < SLSB_CHUNK ? chunk : SLSB_CHUNK);
+}
+
+// Offsets of the chunk starting at system first; the layout traits take an
+// int system index, but offsets are linear in whole chunks.
+template<typename Layout>
+static size_t slsb_chunk_offset_a(int n, int ld, int chunk, int64_t first)
+{
+    return (size_t)(first / chunk) * slsb::layout_traits<Layout>::a(n, ld, chunk, 0, 0);
+}
+
+template<typename Layout>
+static size_t slsb_chunk_offset_b(int n, int ld, int chunk, int64_t first)
+{
+    return (size_t)(first / chunk) * slsb::layout_traits<Layout>::b(n, ld, chunk, 0);
+}
+
+// Status of a negative return code of the solvers: the MAGMA errors
+// (MAGMA_ERR and below) by kind, argument errors (above MAGMA_ERR, the
+// negative position of the argument as in LAPACK) as SLSB_ERR_INVALID_ARG.
+static int32_t slsb_error_status(int res)
+{
+    switch (res) {
+        case MAGMA_ERR_NOT_SUPPORTED:
+            return SLSB_ERR_UNSUPPORTED;
+        case MAGMA_ERR_ALLOCATION:
+        case MAGMA_ERR_HOST_ALLOC:
+        case MAGMA_ERR_DEVICE_ALLOC:
+            return SLSB_ERR_ALLOC;
+        default:
+            return res > MAGMA_ERR ? SLSB_ERR_INVALID_ARG : SLSB_ERR_BACKEND;
+    }
+}
+
+typedef int (*slsb_solve_fn)(const slsb_batch_s* batch, float* A, float* B,
+                             float* X, int32_t* info, int64_t first, int count);
+
+struct slsb_context_s
+{
+    int32_t backend;
+    cudaStream_t stream;
+};
+
+struct slsb_batch_s
+{
+    slsb_context ctx;
+    int64_t n;
+    int64_t batch_count;
+    int64_t param;
+    int32_t memory;
+    int32_t layout;
+    int32_t chunk;         // systems per call of solve, see slsb_chunk
+    slsb_solve_fn solve;   // picked by slsb_batch_create
+};
+
+template<typename Exec>
+struct slsb_exec;
+
+template<>
+struct slsb_exec<slsb::exec_cpu>
+{
+    static slsb::exec_cpu get(const slsb_context_s*) { return slsb::exec_cpu(); }
+};
+
+template<>
+struct slsb_exec<slsb::exec_gpu>
+{
+    static slsb::exec_gpu get(const slsb_context_s* ctx)
+    {
+        slsb::exec_gpu exec = { ctx->stream };
+        return exec;
+    }
+};
+
+// Host memory: the info array is int32_t on both sides.
+template<typename Exec, typename Layout>
+static int
+slsb_solve_host(const slsb_batch_s* batch, float* A, float* B, float* X,
+                int32_t* info, int64_t first, int count)
+{
+    typedef slsb::layout_traits<Layout> traits;
+    const int n  = (int)batch->n;
+    const int ld = traits::has_ld ? (int)batch->param : n;
+
+    return slsb::sgesv(slsb_exec<Exec>::get(batch->ctx),
+        slsb::make_matrix_batch<slsb::host_memory, Layout>(A + slsb_chunk_offset_a<Layout>(n, ld, batch->chunk, first), n, count, ld),
+        slsb::make_vector_batch<slsb::host_memory, Layout>(B + slsb_chunk_offset_b<Layout>(n, ld, batch->chunk, first), n, count, ld),
+        slsb::make_vector_batch<slsb::host_memory, Layout>(X + slsb_chunk_offset_b<Layout>(n, ld, batch->chunk, first), n, count, ld),
+        info + first);
+}
+
+#if defined(MAGMA_ILP64) || defined(MKL_ILP64)
+// magma_int_t is 64 bit, the kernel results are stored as int32_t by a consumer.
+template<typename Layout>
+struct slsb_device_store
+{
+    float* dX;
+    int32_t* dinfo;
+    int n;
+    int ld;
+
+    __device__ void operator()(int batchid, const float* x, int info) const
+    {
+        for (int i = 0; i < n; i++) {
+            dX[ slsb::layout_traits<Layout>::b(n, ld, batchid, i) ] = x[i];
+        }
+        dinfo[batchid] = (int32_t)info;
+    }
+};
+#endif
+
+// Device memory: asynchronous on the context stream.
+template<typename Layout>
+static int
+slsb_solve_device(const slsb_batch_s* batch, float* A, float* B, float* X,
+                  int32_t* info, int64_t first, int count)
+{
+    typedef slsb::layout_traits<Layout> traits;
+    const int n  = (int)batch->n;
+    const int ld = traits::has_ld ? (int)batch->param : n;
+
+    slsb::matrix_batch<slsb::device_memory, Layout> vA =
+        slsb::make_matrix_batch<slsb::device_memory, Layout>(A + slsb_chunk_offset_a<Layout>(n, ld, batch->chunk, first), n, count, ld);
+    slsb::vector_batch<slsb::device_memory, Layout> vB =
+        slsb::make_vector_batch<slsb::device_memory, Layout>(B + slsb_chunk_offset_b<Layout>(n, ld, batch->chunk, first), n, count, ld);
+    slsb::vector_batch<slsb::device_memory, Layout> vX =
+        slsb::make_vector_batch<slsb::device_memory, Layout>(X + slsb_chunk_offset_b<Layout>(n, ld, batch->chunk, first), n, count, ld);
+
+#if defined(MAGMA_ILP64) || defined(MKL_ILP64)
+    const int check = slsb::sgesv_check(vA, vB, vX);
+    if (check != 0) {
+        return check;
+    }
+    slsb_device_store<Layout> cons = { vX.data, info + first, n, ld };
+    return (int)magma_sgesv_batched_smallsq_consumed(
+                n, slsb::make_view_generator(vA, vB), cons, count, batch->ctx->stream);
+#else
+    return slsb::sgesv(slsb_exec<slsb::exec_gpu>::get(batch->ctx), vA, vB, vX,
+                       (magma_int_t*)(info + first));
+#endif
+}
+
+// Solver of a backend / memory / layout combination, NULL if there is none.
+static slsb_solve_fn
+slsb_select(int32_t backend, int32_t memory, int32_t layout, int64_t param)
+{
+    if (backend == SLSB_BACKEND_CPU && memory == SLSB_MEMORY_HOST) {
+        if (layout == SLSB_LAYOUT_PACKED) {
+            return slsb_solve_host<slsb::exec_cpu, slsb::layout_packed>;
+        }
+        if (layout == SLSB_LAYOUT_INTERLEAVED) {
+            switch (param) {
+                case  4: return slsb_solve_host<slsb::exec_cpu, slsb::layout_interleaved< 4> >;
+                case  8: return slsb_solve_host<slsb::exec_cpu, slsb::layout_interleaved< 8> >;
+                case 16: return slsb_solve_host<slsb::exec_cpu, slsb::layout_interleaved<16> >;
+                default: return NULL;
+            }
+        }
+    }
+    else if (backend == SLSB_BACKEND_GPU && memory == SLSB_MEMORY_HOST) {
+        if (layout == SLSB_LAYOUT_PACKED) {
+            return slsb_solve_host<slsb::exec_gpu, slsb::layout_packed>;
+        }
+    }
+    else if (backend == SLSB_BACKEND_GPU && memory == SLSB_MEMORY_DEVICE) {
+        switch (layout) {
+            case SLSB_LAYOUT_PACKED: return slsb_solve_device<slsb::layout_packed>;
+            case SLSB_LAYOUT_PADDED: return slsb_solve_device<slsb::layout_padded>;
+            case SLSB_LAYOUT_INTERLEAVED:
+                switch (param) {
+                    case  4: return slsb_solve_device<slsb::layout_interleaved< 4> >;
+                    case  8: return slsb_solve_device<slsb::layout_interleaved< 8> >;
+                    case 16: return slsb_solve_device<slsb::layout_interleaved<16> >;
+                    case 32: return slsb_solve_device<slsb::layout_interleaved<32> >;
+                    default: return NULL;
+                }
+            default: return NULL;
+        }
+    }
+    return NULL;
+}
+
+extern "C" {
+
+int32_t slsb_abi_version(void)
+{
+    return SLSB_ABI_VERSION;
+}
+
+void slsb_version(int32_t* major, int32_t* minor, int32_t* patch)
+{
+    if (major != NULL) *major = SLSB_VERSION_MAJOR;
+    if (minor != NULL) *minor = SLSB_VERSION_MINOR;
+    if (patch != NULL) *patch = SLSB_VERSION_PATCH;
+}
+
+int32_t slsb_query(int32_t capability, int64_t* value)
+{
+    int ngpu = 0;
+    if (value == NULL) {
+        return SLSB_ERR_INVALID_ARG;
+    }
+    switch (capability) {
+        case SLSB_CAP_MAX_N:
+            *value = 0;
+            for (int n = 1; n <= 32; n++) {
+                if (smallsq_size_instantiated(n)) {
+                    *value = n;
+                }
+            }
+            break;
+        case SLSB_CAP_SIZES:
+            *value = 0;
+            for (int n = 1; n <= 32; n++) {
+                if (smallsq_size_instantiated(n)) {
+                    *value |= 1LL << n;
+                }
+            }
+            break;
+        case SLSB_CAP_BACKENDS:
+            if (cudaGetDeviceCount(&ngpu) != cudaSuccess) {
+                ngpu = 0;
+            }
+            *value = (1 << SLSB_BACKEND_CPU) | (ngpu > 0 ? (1 << SLSB_BACKEND_GPU) : 0);
+            break;
+        case SLSB_CAP_INTERLEAVE_WIDTHS:
+            // 32 is only solved by the GPU backend, on device memory
+            if (cudaGetDeviceCount(&ngpu) != cudaSuccess) {
+                ngpu = 0;
+            }
+            *value = (1LL << 4) | (1LL << 8) | (1LL << 16) | (ngpu > 0 ? (1LL << 32) : 0);
+            break;
+        case SLSB_CAP_NUM_THREADS:
+#if defined(_OPENMP)
+            *value = omp_get_max_threads();
+#else
+            *value = 1;
+#endif
+            break;
+        case SLSB_CAP_GPU_COUNT:
+            if (cudaGetDeviceCount(&ngpu) != cudaSuccess) {
+                ngpu = 0;
+            }
+            *value = ngpu;
+            break;
+        default:
+            return SLSB_ERR_INVALID_ARG;
+    }
+    return SLSB_SUCCESS;
+}
+
+const char* slsb_status_string(int32_t status)
+{
+    switch (status) {
+        case SLSB_SUCCESS:         return "success";
+        case SLSB_SINGULAR:        return "some systems are singular, see info";
+        case SLSB_ERR_INVALID_ARG: return "invalid argument";
+        case SLSB_ERR_UNSUPPORTED: return "unsupported backend, memory and layout combination";
+        case SLSB_ERR_ALLOC:       return "allocation failed";
+        case SLSB_ERR_BACKEND:     return "CUDA, cuBLAS or MAGMA error";
+        default:                   return "unknown status";
+    }
+}
+
+int32_t slsb_context_create(slsb_context* ctx, int32_t backend, void* stream)
+{
+    if (ctx == NULL || (backend != SLSB_BACKEND_CPU && backend != SLSB_BACKEND_GPU)) {
+        return SLSB_ERR_INVALID_ARG;
+    }
+    *ctx = (slsb_context)malloc(sizeof(slsb_context_s));
+    if (*ctx == NULL) {
+        return SLSB_ERR_ALLOC;
+    }
+    (*ctx)->backend = backend;
+    (*ctx)->stream  = (cudaStream_t)stream;
+    return SLSB_SUCCESS;
+}
+
+int32_t slsb_context_destroy(slsb_context ctx)
+{
+    free(ctx);
+    return SLSB_SUCCESS;
+}
+
+int32_t slsb_batch_create(slsb_batch* batch, slsb_context ctx,
+                          int64_t n, int64_t batch_count,
+                          int32_t memory, int32_t layout, int64_t param)
+{
+    slsb_solve_fn solve;
+    if (batch == NULL || ctx == NULL || n < 0 || n > 32 || batch_count < 0) {
+        return SLSB_ERR_INVALID_ARG;
+    }
+    if (layout == SLSB_LAYOUT_PADDED && (param < n || param > 1024)) {
+        return SLSB_ERR_INVALID_ARG;
+    }
+    if (n > 0 && !smallsq_size_instantiated((int)n)) {
+        return SLSB_ERR_UNSUPPORTED;
+    }
+    solve = slsb_select(ctx->backend, memory, layout, param);
+    if (solve == NULL) {
+        return SLSB_ERR_UNSUPPORTED;
+    }
+
+    *batch = (slsb_batch)malloc(sizeof(slsb_batch_s));
+    if (*batch == NULL) {
+        return SLSB_ERR_ALLOC;
+    }
+    (*batch)->ctx         = ctx;
+    (*batch)->n           = n;
+    (*batch)->batch_count = batch_count;
+    (*batch)->param       = param;
+    (*batch)->memory      = memory;
+    (*batch)->layout      = layout;
+    (*batch)->chunk       = slsb_chunk(n, layout == SLSB_LAYOUT_PADDED ? param : n);
+    (*batch)->solve       = solve;
+    return SLSB_SUCCESS;
+}
+
+int32_t slsb_batch_destroy(slsb_batch batch)
+{
+    free(batch);
+    return SLSB_SUCCESS;
+}
+
+int32_t slsb_solve(slsb_batch batch, const float* A, const float* B,
+                   float* X, int32_t* info)
+{
+    int32_t status = SLSB_SUCCESS;
+    if (batch == NULL || A == NULL || B == NULL || X == NULL || info == NULL) {
+        return SLSB_ERR_INVALID_ARG;
+    }
+    if (batch->n == 0 || batch->batch_count == 0) {
+        return SLSB_SUCCESS;
+    }
+
+    // the solvers do not write A and B, their interfaces just predate const
+    for (int64_t first = 0; first < batch->batch_count; first += batch->chunk) {
+        const int count = (int)((batch->batch_count - first < batch->chunk) ?
+                                 batch->batch_count - first : batch->chunk);
+        const int res = batch->solve(batch, (float*)A, (float*)B, X, info, first, count);
+        if (res < 0) {
+            return slsb_error_status(res);
+        }
+        if (res == 0) {
+            continue;
+        }
+        if (batch->memory == SLSB_MEMORY_DEVICE) {
+            return SLSB_ERR_BACKEND;
+        }
+        // a positive code is either a getrf info or a CUDA error
+        status = SLSB_ERR_BACKEND;
+        for (int i = 0; i < count; i++) {
+            if (info[first + i] > 0) {
+                status = SLSB_SINGULAR;
+                break;
+            }
+        }
+        if (status == SLSB_ERR_BACKEND) {
+            return status;
+        }
+    }
+    return status;
+}
+
+} // extern "C"
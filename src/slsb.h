@@ -0,0 +1,133 @@
+#ifndef SLSB_H
+#define SLSB_H
+
+/*
+    Stable C interface of the small linear solver batched library (slsb).
+
+    Meant for foreign callers (Fortran bind(C), Julia ccall, Python ctypes /
+    cffi): only fixed width integers, float, opaque pointers and void* appear
+    in the signatures, so nothing depends on magma_int_t (int or long long
+    depending on MAGMA_ILP64), on cudaStream_t or on C++.
+
+    Usage:
+        slsb_context ctx;
+        slsb_batch   batch;
+        slsb_context_create(&ctx, SLSB_BACKEND_GPU, stream);
+        slsb_batch_create(&batch, ctx, n, count, SLSB_MEMORY_DEVICE, SLSB_LAYOUT_PADDED, ldd);
+        slsb_solve(batch, dA, dB, dX, dinfo);      // as many times as needed
+        slsb_batch_destroy(batch);
+        slsb_context_destroy(ctx);
+
+    Buffers are never copied or repacked by this layer: slsb_solve hands the
+    caller's pointers to the solver selected when the batch was created, so a
+    foreign caller gets exactly the throughput of a C++ caller. All sizes are
+    64 bit; batches larger than the int range of the kernels are split
+    internally.
+
+    Compatibility: functions are only added, never changed, within a major
+    version. SLSB_ABI_VERSION is bumped when an incompatible change is made,
+    and callers should compare it with slsb_abi_version() at load time.
+*/
+
+#include <stdint.h>
+
+#define SLSB_VERSION_MAJOR  1
+#define SLSB_VERSION_MINOR  1
+#define SLSB_VERSION_PATCH  0
+#define SLSB_ABI_VERSION    1
+
+/* SLSB_BUILD is defined when the library itself is compiled: its functions
+   are exported from the DLL, and imported by the callers. */
+#if defined(_WIN32) && defined(SLSB_BUILD)
+#define SLSB_API  __declspec(dllexport)
+#elif defined(_WIN32)
+#define SLSB_API  __declspec(dllimport)
+#else
+#define SLSB_API  __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct slsb_context_s* slsb_context;
+typedef struct slsb_batch_s*   slsb_batch;
+
+/* Return codes. Values are part of the ABI. */
+enum {
+    SLSB_SUCCESS            =  0,
+    SLSB_SINGULAR           =  1,  /* solved, but some info[i] > 0 */
+    SLSB_ERR_INVALID_ARG    = -1,
+    SLSB_ERR_UNSUPPORTED    = -2,  /* backend / memory / layout combination without a kernel */
+    SLSB_ERR_ALLOC          = -3,  /* host or device memory of the solver */
+    SLSB_ERR_BACKEND        = -4   /* CUDA, cuBLAS or MAGMA error */
+};
+
+enum {
+    SLSB_BACKEND_CPU = 0,
+    SLSB_BACKEND_GPU = 1
+};
+
+enum {
+    SLSB_MEMORY_HOST   = 0,
+    SLSB_MEMORY_DEVICE = 1
+};
+
+/* Layouts, see sgesv_batched_views.h. param of slsb_batch_create is the
+   leading dimension for SLSB_LAYOUT_PADDED (n <= ld <= 1024), the group width W for
+   SLSB_LAYOUT_INTERLEAVED and is ignored for SLSB_LAYOUT_PACKED. */
+enum {
+    SLSB_LAYOUT_PACKED      = 0,
+    SLSB_LAYOUT_PADDED      = 1,
+    SLSB_LAYOUT_INTERLEAVED = 2
+};
+
+/* Capabilities for slsb_query. */
+enum {
+    SLSB_CAP_MAX_N              = 0,  /* largest supported order */
+    SLSB_CAP_BACKENDS           = 1,  /* bit b set if backend b is usable */
+    SLSB_CAP_INTERLEAVE_WIDTHS  = 2,  /* bit W set if SLSB_LAYOUT_INTERLEAVED supports W: 4, 8
+                                         and 16, and 32 when a GPU is visible (W = 32 is
+                                         only solved by SLSB_BACKEND_GPU on device memory) */
+    SLSB_CAP_NUM_THREADS        = 3,  /* threads used by the CPU backend */
+    SLSB_CAP_GPU_COUNT          = 4,  /* number of visible CUDA devices */
+    SLSB_CAP_SIZES              = 5   /* bit n set if order n is built, see SLSB_SMALLSQ_SIZES */
+};
+
+/* Version of the library actually loaded. */
+SLSB_API int32_t slsb_abi_version(void);
+SLSB_API void    slsb_version(int32_t* major, int32_t* minor, int32_t* patch);
+
+/* Stores in *value what the loaded library and machine support. */
+SLSB_API int32_t slsb_query(int32_t capability, int64_t* value);
+
+/* Human readable text of a return code, never NULL. */
+SLSB_API const char* slsb_status_string(int32_t status);
+
+/* stream is a cudaStream_t for SLSB_BACKEND_GPU (NULL for the default
+   stream), ignored for SLSB_BACKEND_CPU. The context does not own it. */
+SLSB_API int32_t slsb_context_create(slsb_context* ctx, int32_t backend, void* stream);
+SLSB_API int32_t slsb_context_destroy(slsb_context ctx);
+
+/* Describes batch_count n-by-n systems; no memory is allocated for them.
+   Fails with SLSB_ERR_UNSUPPORTED if no solver handles the combination
+   or if the library was built without order n,
+   so slsb_solve does no validation beyond the pointers. */
+SLSB_API int32_t slsb_batch_create(slsb_batch* batch, slsb_context ctx,
+                                   int64_t n, int64_t batch_count,
+                                   int32_t memory, int32_t layout, int64_t param);
+SLSB_API int32_t slsb_batch_destroy(slsb_batch batch);
+
+/* Solves A * X = B for every system. A, B, X and info are the caller's
+   buffers in the memory space and layout of the batch; A and B are left
+   untouched. For SLSB_MEMORY_DEVICE the call is asynchronous on the context
+   stream, info is a device array, and SLSB_SINGULAR is never returned:
+   the caller checks info after synchronizing. */
+SLSB_API int32_t slsb_solve(slsb_batch batch, const float* A, const float* B,
+                            float* X, int32_t* info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SLSB_H
@@ -0,0 +1,82 @@
+#ifndef SMALLSQ_DISPATCH_H
+#define SMALLSQ_DISPATCH_H
+
+#include <utility>
+
+/*
+    Compile time dispatch tables for the kernels templated on the matrix size.
+
+    Instead of a hand written 32-case switch per kernel, a launcher names its
+    instantiations with a class template Entry<V, N> whose static member
+    run() does the work for variant V and size N, and
+
+        static constexpr smallsq_table<Fn, NV> table = make_smallsq_table<Fn, Entry, NV>();
+
+    builds, at compile time, a table of function pointers indexed by variant
+    and size; table.get(v, n) is NULL for the sizes that are not instantiated.
+    Adding a variant is adding a row, not 32 cases.
+
+    The sizes instantiated are set for the whole build with SLSB_SMALLSQ_SIZES,
+    e.g. -DSLSB_SMALLSQ_SIZES=4,8,16 for a deployment that only solves these,
+    which cuts compile time, binary size and load time accordingly. Calls for
+    other sizes fail at run time with a message. The default is 1 to 32.
+*/
+
+#ifndef SLSB_SMALLSQ_SIZES
+#define SLSB_SMALLSQ_SIZES  1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, \
+                            17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32
+#endif
+
+template<int... Ns>
+struct smallsq_sizes {};
+
+typedef smallsq_sizes<SLSB_SMALLSQ_SIZES> smallsq_instantiated_sizes;
+
+/// True if size n is in SLSB_SMALLSQ_SIZES.
+constexpr bool smallsq_size_instantiated(int n)
+{
+    const int sizes[] = { SLSB_SMALLSQ_SIZES };
+    for (int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        if (sizes[i] == n) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template<typename Fn, int NV>
+struct smallsq_table
+{
+    Fn fn[NV][33];
+
+    /// Instantiation of variant v for size n, NULL if there is none.
+    constexpr Fn get(int v, int n) const
+    {
+        return (v >= 0 && v < NV && n >= 1 && n <= 32) ? fn[v][n] : nullptr;
+    }
+};
+
+template<typename Fn, template<int, int> class Entry, int V, int... Ns>
+constexpr void smallsq_fill_row(Fn* row, smallsq_sizes<Ns...>)
+{
+    const int unused[] = { 0, (row[Ns] = &Entry<V, Ns>::run, 0)... };
+    (void)unused;
+}
+
+template<typename Fn, int NV, template<int, int> class Entry, int... Vs>
+constexpr smallsq_table<Fn, NV> smallsq_fill(std::integer_sequence<int, Vs...>)
+{
+    smallsq_table<Fn, NV> table = {};
+    const int unused[] = { 0, (smallsq_fill_row<Fn, Entry, Vs>(table.fn[Vs], smallsq_instantiated_sizes()), 0)... };
+    (void)unused;
+    return table;
+}
+
+/// Table of Entry<V, N>::run for V in [0, NV) and N in SLSB_SMALLSQ_SIZES.
+template<typename Fn, template<int, int> class Entry, int NV>
+constexpr smallsq_table<Fn, NV> make_smallsq_table()
+{
+    return smallsq_fill<Fn, NV, Entry>(std::make_integer_sequence<int, NV>());
+}
+
+#endif //SMALLSQ_DISPATCH_H
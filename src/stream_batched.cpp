@@ -0,0 +1,592 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "operation_batched.h"
+#include "utils.h"
+#include "npy_batched.h"
+#include "aio_batched.h"
+#include "stream_batched.h"
+
+/*
+    Streaming solve: the batch never is in memory, only cfg->buffers chunks
+    of it, each buffer going around
+        free -> reading (A and B of its chunk) -> ready -> solved -> writing (X) -> free
+    while the thread that solves (with the threads of the solver) only
+    waits when no chunk has arrived. With a chunk being solved and the
+    others being read and written, the throughput is the lower of the disk
+    and the solver, and the memory is the buffers, whatever the size of the
+    files.
+
+    The files are the .npy files of npy_batched_solve; their headers are read
+    by npy_batched_open, and the data is moved by aio_batched. Each region
+    of a chunk (its A, B or X in the file) is placed in its buffer at the
+    offset it has in its page of the file, so that reads can take the whole
+    pages, aligned, and go through O_DIRECT, and so can the writes of X
+    except their first and last partial page, which go through the page
+    cache.
+
+    Buffers are solved in the order of their chunks, so the output file is
+    written mostly sequentially.
+
+    Checkpoints: a bitmap of the chunks whose X has been written, after an
+    fdatasync of X so that they are on the disk, replaces the checkpoint
+    file (written to a temporary file, synced and renamed, so that a crash
+    leaves the old one or the new one) at most every
+    cfg->checkpointSeconds, when chunks have completed since the last one.
+    A few kilobytes and one sync per interval, next to gigabytes streamed.
+    The file has a header (stream_checkpoint), then the bitmap. It is tied
+    to the solve by a hash of what decides the content of each chunk: the
+    shapes and layouts, the chunk size, and the size and modification time
+    of the input files; and to X by its data offset and size. A resumed
+    solve skips the chunks of the bitmap, and is otherwise the same.
+
+    X is written under another name and renamed to pathX when complete, so
+    that pathX is never a partial output: a unique temporary file, or with a
+    checkpoint "<pathX>.part", which a resumed solve finds again and which
+    is kept when the solve stops after a checkpoint was written.
+*/
+
+#define STREAM_FREE     0
+#define STREAM_READING  1
+#define STREAM_READY    2
+#define STREAM_WRITING  3
+
+#define STREAM_REGION_A  0
+#define STREAM_REGION_B  1
+#define STREAM_REGION_X  2
+
+#define STREAM_TAG_KINDS  8     // transfers of a buffer: A, B, and up to three pieces of X
+
+#define STREAM_PART_SUFFIX  ".part"    // X in progress, with a checkpoint
+
+#define STREAM_CHECKPOINT_MAGIC    "SLSBCKP1"
+#define STREAM_CHECKPOINT_VERSION  1
+
+struct stream_checkpoint
+{
+    char magic[8];              // STREAM_CHECKPOINT_MAGIC, not terminated
+    uint32_t version;
+    uint32_t chunkSystems;
+    uint64_t config;            // stream_config_hash of the solve
+    uint64_t chunks;            // bits of the bitmap
+    uint64_t completed;         // bits set
+    uint64_t outputOffset;      // of the data in X
+    uint64_t outputBytes;       // size of X
+    uint64_t check;             // stream_hash of the header (this field 0) and the bitmap
+};
+
+typedef int (*stream_solver)(int n, float* h_A, float* h_B, float** h_X, int* h_info, int batchCount);
+
+struct stream_buffer
+{
+    int state;
+    long long chunk;
+    int count;                          // systems of the chunk
+    int pending;                        // transfers in flight
+    size_t position[3];                 // of A, B and X of the chunk in the buffer
+    size_t expected[STREAM_TAG_KINDS];  // bytes of each transfer, at least
+};
+
+static uint64_t stream_align(uint64_t bytes)
+{
+    return (bytes + AIO_ALIGN - 1) / AIO_ALIGN * AIO_ALIGN;
+}
+
+void stream_batched_defaults(stream_config* cfg)
+{
+    cfg->backend = STREAM_BACKEND_CPU;
+    cfg->chunkBytes = (size_t)STREAM_DEFAULT_CHUNK_MB << 20;
+    cfg->buffers = STREAM_DEFAULT_BUFFERS;
+    cfg->checkpoint = NULL;
+    cfg->checkpointSeconds = STREAM_DEFAULT_CHECKPOINT_SECONDS;
+    cfg->maxChunks = 0;
+}
+
+// FNV-1a, 64 bits.
+static uint64_t stream_hash(uint64_t h, const void* data, size_t bytes)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t k = 0; k < bytes; k++) {
+        h = (h ^ p[k]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+#define STREAM_HASH_SEED  14695981039346656037ULL
+
+// Hash of what the content of the chunks depends on.
+static uint64_t stream_config_hash(const npy_array* A, const npy_array* B, int n, long long batch, int rowMajor,
+                                   int chunkSystems)
+{
+    const npy_array* input[2] = { A, B };
+    uint64_t h = STREAM_HASH_SEED;
+    long long value[5] = { n, batch, rowMajor, B->fortran, chunkSystems };
+
+    h = stream_hash(h, value, sizeof(value));
+    for (int k = 0; k < 2; k++) {
+        struct stat sb;
+        long long file[4] = { -1, -1, -1, (long long)(input[k]->data - (char*)input[k]->map) };
+        if (fstat(input[k]->fd, &sb) == 0) {
+            file[0] = (long long)sb.st_size;
+            file[1] = (long long)sb.st_mtim.tv_sec;
+            file[2] = (long long)sb.st_mtim.tv_nsec;
+        }
+        h = stream_hash(h, file, sizeof(file));
+    }
+    return h;
+}
+
+static int stream_bit(const unsigned char* bitmap, long long k)
+{
+    return (bitmap[k >> 3] >> (k & 7)) & 1;
+}
+
+// Reads the checkpoint at path into done (chunks bits), and the output
+// offset and size into expected. 0, 1 if there is none, -1 with a message
+// if it is not one of this solve.
+static int stream_checkpoint_load(const char* path, stream_checkpoint* expected, unsigned char* done,
+                                  long long* completed)
+{
+    const size_t bitmapBytes = (size_t)(expected->chunks + 7) / 8;
+    stream_checkpoint c;
+    uint64_t check;
+    FILE* f = fopen(path, "rb");
+    int ok;
+
+    if (f == NULL) {
+        return 1;
+    }
+    ok = fread(&c, sizeof(c), 1, f) == 1 && memcmp(c.magic, STREAM_CHECKPOINT_MAGIC, sizeof(c.magic)) == 0;
+    if (ok && (c.version != expected->version || c.config != expected->config || c.chunks != expected->chunks
+               || c.chunkSystems != expected->chunkSystems)) {
+        printf("Error in: stream_batched_solve, checkpoint %s is for other inputs or another chunk size;"
+               " remove it to start over\n", path);
+        fclose(f);
+        return -1;
+    }
+    ok = ok && fread(done, 1, bitmapBytes, f) == bitmapBytes;
+    fclose(f);
+    check = c.check;
+    c.check = 0;
+    if (!ok || check != stream_hash(stream_hash(STREAM_HASH_SEED, &c, sizeof(c)), done, bitmapBytes)) {
+        printf("Error in: stream_batched_solve, %s is not a valid checkpoint\n", path);
+        return -1;
+    }
+    expected->outputOffset = c.outputOffset;
+    expected->outputBytes = c.outputBytes;
+    *completed = (long long)c.completed;
+    return 0;
+}
+
+// Syncs X, then replaces the checkpoint with the chunks of done. 0, or -1
+// with a message.
+static int stream_checkpoint_save(const char* path, const stream_checkpoint* header, const unsigned char* done,
+                                  long long completed, int fdX)
+{
+    const size_t bitmapBytes = (size_t)(header->chunks + 7) / 8;
+    stream_checkpoint c = *header;
+    char tmp[1024];
+    int fd, ok;
+
+    if (fdatasync(fdX) != 0) {
+        printf("Error in: stream_batched_solve, cannot sync the output for the checkpoint\n");
+        return -1;
+    }
+    c.completed = (uint64_t)completed;
+    c.check = 0;
+    c.check = stream_hash(stream_hash(STREAM_HASH_SEED, &c, sizeof(c)), done, bitmapBytes);
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ok = fd >= 0 && write(fd, &c, sizeof(c)) == (ssize_t)sizeof(c)
+      && write(fd, done, bitmapBytes) == (ssize_t)bitmapBytes && fdatasync(fd) == 0;
+    if (fd >= 0) {
+        ok = close(fd) == 0 && ok;
+    }
+    if (!ok || rename(tmp, path) != 0) {
+        printf("Error in: stream_batched_solve, cannot write the checkpoint %s\n", path);
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// A transfer of a buffer is done: the buffer is ready when its reads are,
+// free when its writes are, and its chunk is then set in done (if not
+// NULL). 0, or -1 with a message on a failed transfer.
+static int stream_complete(stream_buffer* buffer, uint64_t tag, long long result, stream_stats* st,
+                           unsigned char* done, long long* completed)
+{
+    stream_buffer* buf = &buffer[tag / STREAM_TAG_KINDS];
+    const int kind = (int)(tag % STREAM_TAG_KINDS);
+
+    if (result < (long long)buf->expected[kind]) {
+        printf("Error in: stream_batched_solve, %s of chunk %lld: %s\n",
+               buf->state == STREAM_READING ? "read" : "write", buf->chunk,
+               result < 0 ? strerror((int)-result) : "end of file");
+        return -1;
+    }
+    if (buf->state == STREAM_READING) {
+        st->bytesRead += result;
+    }
+    else {
+        st->bytesWritten += result;
+    }
+    if (--buf->pending == 0) {
+        if (buf->state == STREAM_READING) {
+            buf->state = STREAM_READY;
+        }
+        else {
+            buf->state = STREAM_FREE;
+            if (done != NULL) {
+                done[buf->chunk >> 3] |= (unsigned char)(1 << (buf->chunk & 7));
+            }
+            (*completed)++;
+        }
+    }
+    return 0;
+}
+
+// Offset of the data of an array opened by npy_batched_open.
+static uint64_t stream_data_offset(const npy_array* a)
+{
+    return (uint64_t)(a->data - (char*)a->map);
+}
+
+int stream_batched_solve(const char* pathA, const char* pathB, const char* pathX, const stream_config* cfg,
+                         stream_stats* stats)
+{
+    const int inPlace = pathX == NULL || npy_batched_same_file(pathX, pathB);
+    char workX[1024] = "";              // X until it is complete, then renamed to pathX
+    npy_array A, B, X;
+    aio_file file[3];
+    aio_queue* q = NULL;
+    stream_buffer* buffer = NULL;
+    int* info = NULL;
+    stream_solver solver;
+    stream_stats st;
+    uint64_t dataOffset[3];
+    size_t systemBytes[3], base[3], bufferBytes = 0;
+    long long batch = 0, chunks, next = 0, completed = 0, saved, issued = 0, limit;
+    stream_checkpoint checkpoint;
+    unsigned char* done = NULL;         // chunks written, with a checkpoint
+    int n = 0, rowMajor = 0, chunkSystems, resume = 0;
+    int resCode = -1;
+
+    memset(&A, 0, sizeof(A));
+    memset(&B, 0, sizeof(B));
+    memset(&X, 0, sizeof(X));
+    A.fd = B.fd = X.fd = -1;
+    memset(&st, 0, sizeof(st));
+    memset(&checkpoint, 0, sizeof(checkpoint));
+    for (int k = 0; k < 3; k++) {
+        file[k].fd = file[k].direct = -1;
+    }
+
+    // Shapes, data offsets and the output file, from the headers. The
+    // output must not be A: it would be truncated, or written while read.
+    if ((pathX != NULL && npy_batched_same_file(pathX, pathA)) || (inPlace && npy_batched_same_file(pathB, pathA))) {
+        printf("Error in: stream_batched_solve, the output %s is the matrix file %s\n", inPlace ? pathB : pathX, pathA);
+        goto cleanup;
+    }
+    if (npy_batched_open(pathA, 0, &A) != 0 || npy_batched_open(pathB, 0, &B) != 0) {
+        goto cleanup;
+    }
+    if (npy_batched_shape(&A, &B, &n, &batch, &rowMajor) != 0) {
+        goto cleanup;
+    }
+    if (rowMajor && cfg->backend != STREAM_BACKEND_CPU) {
+        printf("Error in: stream_batched_solve, row-major (C order) %s needs the CPU backend\n", pathA);
+        goto cleanup;
+    }
+    if (cfg->checkpoint != NULL && inPlace) {
+        printf("Error in: stream_batched_solve, a checkpoint needs an output file other than B\n");
+        goto cleanup;
+    }
+    dataOffset[STREAM_REGION_A] = stream_data_offset(&A);
+    dataOffset[STREAM_REGION_B] = stream_data_offset(&B);
+
+    systemBytes[STREAM_REGION_A] = (size_t)n * n * sizeof(float);
+    systemBytes[STREAM_REGION_B] = systemBytes[STREAM_REGION_X] = (size_t)n * sizeof(float);
+    {
+        // Each region needs a page more than its systems, for its offset in the page.
+        const size_t perSystem = systemBytes[0] + systemBytes[1] + systemBytes[2];
+        const size_t room = cfg->chunkBytes > 3 * AIO_ALIGN ? cfg->chunkBytes - 3 * AIO_ALIGN : 0;
+        long long c = (long long)(room / perSystem);
+        if (c < 1) {
+            c = 1;
+        }
+        if (c > batch) {
+            c = batch > 0 ? batch : 1;
+        }
+        // one transfer per region, which reads whole pages from the page
+        // before the systems: at most AIO_ALIGN - 1 bytes more on each side
+        if (c > (long long)((AIO_MAX_REQUEST - AIO_ALIGN) / systemBytes[STREAM_REGION_A])) {
+            c = (long long)((AIO_MAX_REQUEST - AIO_ALIGN) / systemBytes[STREAM_REGION_A]);
+        }
+        chunkSystems = (int)c;
+    }
+    chunks = (batch + chunkSystems - 1) / chunkSystems;
+    limit = cfg->maxChunks > 0 ? cfg->maxChunks : chunks;
+
+    // Resume from the checkpoint if there is one, into the X it was written for.
+    if (cfg->checkpoint != NULL) {
+        memcpy(checkpoint.magic, STREAM_CHECKPOINT_MAGIC, sizeof(checkpoint.magic));
+        checkpoint.version = STREAM_CHECKPOINT_VERSION;
+        checkpoint.chunkSystems = (uint32_t)chunkSystems;
+        checkpoint.config = stream_config_hash(&A, &B, n, batch, rowMajor, chunkSystems);
+        checkpoint.chunks = (uint64_t)chunks;
+        done = (unsigned char*)calloc((size_t)(chunks + 7) / 8 + 1, 1);
+        if (done == NULL) {
+            printf("Error in: stream_batched_solve, checkpoint malloc\n");
+            goto cleanup;
+        }
+        resume = stream_checkpoint_load(cfg->checkpoint, &checkpoint, done, &completed);
+        if (resume < 0) {
+            goto cleanup;
+        }
+        resume = resume == 0;
+    }
+    if (!inPlace && cfg->checkpoint != NULL) {
+        if ((size_t)snprintf(workX, sizeof(workX), "%s" STREAM_PART_SUFFIX, pathX) >= sizeof(workX)) {
+            printf("Error in: stream_batched_solve, path too long: %s\n", pathX);
+            workX[0] = '\0';
+            goto cleanup;
+        }
+    }
+    else if (!inPlace && npy_batched_temp_file(pathX, workX, sizeof(workX)) != 0) {
+        goto cleanup;
+    }
+    if (inPlace) {
+        dataOffset[STREAM_REGION_X] = dataOffset[STREAM_REGION_B];
+    }
+    else if (resume) {
+        if (npy_batched_open(workX, 0, &X) != 0) {
+            goto cleanup;
+        }
+        int same = X.dtype == NPY_FLOAT32 && X.fortran == B.fortran && X.ndim == B.ndim;
+        for (int d = 0; d < B.ndim && same; d++) {
+            same = X.shape[d] == B.shape[d];
+        }
+        if (!same || stream_data_offset(&X) != checkpoint.outputOffset || X.mapBytes != checkpoint.outputBytes) {
+            printf("Error in: stream_batched_solve, %s is not the output of checkpoint %s\n", workX,
+                   cfg->checkpoint);
+            goto cleanup;
+        }
+        dataOffset[STREAM_REGION_X] = checkpoint.outputOffset;
+    }
+    else {
+        if (npy_batched_create(workX, NPY_FLOAT32, B.fortran, B.ndim, B.shape, &X) != 0) {
+            goto cleanup;
+        }
+        dataOffset[STREAM_REGION_X] = stream_data_offset(&X);
+        checkpoint.outputOffset = dataOffset[STREAM_REGION_X];
+        checkpoint.outputBytes = X.mapBytes;
+    }
+    npy_batched_close(&X);
+    npy_batched_close(&B);
+    npy_batched_close(&A);
+
+    for (int k = 0; k < 3; k++) {
+        base[k] = bufferBytes;
+        bufferBytes += stream_align((size_t)chunkSystems * systemBytes[k]) + AIO_ALIGN;
+    }
+    solver = rowMajor ? cpuLinearSolverBatchedRowMajor
+           : cfg->backend == STREAM_BACKEND_GPU ? gpuLinearSolverBatched : cpuLinearSolverBatched;
+
+    if (aio_batched_open_file(pathA, 0, &file[STREAM_REGION_A]) != 0
+        || aio_batched_open_file(pathB, inPlace, &file[STREAM_REGION_B]) != 0
+        || (!inPlace && aio_batched_open_file(workX, 1, &file[STREAM_REGION_X]) != 0)) {
+        goto cleanup;
+    }
+    if (aio_batched_create(cfg->buffers, bufferBytes, cfg->buffers * STREAM_TAG_KINDS, &q) != 0) {
+        goto cleanup;
+    }
+    buffer = (stream_buffer*)calloc(cfg->buffers, sizeof(stream_buffer));
+    info = (int*)malloc((size_t)chunkSystems * sizeof(int));
+    if (buffer == NULL || info == NULL) {
+        printf("Error in: stream_batched_solve, buffer malloc\n");
+        goto cleanup;
+    }
+    st.chunkSystems = chunkSystems;
+    st.memoryBytes = bufferBytes * cfg->buffers;
+    st.io = aio_batched_backend(q);
+    st.resumedChunks = completed;
+    saved = completed;
+
+    {
+        const aio_file* fileX = inPlace ? &file[STREAM_REGION_B] : &file[STREAM_REGION_X];
+        const double t0 = magma_wtime();
+        double lastCheckpoint = t0;
+        resCode = 0;
+        // with a limit, until the chunks solved are written
+        while (resCode == 0 && completed < chunks && (st.chunks < limit || aio_batched_pending(q) > 0)) {
+            uint64_t tag;
+            long long result;
+            int ready = -1;
+
+            // Every free buffer reads the next chunk not done yet.
+            for (int b = 0; b < cfg->buffers && resCode == 0; b++) {
+                stream_buffer* buf = &buffer[b];
+                while (done != NULL && next < chunks && stream_bit(done, next)) {
+                    next++;
+                }
+                if (buf->state != STREAM_FREE || next == chunks || issued == limit) {
+                    continue;
+                }
+                buf->chunk = next++;
+                issued++;
+                buf->count = (int)(batch - buf->chunk * chunkSystems < chunkSystems ? batch - buf->chunk * chunkSystems
+                                                                                      : chunkSystems);
+                buf->state = STREAM_READING;
+                for (int k = 0; k < 3 && resCode == 0; k++) {
+                    const uint64_t offset = dataOffset[k] + (uint64_t)buf->chunk * chunkSystems * systemBytes[k];
+                    const size_t phase = offset % AIO_ALIGN;
+                    const size_t bytes = (size_t)buf->count * systemBytes[k];
+                    buf->position[k] = base[k] + phase;
+                    if (k != STREAM_REGION_X) {
+                        buf->expected[k] = phase + bytes;
+                        resCode = aio_batched_read(q, &file[k], b, base[k], offset - phase, stream_align(phase + bytes),
+                                                   (uint64_t)b * STREAM_TAG_KINDS + k);
+                        buf->pending++;
+                    }
+                }
+            }
+
+            // Completions that are there, then the first chunk that is ready;
+            // with none, wait for the disk.
+            while (resCode == 0 && aio_batched_poll(q, &tag, &result) == 0) {
+                resCode = stream_complete(buffer, tag, result, &st, done, &completed);
+            }
+            for (int b = 0; b < cfg->buffers; b++) {
+                if (buffer[b].state == STREAM_READY && (ready < 0 || buffer[b].chunk < buffer[ready].chunk)) {
+                    ready = b;
+                }
+            }
+            if (resCode != 0) {
+                break;
+            }
+            if (done != NULL && completed > saved && magma_wtime() - lastCheckpoint >= cfg->checkpointSeconds) {
+                resCode = stream_checkpoint_save(cfg->checkpoint, &checkpoint, done, completed, fileX->fd);
+                if (resCode != 0) {
+                    break;
+                }
+                lastCheckpoint = magma_wtime();
+                saved = completed;
+                st.checkpoints++;
+            }
+            if (ready < 0 && aio_batched_pending(q) == 0) {
+                continue;       // the completions freed buffers: refill them
+            }
+            if (ready < 0) {
+                const double tw = magma_wtime();
+                if (aio_batched_wait(q, &tag, &result) != 0) {
+                    resCode = -1;
+                    break;
+                }
+                st.waitSeconds += magma_wtime() - tw;
+                resCode = stream_complete(buffer, tag, result, &st, done, &completed);
+                continue;
+            }
+
+            // Solve, and write X back: the whole pages through O_DIRECT, the
+            // partial first and last pages through the page cache.
+            {
+                const int b = ready;
+                stream_buffer* buf = &buffer[b];
+                char* data = (char*)aio_batched_buffer(q, b);
+                float* h_X = (float*)(data + buf->position[STREAM_REGION_X]);
+                const double ts = magma_wtime();
+                int singular = 0;
+                // cleared, so that a GPU error (a positive code too) leaves no info > 0
+                memset(info, 0, (size_t)buf->count * sizeof(int));
+                const int solved = solver(n, (float*)(data + buf->position[STREAM_REGION_A]),
+                                          (float*)(data + buf->position[STREAM_REGION_B]), &h_X, info, buf->count);
+                st.solveSeconds += magma_wtime() - ts;
+                for (int s = 0; s < buf->count; s++) {
+                    singular += info[s] > 0;
+                }
+                // nothing of this chunk is written nor marked done
+                if (solved < 0 || (solved > 0 && singular == 0)) {
+                    printf("Error in: stream_batched_solve, solver failed for chunk %lld\n", buf->chunk);
+                    resCode = -1;
+                    break;
+                }
+                st.singular += singular;
+                st.systems += buf->count;
+                st.chunks++;
+
+                const uint64_t first = dataOffset[STREAM_REGION_X]
+                                     + (uint64_t)buf->chunk * chunkSystems * systemBytes[STREAM_REGION_X];
+                const uint64_t last = first + (uint64_t)buf->count * systemBytes[STREAM_REGION_X];
+                uint64_t cut[4];
+                cut[0] = first;
+                cut[1] = stream_align(first) < last ? stream_align(first) : last;
+                cut[2] = last / AIO_ALIGN * AIO_ALIGN > cut[1] ? last / AIO_ALIGN * AIO_ALIGN : cut[1];
+                cut[3] = last;
+                buf->state = STREAM_WRITING;
+                for (int k = 0; k < 3 && resCode == 0; k++) {
+                    if (cut[k + 1] == cut[k]) {
+                        continue;
+                    }
+                    buf->expected[STREAM_REGION_X + k] = cut[k + 1] - cut[k];
+                    resCode = aio_batched_write(q, fileX, b, buf->position[STREAM_REGION_X] + (cut[k] - first),
+                                                cut[k], cut[k + 1] - cut[k],
+                                                (uint64_t)b * STREAM_TAG_KINDS + STREAM_REGION_X + k);
+                    buf->pending++;
+                }
+            }
+        }
+        st.seconds = magma_wtime() - t0;
+
+        // Stopped by the limit: the checkpoint of what was done, for the next run.
+        if (resCode == 0 && completed < chunks) {
+            resCode = done != NULL ? stream_checkpoint_save(cfg->checkpoint, &checkpoint, done, completed, fileX->fd) : 0;
+            if (resCode == 0) {
+                st.checkpoints += done != NULL;
+                resCode = 1;
+            }
+        }
+
+        // Done: X on the disk and renamed, then the checkpoint is of no more use.
+        if (resCode == 0 && done != NULL) {
+            if (fdatasync(fileX->fd) != 0) {
+                printf("Error in: stream_batched_solve, cannot sync %s\n", workX);
+                resCode = -1;
+            }
+        }
+    }
+
+cleanup:
+    aio_batched_destroy(q);
+    for (int k = 0; k < 3; k++) {
+        aio_batched_close_file(&file[k]);
+    }
+    if (workX[0] != '\0') {
+        if (resCode == 0 && rename(workX, pathX) != 0) {
+            printf("Error in: stream_batched_solve, cannot rename %s to %s\n", workX, pathX);
+            resCode = -1;
+        }
+        if (resCode == 0 && done != NULL) {
+            remove(cfg->checkpoint);
+        }
+        // kept for the resume when a checkpoint refers to it
+        if (resCode != 0 && (done == NULL || (!resume && st.checkpoints == 0))) {
+            unlink(workX);
+        }
+    }
+    free(done);
+    free(info);
+    free(buffer);
+    npy_batched_close(&X);
+    npy_batched_close(&B);
+    npy_batched_close(&A);
+    if (stats != NULL) {
+        *stats = st;
+    }
+    return resCode;
+}
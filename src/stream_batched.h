@@ -0,0 +1,76 @@
+#ifndef STREAM_BATCHED_H
+#define STREAM_BATCHED_H
+
+#include <stddef.h>
+
+/*
+    Out-of-core solve of batches larger than memory, streamed between .npy
+    files and a fixed set of chunk buffers, see stream_batched.cpp.
+*/
+
+#define STREAM_BACKEND_CPU  0   // cpuLinearSolverBatched
+#define STREAM_BACKEND_GPU  1   // gpuLinearSolverBatched
+
+#define STREAM_DEFAULT_CHUNK_MB  64
+#define STREAM_DEFAULT_BUFFERS   4
+#define STREAM_DEFAULT_CHECKPOINT_SECONDS  60
+
+struct stream_config
+{
+    int backend;            // STREAM_BACKEND_*
+    size_t chunkBytes;      // per buffer: A, B and X of the systems of a chunk
+    int buffers;            // chunks in memory (reading, solving or writing)
+    const char* checkpoint; // progress file, NULL for none; a solve resumes from it
+    double checkpointSeconds;   // between two writes of the checkpoint
+    long long maxChunks;        // chunks solved before stopping, 0 for all
+};
+
+struct stream_stats
+{
+    long long systems;
+    long long singular;
+    long long chunks;
+    long long resumedChunks;    // done before, skipped after reading the checkpoint
+    int checkpoints;            // written
+    int chunkSystems;           // systems per chunk, the last one may have fewer
+    size_t memoryBytes;         // of the buffers, the memory of the solve
+    unsigned long long bytesRead;
+    unsigned long long bytesWritten;
+    double seconds;
+    double solveSeconds;        // in the solver
+    double waitSeconds;         // waiting for the disk, with nothing to solve
+    const char* io;             // "io_uring" or "threads"
+};
+
+// STREAM_BACKEND_CPU, STREAM_DEFAULT_CHUNK_MB, STREAM_DEFAULT_BUFFERS, no
+// checkpoint, STREAM_DEFAULT_CHECKPOINT_SECONDS, and no chunk limit.
+void stream_batched_defaults(stream_config* cfg);
+
+/***************************************************************************//**
+    Solves the batch of pathA and pathB, in the layouts npy_batched_solve
+    takes, into pathX (same shape and order as B), or over B when pathX is
+    NULL or pathB, using cfg->buffers buffers of cfg->chunkBytes whatever
+    the size of the files. Row-major (C order) A needs the CPU backend.
+    As in npy_batched_solve, X is compared with the inputs as files: X being
+    B is the in-place solve, X being A is rejected, and a new X is renamed
+    to pathX once complete.
+
+    With cfg->checkpoint, the chunks whose X is on the disk are recorded in
+    that file every cfg->checkpointSeconds, and when it exists at the start
+    the solve resumes: those chunks are not solved again. It is removed when
+    the solve completes. A checkpoint is only used with the inputs, the
+    output and the chunk size it was written for, and needs pathX (a chunk
+    interrupted in place would have lost its B); X is then written to
+    "<pathX>.part" until it is complete.
+
+    With cfg->maxChunks, the solve stops once it has solved that many chunks
+    and their X is written, after a checkpoint: a job given less time than
+    the whole batch needs does its part, and the next one resumes.
+
+    Returns 0, 1 if cfg->maxChunks stopped it before the end, or -1 on an
+    error. stats, if not NULL, is filled in.
+ *******************************************************************************/
+int stream_batched_solve(const char* pathA, const char* pathB, const char* pathX, const stream_config* cfg,
+                         stream_stats* stats);
+
+#endif //STREAM_BATCHED_H
@@ -9,8 +9,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <float.h>
+#include <math.h>
 #include <cuda_runtime.h>
-#include <curand.h>
 #include <cublas_v2.h>
 #include <lapacke.h>
 #include <sys/time.h>
@@ -18,6 +19,8 @@
 #include "operation_batched.h"
 #include "testings.h"
 #include "flops.h"
+#include "random_batched.h"
+#include "smallsq_dispatch.h"
 #include "cuda_profiler_api.h"
 
 // If MANUAL_TEST is defined, the porgram will perform a single test with command line parameters
@@ -32,6 +35,21 @@
 // automatic tester as there CPU performance is always tested.
 //#define LAPACK_PERFORMANCE
 
+// Defining DISABLE_CPU_ENGINE_TEST will avoid performing the cpuLinearSolverBatched solve when using manual mode.
+//#define DISABLE_CPU_ENGINE_TEST
+
+// Seed of the random matrices: for a given seed the batches are the same whatever the number of threads.
+#define TESTING_SEED 1ULL
+
+// Largest accepted scaled residual ||b - A*x|| / (N * ||A|| * ||x|| * eps) of the CPU engine check.
+#define TESTING_RESIDUAL_TOL 30.0
+
+// Largest accepted difference between the fused (generated) and the regular GPU solutions, relative to max |x|.
+#define TESTING_FUSED_TOL 1e-4
+
+// Batch count of the fused solver checks of the automatic tester.
+#define TESTING_FUSED_BATCH 10000
+
 // Defining BATCHED_DISABLE_PARCPU will disable OMP multithreading directives and block the use of multiple threads for CPU test.
 //#define BATCHED_DISABLE_PARCPU
 #if defined(_OPENMP)
@@ -40,6 +58,16 @@
 
 int gpuLinearSolverBatched_tester(int N, int batchCount, int numThreads);
 int gpuCSVTester();
+int gpuFusedTester();
+int gpuGeneratedCheck(int N, int batchCount);
+int gpuConsumedCheck(int N, int batchCount);
+double cpuEngineResidual(int N, const float *h_A, const float *h_B, const float *h_X, const int *h_info, int batchCount);
+
+//testing_sgesv_fused_batched.cu
+void sgesv_batched_hash_materialize(int n, unsigned int seed, float *h_A, float *h_B, int batchCount);
+int gpuLinearSolverBatchedHash(int n, unsigned int seed, float **h_Xptr, int *h_info, int batchCount);
+int gpuLinearSolverBatchedCounted(int n, float *h_A, float *h_B, float *h_X, int *h_info, int *h_count, int batchCount);
+int gpuLinearSolverBatchedHashCounted(int n, unsigned int seed, float *h_X, int *h_info, int *h_count, int batchCount);
 
 #ifdef MANUAL_TEST
 int main(int argc, char **argv)
@@ -76,10 +104,12 @@ int main(int argc, char **argv)
     // during the first test execution.
     cublasCreate(&handle);
 
-    //Tester
-    gpuCSVTester();
+    //Tester, failing when the CPU engine missed the residual check
+    //or a fused solver disagrees with the regular one
+    const int failures = gpuCSVTester() + gpuFusedTester();
 
     cublasDestroy(handle);
+    return failures > 0 ? 1 : 0;
 }
 #endif
 
@@ -105,10 +135,12 @@ int gpuCSVTester()
     int N, batchCount, memByte;
     double memMB;
     double cpuTime[5];
+    double residual;
+    int residualFailures = 0;
     FILE *fp;
 
-    curandGenerator_t hostRandGenerator;
-    curandCreateGeneratorHost(&hostRandGenerator, CURAND_RNG_PSEUDO_DEFAULT);
+    // position in the random stream, every test gets new matrices
+    unsigned long long randOffset = 0;
 
     fp = fopen("results.csv", "w+");
     fprintf(fp, "#N, #batchCount, #result, #GPUtimeInMs, #CPUtime1InMs, #CPUtime4InMs, #CPUtime8InMs, #CPUtime16InMs, #memMB, #memByte\n");
@@ -176,8 +208,10 @@ int gpuCSVTester()
             TESTING_CHECK(magma_imalloc_cpu(&h_info, batchCount));
 
             // Initialize the matrices
-            curandGenerateNormal(hostRandGenerator, h_A, sizeA, (float)0, (float)1);
-            curandGenerateNormal(hostRandGenerator, h_B, sizeB, (float)0, (float)1);
+            random_batched_normal(h_A, sizeA, TESTING_SEED, randOffset);
+            randOffset += sizeA;
+            random_batched_normal(h_B, sizeB, TESTING_SEED, randOffset);
+            randOffset += sizeB;
 
             //Perform test on GPU
             gettimeofday(&t1, 0);
@@ -185,6 +219,16 @@ int gpuCSVTester()
             gettimeofday(&t2, 0);
             double gpuTime = (1000000.0 * (t2.tv_sec - t1.tv_sec) + t2.tv_usec - t1.tv_usec) / 1000.0;
 
+            //Check the CPU engine, before sgesv_ overwrites A and B
+            cpuLinearSolverBatched(N, h_A, h_B, &h_X, h_info, batchCount);
+            residual = cpuEngineResidual(N, h_A, h_B, h_X, h_info, batchCount);
+            if (!(residual < TESTING_RESIDUAL_TOL))
+            {
+                printf("CPU engine residual check failed: N=%d, batchCount=%d, scaled residual %e\n",
+                       N, batchCount, residual);
+                residualFailures++;
+            }
+
             //Perform test on CPU
             int nrhs = 1;
             int lda = N;
@@ -251,6 +295,184 @@ int gpuCSVTester()
     }
 
     fclose(fp);
+    printf("CPU engine residual check: %d failures\n", residualFailures);
+    return residualFailures;
+}
+
+// Largest difference between the solutions h_X and h_Xfused, relative to max |h_X|.
+static double fusedDifference(const float *h_X, const float *h_Xfused, int size)
+{
+    double diff = 0.0, normX = 0.0;
+    for (int i = 0; i < size; i++)
+    {
+        diff = fmax(diff, fabs((double)h_X[i] - h_Xfused[i]));
+        normX = fmax(normX, fabs(h_X[i]));
+    }
+    return normX > 0.0 ? diff / normX : diff;
+}
+
+// Fused solvers of linearSolverFusedSLU_batched.cuh against gpuLinearSolverBatched,
+// for every instantiated size. Returns the number of failed checks.
+int gpuFusedTester()
+{
+    int failures = 0;
+
+    for (int N = 1; N <= 32; N++)
+    {
+        if (smallsq_size_instantiated(N))
+        {
+            failures += gpuGeneratedCheck(N, TESTING_FUSED_BATCH);
+            failures += gpuConsumedCheck(N, TESTING_FUSED_BATCH);
+        }
+    }
+    printf("Fused solver checks: %d failures\n", failures);
+    return failures;
+}
+
+// Solves the systems of sgesv_batched_hash_generator with gpuLinearSolverBatchedGenerated
+// and, materialized in h_A and h_B, with gpuLinearSolverBatched. Returns 1 if a solve
+// fails or the solutions differ by more than TESTING_FUSED_TOL, 0 otherwise.
+int gpuGeneratedCheck(int N, int batchCount)
+{
+    float *h_A, *h_B, *h_X, *h_Xgen;
+    int *h_info, *h_infoGen;
+    int resultRef, resultGen, failed;
+    double diff;
+
+    TESTING_CHECK(magma_smalloc_cpu(&h_A, N * N * batchCount));
+    TESTING_CHECK(magma_smalloc_cpu(&h_B, N * batchCount));
+    TESTING_CHECK(magma_smalloc_cpu(&h_X, N * batchCount));
+    TESTING_CHECK(magma_smalloc_cpu(&h_Xgen, N * batchCount));
+    TESTING_CHECK(magma_imalloc_cpu(&h_info, batchCount));
+    TESTING_CHECK(magma_imalloc_cpu(&h_infoGen, batchCount));
+
+    sgesv_batched_hash_materialize(N, (unsigned int)TESTING_SEED, h_A, h_B, batchCount);
+    resultRef = gpuLinearSolverBatched(N, h_A, h_B, &h_X, h_info, batchCount);
+    resultGen = gpuLinearSolverBatchedHash(N, (unsigned int)TESTING_SEED, &h_Xgen, h_infoGen, batchCount);
+
+    diff = fusedDifference(h_X, h_Xgen, N * batchCount);
+    failed = resultRef != 0 || resultGen != 0 || !(diff <= TESTING_FUSED_TOL);
+    if (failed)
+    {
+        printf("Generated solve check failed: N=%d, batchCount=%d, exit codes %d %d, difference %e\n",
+               N, batchCount, resultRef, resultGen, diff);
+    }
+
+    magma_free_cpu(h_A);
+    magma_free_cpu(h_B);
+    magma_free_cpu(h_X);
+    magma_free_cpu(h_Xgen);
+    magma_free_cpu(h_info);
+    magma_free_cpu(h_infoGen);
+    return failed;
+}
+
+// Solves the systems of sgesv_batched_hash_generator with gpuLinearSolverBatchedConsumed
+// (materialized) and gpuLinearSolverBatchedGeneratedConsumed, with a consumer counting its
+// calls. Returns 1 if a solve fails, a system is not consumed exactly once, with info 0,
+// or the consumed solutions differ from gpuLinearSolverBatched's by more than
+// TESTING_FUSED_TOL, 0 otherwise.
+int gpuConsumedCheck(int N, int batchCount)
+{
+    float *h_A, *h_B, *h_X, *h_Xcons;
+    int *h_info, *h_infoCons, *h_count;
+    int resultRef, failed = 0;
+
+    TESTING_CHECK(magma_smalloc_cpu(&h_A, N * N * batchCount));
+    TESTING_CHECK(magma_smalloc_cpu(&h_B, N * batchCount));
+    TESTING_CHECK(magma_smalloc_cpu(&h_X, N * batchCount));
+    TESTING_CHECK(magma_smalloc_cpu(&h_Xcons, N * batchCount));
+    TESTING_CHECK(magma_imalloc_cpu(&h_info, batchCount));
+    TESTING_CHECK(magma_imalloc_cpu(&h_infoCons, batchCount));
+    TESTING_CHECK(magma_imalloc_cpu(&h_count, batchCount));
+
+    sgesv_batched_hash_materialize(N, (unsigned int)TESTING_SEED, h_A, h_B, batchCount);
+    resultRef = gpuLinearSolverBatched(N, h_A, h_B, &h_X, h_info, batchCount);
+
+    for (int generated = 0; generated <= 1 && resultRef == 0; generated++)
+    {
+        const char *name = generated ? "gpuLinearSolverBatchedGeneratedConsumed" : "gpuLinearSolverBatchedConsumed";
+        int result, wrongCount = 0, wrongInfo = 0;
+        double diff;
+
+        if (generated)
+        {
+            result = gpuLinearSolverBatchedHashCounted(N, (unsigned int)TESTING_SEED, h_Xcons, h_infoCons, h_count, batchCount);
+        }
+        else
+        {
+            result = gpuLinearSolverBatchedCounted(N, h_A, h_B, h_Xcons, h_infoCons, h_count, batchCount);
+        }
+        for (int s = 0; s < batchCount && result == 0; s++)
+        {
+            wrongCount += h_count[s] != 1;
+            wrongInfo += h_infoCons[s] != 0;
+        }
+        diff = result == 0 ? fusedDifference(h_X, h_Xcons, N * batchCount) : INFINITY;
+        if (result != 0 || wrongCount > 0 || wrongInfo > 0 || !(diff <= TESTING_FUSED_TOL))
+        {
+            printf("%s check failed: N=%d, batchCount=%d, exit code %d, %d systems not consumed once, "
+                   "%d with info, difference %e\n",
+                   name, N, batchCount, result, wrongCount, wrongInfo, diff);
+            failed = 1;
+        }
+    }
+    if (resultRef != 0)
+    {
+        printf("Consumed solve check failed: N=%d, batchCount=%d, gpuLinearSolverBatched exit code %d\n",
+               N, batchCount, resultRef);
+        failed = 1;
+    }
+
+    magma_free_cpu(h_A);
+    magma_free_cpu(h_B);
+    magma_free_cpu(h_X);
+    magma_free_cpu(h_Xcons);
+    magma_free_cpu(h_info);
+    magma_free_cpu(h_infoCons);
+    magma_free_cpu(h_count);
+    return failed;
+}
+
+// Largest scaled residual ||b - A*x||_inf / (N * ||A||_inf * ||x||_inf * eps) of the
+// systems of the batch, column-major as in cpuLinearSolverBatched. Systems reported
+// singular in h_info are skipped.
+double cpuEngineResidual(int N, const float *h_A, const float *h_B, const float *h_X, const int *h_info, int batchCount)
+{
+    double worst = 0.0;
+    for (int s = 0; s < batchCount; s++)
+    {
+        const float *A = h_A + (size_t)s * N * N;
+        const float *b = h_B + (size_t)s * N;
+        const float *x = h_X + (size_t)s * N;
+        double normA = 0.0, normX = 0.0, normR = 0.0;
+
+        if (h_info[s] != 0)
+        {
+            continue;
+        }
+        for (int i = 0; i < N; i++)
+        {
+            double r = b[i], row = 0.0;
+            if (!isfinite(x[i]))
+            {
+                return INFINITY;
+            }
+            for (int j = 0; j < N; j++)
+            {
+                r -= (double)A[i + j * N] * x[j];
+                row += fabs(A[i + j * N]);
+            }
+            normR = fmax(normR, fabs(r));
+            normA = fmax(normA, row);
+            normX = fmax(normX, fabs(x[i]));
+        }
+        if (normA * normX > 0.0)
+        {
+            worst = fmax(worst, normR / (N * normA * normX * FLT_EPSILON));
+        }
+    }
+    return worst;
 }
 
 // Manual tester
@@ -271,12 +493,9 @@ int gpuLinearSolverBatched_tester(int N, int batchCount, int numThreads)
     TESTING_CHECK(magma_smalloc_cpu(&h_X, sizeB));
     TESTING_CHECK(magma_imalloc_cpu(&h_info, batchCount));
 
-    curandGenerator_t hostRandGenerator;
-    curandCreateGeneratorHost(&hostRandGenerator, CURAND_RNG_PSEUDO_DEFAULT);
-
     // Initialize the matrices
-    curandGenerateNormal(hostRandGenerator, h_A, sizeA, (float)0, (float)1);
-    curandGenerateNormal(hostRandGenerator, h_B, sizeB, (float)0, (float)1);
+    random_batched_normal(h_A, sizeA, TESTING_SEED, 0);
+    random_batched_normal(h_B, sizeB, TESTING_SEED, sizeA);
 
 //Perform test on GPU
 #if !defined(DISABLE_GPU_TEST)
@@ -298,8 +517,27 @@ int gpuLinearSolverBatched_tester(int N, int batchCount, int numThreads)
     gpuTime = (1000000.0 * (t2.tv_sec - t1.tv_sec) + t2.tv_usec - t1.tv_usec) / 1000.0;
     printf("Batched Solve operation finished with exit code: %d in %f\n", result, gpuTime);
 
+    //Fused solver on generated systems, against the same systems materialized
+    printf("Generated solve check: %s\n", gpuGeneratedCheck(N, batchCount) == 0 ? "passed" : "failed");
+    printf("Consumed solve check: %s\n", gpuConsumedCheck(N, batchCount) == 0 ? "passed" : "failed");
+
 #endif //GPU_TEST
 
+    //CPU engine test, same numerics as the inline sgesv_smallsq templates
+#if !defined(DISABLE_CPU_ENGINE_TEST)
+#if !defined(BATCHED_DISABLE_PARCPU) && defined(_OPENMP)
+    omp_set_num_threads(numThreads);
+#endif
+    gettimeofday(&t1, 0);
+    result = cpuLinearSolverBatched(N, h_A, h_B, &h_X, h_info, batchCount);
+    gettimeofday(&t2, 0);
+
+    double cpuEngineTime = (1000000.0 * (t2.tv_sec - t1.tv_sec) + t2.tv_usec - t1.tv_usec) / 1000.0;
+    printf("CPU engine solve finished with exit code: %d in %f\n", result, cpuEngineTime);
+    printf("CPU engine scaled residual: %e (tolerance %.0f)\n",
+           cpuEngineResidual(N, h_A, h_B, h_X, h_info, batchCount), TESTING_RESIDUAL_TOL);
+#endif //DISABLE_CPU_ENGINE_TEST
+
     //CPU test
 #ifdef LAPACK_PERFORMANCE
     double cpu_time;
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <cuda_runtime.h>
+#include "linearSolverFusedSLU_batched.cuh"
+
+/*
+    Instantiations of the header only solvers of linearSolverFusedSLU_batched.cuh
+    for testing_sgesv_batched.cpp, which is compiled as C++ and cannot
+    instantiate device templates itself: the generated solver on
+    sgesv_batched_hash_generator, the consumed ones with a consumer counting
+    its calls per system. Not part of the library.
+*/
+
+template magma_int_t magma_sgesv_batched_smallsq_generated<sgesv_batched_hash_generator>(
+    magma_int_t n, sgesv_batched_hash_generator gen,
+    float* dX, magma_int_t lddx,
+    magma_int_t* dinfo_array,
+    magma_int_t batchCount, cudaStream_t queue);
+
+template int gpuLinearSolverBatchedGenerated<sgesv_batched_hash_generator>(
+    int n, sgesv_batched_hash_generator gen,
+    float** h_Xptr, int* h_info, int batchCount);
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Writes the systems of sgesv_batched_hash_generator(seed, n) to h_A and h_B,
+ packed in column-major order as gpuLinearSolverBatched expects them.
+ *******************************************************************************/
+void sgesv_batched_hash_materialize(int n, unsigned int seed,
+        float* h_A, float* h_B, int batchCount)
+{
+    sgesv_batched_hash_generator gen = { seed, n };
+
+    for (int s = 0; s < batchCount; s++) {
+        for (int j = 0; j < n; j++) {
+            for (int i = 0; i < n; i++) {
+                h_A[((size_t)s * n + j) * n + i] = gen.a(s, i, j);
+            }
+            h_B[(size_t)s * n + j] = gen.b(s, j);
+        }
+    }
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ gpuLinearSolverBatchedGenerated on the systems of
+ sgesv_batched_hash_generator(seed, n).
+ *******************************************************************************/
+int gpuLinearSolverBatchedHash(int n, unsigned int seed,
+        float** h_Xptr, int* h_info, int batchCount)
+{
+    sgesv_batched_hash_generator gen = { seed, n };
+
+    return gpuLinearSolverBatchedGenerated(n, gen, h_Xptr, h_info, batchCount);
+}
+
+// Consumer of the tests: stores x and info of every system and counts the
+// calls per system, to check that each one is consumed exactly once.
+struct sgesv_batched_counting_consumer
+{
+    float* dX;
+    int* dinfo;
+    int* dcount;
+    int n;
+
+    __device__ void operator()(int batchid, const float* x, int info) const
+    {
+        for (int i = 0; i < n; i++) {
+            dX[(size_t)batchid * n + i] = x[i];
+        }
+        dinfo[batchid] = info;
+        atomicAdd(&dcount[batchid], 1);
+    }
+};
+
+template int gpuLinearSolverBatchedConsumed<sgesv_batched_counting_consumer>(
+    int n, float* h_A, float* h_B,
+    sgesv_batched_counting_consumer cons, int batchCount);
+
+template int gpuLinearSolverBatchedGeneratedConsumed<sgesv_batched_hash_generator, sgesv_batched_counting_consumer>(
+    int n, sgesv_batched_hash_generator gen,
+    sgesv_batched_counting_consumer cons, int batchCount);
+
+// Solves with sgesv_batched_counting_consumer: h_A and h_B through
+// gpuLinearSolverBatchedConsumed or, if h_A is NULL, the systems of
+// sgesv_batched_hash_generator(seed, n) through
+// gpuLinearSolverBatchedGeneratedConsumed. Copies back what was consumed.
+static int sgesv_batched_counted(int n, float* h_A, float* h_B, unsigned int seed,
+        float* h_X, int* h_info, int* h_count, int batchCount)
+{
+    sgesv_batched_counting_consumer cons = { NULL, NULL, NULL, n };
+    sgesv_batched_hash_generator gen = { seed, n };
+    magma_int_t resCode = 0;
+
+    magma_init();
+
+    resCode = magma_smalloc( &cons.dX, (size_t)n*batchCount);
+    if (resCode != 0) {printf("Error in: dX malloc\n"); goto cleanup;}
+    resCode = magma_malloc( (void**)&cons.dinfo, sizeof(int)*batchCount);
+    if (resCode != 0) {printf("Error in: dinfo malloc\n"); goto cleanup;}
+    resCode = magma_malloc( (void**)&cons.dcount, sizeof(int)*batchCount);
+    if (resCode != 0) {printf("Error in: dcount malloc\n"); goto cleanup;}
+    resCode = cudaMemset(cons.dcount, 0, sizeof(int)*batchCount);
+    if (resCode != 0) {printf("Error in: dcount memset\n"); goto cleanup;}
+
+    if (h_A != NULL) {
+        resCode = gpuLinearSolverBatchedConsumed(n, h_A, h_B, cons, batchCount);
+    }
+    else {
+        resCode = gpuLinearSolverBatchedGeneratedConsumed(n, gen, cons, batchCount);
+    }
+    if (resCode != 0) {goto cleanup;}
+
+    resCode = cudaMemcpy(h_X, cons.dX, sizeof(float)*n*batchCount, cudaMemcpyDeviceToHost);
+    if (resCode != 0) {printf("Error in: X copy\n"); goto cleanup;}
+    resCode = cudaMemcpy(h_info, cons.dinfo, sizeof(int)*batchCount, cudaMemcpyDeviceToHost);
+    if (resCode != 0) {printf("Error in: info copy\n"); goto cleanup;}
+    resCode = cudaMemcpy(h_count, cons.dcount, sizeof(int)*batchCount, cudaMemcpyDeviceToHost);
+    if (resCode != 0) {printf("Error in: count copy\n"); goto cleanup;}
+
+cleanup:
+    magma_free( cons.dX );
+    magma_free( cons.dinfo );
+    magma_free( cons.dcount );
+
+    magma_finalize();
+
+    return resCode;
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ gpuLinearSolverBatchedConsumed on h_A and h_B with a consumer that stores
+ the solutions in h_X, the infos in h_info and in h_count the number of
+ times each system was consumed.
+ *******************************************************************************/
+int gpuLinearSolverBatchedCounted(int n, float* h_A, float* h_B,
+        float* h_X, int* h_info, int* h_count, int batchCount)
+{
+    return sgesv_batched_counted(n, h_A, h_B, 0, h_X, h_info, h_count, batchCount);
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Same as gpuLinearSolverBatchedCounted, through
+ gpuLinearSolverBatchedGeneratedConsumed on the systems of
+ sgesv_batched_hash_generator(seed, n).
+ *******************************************************************************/
+int gpuLinearSolverBatchedHashCounted(int n, unsigned int seed,
+        float* h_X, int* h_info, int* h_count, int batchCount)
+{
+    return sgesv_batched_counted(n, NULL, NULL, seed, h_X, h_info, h_count, batchCount);
+}
@@ -3,6 +3,8 @@
 #include "magma_types.h"
 #include <cuda_runtime.h>
 #include "device_launch_parameters.h"
+#include "tunedTables_batched.h"
+#include "smallsq_dispatch.h"
 
 /*
     -- MAGMA (version 2.5.1) --
@@ -42,15 +44,38 @@ const magma_int_t dgetrf_batched_ntcol_700[] = {7, 4, 2, 2, 1, 1, 1, 2, 1, 1, 1,
 const magma_int_t cgetrf_batched_ntcol_700[] = {NTCOL_1D_DEFAULT};
 const magma_int_t zgetrf_batched_ntcol_700[] = {NTCOL_1D_DEFAULT};
 
+// Set by magma_set_sgetrf_batched_ntcol, 0 to use the tables.
+static magma_int_t sgetrf_batched_ntcol_override = 0;
+
+/// Forces the ntcol of every smallsq kernel launch, 0 restores the tables.
+/// Meant for tuning (tools/tuneTables.cpp), not thread safe.
+void magma_set_sgetrf_batched_ntcol(magma_int_t ntcol)
+{
+    sgetrf_batched_ntcol_override = ntcol;
+}
+
+// The tuned table is only used on the GPU it was measured on: same compute
+// capability and, if recorded, same name, since the GPUs of one architecture
+// differ in multiprocessors and clocks.
+static bool sgetrf_batched_ntcol_tuned(magma_int_t arch)
+{
+    return TUNED_SGETRF_NTCOL_ARCH != 0 && arch == TUNED_SGETRF_NTCOL_ARCH
+        && (TUNED_SGETRF_NTCOL_GPU[0] == '\0'
+            || strcmp(magma_getdevice_name(), TUNED_SGETRF_NTCOL_GPU) == 0);
+}
+
 /// @see magma_get_zgetrf_batched_ntcol
 magma_int_t magma_get_sgetrf_batched_ntcol(magma_int_t m, magma_int_t n)
 {
     magma_int_t* ntcol_array; 
 
     if(m != n || m < 0 || m > 32) return 1;
+    if(sgetrf_batched_ntcol_override > 0) return sgetrf_batched_ntcol_override;
     
     magma_int_t arch = magma_getdevice_arch();
-    if      (arch <= 300) ntcol_array = (magma_int_t*)sgetrf_batched_ntcol_300; 
+    if      (sgetrf_batched_ntcol_tuned(arch))
+                          ntcol_array = (magma_int_t*)tuned_sgetrf_batched_ntcol;
+    else if (arch <= 300) ntcol_array = (magma_int_t*)sgetrf_batched_ntcol_300; 
     else if (arch <= 600) ntcol_array = (magma_int_t*)sgetrf_batched_ntcol_600;
     else if (arch <= 700) ntcol_array = (magma_int_t*)sgetrf_batched_ntcol_700;
     else                  ntcol_array = (magma_int_t*)ntcol_1d_default; 
@@ -58,6 +83,18 @@ magma_int_t magma_get_sgetrf_batched_ntcol(magma_int_t m, magma_int_t n)
     return ntcol_array[m-1];
 }
 
+// Launchers of the smallsq getrf kernels, one per variant and size, see
+// smallsq_dispatch.h; the table is built at the end of this file.
+#define SGETRF_SMALLSQ_NOSHFL  0
+#define SGETRF_SMALLSQ_SHFL    1
+#define SGETRF_SMALLSQ_NVARIANTS 2
+
+typedef void (*sgetrf_smallsq_launch_fn)( dim3 grid, dim3 threads, magma_int_t shmem, cudaStream_t queue,
+                                float** dA_array, int ldda,
+                                magma_int_t** ipiv_array, magma_int_t *info_array, int batchCount);
+
+static sgetrf_smallsq_launch_fn sgetrf_smallsq_get_launch(int variant, magma_int_t m);
+
 // This kernel uses registers for matrix storage, shared mem. for communication.
 // It also uses lazy swap.
 extern __shared__ float zdata[];
@@ -240,41 +277,12 @@ magma_sgetrf_batched_smallsq_noshfl(
     dim3 threads(magma_ceilpow2(m), ntcol, 1);
     const magma_int_t gridx = magma_ceildiv(batchCount, ntcol);
     dim3 grid(gridx, 1, 1);
-    switch(m){
-        case  1: sgetrf_batched_smallsq_noshfl_kernel< 1, magma_ceilpow2( 1)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case  2: sgetrf_batched_smallsq_noshfl_kernel< 2, magma_ceilpow2( 2)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case  3: sgetrf_batched_smallsq_noshfl_kernel< 3, magma_ceilpow2( 3)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case  4: sgetrf_batched_smallsq_noshfl_kernel< 4, magma_ceilpow2( 4)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case  5: sgetrf_batched_smallsq_noshfl_kernel< 5, magma_ceilpow2( 5)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case  6: sgetrf_batched_smallsq_noshfl_kernel< 6, magma_ceilpow2( 6)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case  7: sgetrf_batched_smallsq_noshfl_kernel< 7, magma_ceilpow2( 7)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case  8: sgetrf_batched_smallsq_noshfl_kernel< 8, magma_ceilpow2( 8)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case  9: sgetrf_batched_smallsq_noshfl_kernel< 9, magma_ceilpow2( 9)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 10: sgetrf_batched_smallsq_noshfl_kernel<10, magma_ceilpow2(10)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 11: sgetrf_batched_smallsq_noshfl_kernel<11, magma_ceilpow2(11)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 12: sgetrf_batched_smallsq_noshfl_kernel<12, magma_ceilpow2(12)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 13: sgetrf_batched_smallsq_noshfl_kernel<13, magma_ceilpow2(13)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 14: sgetrf_batched_smallsq_noshfl_kernel<14, magma_ceilpow2(14)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 15: sgetrf_batched_smallsq_noshfl_kernel<15, magma_ceilpow2(15)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 16: sgetrf_batched_smallsq_noshfl_kernel<16, magma_ceilpow2(16)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 17: sgetrf_batched_smallsq_noshfl_kernel<17, magma_ceilpow2(17)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 18: sgetrf_batched_smallsq_noshfl_kernel<18, magma_ceilpow2(18)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 19: sgetrf_batched_smallsq_noshfl_kernel<19, magma_ceilpow2(19)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 20: sgetrf_batched_smallsq_noshfl_kernel<20, magma_ceilpow2(20)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 21: sgetrf_batched_smallsq_noshfl_kernel<21, magma_ceilpow2(21)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 22: sgetrf_batched_smallsq_noshfl_kernel<22, magma_ceilpow2(22)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 23: sgetrf_batched_smallsq_noshfl_kernel<23, magma_ceilpow2(23)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 24: sgetrf_batched_smallsq_noshfl_kernel<24, magma_ceilpow2(24)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 25: sgetrf_batched_smallsq_noshfl_kernel<25, magma_ceilpow2(25)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 26: sgetrf_batched_smallsq_noshfl_kernel<26, magma_ceilpow2(26)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 27: sgetrf_batched_smallsq_noshfl_kernel<27, magma_ceilpow2(27)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 28: sgetrf_batched_smallsq_noshfl_kernel<28, magma_ceilpow2(28)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 29: sgetrf_batched_smallsq_noshfl_kernel<29, magma_ceilpow2(29)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 30: sgetrf_batched_smallsq_noshfl_kernel<30, magma_ceilpow2(30)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 31: sgetrf_batched_smallsq_noshfl_kernel<31, magma_ceilpow2(31)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 32: sgetrf_batched_smallsq_noshfl_kernel<32, magma_ceilpow2(32)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        default: printf("error: size %lld is not supported\n", (long long) m);
+    sgetrf_smallsq_launch_fn launch = sgetrf_smallsq_get_launch(SGETRF_SMALLSQ_NOSHFL, m);
+    if (launch == NULL) {
+        printf("error: size %lld is not instantiated, see SLSB_SMALLSQ_SIZES\n", (long long) m);
+        return MAGMA_ERR_NOT_SUPPORTED;
     }
+    launch(grid, threads, shmem, queue, dA_array, ldda, ipiv_array, info_array, batchCount);
     return arginfo;
 }
 
@@ -471,40 +479,44 @@ magma_sgetrf_batched_smallsq_shfl(
     dim3 threads(magma_ceilpow2(m), ntcol, 1);
     const magma_int_t gridx = magma_ceildiv(batchCount, ntcol);
     dim3 grid(gridx, 1, 1);
-    switch(m){
-        case  1: sgetrf_batched_smallsq_shfl_kernel< 1, magma_ceilpow2( 1)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case  2: sgetrf_batched_smallsq_shfl_kernel< 2, magma_ceilpow2( 2)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case  3: sgetrf_batched_smallsq_shfl_kernel< 3, magma_ceilpow2( 3)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case  4: sgetrf_batched_smallsq_shfl_kernel< 4, magma_ceilpow2( 4)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case  5: sgetrf_batched_smallsq_shfl_kernel< 5, magma_ceilpow2( 5)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case  6: sgetrf_batched_smallsq_shfl_kernel< 6, magma_ceilpow2( 6)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case  7: sgetrf_batched_smallsq_shfl_kernel< 7, magma_ceilpow2( 7)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case  8: sgetrf_batched_smallsq_shfl_kernel< 8, magma_ceilpow2( 8)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case  9: sgetrf_batched_smallsq_shfl_kernel< 9, magma_ceilpow2( 9)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 10: sgetrf_batched_smallsq_shfl_kernel<10, magma_ceilpow2(10)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 11: sgetrf_batched_smallsq_shfl_kernel<11, magma_ceilpow2(11)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 12: sgetrf_batched_smallsq_shfl_kernel<12, magma_ceilpow2(12)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 13: sgetrf_batched_smallsq_shfl_kernel<13, magma_ceilpow2(13)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 14: sgetrf_batched_smallsq_shfl_kernel<14, magma_ceilpow2(14)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 15: sgetrf_batched_smallsq_shfl_kernel<15, magma_ceilpow2(15)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 16: sgetrf_batched_smallsq_shfl_kernel<16, magma_ceilpow2(16)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 17: sgetrf_batched_smallsq_shfl_kernel<17, magma_ceilpow2(17)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 18: sgetrf_batched_smallsq_shfl_kernel<18, magma_ceilpow2(18)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 19: sgetrf_batched_smallsq_shfl_kernel<19, magma_ceilpow2(19)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 20: sgetrf_batched_smallsq_shfl_kernel<20, magma_ceilpow2(20)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 21: sgetrf_batched_smallsq_shfl_kernel<21, magma_ceilpow2(21)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 22: sgetrf_batched_smallsq_shfl_kernel<22, magma_ceilpow2(22)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 23: sgetrf_batched_smallsq_shfl_kernel<23, magma_ceilpow2(23)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 24: sgetrf_batched_smallsq_shfl_kernel<24, magma_ceilpow2(24)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 25: sgetrf_batched_smallsq_shfl_kernel<25, magma_ceilpow2(25)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 26: sgetrf_batched_smallsq_shfl_kernel<26, magma_ceilpow2(26)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 27: sgetrf_batched_smallsq_shfl_kernel<27, magma_ceilpow2(27)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 28: sgetrf_batched_smallsq_shfl_kernel<28, magma_ceilpow2(28)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 29: sgetrf_batched_smallsq_shfl_kernel<29, magma_ceilpow2(29)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 30: sgetrf_batched_smallsq_shfl_kernel<30, magma_ceilpow2(30)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 31: sgetrf_batched_smallsq_shfl_kernel<31, magma_ceilpow2(31)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        case 32: sgetrf_batched_smallsq_shfl_kernel<32, magma_ceilpow2(32)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount); break;
-        default: printf("error: size %lld is not supported\n", (long long) m);
+    sgetrf_smallsq_launch_fn launch = sgetrf_smallsq_get_launch(SGETRF_SMALLSQ_SHFL, m);
+    if (launch == NULL) {
+        printf("error: size %lld is not instantiated, see SLSB_SMALLSQ_SIZES\n", (long long) m);
+        return MAGMA_ERR_NOT_SUPPORTED;
     }
+    launch(grid, threads, shmem, queue, dA_array, ldda, ipiv_array, info_array, batchCount);
     return arginfo;
 }
+
+
+template<int V, int N>
+struct sgetrf_smallsq_launch;
+
+template<int N>
+struct sgetrf_smallsq_launch<SGETRF_SMALLSQ_NOSHFL, N>
+{
+    static void run( dim3 grid, dim3 threads, magma_int_t shmem, cudaStream_t queue,
+                     float** dA_array, int ldda,
+                     magma_int_t** ipiv_array, magma_int_t *info_array, int batchCount)
+    {
+        sgetrf_batched_smallsq_noshfl_kernel<N, magma_ceilpow2(N)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount);
+    }
+};
+
+template<int N>
+struct sgetrf_smallsq_launch<SGETRF_SMALLSQ_SHFL, N>
+{
+    static void run( dim3 grid, dim3 threads, magma_int_t shmem, cudaStream_t queue,
+                     float** dA_array, int ldda,
+                     magma_int_t** ipiv_array, magma_int_t *info_array, int batchCount)
+    {
+        sgetrf_batched_smallsq_shfl_kernel<N, magma_ceilpow2(N)><<<grid, threads, shmem, queue >>>(dA_array, ldda, ipiv_array, info_array, batchCount);
+    }
+};
+
+static sgetrf_smallsq_launch_fn sgetrf_smallsq_get_launch(int variant, magma_int_t m)
+{
+    static constexpr smallsq_table<sgetrf_smallsq_launch_fn, SGETRF_SMALLSQ_NVARIANTS> table =
+        make_smallsq_table<sgetrf_smallsq_launch_fn, sgetrf_smallsq_launch, SGETRF_SMALLSQ_NVARIANTS>();
+    return table.get(variant, (int)m);
+}
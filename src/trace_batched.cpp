@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "trace_batched.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+/*
+    Low overhead tracing of the solvers, for load imbalance and stalls in
+    production runs: chrome://tracing and https://ui.perfetto.dev load the
+    output directly.
+
+    Environment:
+        SLSB_TRACE         output file; tracing is off when it is not set
+        SLSB_TRACE_EVENTS  events kept per thread, default 65536
+        SLSB_TRACE_PHASES  1 makes the CPU engine solve tile by tile and
+                           trace each phase (factor, permute, forward,
+                           backward) instead of one event per chunk; the
+                           results are the same, the times are longer
+
+    Every thread writes to its own ring buffer, registered once under a
+    mutex, so recording an event costs two clock reads and a store. When a
+    ring is full the oldest events are overwritten: the file holds the last
+    SLSB_TRACE_EVENTS events of every thread, and the number of lost ones.
+
+    Events are complete events ("ph": "X") named after the section, with
+    the chunk (or tile) index, n and the number of systems as arguments;
+    threads are numbered in the order of their first event. The file is
+    written at exit, or earlier by trace_batched_flush, which must be
+    called while no solver is running.
+*/
+
+#define TRACE_DEFAULT_EVENTS  65536
+
+struct trace_event
+{
+    const char* name;
+    const char* cat;
+    double begin;       // microseconds
+    double duration;
+    long long chunk;
+    int n;
+    int systems;
+};
+
+struct trace_ring
+{
+    long long tid;
+    int index;          // registration order
+    size_t capacity;
+    size_t head;        // events recorded, the last capacity of them are kept
+    trace_event* events;
+};
+
+static std::mutex trace_mutex;
+static std::vector<trace_ring*> trace_rings;
+static std::atomic<int> trace_state(-1);    // -1 environment not read yet, 0 off, 1 on
+static int trace_phase_events = 0;
+static size_t trace_capacity = TRACE_DEFAULT_EVENTS;
+static const char* trace_path = NULL;
+static struct timespec trace_origin;
+
+static thread_local trace_ring* trace_self = NULL;
+static thread_local bool trace_registered = false;
+
+static void trace_atexit()
+{
+    trace_batched_flush(NULL);
+}
+
+static void trace_init()
+{
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    if (trace_state.load() >= 0) {
+        return;
+    }
+    const char* path   = getenv("SLSB_TRACE");
+    const char* events = getenv("SLSB_TRACE_EVENTS");
+    const char* phases = getenv("SLSB_TRACE_PHASES");
+
+    if (path == NULL || path[0] == '\0') {
+        trace_state.store(0);
+        return;
+    }
+    trace_path = path;
+    if (events != NULL && atol(events) > 0) {
+        trace_capacity = (size_t)atol(events);
+    }
+    trace_phase_events = phases != NULL && atoi(phases) != 0;
+    clock_gettime(CLOCK_MONOTONIC, &trace_origin);
+    atexit(trace_atexit);
+    trace_state.store(1);
+}
+
+int trace_batched_enabled()
+{
+    int state = trace_state.load(std::memory_order_relaxed);
+    if (state < 0) {
+        trace_init();
+        state = trace_state.load();
+    }
+    return state;
+}
+
+int trace_batched_phases()
+{
+    return trace_batched_enabled() && trace_phase_events;
+}
+
+double trace_batched_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return 1e6 * (double)(now.tv_sec - trace_origin.tv_sec)
+         + 1e-3 * (double)(now.tv_nsec - trace_origin.tv_nsec);
+}
+
+// Ring of the calling thread, NULL if it could not be allocated.
+static trace_ring* trace_thread_ring()
+{
+    if (trace_registered) {
+        return trace_self;
+    }
+    trace_registered = true;
+
+    trace_ring* ring = (trace_ring*)malloc(sizeof(trace_ring));
+    trace_event* events = (trace_event*)malloc(trace_capacity * sizeof(trace_event));
+    if (ring == NULL || events == NULL) {
+        printf("Error in: trace buffer malloc, the events of this thread are dropped\n");
+        free(ring);
+        free(events);
+        return NULL;
+    }
+    ring->capacity = trace_capacity;
+    ring->head     = 0;
+    ring->events   = events;
+#if defined(__linux__)
+    ring->tid = (long long)syscall(SYS_gettid);
+#else
+    ring->tid = 0;
+#endif
+
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    ring->index = (int)trace_rings.size();
+    if (ring->tid == 0) {
+        ring->tid = ring->index + 1;
+    }
+    trace_rings.push_back(ring);
+    trace_self = ring;
+    return ring;
+}
+
+void trace_batched_event(const char* name, const char* cat, double begin,
+                         long long chunk, int n, int systems)
+{
+    const double end = trace_batched_now();
+    trace_ring* ring = trace_thread_ring();
+    if (ring == NULL) {
+        return;
+    }
+    trace_event* e = &ring->events[ring->head % ring->capacity];
+    e->name     = name;
+    e->cat      = cat;
+    e->begin    = begin;
+    e->duration = end - begin;
+    e->chunk    = chunk;
+    e->n        = n;
+    e->systems  = systems;
+    ring->head++;
+}
+
+int trace_batched_flush(const char* path)
+{
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    long long pid = 0, dropped = 0;
+    int first = 1;
+
+    if (path == NULL) {
+        path = trace_path;
+    }
+    if (path == NULL) {
+        return 0;
+    }
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        printf("Error in: cannot write the trace to %s\n", path);
+        return -1;
+    }
+#if defined(__linux__)
+    pid = (long long)getpid();
+#endif
+
+    fprintf(f, "{\"traceEvents\": [\n");
+    for (size_t r = 0; r < trace_rings.size(); r++) {
+        const trace_ring* ring = trace_rings[r];
+        const size_t kept = ring->head < ring->capacity ? ring->head : ring->capacity;
+
+        fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %lld, \"tid\": %lld, "
+                   "\"args\": {\"name\": \"slsb thread %d\"}}",
+                first ? "" : ",\n", pid, ring->tid, ring->index);
+        first = 0;
+        dropped += (long long)(ring->head - kept);
+        for (size_t k = ring->head - kept; k < ring->head; k++) {
+            const trace_event* e = &ring->events[k % ring->capacity];
+            fprintf(f, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                       "\"pid\": %lld, \"tid\": %lld, \"args\": {",
+                    e->name, e->cat, e->begin, e->duration, pid, ring->tid);
+            if (e->chunk >= 0) {
+                fprintf(f, "\"chunk\": %lld, ", e->chunk);
+            }
+            fprintf(f, "\"n\": %d, \"systems\": %d}}", e->n, e->systems);
+        }
+    }
+    fprintf(f, "\n],\n\"displayTimeUnit\": \"ns\",\n");
+    fprintf(f, "\"otherData\": {\"tool\": \"slsb\", \"threads\": %zu, \"events_per_thread\": %zu, "
+               "\"dropped_events\": %lld}}\n",
+            trace_rings.size(), trace_capacity, dropped);
+    fclose(f);
+    return 0;
+}
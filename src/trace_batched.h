@@ -0,0 +1,37 @@
+#ifndef TRACE_BATCHED_H
+#define TRACE_BATCHED_H
+
+/*
+    Execution timeline of the solvers in Chrome trace event format, see
+    trace_batched.cpp.
+
+    Tracing is off unless SLSB_TRACE names an output file. A traced section
+    is
+
+        const double t0 = trace_batched_enabled() ? trace_batched_now() : 0.0;
+        ...
+        if (trace_batched_enabled()) {
+            trace_batched_event("solve", "cpu", t0, chunk, n, count);
+        }
+
+    name and cat must be string literals (only the pointers are stored).
+*/
+
+// Nonzero if SLSB_TRACE is set; the environment is read on the first call.
+int trace_batched_enabled();
+
+// Nonzero if SLSB_TRACE_PHASES asks the CPU engine for one event per phase.
+int trace_batched_phases();
+
+// Microseconds since tracing started.
+double trace_batched_now();
+
+// Records the section [begin, now] of the calling thread. chunk < 0 is omitted.
+void trace_batched_event(const char* name, const char* cat, double begin,
+                         long long chunk, int n, int systems);
+
+// Writes the events recorded so far as Chrome trace JSON, to path or, if path
+// is NULL, to the SLSB_TRACE file. Returns 0 or -1 if the file cannot be written.
+int trace_batched_flush(const char* path);
+
+#endif //TRACE_BATCHED_H
@@ -0,0 +1,34 @@
+#ifndef TUNEDTABLES_BATCHED_H
+#define TUNEDTABLES_BATCHED_H
+
+/*
+    Tuned launch tables, generated by tools/tuneTables.cpp (make tuneTables,
+    then ./tuneTables -o ../src/tunedTables_batched.h). Do not edit by hand.
+
+    This is the untuned placeholder: with TUNED_SGETRF_NTCOL_ARCH 0 and an
+    empty TUNED_CPU_MODEL, magma_get_sgetrf_batched_ntcol keeps its built-in
+    tables and the CPU engine tunes itself on first use.
+*/
+
+#include "magma_types.h"
+
+// compute capability and name of the GPU the ntcol table was measured on
+// (e.g. 700), 0 if none; the table is used on GPUs of that name only
+#define TUNED_SGETRF_NTCOL_ARCH  0
+#define TUNED_SGETRF_NTCOL_GPU   ""
+
+// threads per matrix column group of the sgetrf/sgesv smallsq kernels, for n = 1..32
+constexpr magma_int_t tuned_sgetrf_batched_ntcol[32] =
+    {32, 16, 10, 8, 6, 5, 4, 4, 3, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+
+// CPU model (as in /proc/cpuinfo) and OpenMP threads the CPU tables were measured with
+#define TUNED_CPU_MODEL    ""
+#define TUNED_CPU_THREADS  0
+
+// CPU_VARIANT_* and OpenMP chunk of cpuLinearSolverBatched, for n = 1..32
+constexpr int tuned_cpu_variant[32] =
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+constexpr int tuned_cpu_chunk[32] =
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+#endif //TUNEDTABLES_BATCHED_H
@@ -23,6 +23,7 @@ struct magma_device_info
     size_t shmem_multiproc;  // maximum shared memory per multiprocessor in bytes
     magma_int_t cuda_arch;
     magma_int_t multiproc_count;    // number of multiprocessors
+    char name[256];                 // as in cudaDeviceProp
 };
 struct magma_device_info* g_magma_devices = NULL;
 
@@ -153,6 +154,7 @@ magma_init()
                     g_magma_devices[dev].shmem_block = prop.sharedMemPerBlock;
                     g_magma_devices[dev].shmem_multiproc = prop.sharedMemPerMultiprocessor;
                     g_magma_devices[dev].multiproc_count = prop.multiProcessorCount;
+                    snprintf(g_magma_devices[dev].name, sizeof(g_magma_devices[dev].name), "%s", prop.name);
                 }
             }
 
@@ -310,6 +312,22 @@ magma_getdevice_arch()
 }
 
 
+/// Name of the current device, "" if MAGMA is not initialized.
+extern "C" const char*
+magma_getdevice_name()
+{
+    int dev;
+    cudaError_t err;
+    err = cudaGetDevice(&dev);
+    check_error(err);
+    ((void)(err));
+    if (g_magma_devices == NULL || dev < 0 || dev >= g_magma_devices_cnt) {
+        return "";
+    }
+    return g_magma_devices[dev].name;
+}
+
+
 void magma_xerror(cudaError_t err, const char* func, const char* file, int line)
 {
     if (err != cudaSuccess) {
@@ -44,6 +44,7 @@ extern "C" {
     static inline int magma_imalloc(magmaInt_ptr* ptr_ptr, size_t n) { return magma_malloc((magma_ptr*)ptr_ptr, n * sizeof(magma_int_t)); }
     int utils_getdevice_arch();
     int magma_getdevice_arch();
+    const char* magma_getdevice_name();
     void magma_queue_sync_internal(
         cudaStream_t queue,
         const char* func, const char* file, int line);
@@ -0,0 +1,188 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <vector>
+#include "operation_batched.h"
+#include "matgen_batched.h"
+
+/*
+    Shared definitions of the benchmark suite (tools/benchSgesv.cpp).
+
+    A run is a sweep: every combination of the lists of a bench_config is a
+    bench_case, timed by bench_run_case and written by the bench_report_*
+    functions as one JSON object or CSV row. A scaling study runs the same
+    cases over a range of thread counts and adds speedup and efficiency; a
+    baseline check runs the cases of a stored results file and compares.
+*/
+
+// Backends
+#define BENCH_CPU         0   // cpuLinearSolverBatched*, host memory
+#define BENCH_GPU         1   // gpuLinearSolverBatched, host memory, transfers included
+#define BENCH_GPU_DEVICE  2   // slsb_solve on device resident data
+#define BENCH_LAPACK      3   // sgesv_ per system, OpenMP over the systems
+
+// Layouts, see sgesv_batched_views.h
+#define BENCH_LAYOUT_PACKED       0
+#define BENCH_LAYOUT_PADDED       1   // ld = magma_roundup(n, 32)
+#define BENCH_LAYOUT_INTERLEAVED  2   // param is the group width
+
+// Variant of the CPU engine, CPU_VARIANT_* or BENCH_VARIANT_AUTO for the tuning table
+#define BENCH_VARIANT_AUTO  -1
+
+// Cache state at the start of each timed run
+#define BENCH_CACHE_WARM  0   // the batch is left where the previous run put it
+#define BENCH_CACHE_COLD  1   // caches (and the TLB) are flushed before each run
+
+// Scaling studies, see benchScaling.cpp
+#define BENCH_SCALING_NONE    0
+#define BENCH_SCALING_STRONG  1   // fixed batch, growing thread count
+#define BENCH_SCALING_WEAK    2   // batch proportional to the thread count
+
+#define BENCH_FORMAT_CSV   0
+#define BENCH_FORMAT_JSON  1
+
+struct bench_layout
+{
+    int layout;
+    int param;
+};
+
+// Test matrices, MATGEN_* of matgen_batched.h, param <= 0 for the default
+struct bench_matrix
+{
+    int type;
+    double param;
+};
+
+// Captured systems per N, packed, see benchReplay.cpp
+struct bench_replay
+{
+    std::vector<float> A[33];
+    std::vector<float> B[33];
+};
+
+struct bench_config
+{
+    std::vector<int> ns;
+    std::vector<int> batchCounts;
+    std::vector<int> backends;
+    std::vector<int> variants;
+    std::vector<int> chunks;
+    std::vector<bench_layout> layouts;
+    std::vector<int> threads;
+    std::vector<int> caches;
+    std::vector<bench_matrix> matrices;
+    std::vector<int> scalings;  // empty for a plain sweep
+    int threadsGiven;           // --threads was set
+    int nsGiven;                // --n, --batch and --backend were set, they select baseline cases
+    int batchGiven;
+    int backendsGiven;
+    double efficiency;          // a size scales while the parallel efficiency is above
+    int roofline;               // adds the roofline of the host backends to the results
+    int counters;               // hardware counters per phase of the cpu backend
+    const char* baseline;       // results to check for regressions, NULL for none
+    double threshold;           // relative slowdown tolerated by the baseline check
+    double alpha;               // significance level of the baseline check
+    const char* replayPath;     // capture file replayed, NULL for none
+    const bench_replay* replay; // its systems, NULL for generated ones
+    // measured at startup by bench_peak_measure for the scaling studies and the roofline
+    int peakThreads;
+    double peakBandwidth;       // bytes/s, peakThreads threads
+    double peakBandwidth1;      // bytes/s, one thread
+    double peakFlops;           // flop/s, peakThreads threads
+    size_t flushBytes;  // host buffer swept by the cold runs
+    int dropPages;      // cold runs also drop the page cache (needs root)
+    int warmup;
+    int reps;
+    int format;
+    const char* output;
+    unsigned int seed;
+};
+
+struct bench_case
+{
+    int backend;
+    int n;
+    int batchCount;
+    int variant;
+    int chunk;
+    bench_layout layout;
+    int threads;        // 0 when the backend does not use host threads
+    int cache;
+    bench_matrix matrix;    // ignored when the systems are replayed
+};
+
+// Seconds
+struct bench_stats
+{
+    int    reps;
+    double median;
+    double min;
+    double max;
+    double mean;
+    double stddev;
+};
+
+struct bench_result
+{
+    bench_case c;
+    int status;         // return code of the solver on the last repetition
+    bench_stats time;
+    double time_first;  // first call of the case, warmup included, CPU tuning excluded
+    double flops;       // per batch
+    double bytes;       // per batch
+    double gflops;      // at the median time
+    double gbs;         // at the median time
+    double backward_error;  // largest |b - Ax| / (|A| |x| + |b|) (infinity norms) of the batch, negative if not checked
+    int scaling;        // BENCH_SCALING_*, the fields below are set by the scaling studies
+    double speedup;
+    double efficiency;
+    double peak_fraction;   // gbs over the measured peak bandwidth
+    double intensity;       // flop/byte, set with config->roofline
+    double attainable;      // flop/s, roofline bound at this intensity and thread count
+    double roofline_fraction;
+    int memory_bound;       // the bandwidth term of the roofline is the smaller one
+    cpu_perf_counters perf; // with config->counters, over config->reps extra runs
+};
+
+// benchRun.cpp
+const char* bench_backend_name(int backend);
+const char* bench_variant_name(int variant);
+const char* bench_cache_name(int cache);
+size_t bench_default_flush_bytes();
+void bench_layout_name(const bench_layout* layout, char* name, size_t len);
+void bench_matrix_name(const bench_matrix* matrix, char* name, size_t len);
+int  bench_parse_matrix(const char* name, bench_matrix* matrix);
+int  bench_case_supported(const bench_case* c);
+int  bench_layout_ld(const bench_case* c);
+double bench_case_flops(const bench_case* c);
+double bench_case_bytes(const bench_case* c);
+int  bench_run_case(const bench_config* config, const bench_case* c, bench_result* result);
+
+// benchPeak.cpp
+double bench_peak_bandwidth(size_t bytes, int threads);
+double bench_peak_flops(int threads);
+void bench_peak_measure(bench_config* config);
+void bench_roofline(const bench_config* config, bench_result* result);
+
+// benchScaling.cpp
+const char* bench_scaling_name(int scaling);
+int bench_scaling(const bench_config* config, FILE* out, FILE* log, int* first);
+
+// benchBaseline.cpp
+int bench_baseline(const bench_config* config, int ngpu, FILE* out, FILE* log, int* first, int* regressions);
+
+// benchReplay.cpp
+int  bench_replay_load(const char* path, bench_replay* replay, FILE* log);
+int  bench_replay_count(const bench_replay* replay, int n);
+void bench_replay_ns(const bench_replay* replay, std::vector<int>* ns);
+
+// benchReport.cpp
+void bench_compute_stats(std::vector<double>& times, bench_stats* stats);
+void bench_report_begin(FILE* f, const bench_config* config);
+void bench_report_result(FILE* f, const bench_config* config, const bench_result* result, int first);
+void bench_report_end(FILE* f, const bench_config* config);
+void bench_log_result(FILE* log, const bench_result* result);
+
+#endif //BENCH_H
@@ -0,0 +1,421 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "bench.h"
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+/*
+    Regression check of the benchmark suite against stored results.
+
+    The baseline is a CSV file, either
+      - written by benchSgesv --format csv: every row is a case, with the
+        mean, standard deviation and number of its repetitions (files
+        without the matrix column are of normal matrices), or
+      - written by gpuCSVTester (Release/results.csv): every row holds one
+        time per backend, gpu for #GPUtimeInMs and lapack on 1, 4, 8 and 16
+        threads for the #CPUtime*InMs columns, a single run each.
+    Every case of the baseline is run again, rows that failed (negative
+    status or time) are skipped, and so are the thread counts above the
+    OpenMP maximum. --n, --batch and --backend, when given, select cases.
+
+    A case regressed when its time is beyond (1 + threshold) times the
+    baseline with statistical significance, so that noise alone does not
+    fail a run. With r = 1 + threshold, the one sided Welch test of
+        H0: mean_new <= r * mean_base
+    uses
+        t = (mean_new - r * mean_base) / sqrt(s_new^2 / n_new + r^2 s_base^2 / n_base)
+    with Welch-Satterthwaite degrees of freedom; a baseline of a single run
+    has no variance and the test is then the one sample t test of the new
+    runs against r * mean_base. H0 is rejected when the p value is below
+    alpha, and the median, less sensitive to outliers than the mean, must
+    also have slowed down beyond r. A case whose median improved beyond r
+    is reported faster, for information.
+
+    One line per case and a summary go to the log; the runs themselves are
+    written to the output as in a sweep.
+*/
+
+struct bench_baseline_entry
+{
+    bench_case c;
+    int reps;
+    double median;      // seconds
+    double mean;
+    double stddev;
+};
+
+#define BENCH_VERDICT_SAME     0
+#define BENCH_VERDICT_SLOWER   1
+#define BENCH_VERDICT_FASTER   2
+
+static int bench_baseline_max_threads()
+{
+#if defined(_OPENMP)
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+// Continued fraction of the incomplete beta function (modified Lentz).
+static double bench_betacf(double a, double b, double x)
+{
+    const double tiny = 1e-300;
+    double c = 1.0, d = 1.0 - (a + b) * x / (a + 1.0), h;
+
+    if (fabs(d) < tiny) d = tiny;
+    d = 1.0 / d;
+    h = d;
+    for (int m = 1; m <= 200; m++) {
+        const int m2 = 2 * m;
+        double aa = m * (b - m) * x / ((a + m2 - 1.0) * (a + m2));
+        d = 1.0 + aa * d;
+        if (fabs(d) < tiny) d = tiny;
+        c = 1.0 + aa / c;
+        if (fabs(c) < tiny) c = tiny;
+        d = 1.0 / d;
+        h *= d * c;
+        aa = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1.0));
+        d = 1.0 + aa * d;
+        if (fabs(d) < tiny) d = tiny;
+        c = 1.0 + aa / c;
+        if (fabs(c) < tiny) c = tiny;
+        d = 1.0 / d;
+        const double del = d * c;
+        h *= del;
+        if (fabs(del - 1.0) < 1e-12) {
+            break;
+        }
+    }
+    return h;
+}
+
+// Regularized incomplete beta function I_x(a, b).
+static double bench_betai(double a, double b, double x)
+{
+    if (x <= 0.0) return 0.0;
+    if (x >= 1.0) return 1.0;
+    const double front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log(1.0 - x));
+    if (x < (a + 1.0) / (a + b + 2.0)) {
+        return front * bench_betacf(a, b, x) / a;
+    }
+    return 1.0 - front * bench_betacf(b, a, 1.0 - x) / b;
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ P(T > t) for a Student t variable T with df degrees of freedom.
+ *******************************************************************************/
+static double bench_student_upper(double t, double df)
+{
+    const double tail = 0.5 * bench_betai(0.5 * df, 0.5, df / (df + t * t));
+    return t > 0 ? tail : 1.0 - tail;
+}
+
+// p value of the test of the header; 0 or 1 when neither sample varies.
+static double bench_baseline_pvalue(const bench_baseline_entry* base, const bench_stats* now, double ratio)
+{
+    const double vn = now->reps > 1 ? now->stddev * now->stddev / now->reps : 0.0;
+    const double vb = base->reps > 1 ? ratio * ratio * base->stddev * base->stddev / base->reps : 0.0;
+    const double diff = now->mean - ratio * base->mean;
+    double df = 0.0;
+
+    if (vn + vb <= 0.0) {
+        return diff > 0 ? 0.0 : 1.0;
+    }
+    if (now->reps > 1)  df += vn * vn / (now->reps - 1);
+    if (base->reps > 1) df += vb * vb / (base->reps - 1);
+    df = (vn + vb) * (vn + vb) / df;
+    return bench_student_upper(diff / sqrt(vn + vb), df);
+}
+
+// Splits a CSV line in place, trimming the blanks around the fields.
+static int bench_split_csv(char* line, char** fields, int max)
+{
+    int count = 0;
+    char* p = line;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    while (count < max) {
+        char* end = p + strcspn(p, ",");
+        const int last = *end == '\0';
+        *end = '\0';
+        p += strspn(p, " \t");
+        for (char* e = end; e > p && (e[-1] == ' ' || e[-1] == '\t'); e--) {
+            e[-1] = '\0';
+        }
+        fields[count++] = p;
+        if (last) {
+            break;
+        }
+        p = end + 1;
+    }
+    return count;
+}
+
+static int bench_name_id(const char* name, const char* (*namer)(int), int first, int last, int* id)
+{
+    for (int k = first; k <= last; k++) {
+        if (strcmp(name, namer(k)) == 0) {
+            *id = k;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int bench_parse_layout_name(const char* name, bench_layout* layout)
+{
+    layout->param = 0;
+    if (strcmp(name, "packed") == 0) {
+        layout->layout = BENCH_LAYOUT_PACKED;
+    }
+    else if (strcmp(name, "padded") == 0) {
+        layout->layout = BENCH_LAYOUT_PADDED;
+    }
+    else if (strncmp(name, "interleaved", 11) == 0 && atoi(name + 11) > 0) {
+        layout->layout = BENCH_LAYOUT_INTERLEAVED;
+        layout->param  = atoi(name + 11);
+    }
+    else {
+        return -1;
+    }
+    return 0;
+}
+
+static void bench_baseline_default_case(bench_case* c, int backend, int n, int batchCount, int threads)
+{
+    c->backend       = backend;
+    c->n             = n;
+    c->batchCount    = batchCount;
+    c->variant       = BENCH_VARIANT_AUTO;
+    c->chunk         = 0;
+    c->layout.layout = BENCH_LAYOUT_PACKED;
+    c->layout.param  = 0;
+    c->threads       = threads;
+    c->cache         = BENCH_CACHE_WARM;
+    c->matrix.type   = MATGEN_NORMAL;
+    c->matrix.param  = 0.0;
+}
+
+// Row of gpuCSVTester: N, batchCount, result, GPU and CPU (1, 4, 8, 16 threads) times in ms.
+static void bench_baseline_legacy_row(char** fields, int count, std::vector<bench_baseline_entry>* entries)
+{
+    static const int threads[4] = { 1, 4, 8, 16 };
+
+    if (count < 8 || atoi(fields[2]) != 0) {
+        return;
+    }
+    for (int k = 0; k < 5; k++) {
+        bench_baseline_entry e;
+        const double ms = atof(fields[3 + k]);
+        if (ms <= 0) {
+            continue;
+        }
+        bench_baseline_default_case(&e.c, k == 0 ? BENCH_GPU : BENCH_LAPACK, atoi(fields[0]), atoi(fields[1]),
+                                    k == 0 ? 0 : threads[k - 1]);
+        e.reps   = 1;
+        e.median = e.mean = 1e-3 * ms;
+        e.stddev = 0.0;
+        entries->push_back(e);
+    }
+}
+
+// Column of name in the header, -1 if it is missing.
+static int bench_column(char** header, int count, const char* name)
+{
+    for (int k = 0; k < count; k++) {
+        if (strcmp(header[k], name) == 0) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Reads the cases of a baseline file, see the header. Returns 0, or -1 if the
+ file cannot be read or is in neither format.
+ *******************************************************************************/
+static int bench_baseline_load(const char* path, std::vector<bench_baseline_entry>* entries)
+{
+    enum { C_BACKEND, C_LAYOUT, C_VARIANT, C_CHUNK, C_THREADS, C_CACHE, C_N, C_BATCH,
+           C_STATUS, C_REPS, C_MEDIAN, C_MEAN, C_STDDEV, C_COUNT };
+    static const char* const names[C_COUNT] = { "backend", "layout", "variant", "chunk", "threads", "cache",
+                                                "n", "batch_count", "status", "reps",
+                                                "time_median", "time_mean", "time_stddev" };
+    char line[4096], header_line[4096];
+    char* header[256];
+    char* fields[256];
+    int column[C_COUNT];
+    int matrix_column = -1;
+    int nheader, legacy, resCode = 0, row = 1;
+    FILE* f = fopen(path, "r");
+
+    if (f == NULL) {
+        fprintf(stderr, "Error in: cannot open the baseline %s\n", path);
+        return -1;
+    }
+    if (fgets(header_line, sizeof(header_line), f) == NULL) {
+        fprintf(stderr, "Error in: empty baseline %s\n", path);
+        fclose(f);
+        return -1;
+    }
+    nheader = bench_split_csv(header_line, header, 256);
+    legacy = strcmp(header[0], "#N") == 0;
+    for (int k = 0; k < C_COUNT && !legacy; k++) {
+        column[k] = bench_column(header, nheader, names[k]);
+        if (column[k] < 0) {
+            fprintf(stderr, "Error in: baseline %s has no column %s\n", path, names[k]);
+            fclose(f);
+            return -1;
+        }
+    }
+    if (!legacy) {
+        matrix_column = bench_column(header, nheader, "matrix");
+    }
+
+    while (resCode == 0 && fgets(line, sizeof(line), f) != NULL) {
+        const int count = bench_split_csv(line, fields, 256);
+        bench_baseline_entry e;
+        row++;
+        if (count == 0 || fields[0][0] == '\0' || fields[0][0] == '#') {
+            continue;
+        }
+        if (legacy) {
+            bench_baseline_legacy_row(fields, count, entries);
+            continue;
+        }
+        if (count < nheader) {
+            fprintf(stderr, "Error in: baseline %s, row %d is short\n", path, row);
+            resCode = -1;
+            break;
+        }
+        if (atoi(fields[column[C_STATUS]]) < 0) {
+            continue;
+        }
+        bench_baseline_default_case(&e.c, BENCH_CPU, atoi(fields[column[C_N]]), atoi(fields[column[C_BATCH]]),
+                                    atoi(fields[column[C_THREADS]]));
+        e.c.chunk = atoi(fields[column[C_CHUNK]]);
+        if (bench_name_id(fields[column[C_BACKEND]], bench_backend_name, BENCH_CPU, BENCH_LAPACK, &e.c.backend) != 0
+            || bench_name_id(fields[column[C_VARIANT]], bench_variant_name, BENCH_VARIANT_AUTO,
+                             CPU_VARIANT_GATHER16, &e.c.variant) != 0
+            || bench_name_id(fields[column[C_CACHE]], bench_cache_name, BENCH_CACHE_WARM,
+                             BENCH_CACHE_COLD, &e.c.cache) != 0
+            || bench_parse_layout_name(fields[column[C_LAYOUT]], &e.c.layout) != 0
+            || (matrix_column >= 0 && bench_parse_matrix(fields[matrix_column], &e.c.matrix) != 0)) {
+            fprintf(stderr, "Error in: baseline %s, row %d has an unknown case\n", path, row);
+            resCode = -1;
+            break;
+        }
+        e.reps   = atoi(fields[column[C_REPS]]);
+        e.median = atof(fields[column[C_MEDIAN]]);
+        e.mean   = atof(fields[column[C_MEAN]]);
+        e.stddev = atof(fields[column[C_STDDEV]]);
+        if (e.reps > 0 && e.mean > 0) {
+            entries->push_back(e);
+        }
+    }
+    fclose(f);
+    return resCode;
+}
+
+static int bench_contains(const std::vector<int>& list, int value)
+{
+    for (size_t k = 0; k < list.size(); k++) {
+        if (list[k] == value) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Runs every case of config->baseline again and compares it to the baseline,
+ see the header.
+
+ Arguments
+ ---------
+ @param[in]
+ ngpu     INTEGER
+ CUDA devices, the gpu cases are skipped without one.
+
+ @param[out]
+ regressions  INTEGER
+ Cases slower than the baseline.
+
+ Returns the number of cases that could not be run, -1 if the baseline
+ cannot be read.
+ *******************************************************************************/
+int bench_baseline(const bench_config* config, int ngpu, FILE* out, FILE* log, int* first, int* regressions)
+{
+    std::vector<bench_baseline_entry> entries;
+    const double ratio = 1.0 + config->threshold;
+    int failed = 0, skipped = 0, faster = 0, same = 0;
+
+    *regressions = 0;
+    if (bench_baseline_load(config->baseline, &entries) != 0) {
+        return -1;
+    }
+    fprintf(log, "baseline %s: %zu cases, threshold %.1f%%, alpha %g\n",
+            config->baseline, entries.size(), 100.0 * config->threshold, config->alpha);
+
+    for (size_t k = 0; k < entries.size(); k++) {
+        const bench_baseline_entry* base = &entries[k];
+        const bench_case* c = &base->c;
+        const int gpu = c->backend == BENCH_GPU || c->backend == BENCH_GPU_DEVICE;
+        bench_result result;
+        char layout[32], matrix[32];
+
+        if ((config->nsGiven && !bench_contains(config->ns, c->n))
+            || (config->batchGiven && !bench_contains(config->batchCounts, c->batchCount))
+            || (config->backendsGiven && !bench_contains(config->backends, c->backend))) {
+            continue;
+        }
+        if ((gpu && ngpu == 0) || c->threads > bench_baseline_max_threads() || !bench_case_supported(c)) {
+            skipped++;
+            continue;
+        }
+        if (bench_run_case(config, c, &result) != 0) {
+            failed++;
+            continue;
+        }
+        bench_report_result(out, config, &result, *first);
+        *first = 0;
+
+        const double p = bench_baseline_pvalue(base, &result.time, ratio);
+        const double change = result.time.median / base->median - 1.0;
+        int verdict = BENCH_VERDICT_SAME;
+        if (p < config->alpha && result.time.median > ratio * base->median) {
+            verdict = BENCH_VERDICT_SLOWER;
+            (*regressions)++;
+        }
+        else if (result.time.median * ratio < base->median) {
+            verdict = BENCH_VERDICT_FASTER;
+            faster++;
+        }
+        else {
+            same++;
+        }
+        bench_layout_name(&c->layout, layout, sizeof(layout));
+        bench_matrix_name(&c->matrix, matrix, sizeof(matrix));
+        fprintf(log, "%-10s %-13s %-8s chunk %3d threads %3d %s %s n %2d batch %8d: "
+                     "baseline %10.3f ms  now %10.3f ms  %+7.1f%%  p %.2g  %s\n",
+                bench_backend_name(c->backend), layout, bench_variant_name(c->variant), c->chunk,
+                c->threads, bench_cache_name(c->cache), matrix, c->n, c->batchCount,
+                base->median * 1e3, result.time.median * 1e3, 100.0 * change, p,
+                verdict == BENCH_VERDICT_SLOWER ? "SLOWER" : verdict == BENCH_VERDICT_FASTER ? "faster" : "ok");
+    }
+    fprintf(log, "baseline check: %d slower, %d faster, %d unchanged, %d skipped, %d failed\n",
+            *regressions, faster, same, skipped, failed);
+    return failed;
+}
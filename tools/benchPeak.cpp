@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <string.h>
+#include "utils.h"
+#include "bench.h"
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+/*
+    Hardware baselines the benchmark results are compared with, and the
+    roofline of the host backends.
+
+    The bandwidth is a STREAM triad, the compute peak a chain of
+    independent multiply-adds on BENCH_FMA_LANES floats that the compiler
+    keeps in vector registers. Both are compiled with the flags of the
+    solvers, so the peak is the one this build can reach (with FMA and
+    wide vectors only if the build enables them).
+
+    Roofline of a case run on p threads:
+        intensity  = flops / bytes of the case (bytes of its layout, see
+                     bench_case_bytes)
+        bandwidth  = min(peakBandwidth, p * peakBandwidth1)
+        attainable = min(p / peakThreads * peakFlops, intensity * bandwidth)
+    The case is memory bound if the second term is the smaller one. Warm
+    runs may beat the memory roof of small batches, which live in cache.
+*/
+
+#define BENCH_PEAK_REPS   5
+#define BENCH_FMA_LANES   64
+#define BENCH_FMA_ITERS   (1 << 22)
+
+/***************************************************************************//**
+ Purpose
+ -------
+ STREAM triad a = b + s*c over three float arrays of bytes each on threads
+ threads, first touch included so that the pages are local to the threads
+ that sweep them.
+
+ @return the best bandwidth of BENCH_PEAK_REPS runs in bytes/s, counting
+         the two reads and the write; 0 on allocation failure.
+ *******************************************************************************/
+double bench_peak_bandwidth(size_t bytes, int threads)
+{
+    const size_t count = bytes / sizeof(float);
+    float *a = NULL, *b = NULL, *c = NULL;
+    double best = 0.0;
+
+    if (magma_smalloc_cpu(&a, count) != 0 || magma_smalloc_cpu(&b, count) != 0
+        || magma_smalloc_cpu(&c, count) != 0) {
+        fprintf(stderr, "Error in: bandwidth arrays malloc\n");
+        goto cleanup;
+    }
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static) num_threads(threads)
+#endif
+    for (size_t k = 0; k < count; k++) {
+        a[k] = 0.0f;
+        b[k] = 1.0f;
+        c[k] = 2.0f;
+    }
+
+    for (int r = 0; r < BENCH_PEAK_REPS; r++) {
+        const float s = 0.5f + r;
+        double t = magma_wtime();
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static) num_threads(threads)
+#endif
+        for (size_t k = 0; k < count; k++) {
+            a[k] = b[k] + s * c[k];
+        }
+        t = magma_wtime() - t;
+        if (t > 0 && 3.0 * count * sizeof(float) / t > best) {
+            best = 3.0 * count * sizeof(float) / t;
+        }
+    }
+
+cleanup:
+    magma_free_cpu(a);
+    magma_free_cpu(b);
+    magma_free_cpu(c);
+    return best;
+}
+
+// BENCH_FMA_ITERS multiply-adds on each of the lanes, returns their sum so
+// that nothing is optimized away.
+static float bench_fma_kernel(float seed)
+{
+    float acc[BENCH_FMA_LANES];
+    const float a = 0.999999f;
+    const float b = 1e-7f;
+
+    for (int l = 0; l < BENCH_FMA_LANES; l++) {
+        acc[l] = seed + l;
+    }
+    for (int it = 0; it < BENCH_FMA_ITERS; it++) {
+#if defined(_OPENMP)
+#pragma omp simd
+#endif
+        for (int l = 0; l < BENCH_FMA_LANES; l++) {
+            acc[l] = acc[l] * a + b;
+        }
+    }
+    float sum = 0.0f;
+    for (int l = 0; l < BENCH_FMA_LANES; l++) {
+        sum += acc[l];
+    }
+    return sum;
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Peak single precision multiply-add rate of threads threads.
+
+ @return the best rate of BENCH_PEAK_REPS runs in flop/s.
+ *******************************************************************************/
+double bench_peak_flops(int threads)
+{
+    const double flops = 2.0 * BENCH_FMA_LANES * (double)BENCH_FMA_ITERS * threads;
+    double best = 0.0;
+    volatile float sink = 0.0f;
+
+    for (int r = 0; r < BENCH_PEAK_REPS; r++) {
+        float sum = 0.0f;
+        double t = magma_wtime();
+#if defined(_OPENMP)
+#pragma omp parallel num_threads(threads) reduction(+:sum)
+#endif
+        {
+            sum += bench_fma_kernel((float)r);
+        }
+        t = magma_wtime() - t;
+        sink = sink + sum;
+        if (t > 0 && flops / t > best) {
+            best = flops / t;
+        }
+    }
+    return best;
+}
+
+// Fills the peak fields of config, with all the OpenMP threads.
+void bench_peak_measure(bench_config* config)
+{
+    config->peakThreads = 1;
+#if defined(_OPENMP)
+    config->peakThreads = omp_get_max_threads();
+#endif
+    config->peakBandwidth  = bench_peak_bandwidth(config->flushBytes, config->peakThreads);
+    config->peakBandwidth1 = bench_peak_bandwidth(config->flushBytes, 1);
+    config->peakFlops      = bench_peak_flops(config->peakThreads);
+}
+
+// Sets the roofline fields of a result of a host backend.
+void bench_roofline(const bench_config* config, bench_result* result)
+{
+    const bench_case* c = &result->c;
+    double bandwidth, flops;
+
+    if ((c->backend != BENCH_CPU && c->backend != BENCH_LAPACK) || result->bytes <= 0
+        || config->peakThreads <= 0) {
+        return;
+    }
+    bandwidth = c->threads * config->peakBandwidth1;
+    bandwidth = bandwidth < config->peakBandwidth ? bandwidth : config->peakBandwidth;
+    flops = config->peakFlops * c->threads / config->peakThreads;
+
+    result->intensity  = result->flops / result->bytes;
+    result->memory_bound = result->intensity * bandwidth < flops;
+    result->attainable = result->memory_bound ? result->intensity * bandwidth : flops;
+    if (result->attainable > 0) {
+        result->roofline_fraction = result->gflops * 1e9 / result->attainable;
+    }
+}
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "capture_batched.h"
+#include "bench.h"
+
+/*
+    Replay of captured batches (SLSB_CAPTURE, see capture_batched.cpp) by the
+    benchmark suite: with --replay FILE the systems of a case are those of
+    FILE with the same N instead of random normal ones, in the order of the
+    file and repeated cyclically up to the batch count of the case, so every
+    run of a given case solves the same systems. Without --n the sweep runs
+    the orders present in the file.
+*/
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Reads every record of the capture file path into replay, grouped by N.
+ Returns 0, or -1 if the file cannot be read; a truncated last record (the
+ capturing process was killed) is ignored with a warning.
+ *******************************************************************************/
+int bench_replay_load(const char* path, bench_replay* replay, FILE* log)
+{
+    capture_record_header h;
+    float *A, *B;
+    long long records = 0, systems = 0;
+    int status;
+    FILE* f = capture_batched_open(path);
+
+    if (f == NULL) {
+        return -1;
+    }
+    for (int n = 0; n <= 32; n++) {
+        replay->A[n].clear();
+        replay->B[n].clear();
+    }
+    while ((status = capture_batched_read(f, &h, &A, &B)) == 1) {
+        const size_t nn = (size_t)h.n * h.n;
+        replay->A[h.n].insert(replay->A[h.n].end(), A, A + h.systems * nn);
+        replay->B[h.n].insert(replay->B[h.n].end(), B, B + (size_t)h.systems * h.n);
+        free(A);
+        free(B);
+        records++;
+        systems += h.systems;
+    }
+    fclose(f);
+    if (status < 0) {
+        if (records == 0) {
+            return -1;
+        }
+        fprintf(log, "warning: %s ends with a truncated record, %lld records kept\n", path, records);
+    }
+    fprintf(log, "replay %s: %lld records, %lld systems\n", path, records, systems);
+    return 0;
+}
+
+int bench_replay_count(const bench_replay* replay, int n)
+{
+    if (n < 1 || n > 32) {
+        return 0;
+    }
+    return (int)(replay->B[n].size() / n);
+}
+
+// Orders with captured systems.
+void bench_replay_ns(const bench_replay* replay, std::vector<int>* ns)
+{
+    ns->clear();
+    for (int n = 1; n <= 32; n++) {
+        if (bench_replay_count(replay, n) > 0) {
+            ns->push_back(n);
+        }
+    }
+}
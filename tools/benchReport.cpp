@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include "bench.h"
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+/*
+    Statistics and machine readable output of the benchmark suite.
+
+    CSV: one header line, then one row per case.
+    JSON: one object with the run parameters and a "results" array holding
+    one object per case, with the same keys as the CSV columns.
+    Times are in seconds, rates at the median time. backward_error is
+    empty in CSV and null in JSON when it was not checked or is infinite.
+
+    With --counters, every phase of the cpu backend adds <phase>_ns, one
+    <phase>_<counter> per hardware counter and <phase>_ipc, all per system;
+    counters that could not be opened are empty in CSV and null in JSON.
+*/
+
+void bench_compute_stats(std::vector<double>& times, bench_stats* stats)
+{
+    const int reps = (int)times.size();
+    double sum = 0.0, sq = 0.0;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->reps = reps;
+    if (reps == 0) {
+        return;
+    }
+    std::sort(times.begin(), times.end());
+    stats->min = times[0];
+    stats->max = times[reps - 1];
+    stats->median = (reps % 2 == 1) ? times[reps / 2]
+                                    : 0.5 * (times[reps / 2 - 1] + times[reps / 2]);
+    for (int r = 0; r < reps; r++) {
+        sum += times[r];
+    }
+    stats->mean = sum / reps;
+    for (int r = 0; r < reps; r++) {
+        sq += (times[r] - stats->mean) * (times[r] - stats->mean);
+    }
+    stats->stddev = reps > 1 ? sqrt(sq / (reps - 1)) : 0.0;
+}
+
+// Backward error of the case, "" or null if it was not checked or is infinite.
+static void bench_report_backward_error(FILE* f, const bench_config* config, const bench_result* result)
+{
+    if (result->backward_error >= 0 && result->backward_error < HUGE_VAL) {
+        fprintf(f, "%.3e", result->backward_error);
+    }
+    else if (config->format == BENCH_FORMAT_JSON) {
+        fprintf(f, "null");
+    }
+}
+
+// "memory" or "compute", "" without a roofline.
+static const char* bench_roofline_bound(const bench_result* result)
+{
+    if (result->attainable <= 0) {
+        return "";
+    }
+    return result->memory_bound ? "memory" : "compute";
+}
+
+// Hardware counter c of phase p per system, negative if it was not counted.
+static double bench_counter(const bench_result* result, int p, int c)
+{
+    const cpu_perf_counters* perf = &result->perf;
+    if (perf->systems <= 0 || !(perf->available & (1u << c))) {
+        return -1.0;
+    }
+    return perf->value[p][c] / (double)perf->systems;
+}
+
+static double bench_ipc(const bench_result* result, int p)
+{
+    const double cycles = bench_counter(result, p, CPU_PERF_CYCLES);
+    const double instructions = bench_counter(result, p, CPU_PERF_INSTRUCTIONS);
+    return (cycles > 0 && instructions >= 0) ? instructions / cycles : -1.0;
+}
+
+// One value of the counters, "" or null if it was not counted.
+static void bench_counter_value(FILE* f, const bench_config* config, double value)
+{
+    if (value >= 0) {
+        fprintf(f, "%.4f", value);
+    }
+    else if (config->format == BENCH_FORMAT_JSON) {
+        fprintf(f, "null");
+    }
+}
+
+static void bench_report_counters(FILE* f, const bench_config* config, const bench_result* result)
+{
+    const cpu_perf_counters* perf = &result->perf;
+
+    for (int p = 0; p < CPU_PERF_NPHASES; p++) {
+        const double ns = perf->systems > 0 ? 1e9 * perf->seconds[p] / perf->systems : -1.0;
+        if (config->format == BENCH_FORMAT_JSON) {
+            fprintf(f, "%s\"%s\": {\"ns\": ", p == 0 ? "" : ",\n       ",
+                    cpuLinearSolverBatchedPerfPhaseName(p));
+        }
+        else {
+            fprintf(f, ",");
+        }
+        bench_counter_value(f, config, ns);
+        for (int c = 0; c < CPU_PERF_NCOUNTERS; c++) {
+            if (config->format == BENCH_FORMAT_JSON) {
+                fprintf(f, ", \"%s\": ", cpuLinearSolverBatchedPerfCounterName(c));
+            }
+            else {
+                fprintf(f, ",");
+            }
+            bench_counter_value(f, config, bench_counter(result, p, c));
+        }
+        fprintf(f, config->format == BENCH_FORMAT_JSON ? ", \"ipc\": " : ",");
+        bench_counter_value(f, config, bench_ipc(result, p));
+        if (config->format == BENCH_FORMAT_JSON) {
+            fprintf(f, "}");
+        }
+    }
+}
+
+void bench_report_begin(FILE* f, const bench_config* config)
+{
+    char host[256] = "unknown";
+    char date[64];
+    time_t now = time(NULL);
+    int threads = 1;
+
+#if defined(_OPENMP)
+    threads = omp_get_max_threads();
+#endif
+    gethostname(host, sizeof(host) - 1);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    if (config->format == BENCH_FORMAT_JSON) {
+        fprintf(f, "{\n");
+        fprintf(f, "  \"tool\": \"benchSgesv\",\n");
+        fprintf(f, "  \"format_version\": 1,\n");
+        fprintf(f, "  \"date\": \"%s\",\n", date);
+        fprintf(f, "  \"host\": \"%s\",\n", host);
+        fprintf(f, "  \"max_threads\": %d,\n", threads);
+        fprintf(f, "  \"warmup\": %d,\n", config->warmup);
+        fprintf(f, "  \"reps\": %d,\n", config->reps);
+        fprintf(f, "  \"seed\": %u,\n", config->seed);
+        fprintf(f, "  \"flush_bytes\": %zu,\n", config->flushBytes);
+        if (!config->scalings.empty() || config->roofline) {
+            fprintf(f, "  \"peak_threads\": %d,\n", config->peakThreads);
+            fprintf(f, "  \"peak_bandwidth\": %.0f,\n", config->peakBandwidth);
+            fprintf(f, "  \"peak_bandwidth_1\": %.0f,\n", config->peakBandwidth1);
+            fprintf(f, "  \"peak_flops\": %.0f,\n", config->peakFlops);
+        }
+        fprintf(f, "  \"results\": [\n");
+    }
+    else {
+        fprintf(f, "backend,layout,variant,chunk,threads,cache,matrix,n,batch_count,status,reps,"
+                   "time_first,time_median,time_min,time_max,time_mean,time_stddev,"
+                   "gflops,gbs,flops,bytes,backward_error%s%s",
+                config->scalings.empty() ? "" : ",scaling,speedup,efficiency,peak_fraction",
+                config->roofline ? ",intensity,attainable_gflops,roofline_fraction,bound" : "");
+        for (int p = 0; config->counters && p < CPU_PERF_NPHASES; p++) {
+            const char* phase = cpuLinearSolverBatchedPerfPhaseName(p);
+            fprintf(f, ",%s_ns", phase);
+            for (int c = 0; c < CPU_PERF_NCOUNTERS; c++) {
+                fprintf(f, ",%s_%s", phase, cpuLinearSolverBatchedPerfCounterName(c));
+            }
+            fprintf(f, ",%s_ipc", phase);
+        }
+        fprintf(f, "\n");
+    }
+}
+
+void bench_report_result(FILE* f, const bench_config* config, const bench_result* result, int first)
+{
+    const bench_case* c = &result->c;
+    const bench_stats* t = &result->time;
+    char layout[32], matrix[32];
+
+    bench_layout_name(&c->layout, layout, sizeof(layout));
+    bench_matrix_name(&c->matrix, matrix, sizeof(matrix));
+    if (config->format == BENCH_FORMAT_JSON) {
+        fprintf(f, "%s    {\"backend\": \"%s\", \"layout\": \"%s\", \"variant\": \"%s\", \"chunk\": %d, "
+                   "\"threads\": %d, \"cache\": \"%s\", \"matrix\": \"%s\", \"n\": %d, \"batch_count\": %d, "
+                   "\"status\": %d, \"reps\": %d,\n"
+                   "     \"time_first\": %.9e, \"time_median\": %.9e, \"time_min\": %.9e, \"time_max\": %.9e, "
+                   "\"time_mean\": %.9e, \"time_stddev\": %.9e,\n"
+                   "     \"gflops\": %.6f, \"gbs\": %.6f, \"flops\": %.0f, \"bytes\": %.0f",
+                first ? "" : ",\n",
+                bench_backend_name(c->backend), layout, bench_variant_name(c->variant), c->chunk,
+                c->threads, bench_cache_name(c->cache), matrix, c->n, c->batchCount, result->status, t->reps,
+                result->time_first, t->median, t->min, t->max, t->mean, t->stddev,
+                result->gflops, result->gbs, result->flops, result->bytes);
+        fprintf(f, ", \"backward_error\": ");
+        bench_report_backward_error(f, config, result);
+        if (result->scaling != BENCH_SCALING_NONE) {
+            fprintf(f, ",\n     \"scaling\": \"%s\", \"speedup\": %.6f, \"efficiency\": %.6f, "
+                       "\"peak_fraction\": %.6f",
+                    bench_scaling_name(result->scaling), result->speedup, result->efficiency,
+                    result->peak_fraction);
+        }
+        if (config->roofline) {
+            fprintf(f, ",\n     \"intensity\": %.6f, \"attainable_gflops\": %.6f, "
+                       "\"roofline_fraction\": %.6f, \"bound\": \"%s\"",
+                    result->intensity, result->attainable / 1e9, result->roofline_fraction,
+                    bench_roofline_bound(result));
+        }
+        if (result->perf.systems > 0) {
+            fprintf(f, ",\n     \"counters\": {");
+            bench_report_counters(f, config, result);
+            fprintf(f, "}");
+        }
+        fprintf(f, "}");
+    }
+    else {
+        fprintf(f, "%s,%s,%s,%d,%d,%s,%s,%d,%d,%d,%d,%.9e,%.9e,%.9e,%.9e,%.9e,%.9e,%.6f,%.6f,%.0f,%.0f,",
+                bench_backend_name(c->backend), layout, bench_variant_name(c->variant), c->chunk,
+                c->threads, bench_cache_name(c->cache), matrix, c->n, c->batchCount, result->status, t->reps,
+                result->time_first, t->median, t->min, t->max, t->mean, t->stddev,
+                result->gflops, result->gbs, result->flops, result->bytes);
+        bench_report_backward_error(f, config, result);
+        if (!config->scalings.empty()) {
+            fprintf(f, ",%s,%.6f,%.6f,%.6f", bench_scaling_name(result->scaling),
+                    result->speedup, result->efficiency, result->peak_fraction);
+        }
+        if (config->roofline) {
+            fprintf(f, ",%.6f,%.6f,%.6f,%s", result->intensity, result->attainable / 1e9,
+                    result->roofline_fraction, bench_roofline_bound(result));
+        }
+        if (config->counters) {
+            bench_report_counters(f, config, result);
+        }
+        fprintf(f, "\n");
+    }
+    fflush(f);
+}
+
+void bench_report_end(FILE* f, const bench_config* config)
+{
+    if (config->format == BENCH_FORMAT_JSON) {
+        fprintf(f, "\n  ]\n}\n");
+    }
+    fflush(f);
+}
+
+// One human readable line per case.
+void bench_log_result(FILE* log, const bench_result* result)
+{
+    const bench_case* c = &result->c;
+    char layout[32], matrix[32];
+
+    bench_layout_name(&c->layout, layout, sizeof(layout));
+    bench_matrix_name(&c->matrix, matrix, sizeof(matrix));
+    fprintf(log, "%-10s %-13s %-8s chunk %3d threads %3d %s %s n %2d batch %8d: "
+                 "median %10.3f ms  min %10.3f ms  sd %8.3f ms  %8.2f GFLOP/s  %7.2f GB/s",
+            bench_backend_name(c->backend), layout, bench_variant_name(c->variant), c->chunk,
+            c->threads, bench_cache_name(c->cache), matrix, c->n, c->batchCount,
+            result->time.median * 1e3, result->time.min * 1e3, result->time.stddev * 1e3,
+            result->gflops, result->gbs);
+    if (result->backward_error >= 0) {
+        fprintf(log, "  berr %8.2e", result->backward_error);
+    }
+    if (result->scaling != BENCH_SCALING_NONE) {
+        fprintf(log, "  speedup %6.2f  efficiency %5.2f", result->speedup, result->efficiency);
+    }
+    if (result->attainable > 0) {
+        fprintf(log, "  AI %5.2f flop/B, roof %8.2f GFLOP/s (%s), %5.1f%% of roof",
+                result->intensity, result->attainable / 1e9, bench_roofline_bound(result),
+                100.0 * result->roofline_fraction);
+    }
+    fprintf(log, "%s\n", result->status < 0 ? "  (error)" : "");
+
+    for (int p = 0; result->perf.systems > 0 && p < CPU_PERF_NPHASES; p++) {
+        const double cycles = bench_counter(result, p, CPU_PERF_CYCLES);
+        fprintf(log, "    %-8s %8.1f ns/system", cpuLinearSolverBatchedPerfPhaseName(p),
+                1e9 * result->perf.seconds[p] / result->perf.systems);
+        if (cycles >= 0) {
+            fprintf(log, "  %9.1f cycles", cycles);
+        }
+        if (bench_ipc(result, p) >= 0) {
+            fprintf(log, "  IPC %5.2f", bench_ipc(result, p));
+        }
+        for (int c = CPU_PERF_CACHE_REFS; c < CPU_PERF_NCOUNTERS; c++) {
+            if (bench_counter(result, p, c) >= 0) {
+                fprintf(log, "  %s %.2f", cpuLinearSolverBatchedPerfCounterName(c), bench_counter(result, p, c));
+            }
+        }
+        fprintf(log, "\n");
+    }
+}
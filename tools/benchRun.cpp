@@ -0,0 +1,639 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <cuda_runtime.h>
+#include <lapacke.h>
+#include "utils.h"
+#include "flops.h"
+#include "operation_batched.h"
+#include "smallsq_dispatch.h"
+#include "slsb.h"
+#include "matgen_batched.h"
+#include "bench.h"
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+/*
+    Execution of one benchmark case: the batch is generated from the seed
+    (matrices of the type of the case, see matgen_batched.h), or taken from
+    the replayed capture, directly in the layout of the case (and copied to
+    the device if needed), then the solver of the backend is run
+    config->warmup times untimed and config->reps times timed. The solution
+    of the last run is checked: the largest normwise backward error of the
+    batch is reported with the times, so that a fast path can be judged on
+    its accuracy too, e.g. on ill conditioned or nearly singular matrices.
+
+    Cold runs (BENCH_CACHE_COLD) flush the caches before each run, untimed:
+    every core sweeps its share of a host buffer several times the size of
+    the last level cache (dirtying the lines, so the batch is written back
+    and evicted, and touching other pages, so its TLB entries are gone too),
+    for gpu-device the L2 cache of the GPU is overwritten as well, and with
+    dropPages the page cache is dropped, which matters for file backed data.
+    Warm runs leave the batch where the previous run (or the generation)
+    put it. Solving a batch that was just produced is the warm case, solving
+    batches streamed from memory or disk the cold one.
+*/
+
+// Buffers of a case. A, B and X are in the layout of the case and in host
+// memory; d_* are their device copies for BENCH_GPU_DEVICE, w_* the work
+// copies overwritten by sgesv_ for BENCH_LAPACK.
+struct bench_data
+{
+    float *A, *B, *X;
+    int   *info;
+    float *w_A, *w_B;
+    int   *ipiv;
+    float *d_A, *d_B, *d_X;
+    int32_t *d_info;
+    unsigned char *d_flush;
+    size_t d_flushBytes;
+    cudaStream_t stream;
+    slsb_context ctx;
+    slsb_batch   batch;
+};
+
+const char* bench_backend_name(int backend)
+{
+    switch (backend) {
+        case BENCH_CPU:        return "cpu";
+        case BENCH_GPU:        return "gpu";
+        case BENCH_GPU_DEVICE: return "gpu-device";
+        case BENCH_LAPACK:     return "lapack";
+        default:               return "unknown";
+    }
+}
+
+const char* bench_variant_name(int variant)
+{
+    switch (variant) {
+        case BENCH_VARIANT_AUTO:   return "auto";
+        case CPU_VARIANT_SCALAR:   return "scalar";
+        case CPU_VARIANT_GATHER4:  return "gather4";
+        case CPU_VARIANT_GATHER8:  return "gather8";
+        case CPU_VARIANT_GATHER16: return "gather16";
+        default:                   return "unknown";
+    }
+}
+
+const char* bench_cache_name(int cache)
+{
+    return cache == BENCH_CACHE_COLD ? "cold" : "warm";
+}
+
+// Four times the largest cache of cpu0, at least 64 MiB.
+size_t bench_default_flush_bytes()
+{
+    size_t largest = 0;
+    for (int index = 0; index < 8; index++) {
+        char path[128];
+        unsigned long size = 0;
+        char unit = 'K';
+        FILE* f;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+        f = fopen(path, "r");
+        if (f == NULL) {
+            continue;
+        }
+        if (fscanf(f, "%lu%c", &size, &unit) >= 1) {
+            size *= (unit == 'M') ? 1024 * 1024 : (unit == 'K') ? 1024 : 1;
+            largest = size > largest ? size : largest;
+        }
+        fclose(f);
+    }
+    largest *= 4;
+    return largest > ((size_t)64 << 20) ? largest : ((size_t)64 << 20);
+}
+
+void bench_layout_name(const bench_layout* layout, char* name, size_t len)
+{
+    switch (layout->layout) {
+        case BENCH_LAYOUT_PACKED:      snprintf(name, len, "packed"); break;
+        case BENCH_LAYOUT_PADDED:      snprintf(name, len, "padded"); break;
+        case BENCH_LAYOUT_INTERLEAVED: snprintf(name, len, "interleaved%d", layout->param); break;
+        default:                       snprintf(name, len, "unknown");
+    }
+}
+
+void bench_matrix_name(const bench_matrix* matrix, char* name, size_t len)
+{
+    if (matrix->param > 0) {
+        snprintf(name, len, "%s:%g", matgen_batched_name(matrix->type), matrix->param);
+    }
+    else {
+        snprintf(name, len, "%s", matgen_batched_name(matrix->type));
+    }
+}
+
+// Parses "type" or "type:param" (e.g. cond:1e6), the inverse of bench_matrix_name. 0 on success.
+int bench_parse_matrix(const char* name, bench_matrix* matrix)
+{
+    const char* colon = strchr(name, ':');
+    const size_t len = colon != NULL ? (size_t)(colon - name) : strlen(name);
+
+    matrix->param = 0.0;
+    for (int type = 0; type < MATGEN_NTYPES; type++) {
+        if (strlen(matgen_batched_name(type)) == len && strncmp(name, matgen_batched_name(type), len) == 0) {
+            matrix->type = type;
+            if (colon != NULL) {
+                char* end;
+                matrix->param = strtod(colon + 1, &end);
+                if (end == colon + 1 || *end != '\0' || matrix->param <= 0) {
+                    return -1;
+                }
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// 1 if a solver exists for the combination.
+int bench_case_supported(const bench_case* c)
+{
+    const int layout = c->layout.layout;
+    const int W = c->layout.param;
+
+    if (c->n < 1 || c->n > 32) {
+        return 0;
+    }
+    if (c->backend != BENCH_LAPACK && !smallsq_size_instantiated(c->n)) {
+        return 0;
+    }
+    if (c->variant != BENCH_VARIANT_AUTO
+        && !(c->backend == BENCH_CPU && layout == BENCH_LAYOUT_PACKED)) {
+        return 0;
+    }
+    switch (c->backend) {
+        case BENCH_CPU:
+            return layout == BENCH_LAYOUT_PACKED
+                || (layout == BENCH_LAYOUT_INTERLEAVED && (W == 4 || W == 8 || W == 16));
+        case BENCH_GPU:
+        case BENCH_LAPACK:
+            return layout == BENCH_LAYOUT_PACKED;
+        case BENCH_GPU_DEVICE:
+            return layout == BENCH_LAYOUT_PACKED || layout == BENCH_LAYOUT_PADDED
+                || (layout == BENCH_LAYOUT_INTERLEAVED && (W == 4 || W == 8 || W == 16 || W == 32));
+        default:
+            return 0;
+    }
+}
+
+int bench_layout_ld(const bench_case* c)
+{
+    return c->layout.layout == BENCH_LAYOUT_PADDED ? (int)magma_roundup(c->n, 32) : c->n;
+}
+
+double bench_case_flops(const bench_case* c)
+{
+    return (double)c->batchCount * (FLOPS_SGETRF(c->n, c->n) + FLOPS_SGETRS(c->n, 1));
+}
+
+// Number of systems the arrays must be allocated for.
+static size_t bench_alloc_count(const bench_case* c)
+{
+    const int W = c->layout.param;
+    if (c->layout.layout == BENCH_LAYOUT_INTERLEAVED) {
+        return (size_t)((c->batchCount + W - 1) / W) * W;
+    }
+    return (size_t)c->batchCount;
+}
+
+// Bytes the solver has to move at least: A and B read once, X and info
+// written once, with the padding of the layout (leading dimension, and the
+// lanes of the last interleaved group).
+double bench_case_bytes(const bench_case* c)
+{
+    const double ld = bench_layout_ld(c);
+    return (double)bench_alloc_count(c) * sizeof(float) * (ld * c->n + 2.0 * ld)
+         + (double)c->batchCount * sizeof(int);
+}
+
+// Index of A(i,j) and B(i) of system s, same as the layout_traits of
+// sgesv_batched_views.h with the layout chosen at run time.
+static size_t bench_index_a(const bench_case* c, int ld, int s, int i, int j)
+{
+    const int n = c->n;
+    const int W = c->layout.param;
+    switch (c->layout.layout) {
+        case BENCH_LAYOUT_INTERLEAVED:
+            return ((size_t)(s / W) * n * n + i + (size_t)j * n) * W + s % W;
+        default:
+            return (size_t)s * ld * n + i + (size_t)j * ld;
+    }
+}
+
+static size_t bench_index_b(const bench_case* c, int ld, int s, int i)
+{
+    const int n = c->n;
+    const int W = c->layout.param;
+    switch (c->layout.layout) {
+        case BENCH_LAYOUT_INTERLEAVED:
+            return ((size_t)(s / W) * n + i) * W + s % W;
+        default:
+            return (size_t)s * ld + i;
+    }
+}
+
+// Captured systems of order n, repeated cyclically over the batch.
+static void bench_fill_replay(const bench_case* c, int ld, float* A, float* B, const bench_replay* replay)
+{
+    const int n = c->n;
+    const int count = bench_replay_count(replay, n);
+
+    for (int s = 0; s < c->batchCount; s++) {
+        const float* sA = &replay->A[n][(size_t)(s % count) * n * n];
+        const float* sB = &replay->B[n][(size_t)(s % count) * n];
+        for (int j = 0; j < n; j++) {
+            for (int i = 0; i < n; i++) {
+                A[bench_index_a(c, ld, s, i, j)] = sA[i + j * n];
+            }
+            B[bench_index_b(c, ld, s, j)] = sB[j];
+        }
+    }
+}
+
+// Matrices of the type of the case from the counter based generator: system
+// s only depends on the seed and s, whatever the thread count, and normal
+// ones are the systems of the tester.
+static void bench_fill(const bench_case* c, int ld, float* A, float* B, unsigned int seed)
+{
+    const int n = c->n;
+
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
+    for (int s = 0; s < c->batchCount; s++) {
+        float sA[32 * 32], sB[32];
+        matgen_batched_system(c->matrix.type, c->matrix.param, n, sA, sB, s, seed);
+        for (int k = 0; k < n * n; k++) {
+            A[bench_index_a(c, ld, s, k % n, k / n)] = sA[k];
+        }
+        for (int k = 0; k < n; k++) {
+            B[bench_index_b(c, ld, s, k)] = sB[k];
+        }
+    }
+}
+
+static void bench_free(bench_data* d)
+{
+    if (d->batch != NULL) slsb_batch_destroy(d->batch);
+    if (d->ctx != NULL) slsb_context_destroy(d->ctx);
+    if (d->stream != NULL) cudaStreamDestroy(d->stream);
+    magma_free_cpu(d->A);
+    magma_free_cpu(d->B);
+    magma_free_cpu(d->X);
+    magma_free_cpu(d->info);
+    magma_free_cpu(d->w_A);
+    magma_free_cpu(d->w_B);
+    magma_free_cpu(d->ipiv);
+    magma_free(d->d_A);
+    magma_free(d->d_B);
+    magma_free(d->d_X);
+    magma_free(d->d_info);
+    magma_free(d->d_flush);
+    memset(d, 0, sizeof(*d));
+}
+
+static int bench_alloc(const bench_config* config, const bench_case* c, bench_data* d)
+{
+    const int n  = c->n;
+    const int ld = bench_layout_ld(c);
+    const size_t count = bench_alloc_count(c);
+    const size_t sizeA = count * ld * n;
+    const size_t sizeB = count * ld;
+    int resCode = 0;
+
+    memset(d, 0, sizeof(*d));
+
+    resCode = magma_smalloc_cpu(&d->A, sizeA);
+    if (resCode != 0) {fprintf(stderr, "Error in: h_A malloc\n"); goto cleanup;}
+    resCode = magma_smalloc_cpu(&d->B, sizeB);
+    if (resCode != 0) {fprintf(stderr, "Error in: h_B malloc\n"); goto cleanup;}
+    resCode = magma_smalloc_cpu(&d->X, sizeB);
+    if (resCode != 0) {fprintf(stderr, "Error in: h_X malloc\n"); goto cleanup;}
+    resCode = magma_malloc_cpu((void**)&d->info, count * sizeof(int));
+    if (resCode != 0) {fprintf(stderr, "Error in: h_info malloc\n"); goto cleanup;}
+
+    // padding and unused lanes are zero
+    memset(d->A, 0, sizeA * sizeof(float));
+    memset(d->B, 0, sizeB * sizeof(float));
+    if (config->replay != NULL && bench_replay_count(config->replay, n) > 0) {
+        bench_fill_replay(c, ld, d->A, d->B, config->replay);
+    }
+    else {
+        bench_fill(c, ld, d->A, d->B, config->seed);
+    }
+
+    if (c->backend == BENCH_LAPACK) {
+        resCode = magma_smalloc_cpu(&d->w_A, sizeA);
+        if (resCode != 0) {fprintf(stderr, "Error in: w_A malloc\n"); goto cleanup;}
+        resCode = magma_smalloc_cpu(&d->w_B, sizeB);
+        if (resCode != 0) {fprintf(stderr, "Error in: w_B malloc\n"); goto cleanup;}
+        resCode = magma_malloc_cpu((void**)&d->ipiv, count * n * sizeof(int));
+        if (resCode != 0) {fprintf(stderr, "Error in: ipiv malloc\n"); goto cleanup;}
+    }
+
+    if (c->backend == BENCH_GPU_DEVICE) {
+        const int64_t param = c->layout.layout == BENCH_LAYOUT_PADDED ? ld : c->layout.param;
+        const int32_t layout = c->layout.layout == BENCH_LAYOUT_PADDED ? SLSB_LAYOUT_PADDED
+                             : c->layout.layout == BENCH_LAYOUT_INTERLEAVED ? SLSB_LAYOUT_INTERLEAVED
+                             : SLSB_LAYOUT_PACKED;
+
+        resCode = cudaStreamCreate(&d->stream);
+        if (resCode != 0) {fprintf(stderr, "Error in: stream creation\n"); goto cleanup;}
+        resCode = magma_smalloc(&d->d_A, sizeA);
+        if (resCode != 0) {fprintf(stderr, "Error in: d_A malloc\n"); goto cleanup;}
+        resCode = magma_smalloc(&d->d_B, sizeB);
+        if (resCode != 0) {fprintf(stderr, "Error in: d_B malloc\n"); goto cleanup;}
+        resCode = magma_smalloc(&d->d_X, sizeB);
+        if (resCode != 0) {fprintf(stderr, "Error in: d_X malloc\n"); goto cleanup;}
+        resCode = magma_malloc((void**)&d->d_info, count * sizeof(int32_t));
+        if (resCode != 0) {fprintf(stderr, "Error in: d_info malloc\n"); goto cleanup;}
+        resCode = cudaMemcpy(d->d_A, d->A, sizeA * sizeof(float), cudaMemcpyHostToDevice);
+        if (resCode != 0) {fprintf(stderr, "Error in: A copy\n"); goto cleanup;}
+        resCode = cudaMemcpy(d->d_B, d->B, sizeB * sizeof(float), cudaMemcpyHostToDevice);
+        if (resCode != 0) {fprintf(stderr, "Error in: B copy\n"); goto cleanup;}
+
+        if (c->cache == BENCH_CACHE_COLD) {
+            cudaDeviceProp prop;
+            int device = 0;
+            cudaGetDevice(&device);
+            cudaGetDeviceProperties(&prop, device);
+            d->d_flushBytes = (size_t)2 * prop.l2CacheSize > ((size_t)8 << 20)
+                            ? (size_t)2 * prop.l2CacheSize : ((size_t)8 << 20);
+            resCode = magma_malloc((void**)&d->d_flush, d->d_flushBytes);
+            if (resCode != 0) {fprintf(stderr, "Error in: d_flush malloc\n"); goto cleanup;}
+        }
+
+        resCode = slsb_context_create(&d->ctx, SLSB_BACKEND_GPU, d->stream);
+        if (resCode != 0) {fprintf(stderr, "Error in: slsb_context_create, %s\n", slsb_status_string(resCode)); goto cleanup;}
+        resCode = slsb_batch_create(&d->batch, d->ctx, n, c->batchCount,
+                                    SLSB_MEMORY_DEVICE, layout, param);
+        if (resCode != 0) {fprintf(stderr, "Error in: slsb_batch_create, %s\n", slsb_status_string(resCode)); goto cleanup;}
+    }
+
+cleanup:
+    if (resCode != 0) {
+        bench_free(d);
+    }
+    return resCode;
+}
+
+// Untimed work before each run: sgesv_ overwrites its inputs.
+static void bench_prepare(const bench_case* c, bench_data* d)
+{
+    if (c->backend == BENCH_LAPACK) {
+        const size_t count = bench_alloc_count(c);
+        memcpy(d->w_A, d->A, count * c->n * c->n * sizeof(float));
+        memcpy(d->w_B, d->B, count * c->n * sizeof(float));
+    }
+}
+
+// Sweeps the host flush buffer from every core.
+static void bench_flush_host(size_t bytes)
+{
+    static float* buffer = NULL;
+    static size_t size = 0;
+    static unsigned int sweep = 0;
+    const size_t count = bytes / sizeof(float);
+
+    if (size < count) {
+        magma_free_cpu(buffer);
+        buffer = NULL;
+        size = 0;
+        if (magma_smalloc_cpu(&buffer, count) != 0) {
+            fprintf(stderr, "Error in: flush buffer malloc\n");
+            return;
+        }
+        memset(buffer, 0, count * sizeof(float));
+        size = count;
+    }
+    sweep++;
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static) num_threads(omp_get_num_procs())
+#endif
+    for (size_t k = 0; k < count; k++) {
+        buffer[k] = buffer[k] * 0.5f + (float)sweep;
+    }
+}
+
+// Drops the page cache, warns once if not permitted.
+static void bench_drop_pages()
+{
+    static int warned = 0;
+    FILE* f;
+
+    sync();
+    f = fopen("/proc/sys/vm/drop_caches", "w");
+    if (f == NULL || fputs("1\n", f) < 0) {
+        if (!warned) {
+            fprintf(stderr, "Cannot drop the page cache (needs root), cold runs only flush the caches\n");
+            warned = 1;
+        }
+    }
+    if (f != NULL) {
+        fclose(f);
+    }
+}
+
+static void bench_flush(const bench_config* config, const bench_case* c, bench_data* d)
+{
+    if (c->cache != BENCH_CACHE_COLD) {
+        return;
+    }
+    bench_flush_host(config->flushBytes);
+    if (config->dropPages) {
+        bench_drop_pages();
+    }
+    if (d->d_flush != NULL) {
+        static int value = 0;
+        cudaMemsetAsync(d->d_flush, ++value & 0xff, d->d_flushBytes, d->stream);
+        cudaStreamSynchronize(d->stream);
+    }
+}
+
+// One solve of the whole batch, returns the status of the solver.
+static int bench_solve(const bench_case* c, bench_data* d)
+{
+    const int n = c->n;
+    int status = 0;
+
+    switch (c->backend) {
+        case BENCH_CPU:
+            if (c->layout.layout == BENCH_LAYOUT_INTERLEAVED) {
+                switch (c->layout.param) {
+                    case  4: return cpuLinearSolverBatchedInterleaved< 4>(n, d->A, d->B, &d->X, d->info, c->batchCount);
+                    case  8: return cpuLinearSolverBatchedInterleaved< 8>(n, d->A, d->B, &d->X, d->info, c->batchCount);
+                    case 16: return cpuLinearSolverBatchedInterleaved<16>(n, d->A, d->B, &d->X, d->info, c->batchCount);
+                    default: return -1;
+                }
+            }
+            if (c->variant == BENCH_VARIANT_AUTO) {
+                return cpuLinearSolverBatched(n, d->A, d->B, &d->X, d->info, c->batchCount);
+            }
+            return cpuLinearSolverBatchedVariant(n, c->variant, c->chunk, d->A, d->B, &d->X, d->info, c->batchCount);
+
+        case BENCH_GPU:
+            return gpuLinearSolverBatched(n, d->A, d->B, &d->X, d->info, c->batchCount);
+
+        case BENCH_GPU_DEVICE:
+            status = slsb_solve(d->batch, d->d_A, d->d_B, d->d_X, d->d_info);
+            if (cudaStreamSynchronize(d->stream) != cudaSuccess) {
+                status = SLSB_ERR_BACKEND;
+            }
+            return status;
+
+        case BENCH_LAPACK:
+        {
+            int nrhs = 1;
+            int lda = n;
+            int ldb = n;
+#if defined(_OPENMP)
+#pragma omp parallel for reduction(max:status)
+#endif
+            for (int s = 0; s < c->batchCount; s++) {
+                magma_int_t locinfo;
+                int N = n;
+                sgesv_(&N, &nrhs, d->w_A + (size_t)s * lda * n, &lda, d->ipiv + (size_t)s * n,
+                       d->w_B + (size_t)s * ldb, &ldb, &locinfo);
+                status = (int)locinfo > status ? (int)locinfo : status;
+            }
+            return status;
+        }
+
+        default:
+            return -1;
+    }
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Largest normwise backward error |b - Ax| / (|A| |x| + |b|), infinity
+ norms, of the solutions of the last run, in double. gpu-device copies its
+ solution back first; sgesv_ leaves it in w_B. Infinite when a solution is
+ not finite (a singular system).
+ *******************************************************************************/
+static double bench_backward_error(const bench_case* c, bench_data* d)
+{
+    const int n  = c->n;
+    const int ld = bench_layout_ld(c);
+    const float* X = c->backend == BENCH_LAPACK ? d->w_B : d->X;
+    double worst = 0.0;
+
+    if (c->backend == BENCH_GPU_DEVICE
+        && cudaMemcpy(d->X, d->d_X, bench_alloc_count(c) * ld * sizeof(float), cudaMemcpyDeviceToHost) != cudaSuccess) {
+        return -1.0;
+    }
+#if defined(_OPENMP)
+#pragma omp parallel for reduction(max:worst)
+#endif
+    for (int s = 0; s < c->batchCount; s++) {
+        double normA = 0.0, normX = 0.0, normB = 0.0, normR = 0.0;
+        for (int i = 0; i < n; i++) {
+            const double b = d->B[bench_index_b(c, ld, s, i)];
+            double r = b, row = 0.0;
+            for (int j = 0; j < n; j++) {
+                const double a = d->A[bench_index_a(c, ld, s, i, j)];
+                r -= a * X[bench_index_b(c, ld, s, j)];
+                row += fabs(a);
+            }
+            normA = fmax(normA, row);
+            normX = fmax(normX, fabs((double)X[bench_index_b(c, ld, s, i)]));
+            normB = fmax(normB, fabs(b));
+            normR = fmax(normR, fabs(r));
+        }
+        const double eta = normR / (normA * normX + normB);
+        worst = fmax(worst, eta == eta ? eta : HUGE_VAL);
+    }
+    return worst;
+}
+
+// Runs the timed repetitions again with the hardware counters of the CPU
+// engine, which slow it down, so that the times stay those of the normal path.
+static void bench_count(const bench_config* config, const bench_case* c, bench_data* d,
+                        bench_result* result)
+{
+    if (cpuLinearSolverBatchedPerfEnable(1) == 0) {
+        return;
+    }
+    cpuLinearSolverBatchedPerfReset();
+    for (int r = 0; r < config->reps; r++) {
+        bench_prepare(c, d);
+        bench_flush(config, c, d);
+        bench_solve(c, d);
+    }
+    cpuLinearSolverBatchedPerfEnable(0);
+    cpuLinearSolverBatchedPerfGet(&result->perf);
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Times one benchmark case. Returns 0 if the case was run, the allocation
+ error otherwise; the status of the solver itself is in result->status.
+ *******************************************************************************/
+int bench_run_case(const bench_config* config, const bench_case* c, bench_result* result)
+{
+    bench_data d;
+    std::vector<double> times;
+    int resCode;
+
+    memset(result, 0, sizeof(*result));
+    result->c = *c;
+    result->flops = bench_case_flops(c);
+    result->bytes = bench_case_bytes(c);
+
+#if defined(_OPENMP)
+    if (c->threads > 0) {
+        omp_set_num_threads(c->threads);
+    }
+#endif
+
+    resCode = bench_alloc(config, c, &d);
+    if (resCode != 0) {
+        return resCode;
+    }
+
+    // the tuning of n (file read or tuning on first use) is not part of the
+    // first call, resolve it untimed
+    if (c->backend == BENCH_CPU && c->variant == BENCH_VARIANT_AUTO
+        && c->layout.layout != BENCH_LAYOUT_INTERLEAVED) {
+        int variant, chunk;
+        cpuLinearSolverBatchedGetTuning(c->n, &variant, &chunk);
+    }
+
+    for (int r = 0; r < config->warmup + config->reps; r++) {
+        bench_prepare(c, &d);
+        bench_flush(config, c, &d);
+        double t = magma_wtime();
+        result->status = bench_solve(c, &d);
+        t = magma_wtime() - t;
+        if (r == 0) {
+            result->time_first = t;
+        }
+        if (r >= config->warmup) {
+            times.push_back(t);
+        }
+    }
+
+    bench_compute_stats(times, &result->time);
+    result->backward_error = bench_backward_error(c, &d);
+    if (result->time.median > 0) {
+        result->gflops = result->flops / result->time.median / 1e9;
+        result->gbs    = result->bytes / result->time.median / 1e9;
+    }
+    if (config->roofline) {
+        bench_roofline(config, result);
+    }
+    if (config->counters && c->backend == BENCH_CPU) {
+        bench_count(config, c, &d, result);
+    }
+
+    bench_free(&d);
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "bench.h"
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+/*
+    Strong and weak scaling studies of the host backends (cpu, lapack).
+
+    For every N, batch count and the other lists of the config, the case is
+    run for each thread count p of the list (by default 1, 2, 4, ... up to
+    the OpenMP maximum, and the maximum itself):
+      - strong scaling: the batch count is fixed,
+            speedup = T(p0) * p0 / T(p),  efficiency = speedup / p
+      - weak scaling: the batch count is batch * p / p0, the batch per thread
+        is fixed,
+            efficiency = T(p0) / T(p),    speedup = efficiency * p
+    where p0 is the smallest thread count, assumed to scale perfectly (p0 = 1
+    by default). The achieved bandwidth is also given as a fraction of the
+    STREAM triad bandwidth measured at startup.
+
+    A summary line per study gives the largest p whose efficiency is still
+    above config->efficiency, i.e. where the size stops scaling.
+*/
+
+const char* bench_scaling_name(int scaling)
+{
+    switch (scaling) {
+        case BENCH_SCALING_STRONG: return "strong";
+        case BENCH_SCALING_WEAK:   return "weak";
+        default:                   return "none";
+    }
+}
+
+// Runs one study, returns the number of cases that could not be run.
+static int bench_scaling_study(const bench_config* config, const bench_case* base,
+                               const std::vector<int>& threads, int scaling,
+                               FILE* out, FILE* log, int* first)
+{
+    double t0 = 0.0, peak_fraction = 0.0;
+    int p0 = 0, scales_to = 0, failed = 0;
+    char layout[32];
+
+    for (size_t t = 0; t < threads.size(); t++) {
+        bench_case c = *base;
+        bench_result result;
+        const int p = threads[t];
+
+        c.threads = p;
+        if (scaling == BENCH_SCALING_WEAK && p0 > 0) {
+            c.batchCount = (int)((long long)base->batchCount * p / p0);
+        }
+        if (bench_run_case(config, &c, &result) != 0) {
+            failed++;
+            continue;
+        }
+        if (p0 == 0) {
+            p0 = p;
+            t0 = result.time.median;
+        }
+
+        result.scaling = scaling;
+        if (result.time.median > 0) {
+            if (scaling == BENCH_SCALING_STRONG) {
+                result.speedup    = t0 * p0 / result.time.median;
+                result.efficiency = result.speedup / p;
+            }
+            else {
+                result.efficiency = t0 / result.time.median;
+                result.speedup    = result.efficiency * p;
+            }
+        }
+        if (config->peakBandwidth > 0) {
+            result.peak_fraction = result.gbs * 1e9 / config->peakBandwidth;
+        }
+        if (result.efficiency >= config->efficiency) {
+            scales_to = p;
+            peak_fraction = result.peak_fraction;
+        }
+
+        bench_report_result(out, config, &result, *first);
+        *first = 0;
+        bench_log_result(log, &result);
+    }
+
+    bench_layout_name(&base->layout, layout, sizeof(layout));
+    fprintf(log, "%s scaling, %s %s %s n %d batch %d: efficiency >= %.2f up to %d threads "
+                 "(%.0f%% of the peak bandwidth)\n",
+            bench_scaling_name(scaling), bench_backend_name(base->backend), layout,
+            bench_cache_name(base->cache), base->n, base->batchCount, config->efficiency,
+            scales_to, 100.0 * peak_fraction);
+    return failed;
+}
+
+/***************************************************************************//**
+ Purpose
+ -------
+ Runs the scaling studies of config->scalings over the host backends of the
+ config, writing one result per case and thread count to out and the
+ progress and summaries to log.
+
+ @return the number of cases that could not be run.
+ *******************************************************************************/
+int bench_scaling(const bench_config* config, FILE* out, FILE* log, int* first)
+{
+    std::vector<int> threads = config->threads;
+    int failed = 0;
+
+    if (!config->threadsGiven) {
+        int max = 1;
+#if defined(_OPENMP)
+        max = omp_get_max_threads();
+#endif
+        threads.clear();
+        for (int p = 1; p < max; p *= 2) {
+            threads.push_back(p);
+        }
+        threads.push_back(max);
+    }
+    std::sort(threads.begin(), threads.end());
+    threads.erase(std::unique(threads.begin(), threads.end()), threads.end());
+
+    for (size_t s = 0; s < config->scalings.size(); s++)
+    for (size_t b = 0; b < config->backends.size(); b++) {
+        const int backend = config->backends[b];
+        if (backend != BENCH_CPU && backend != BENCH_LAPACK) {
+            fprintf(log, "%s is not a host backend, skipped by the scaling study\n",
+                    bench_backend_name(backend));
+            continue;
+        }
+        for (size_t l = 0; l < config->layouts.size(); l++)
+        for (size_t v = 0; v < config->variants.size(); v++)
+        for (size_t ch = 0; ch < config->chunks.size(); ch++)
+        for (size_t ca = 0; ca < config->caches.size(); ca++)
+        for (size_t m = 0; m < config->matrices.size(); m++)
+        for (size_t k = 0; k < config->batchCounts.size(); k++)
+        for (size_t ni = 0; ni < config->ns.size(); ni++) {
+            bench_case c;
+            if (config->variants[v] == BENCH_VARIANT_AUTO && ch > 0) {
+                continue;
+            }
+            c.backend    = backend;
+            c.n          = config->ns[ni];
+            c.batchCount = config->batchCounts[k];
+            c.variant    = config->variants[v];
+            c.chunk      = config->variants[v] == BENCH_VARIANT_AUTO ? 0 : config->chunks[ch];
+            c.layout     = config->layouts[l];
+            c.threads    = threads[0];
+            c.cache      = config->caches[ca];
+            c.matrix     = config->matrices[m];
+            if (!bench_case_supported(&c)) {
+                continue;
+            }
+            failed += bench_scaling_study(config, &c, threads, config->scalings[s], out, log, first);
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,558 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cuda_runtime.h>
+#include "utils.h"
+#include "operation_batched.h"
+#include "bench.h"
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+/*
+    Benchmark suite of the batched solvers.
+
+    Runs every combination of the lists given on the command line (or in a
+    config file) and writes, per combination, the median, min, max, mean and
+    standard deviation of the solve time over the repetitions, with the
+    GFLOP/s (FLOPS_SGETRF + FLOPS_SGETRS of flops.h) and GB/s at the median.
+    Unlike gpuCSVTester nothing is hardcoded, no rebuild is needed to change
+    what is measured.
+
+    Build and run from Release/ (or Debug/):
+        make benchSgesv
+        ./benchSgesv --n 1:32 --batch 10k,100k --backend cpu,gpu --format json --output bench.json
+
+    Options, lists are comma separated, a:b and a:b:step are ranges and the
+    k / M suffixes multiply by 1000 / 1000000:
+        --n LIST         matrix orders, default 1:32
+        --batch LIST     batch counts, default 10k
+        --backend LIST   cpu, gpu (host memory, transfers included),
+                         gpu-device (device resident data) and lapack
+                         (sgesv_ per system), default cpu
+        --variant LIST   CPU engine variants: auto (tuning table), scalar,
+                         gather4, gather8, gather16, default auto
+        --chunk LIST     OpenMP chunk sizes of the explicit variants, default 0
+        --layout LIST    packed, padded, interleaved4, interleaved8,
+                         interleaved16, interleaved32, default packed
+        --threads LIST   OpenMP threads of cpu and lapack, max for all,
+                         default max
+        --matrix LIST    test matrices, type or type:param, see
+                         matgen_batched.h: normal, cond (singular values
+                         from 1 to 1/param), diagdom, spd, banded,
+                         nearsingular, stencil, e.g. normal,cond:1e6,
+                         default normal. Every case also reports the
+                         largest backward error of its batch
+        --cache LIST     warm (the batch stays where the previous run left
+                         it) and cold (caches flushed before each run),
+                         reported separately, default warm
+        --flush-mb N     host buffer swept by the cold runs, default four
+                         times the last level cache, at least 64
+        --drop-pages 0|1 cold runs also drop the page cache, needs root,
+                         default 0
+        --scaling LIST   strong and / or weak: instead of the plain sweep,
+                         runs each case of the host backends over a range of
+                         thread counts (--threads, by default 1, 2, 4, ...
+                         up to the maximum) and reports speedup, parallel
+                         efficiency and the fraction of the peak bandwidth,
+                         see benchScaling.cpp
+        --efficiency E   efficiency below which a size no longer scales,
+                         default 0.8
+        --roofline 0|1   measures the STREAM bandwidth and the multiply-add
+                         peak at startup and places each case of the host
+                         backends on the roofline: arithmetic intensity,
+                         attainable GFLOP/s, fraction reached and whether
+                         it is memory or compute bound, see benchPeak.cpp
+        --counters 0|1   hardware counters of the cpu backend per solve phase
+                         (factor, permute, forward, backward) per system:
+                         cycles, IPC, cache, L1D and dTLB misses, and the
+                         vector event of SLSB_CPU_PERF_VECTOR_EVENT, see
+                         linearSolverCPUperf_batched.cpp. They are taken
+                         over --reps extra runs, the times are not
+                         affected. Ignored with a warning when the
+                         platform does not allow perf_event_open
+        --baseline FILE  instead of the sweep, runs the cases of FILE again
+                         (a CSV of benchSgesv or the results.csv of
+                         gpuCSVTester) and reports, per case, the change of
+                         the median and whether it is a statistically
+                         significant slowdown beyond --threshold, see
+                         benchBaseline.cpp. --n, --batch and --backend,
+                         when given, select the cases. The exit code is 2
+                         when a case slowed down
+        --threshold PCT  slowdown tolerated by --baseline, in percent,
+                         default 5
+        --alpha P        significance level of --baseline, default 0.01
+        --replay FILE    solves the systems captured in FILE (SLSB_CAPTURE,
+                         see capture_batched.cpp) instead of random normal
+                         ones, repeated up to the batch count (--matrix is
+                         ignored); without --n
+                         the orders of the file are run, see benchReplay.cpp
+        --warmup N       untimed runs per case, default 1
+        --reps N         timed runs per case, default 10
+        --seed N         seed of the generated systems, default 1
+        --format F       csv or json, default csv
+        --output FILE    results file, default - (standard output)
+        --config FILE    reads options from FILE, one "key value" or
+                         "key = value" per line, # starts a comment
+
+    The time of the first call of each case (library loading and first
+    touch included) is reported apart as time_first. The CPU tuning of the
+    case's n is resolved before it, untimed.
+
+    Combinations without a solver (e.g. gpu with an interleaved layout) are
+    skipped. Progress goes to the standard output, or to the standard error
+    when the results do.
+*/
+
+static void bench_usage()
+{
+    printf("Usage: benchSgesv [--n LIST] [--batch LIST] [--backend LIST] [--variant LIST]\n"
+           "                  [--chunk LIST] [--layout LIST] [--threads LIST] [--matrix LIST]\n"
+           "                  [--cache LIST] [--flush-mb N] [--drop-pages 0|1] [--scaling LIST]\n"
+           "                  [--efficiency E] [--roofline 0|1] [--counters 0|1]\n"
+           "                  [--baseline FILE] [--threshold PCT] [--alpha P]\n"
+           "                  [--replay FILE] [--warmup N] [--reps N]\n"
+           "                  [--seed N] [--format csv|json] [--output FILE]\n"
+           "                  [--config FILE]\n"
+           "See tools/benchSgesv.cpp for the details.\n");
+}
+
+static int bench_max_threads()
+{
+#if defined(_OPENMP)
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+// Parses one integer with an optional k / M suffix, -1 on error.
+static long bench_parse_int(const char* s, const char** end)
+{
+    char* e;
+    long v = strtol(s, &e, 10);
+    if (e == s) {
+        return -1;
+    }
+    if (*e == 'k' || *e == 'K') {
+        v *= 1000;
+        e++;
+    }
+    else if (*e == 'm' || *e == 'M') {
+        v *= 1000000;
+        e++;
+    }
+    *end = e;
+    return v;
+}
+
+// "a,b:c,d:e:step", with "max" standing for max if max > 0. 0 on success.
+static int bench_parse_int_list(const char* value, std::vector<int>* list, int max)
+{
+    const char* p = value;
+    list->clear();
+    while (*p != '\0') {
+        long first, last, step = 1;
+        const char* e;
+        if (max > 0 && strncmp(p, "max", 3) == 0) {
+            first = last = max;
+            e = p + 3;
+        }
+        else {
+            first = last = bench_parse_int(p, &e);
+            if (first < 0) return -1;
+            if (*e == ':') {
+                last = bench_parse_int(e + 1, &e);
+                if (last < first) return -1;
+                if (*e == ':') {
+                    step = bench_parse_int(e + 1, &e);
+                    if (step < 1) return -1;
+                }
+            }
+        }
+        for (long v = first; v <= last; v += step) {
+            list->push_back((int)v);
+        }
+        if (*e == ',') {
+            e++;
+        }
+        else if (*e != '\0') {
+            return -1;
+        }
+        p = e;
+    }
+    return list->empty() ? -1 : 0;
+}
+
+// Copies the next comma separated token of *p into token, 0 at the end.
+static int bench_next_token(const char** p, char* token, size_t len)
+{
+    size_t k = 0;
+    if (**p == '\0') {
+        return 0;
+    }
+    while (**p != '\0' && **p != ',') {
+        if (k + 1 < len) token[k++] = **p;
+        (*p)++;
+    }
+    token[k] = '\0';
+    if (**p == ',') {
+        (*p)++;
+    }
+    return 1;
+}
+
+static int bench_parse_names(const char* value, std::vector<int>* list,
+                             const char* const* names, const int* ids, int count)
+{
+    char token[64];
+    const char* p = value;
+    list->clear();
+    while (bench_next_token(&p, token, sizeof(token))) {
+        int found = 0;
+        for (int k = 0; k < count && !found; k++) {
+            if (strcmp(token, names[k]) == 0) {
+                list->push_back(ids[k]);
+                found = 1;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Error in: unknown value %s\n", token);
+            return -1;
+        }
+    }
+    return list->empty() ? -1 : 0;
+}
+
+static int bench_parse_layouts(const char* value, std::vector<bench_layout>* list)
+{
+    char token[64];
+    const char* p = value;
+    list->clear();
+    while (bench_next_token(&p, token, sizeof(token))) {
+        bench_layout l = { BENCH_LAYOUT_PACKED, 0 };
+        if (strcmp(token, "packed") == 0) {
+            l.layout = BENCH_LAYOUT_PACKED;
+        }
+        else if (strcmp(token, "padded") == 0) {
+            l.layout = BENCH_LAYOUT_PADDED;
+        }
+        else if (strncmp(token, "interleaved", 11) == 0 && atoi(token + 11) > 0) {
+            l.layout = BENCH_LAYOUT_INTERLEAVED;
+            l.param  = atoi(token + 11);
+        }
+        else {
+            fprintf(stderr, "Error in: unknown layout %s\n", token);
+            return -1;
+        }
+        list->push_back(l);
+    }
+    return list->empty() ? -1 : 0;
+}
+
+static int bench_parse_matrices(const char* value, std::vector<bench_matrix>* list)
+{
+    char token[64];
+    const char* p = value;
+    list->clear();
+    while (bench_next_token(&p, token, sizeof(token))) {
+        bench_matrix m;
+        if (bench_parse_matrix(token, &m) != 0) {
+            fprintf(stderr, "Error in: unknown matrix %s\n", token);
+            return -1;
+        }
+        list->push_back(m);
+    }
+    return list->empty() ? -1 : 0;
+}
+
+static int bench_read_config(bench_config* config, const char* path);
+
+// Applies option key (without the leading --). 0 on success.
+static int bench_set_option(bench_config* config, const char* key, const char* value)
+{
+    static const char* const backend_names[] = { "cpu", "gpu", "gpu-device", "lapack" };
+    static const int backend_ids[] = { BENCH_CPU, BENCH_GPU, BENCH_GPU_DEVICE, BENCH_LAPACK };
+    static const char* const variant_names[] = { "auto", "scalar", "gather4", "gather8", "gather16" };
+    static const int variant_ids[] = { BENCH_VARIANT_AUTO, CPU_VARIANT_SCALAR, CPU_VARIANT_GATHER4,
+                                       CPU_VARIANT_GATHER8, CPU_VARIANT_GATHER16 };
+    static const char* const scaling_names[] = { "strong", "weak" };
+    static const int scaling_ids[] = { BENCH_SCALING_STRONG, BENCH_SCALING_WEAK };
+    static const char* const cache_names[] = { "warm", "cold" };
+    static const int cache_ids[] = { BENCH_CACHE_WARM, BENCH_CACHE_COLD };
+
+    if (strcmp(key, "n") == 0)       { config->nsGiven = 1; return bench_parse_int_list(value, &config->ns, 0); }
+    if (strcmp(key, "batch") == 0)   { config->batchGiven = 1; return bench_parse_int_list(value, &config->batchCounts, 0); }
+    if (strcmp(key, "chunk") == 0)   return bench_parse_int_list(value, &config->chunks, 0);
+    if (strcmp(key, "threads") == 0) { config->threadsGiven = 1; return bench_parse_int_list(value, &config->threads, bench_max_threads()); }
+    if (strcmp(key, "layout") == 0)  return bench_parse_layouts(value, &config->layouts);
+    if (strcmp(key, "backend") == 0) { config->backendsGiven = 1; return bench_parse_names(value, &config->backends, backend_names, backend_ids, 4); }
+    if (strcmp(key, "variant") == 0) return bench_parse_names(value, &config->variants, variant_names, variant_ids, 5);
+    if (strcmp(key, "matrix") == 0)  return bench_parse_matrices(value, &config->matrices);
+    if (strcmp(key, "cache") == 0)   return bench_parse_names(value, &config->caches, cache_names, cache_ids, 2);
+    if (strcmp(key, "flush-mb") == 0) { config->flushBytes = (size_t)atol(value) << 20; return config->flushBytes == 0 ? -1 : 0; }
+    if (strcmp(key, "drop-pages") == 0) { config->dropPages = atoi(value); return 0; }
+    if (strcmp(key, "scaling") == 0) return bench_parse_names(value, &config->scalings, scaling_names, scaling_ids, 2);
+    if (strcmp(key, "efficiency") == 0) { config->efficiency = atof(value); return config->efficiency <= 0 ? -1 : 0; }
+    if (strcmp(key, "roofline") == 0) { config->roofline = atoi(value); return 0; }
+    if (strcmp(key, "counters") == 0) { config->counters = atoi(value); return 0; }
+    if (strcmp(key, "baseline") == 0) { config->baseline = strdup(value); return 0; }
+    if (strcmp(key, "replay") == 0)  { config->replayPath = strdup(value); return 0; }
+    if (strcmp(key, "threshold") == 0) { config->threshold = atof(value) / 100.0; return config->threshold < 0 ? -1 : 0; }
+    if (strcmp(key, "alpha") == 0)   { config->alpha = atof(value); return config->alpha <= 0 || config->alpha >= 1 ? -1 : 0; }
+    if (strcmp(key, "warmup") == 0)  { config->warmup = atoi(value); return config->warmup < 0 ? -1 : 0; }
+    if (strcmp(key, "reps") == 0)    { config->reps = atoi(value); return config->reps < 1 ? -1 : 0; }
+    if (strcmp(key, "seed") == 0)    { config->seed = (unsigned int)strtoul(value, NULL, 10); return 0; }
+    if (strcmp(key, "output") == 0)  { config->output = strdup(value); return 0; }
+    if (strcmp(key, "config") == 0)  return bench_read_config(config, value);
+    if (strcmp(key, "format") == 0) {
+        if (strcmp(value, "csv") == 0)  { config->format = BENCH_FORMAT_CSV;  return 0; }
+        if (strcmp(value, "json") == 0) { config->format = BENCH_FORMAT_JSON; return 0; }
+        return -1;
+    }
+    fprintf(stderr, "Error in: unknown option %s\n", key);
+    return -1;
+}
+
+static int bench_read_config(bench_config* config, const char* path)
+{
+    char line[1024];
+    int resCode = 0;
+    FILE* f = fopen(path, "r");
+
+    if (f == NULL) {
+        fprintf(stderr, "Error in: cannot open %s\n", path);
+        return -1;
+    }
+    while (resCode == 0 && fgets(line, sizeof(line), f) != NULL) {
+        char *key, *value;
+        line[strcspn(line, "#\r\n")] = '\0';
+        key = line + strspn(line, " \t");
+        if (*key == '\0') {
+            continue;
+        }
+        value = key + strcspn(key, " \t=");
+        if (*value != '\0') {
+            *value++ = '\0';
+            value += strspn(value, " \t=");
+        }
+        value[strcspn(value, " \t")] = '\0';
+        resCode = bench_set_option(config, key, value);
+        if (resCode != 0) {
+            fprintf(stderr, "Error in: %s, option %s\n", path, key);
+        }
+    }
+    fclose(f);
+    return resCode;
+}
+
+// Plain sweep over every combination of the config.
+static int bench_sweep(const bench_config* config, int ngpu, FILE* out, FILE* log, int* first)
+{
+    int skipped = 0, failed = 0;
+
+    for (size_t b = 0; b < config->backends.size(); b++) {
+        const int backend = config->backends[b];
+        const int threaded = backend == BENCH_CPU || backend == BENCH_LAPACK;
+        if ((backend == BENCH_GPU || backend == BENCH_GPU_DEVICE) && ngpu == 0) {
+            continue;
+        }
+        for (size_t l = 0; l < config->layouts.size(); l++)
+        for (size_t v = 0; v < config->variants.size(); v++)
+        for (size_t ch = 0; ch < config->chunks.size(); ch++)
+        for (size_t t = 0; t < config->threads.size(); t++)
+        for (size_t ca = 0; ca < config->caches.size(); ca++)
+        for (size_t m = 0; m < config->matrices.size(); m++)
+        for (size_t k = 0; k < config->batchCounts.size(); k++)
+        for (size_t ni = 0; ni < config->ns.size(); ni++) {
+            bench_case c;
+            bench_result result;
+
+            // dimensions that do not apply to the case are run once
+            if ((config->variants[v] == BENCH_VARIANT_AUTO && ch > 0) || (!threaded && t > 0)) {
+                continue;
+            }
+            c.backend    = backend;
+            c.n          = config->ns[ni];
+            c.batchCount = config->batchCounts[k];
+            c.variant    = config->variants[v];
+            c.chunk      = config->variants[v] == BENCH_VARIANT_AUTO ? 0 : config->chunks[ch];
+            c.layout     = config->layouts[l];
+            c.threads    = threaded ? config->threads[t] : 0;
+            c.cache      = config->caches[ca];
+            c.matrix     = config->matrices[m];
+            if (!bench_case_supported(&c)) {
+                skipped++;
+                continue;
+            }
+
+            if (bench_run_case(config, &c, &result) != 0) {
+                failed++;
+                continue;
+            }
+            bench_report_result(out, config, &result, *first);
+            *first = 0;
+            bench_log_result(log, &result);
+        }
+    }
+    if (skipped > 0) {
+        fprintf(log, "%d combinations without a solver were skipped\n", skipped);
+    }
+    return failed;
+}
+
+int main(int argc, char** argv)
+{
+    bench_config config;
+    bench_replay replay;
+    bench_layout packed = { BENCH_LAYOUT_PACKED, 0 };
+    bench_matrix normal = { MATGEN_NORMAL, 0.0 };
+    FILE *out, *log;
+    int ngpu = 0, first = 1, failed = 0, regressions = 0;
+    int uses_gpu = 0;
+
+    config.ns.clear();
+    for (int n = 1; n <= 32; n++) {
+        config.ns.push_back(n);
+    }
+    config.batchCounts.assign(1, 10000);
+    config.backends.assign(1, BENCH_CPU);
+    config.variants.assign(1, BENCH_VARIANT_AUTO);
+    config.chunks.assign(1, 0);
+    config.layouts.assign(1, packed);
+    config.threads.assign(1, bench_max_threads());
+    config.caches.assign(1, BENCH_CACHE_WARM);
+    config.matrices.assign(1, normal);
+    config.scalings.clear();
+    config.threadsGiven = 0;
+    config.nsGiven = 0;
+    config.batchGiven = 0;
+    config.backendsGiven = 0;
+    config.efficiency = 0.8;
+    config.roofline = 0;
+    config.counters = 0;
+    config.baseline = NULL;
+    config.threshold = 0.05;
+    config.alpha = 0.01;
+    config.replayPath = NULL;
+    config.replay = NULL;
+    config.peakThreads = 0;
+    config.peakBandwidth = 0.0;
+    config.peakBandwidth1 = 0.0;
+    config.peakFlops = 0.0;
+    config.flushBytes = bench_default_flush_bytes();
+    config.dropPages = 0;
+    config.warmup = 1;
+    config.reps   = 10;
+    config.format = BENCH_FORMAT_CSV;
+    config.output = "-";
+    config.seed   = 1;
+
+    for (int i = 1; i < argc; i++) {
+        const char* key = argv[i];
+        const char* value;
+        char buffer[64];
+        if (strncmp(key, "--", 2) != 0 || strcmp(key, "--help") == 0) {
+            bench_usage();
+            return strcmp(key, "--help") == 0 ? 0 : 1;
+        }
+        key += 2;
+        value = strchr(key, '=');
+        if (value != NULL) {
+            snprintf(buffer, sizeof(buffer), "%.*s", (int)(value - key), key);
+            key = buffer;
+            value++;
+        }
+        else if (i + 1 < argc) {
+            value = argv[++i];
+        }
+        else {
+            bench_usage();
+            return 1;
+        }
+        if (bench_set_option(&config, key, value) != 0) {
+            fprintf(stderr, "Error in: invalid value %s for --%s\n", value, key);
+            bench_usage();
+            return 1;
+        }
+    }
+
+    if (strcmp(config.output, "-") == 0) {
+        out = stdout;
+        log = stderr;
+    }
+    else {
+        out = fopen(config.output, "w");
+        log = stdout;
+        if (out == NULL) {
+            fprintf(stderr, "Error in: cannot open %s\n", config.output);
+            return 1;
+        }
+    }
+
+    if (config.replayPath != NULL) {
+        if (bench_replay_load(config.replayPath, &replay, log) != 0) {
+            return 1;
+        }
+        config.replay = &replay;
+        if (!config.nsGiven) {
+            bench_replay_ns(&replay, &config.ns);
+        }
+    }
+
+    for (size_t b = 0; b < config.backends.size(); b++) {
+        uses_gpu |= config.backends[b] == BENCH_GPU || config.backends[b] == BENCH_GPU_DEVICE;
+    }
+    // the backends of a baseline are only known once it is read
+    uses_gpu |= config.baseline != NULL && !config.backendsGiven;
+    if (uses_gpu) {
+        magma_init();
+        if (cudaGetDeviceCount(&ngpu) != cudaSuccess) {
+            ngpu = 0;
+        }
+        if (ngpu == 0) {
+            fprintf(log, "no CUDA device, the gpu backends are skipped\n");
+        }
+    }
+
+    if (!config.scalings.empty() || config.roofline) {
+        bench_peak_measure(&config);
+        fprintf(log, "peak bandwidth (STREAM triad): %.2f GB/s on %d threads, %.2f GB/s on 1 thread\n",
+                config.peakBandwidth / 1e9, config.peakThreads, config.peakBandwidth1 / 1e9);
+        fprintf(log, "peak multiply-add rate: %.2f GFLOP/s on %d threads, machine balance %.2f flop/B\n",
+                config.peakFlops / 1e9, config.peakThreads,
+                config.peakBandwidth > 0 ? config.peakFlops / config.peakBandwidth : 0.0);
+    }
+
+    if (config.counters) {
+        if (cpuLinearSolverBatchedPerfEnable(1) == 0) {
+            fprintf(log, "hardware counters unavailable, --counters ignored\n");
+            config.counters = 0;
+        }
+        cpuLinearSolverBatchedPerfEnable(0);
+    }
+
+    bench_report_begin(out, &config);
+    if (config.baseline != NULL) {
+        failed = bench_baseline(&config, ngpu, out, log, &first, &regressions);
+    }
+    else if (config.scalings.empty()) {
+        failed = bench_sweep(&config, ngpu, out, log, &first);
+    }
+    else {
+        failed = bench_scaling(&config, out, log, &first);
+    }
+    bench_report_end(out, &config);
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    if (uses_gpu) {
+        magma_finalize();
+    }
+    if (regressions > 0) {
+        return 2;
+    }
+    return failed != 0 ? 1 : 0;
+}
@@ -0,0 +1,425 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "utils.h"
+#include "npy_batched.h"
+#include "archive_batched.h"
+#include "aio_batched.h"
+#include "stream_batched.h"
+
+/*
+    Solves batches stored in files, without loading them through a program
+    of one's own. One mode per file format:
+
+        slsbSolve npy A.npy B.npy [X.npy]
+            NumPy arrays, see npy_batched.h: A float32 of shape (batch, N, N)
+            in C order or (N, N, batch) in Fortran order, B float32 of shape
+            (batch, N) or (N, batch) in Fortran order. The files are mapped
+            and solved in place; X.npy is created with the shape of B, and
+            without it the solutions overwrite B.
+
+        slsbSolve stream A.npy B.npy [X.npy] [--chunk MB] [--buffers K] [--gpu]
+                         [--checkpoint FILE] [--checkpoint-every S] [--max-chunks C]
+            As npy, for files larger than memory: the systems go through K
+            buffers of MB (defaults 4 and 64), read ahead and written back
+            while other chunks are solved (see stream_batched.h), so the
+            memory used is K * MB whatever the size of the files. --gpu
+            solves with gpuLinearSolverBatched (Fortran order A only).
+            --checkpoint records the progress in FILE every S seconds
+            (default 60) and resumes from it when it exists, so that a job
+            killed by its time limit continues where it stopped when it is
+            run again with the same arguments. --max-chunks stops after C
+            chunks, with a checkpoint, for jobs that do a part each.
+
+        slsbSolve archive-pack OUT.slsb A.npy B.npy [A.npy B.npy ...]
+            Writes the systems of the .npy pairs, of any orders, to the
+            archive OUT.slsb (see archive_batched.h), with the IDs 0, 1, ...
+            in the order of the files.
+
+        slsbSolve archive-info FILE.slsb
+            Lists the segments (order, systems, checksums) and the runs of
+            the index (consecutive IDs and the slots of a segment they map to).
+
+        slsbSolve solve-archive FILE.slsb [--ids FIRST-LAST] [--n LIST] [--verify]
+            Solves the systems of the archive with an ID in [FIRST, LAST]
+            (default all) and an order in LIST (comma separated, default
+            all) straight from the mapped file; X and info are written into
+            the archive. --verify checks the checksums of the data first.
+
+        slsbSolve read-bench FILE [--chunk MB] [--depth N]
+            Reads FILE with the asynchronous reader of the streaming solves
+            (see aio_batched.h), N reads of MB in flight (defaults 8 and 8),
+            and prints the bandwidth, the disk side of their throughput.
+
+    Build from Release/ (or Debug/) with make slsbSolve. The exit code is 0
+    when every system was solved, 1 on an error, 2 when --max-chunks
+    stopped a stream before the end, 3 when some systems are singular
+    (their X is not meaningful).
+*/
+
+static void solve_usage()
+{
+    printf("Usage: slsbSolve npy A.npy B.npy [X.npy]\n"
+           "       slsbSolve stream A.npy B.npy [X.npy] [--chunk MB] [--buffers K] [--gpu]\n"
+           "                        [--checkpoint FILE] [--checkpoint-every S] [--max-chunks C]\n"
+           "       slsbSolve archive-pack OUT.slsb A.npy B.npy [A.npy B.npy ...]\n"
+           "       slsbSolve archive-info FILE.slsb\n"
+           "       slsbSolve solve-archive FILE.slsb [--ids FIRST-LAST] [--n LIST] [--verify]\n"
+           "       slsbSolve read-bench FILE [--chunk MB] [--depth N]\n"
+           "See tools/slsbSolve.cpp for the details.\n");
+}
+
+static int solve_npy(int argc, char** argv)
+{
+    long long singular = 0;
+    double t;
+    int resCode;
+
+    if (argc < 4 || argc > 5) {
+        solve_usage();
+        return 1;
+    }
+    t = magma_wtime();
+    resCode = npy_batched_solve(argv[2], argv[3], argc == 5 ? argv[4] : NULL, &singular);
+    t = magma_wtime() - t;
+    if (resCode < 0) {
+        return 1;
+    }
+    printf("%s: solved in %.3f s, %lld singular systems\n", argc == 5 ? argv[4] : argv[3], t, singular);
+    return singular > 0 ? 3 : 0;
+}
+
+static int solve_stream(int argc, char** argv)
+{
+    stream_config cfg;
+    stream_stats st;
+    const char* path[3] = { NULL, NULL, NULL };
+    int paths = 0;
+
+    stream_batched_defaults(&cfg);
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--gpu") == 0) {
+            cfg.backend = STREAM_BACKEND_GPU;
+        }
+        else if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            cfg.chunkBytes = (size_t)atoi(argv[++i]) << 20;
+        }
+        else if (strcmp(argv[i], "--buffers") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            cfg.buffers = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            cfg.checkpoint = argv[++i];
+        }
+        else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc && atof(argv[i + 1]) >= 0) {
+            cfg.checkpointSeconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-chunks") == 0 && i + 1 < argc && atoll(argv[i + 1]) > 0) {
+            cfg.maxChunks = atoll(argv[++i]);
+        }
+        else if (argv[i][0] != '-' && paths < 3) {
+            path[paths++] = argv[i];
+        }
+        else {
+            solve_usage();
+            return 1;
+        }
+    }
+    if (paths < 2) {
+        solve_usage();
+        return 1;
+    }
+
+    const int resCode = stream_batched_solve(path[0], path[1], path[2], &cfg, &st);
+    if (resCode < 0) {
+        return 1;
+    }
+    printf("%s: %lld systems in %lld chunks of %d, %.3f s (solving %.3f s, waiting for the disk %.3f s)\n",
+           path[2] != NULL ? path[2] : path[1], st.systems, st.chunks, st.chunkSystems, st.seconds, st.solveSeconds,
+           st.waitSeconds);
+    printf("  read %.2f GB/s, written %.2f GB/s, %.1f MB of buffers, %s, %lld singular systems\n",
+           st.bytesRead / st.seconds * 1e-9, st.bytesWritten / st.seconds * 1e-9, st.memoryBytes / 1048576.0, st.io,
+           st.singular);
+    if (cfg.checkpoint != NULL) {
+        printf("  %lld chunks done before, %d checkpoints written\n", st.resumedChunks, st.checkpoints);
+    }
+    if (resCode == 1) {
+        printf("  stopped after %lld chunks, run again to resume\n", st.chunks);
+        return 2;
+    }
+    return st.singular > 0 ? 3 : 0;
+}
+
+// Systems per append of row-major matrices, transposed through a buffer.
+#define SOLVE_PACK_CHUNK  4096
+
+static int solve_archive_pack(int argc, char** argv)
+{
+    long long capacity[33] = { 0 };
+    unsigned long long id = 0;
+    archive_writer* w = NULL;
+    float* buffer = NULL;
+    int resCode = 0;
+
+    if (argc < 5 || (argc - 3) % 2 != 0) {
+        solve_usage();
+        return 1;
+    }
+    for (int pass = 0; pass < 2 && resCode == 0; pass++) {
+        for (int k = 3; k < argc && resCode == 0; k += 2) {
+            npy_array A, B;
+            long long batch;
+            int n, rowMajor;
+            if (npy_batched_open(argv[k], 0, &A) != 0) {
+                resCode = -1;
+                break;
+            }
+            if (npy_batched_open(argv[k + 1], 0, &B) != 0) {
+                npy_batched_close(&A);
+                resCode = -1;
+                break;
+            }
+            resCode = npy_batched_shape(&A, &B, &n, &batch, &rowMajor);
+            if (resCode == 0 && pass == 0) {
+                capacity[n] += batch;
+            }
+            else if (resCode == 0 && !rowMajor) {
+                resCode = archive_batched_append(w, n, (const float*)A.data, (const float*)B.data, batch, id);
+                id += batch;
+            }
+            else if (resCode == 0) {
+                const float* sA = (const float*)A.data;
+                for (long long s = 0; s < batch && resCode == 0; s += SOLVE_PACK_CHUNK) {
+                    const long long count = batch - s < SOLVE_PACK_CHUNK ? batch - s : SOLVE_PACK_CHUNK;
+                    for (long long m = 0; m < count; m++) {
+                        for (int i = 0; i < n; i++) {
+                            for (int j = 0; j < n; j++) {
+                                buffer[(m * n + j) * n + i] = sA[((s + m) * n + i) * n + j];
+                            }
+                        }
+                    }
+                    resCode = archive_batched_append(w, n, buffer, (const float*)B.data + s * n, count, id);
+                    id += count;
+                }
+            }
+            npy_batched_close(&B);
+            npy_batched_close(&A);
+        }
+        if (resCode == 0 && pass == 0) {
+            resCode = archive_batched_create(argv[2], capacity, &w);
+            buffer = (float*)malloc((size_t)SOLVE_PACK_CHUNK * 32 * 32 * sizeof(float));
+            if (resCode == 0 && buffer == NULL) {
+                printf("Error in: archive-pack, buffer malloc\n");
+                resCode = -1;
+            }
+        }
+    }
+    // a failed packing leaves no file that could pass for an archive
+    if (w != NULL) {
+        if (resCode == 0) {
+            resCode = archive_batched_finish(w);
+        }
+        else {
+            archive_batched_abort(w);
+        }
+        if (resCode != 0) {
+            unlink(argv[2]);
+        }
+    }
+    free(buffer);
+    if (resCode != 0) {
+        return 1;
+    }
+    printf("%s: %llu systems\n", argv[2], id);
+    return 0;
+}
+
+static int solve_archive_info(int argc, char** argv)
+{
+    archive_batched ar;
+
+    if (argc != 3) {
+        solve_usage();
+        return 1;
+    }
+    if (archive_batched_open(argv[2], 0, &ar) != 0) {
+        return 1;
+    }
+    printf("%s: %llu systems in %u segments, %llu index runs, %llu bytes\n", argv[2],
+           (unsigned long long)ar.header->systems, ar.header->segments,
+           (unsigned long long)ar.header->index_runs, (unsigned long long)ar.header->file_bytes);
+    for (uint32_t k = 0; k < ar.header->segments; k++) {
+        const archive_segment* s = &ar.segment[k];
+        printf("  segment %2u: n %2u, %12llu systems (capacity %llu), A at %llu, crc %08x %08x\n", k, s->n,
+               (unsigned long long)s->count, (unsigned long long)s->capacity,
+               (unsigned long long)s->offset_a, s->crc_a, s->crc_b);
+    }
+    for (uint64_t r = 0; r < ar.header->index_runs; r++) {
+        const archive_run* run = &ar.runs[r];
+        printf("  run %8llu: IDs %llu-%llu, segment %u (n %u), slots %llu-%llu\n", (unsigned long long)r,
+               (unsigned long long)run->first_id, (unsigned long long)(run->first_id + run->count - 1),
+               run->segment, ar.segment[run->segment].n, (unsigned long long)run->first_slot,
+               (unsigned long long)(run->first_slot + run->count - 1));
+    }
+    archive_batched_close(&ar);
+    return 0;
+}
+
+static int solve_archive(int argc, char** argv)
+{
+    archive_batched ar;
+    unsigned long long firstId = 0, lastId = ~0ULL, nmask = ~0ULL;
+    long long solved = 0, singular = 0;
+    int verify = 0, resCode;
+    double t;
+
+    if (argc < 3) {
+        solve_usage();
+        return 1;
+    }
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--verify") == 0) {
+            verify = 1;
+        }
+        else if (strcmp(argv[i], "--ids") == 0 && i + 1 < argc) {
+            char* end;
+            firstId = lastId = strtoull(argv[++i], &end, 10);
+            if (*end == '-') {
+                lastId = strtoull(end + 1, &end, 10);
+            }
+            if (*end != '\0' || lastId < firstId) {
+                solve_usage();
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--n") == 0 && i + 1 < argc) {
+            const char* p = argv[++i];
+            nmask = 0;
+            while (*p != '\0') {
+                char* end;
+                const long n = strtol(p, &end, 10);
+                if (end == p || n < 1 || n > 32) {
+                    solve_usage();
+                    return 1;
+                }
+                nmask |= 1ULL << n;
+                p = *end == ',' ? end + 1 : end;
+            }
+        }
+        else {
+            solve_usage();
+            return 1;
+        }
+    }
+
+    if (archive_batched_open(argv[2], 1, &ar) != 0) {
+        return 1;
+    }
+    if (verify && archive_batched_verify(&ar) != 0) {
+        archive_batched_close(&ar);
+        return 1;
+    }
+    t = magma_wtime();
+    resCode = archive_batched_solve(&ar, firstId, lastId, nmask, &solved, &singular);
+    t = magma_wtime() - t;
+    archive_batched_close(&ar);
+    if (resCode != 0) {
+        return 1;
+    }
+    printf("%s: %lld systems solved in %.3f s, %lld singular\n", argv[2], solved, t, singular);
+    return singular > 0 ? 3 : 0;
+}
+
+static int solve_read_bench(int argc, char** argv)
+{
+    aio_file f;
+    aio_queue* q = NULL;
+    size_t chunk = (size_t)8 << 20;
+    int depth = 8, resCode = 0;
+    uint64_t size, next = 0, total = 0;
+    double t;
+
+    if (argc < 3) {
+        solve_usage();
+        return 1;
+    }
+    for (int i = 3; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--chunk") == 0 && atoi(argv[i + 1]) > 0) {
+            chunk = (size_t)atoi(argv[i + 1]) << 20;
+        }
+        else if (strcmp(argv[i], "--depth") == 0 && atoi(argv[i + 1]) > 0) {
+            depth = atoi(argv[i + 1]);
+        }
+        else {
+            solve_usage();
+            return 1;
+        }
+    }
+    if ((argc - 3) % 2 != 0) {
+        solve_usage();
+        return 1;
+    }
+
+    if (aio_batched_open_file(argv[2], 0, &f) != 0) {
+        return 1;
+    }
+    size = (uint64_t)lseek(f.fd, 0, SEEK_END);
+    if (aio_batched_create(depth, chunk, depth, &q) != 0) {
+        aio_batched_close_file(&f);
+        return 1;
+    }
+
+    // Buffer k reads chunk k, k + depth, ...: a completed read is requeued
+    // at once, so depth reads are always in flight.
+    t = magma_wtime();
+    for (int k = 0; k < depth && next < size && resCode == 0; k++, next += chunk) {
+        resCode = aio_batched_read(q, &f, k, 0, next, size - next < chunk ? size - next : chunk, k);
+    }
+    while (resCode == 0 && aio_batched_pending(q) > 0) {
+        uint64_t tag;
+        long long result = 0;
+        resCode = aio_batched_wait(q, &tag, &result);
+        if (resCode == 0 && result < 0) {
+            printf("Error in: read-bench, read of %s: %s\n", argv[2], strerror((int)-result));
+            resCode = -1;
+        }
+        if (resCode != 0) {
+            break;
+        }
+        total += result;
+        if (next < size) {
+            resCode = aio_batched_read(q, &f, (int)tag, 0, next, size - next < chunk ? size - next : chunk, tag);
+            next += chunk;
+        }
+    }
+    t = magma_wtime() - t;
+    printf("%s: %llu bytes in %.3f s, %.2f GB/s (%s%s, %d x %zu MB)\n", argv[2], (unsigned long long)total, t,
+           total / t * 1e-9, aio_batched_backend(q), f.direct >= 0 ? ", O_DIRECT" : "", depth, chunk >> 20);
+    aio_batched_destroy(q);
+    aio_batched_close_file(&f);
+    return resCode == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "npy") == 0) {
+        return solve_npy(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "stream") == 0) {
+        return solve_stream(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "archive-pack") == 0) {
+        return solve_archive_pack(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "archive-info") == 0) {
+        return solve_archive_info(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "solve-archive") == 0) {
+        return solve_archive(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "read-bench") == 0) {
+        return solve_read_bench(argc, argv);
+    }
+    solve_usage();
+    return 1;
+}
@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "slsb.h"
+
+/*
+    Test of the C interface of slsb.h, compiled as C (not C++) so that the
+    header is checked the way foreign callers see it; run by `make check`:
+
+        version   slsb_abi_version and slsb_version against the header
+        query     the capabilities, and an unknown one
+        errors    invalid handles, sizes, layouts and pointers
+        solve     create / solve / destroy of packed and interleaved CPU
+                  batches (and a host GPU batch when a GPU is visible):
+                  small residuals, SLSB_SINGULAR and info for a singular system
+
+    Prints one line per test; the exit code is the number of failed tests.
+*/
+
+#define TEST_N      5
+#define TEST_COUNT  203     /* not a multiple of the interleave width */
+#define TEST_W      8
+#define TEST_RESIDUAL_TOL  1e-4
+
+static int check(int ok, const char* what)
+{
+    if (!ok) {
+        printf("Error in: testSlsb, %s\n", what);
+    }
+    return ok ? 0 : 1;
+}
+
+/* 1 if the library was built with order n, see SLSB_CAP_SIZES. */
+static int test_built(int n)
+{
+    int64_t sizes = 0;
+    return slsb_query(SLSB_CAP_SIZES, &sizes) == SLSB_SUCCESS && ((sizes >> n) & 1) != 0;
+}
+
+static int test_version(void)
+{
+    int32_t major = -1, minor = -1, patch = -1;
+    int failed = 0;
+
+    slsb_version(&major, &minor, &patch);
+    failed += check(slsb_abi_version() == SLSB_ABI_VERSION, "slsb_abi_version differs from the header");
+    failed += check(major == SLSB_VERSION_MAJOR && minor == SLSB_VERSION_MINOR && patch == SLSB_VERSION_PATCH,
+                    "slsb_version differs from the header");
+    slsb_version(NULL, NULL, NULL);
+    printf("version %s: ABI %d, %d.%d.%d\n", failed ? "FAILED" : "ok", slsb_abi_version(), major, minor, patch);
+    return failed;
+}
+
+static int test_query(void)
+{
+    int64_t maxN = 0, sizes = 0, backends = 0, widths = 0, threads = 0, gpus = -1, value = 0;
+    int failed = 0;
+
+    failed += check(slsb_query(SLSB_CAP_MAX_N, &maxN) == SLSB_SUCCESS && maxN >= 1 && maxN <= 32,
+                    "SLSB_CAP_MAX_N");
+    failed += check(slsb_query(SLSB_CAP_SIZES, &sizes) == SLSB_SUCCESS && (sizes >> maxN) == 1,
+                    "SLSB_CAP_SIZES does not end at SLSB_CAP_MAX_N");
+    failed += check(slsb_query(SLSB_CAP_BACKENDS, &backends) == SLSB_SUCCESS
+                    && (backends & (1 << SLSB_BACKEND_CPU)) != 0, "SLSB_CAP_BACKENDS without the CPU");
+    failed += check(slsb_query(SLSB_CAP_GPU_COUNT, &gpus) == SLSB_SUCCESS && gpus >= 0, "SLSB_CAP_GPU_COUNT");
+    failed += check(slsb_query(SLSB_CAP_INTERLEAVE_WIDTHS, &widths) == SLSB_SUCCESS
+                    && (widths & ((1LL << 4) | (1LL << 8) | (1LL << 16))) == ((1LL << 4) | (1LL << 8) | (1LL << 16))
+                    && ((widths >> 32) & 1) == (gpus > 0), "SLSB_CAP_INTERLEAVE_WIDTHS");
+    failed += check(slsb_query(SLSB_CAP_NUM_THREADS, &threads) == SLSB_SUCCESS && threads >= 1,
+                    "SLSB_CAP_NUM_THREADS");
+    failed += check(slsb_query(-1, &value) == SLSB_ERR_INVALID_ARG, "an unknown capability was accepted");
+    failed += check(slsb_query(SLSB_CAP_MAX_N, NULL) == SLSB_ERR_INVALID_ARG, "a NULL value was accepted");
+    printf("query   %s: max n %lld, %lld GPUs, %lld threads\n", failed ? "FAILED" : "ok", (long long)maxN,
+           (long long)gpus, (long long)threads);
+    return failed;
+}
+
+static int test_errors(void)
+{
+    slsb_context ctx = NULL;
+    slsb_batch batch = NULL;
+    float a = 1.0f, b = 1.0f, x = 0.0f;
+    int32_t info = 0;
+    int failed = 0;
+
+    failed += check(slsb_context_create(NULL, SLSB_BACKEND_CPU, NULL) == SLSB_ERR_INVALID_ARG,
+                    "a NULL context pointer was accepted");
+    failed += check(slsb_context_create(&ctx, 7, NULL) == SLSB_ERR_INVALID_ARG, "an unknown backend was accepted");
+    if (slsb_context_create(&ctx, SLSB_BACKEND_CPU, NULL) != SLSB_SUCCESS) {
+        printf("Error in: testSlsb, slsb_context_create\n");
+        printf("errors  FAILED\n");
+        return failed + 1;
+    }
+
+    failed += check(slsb_batch_create(NULL, ctx, 4, 1, SLSB_MEMORY_HOST, SLSB_LAYOUT_PACKED, 0)
+                    == SLSB_ERR_INVALID_ARG, "a NULL batch pointer was accepted");
+    failed += check(slsb_batch_create(&batch, NULL, 4, 1, SLSB_MEMORY_HOST, SLSB_LAYOUT_PACKED, 0)
+                    == SLSB_ERR_INVALID_ARG, "a NULL context was accepted");
+    failed += check(slsb_batch_create(&batch, ctx, 33, 1, SLSB_MEMORY_HOST, SLSB_LAYOUT_PACKED, 0)
+                    == SLSB_ERR_INVALID_ARG, "n = 33 was accepted");
+    failed += check(slsb_batch_create(&batch, ctx, -1, 1, SLSB_MEMORY_HOST, SLSB_LAYOUT_PACKED, 0)
+                    == SLSB_ERR_INVALID_ARG, "n = -1 was accepted");
+    failed += check(slsb_batch_create(&batch, ctx, 4, -1, SLSB_MEMORY_HOST, SLSB_LAYOUT_PACKED, 0)
+                    == SLSB_ERR_INVALID_ARG, "a negative batch count was accepted");
+    failed += check(slsb_batch_create(&batch, ctx, 4, 1, SLSB_MEMORY_DEVICE, SLSB_LAYOUT_PADDED, 3)
+                    == SLSB_ERR_INVALID_ARG, "a leading dimension below n was accepted");
+    failed += check(slsb_batch_create(&batch, ctx, 4, 1, SLSB_MEMORY_DEVICE, SLSB_LAYOUT_PACKED, 0)
+                    == SLSB_ERR_UNSUPPORTED, "device memory was accepted by the CPU backend");
+    failed += check(slsb_batch_create(&batch, ctx, 4, 1, SLSB_MEMORY_HOST, SLSB_LAYOUT_INTERLEAVED, 5)
+                    == SLSB_ERR_UNSUPPORTED, "an interleave width of 5 was accepted");
+    failed += check(slsb_batch_create(&batch, ctx, 4, 1, SLSB_MEMORY_HOST, SLSB_LAYOUT_INTERLEAVED, 32)
+                    == SLSB_ERR_UNSUPPORTED, "an interleave width of 32 was accepted on the CPU");
+
+    failed += check(slsb_solve(NULL, &a, &b, &x, &info) == SLSB_ERR_INVALID_ARG, "a NULL batch was solved");
+    if (!test_built(1)) {
+        printf("  order 1 is not built, its solve is skipped\n");
+    }
+    else if (slsb_batch_create(&batch, ctx, 1, 1, SLSB_MEMORY_HOST, SLSB_LAYOUT_PACKED, 0) == SLSB_SUCCESS) {
+        failed += check(slsb_solve(batch, NULL, &b, &x, &info) == SLSB_ERR_INVALID_ARG
+                        && slsb_solve(batch, &a, NULL, &x, &info) == SLSB_ERR_INVALID_ARG
+                        && slsb_solve(batch, &a, &b, NULL, &info) == SLSB_ERR_INVALID_ARG
+                        && slsb_solve(batch, &a, &b, &x, NULL) == SLSB_ERR_INVALID_ARG,
+                        "a NULL buffer was accepted");
+        failed += check(slsb_solve(batch, &a, &b, &x, &info) == SLSB_SUCCESS && x == 1.0f && info == 0,
+                        "1 * x = 1");
+        slsb_batch_destroy(batch);
+    }
+    else {
+        failed += check(0, "slsb_batch_create of a 1-by-1 system");
+    }
+
+    failed += check(strcmp(slsb_status_string(SLSB_ERR_ALLOC), "allocation failed") == 0
+                    && slsb_status_string(12345) != NULL, "slsb_status_string");
+    slsb_context_destroy(ctx);
+    printf("errors  %s\n", failed ? "FAILED" : "ok");
+    return failed;
+}
+
+/* Diagonally dominant systems, packed column-major; system 'singular' (if
+   not negative) gets a zero column. */
+static void test_fill(int n, int count, float* A, float* B, int singular)
+{
+    unsigned int seed = 4321;
+    for (int s = 0; s < count; s++) {
+        for (int j = 0; j < n; j++) {
+            for (int i = 0; i < n; i++) {
+                seed = seed * 1103515245u + 12345u;
+                const float v = (float)((seed >> 8) & 0xffff) / 65536.0f - 0.5f;
+                A[((size_t)s * n + j) * n + i] = (s == singular && j == 1) ? 0.0f : (i == j) ? v + (float)n : v;
+            }
+            seed = seed * 1103515245u + 12345u;
+            B[(size_t)s * n + j] = (float)((seed >> 8) & 0xffff) / 65536.0f;
+        }
+    }
+}
+
+/* Element of system s in the interleaved layout of width W, see
+   sgesv_batched_views.h. */
+static size_t test_interleaved_a(int n, int W, int s, int i, int j)
+{
+    return (((size_t)(s / W) * n * n) + i + (size_t)j * n) * W + s % W;
+}
+
+static size_t test_interleaved_b(int n, int W, int s, int i)
+{
+    return ((size_t)(s / W) * n + i) * W + s % W;
+}
+
+/* Largest |A x - b| of the packed systems other than 'skip'. */
+static double test_residual(int n, int count, const float* A, const float* B, const float* X, int skip)
+{
+    double worst = 0.0;
+    for (int s = 0; s < count; s++) {
+        if (s == skip) {
+            continue;
+        }
+        for (int i = 0; i < n; i++) {
+            double r = -(double)B[(size_t)s * n + i];
+            for (int j = 0; j < n; j++) {
+                r += (double)A[((size_t)s * n + j) * n + i] * X[(size_t)s * n + j];
+            }
+            worst = fmax(worst, fabs(r));
+        }
+    }
+    return worst;
+}
+
+/* Solves the packed batch through a batch of the given backend and layout,
+   the interleaved one through copies in that layout. */
+static int test_solve_one(int32_t backend, int32_t layout, const float* A, const float* B, int singular,
+                          double* residual)
+{
+    const int n = TEST_N, count = TEST_COUNT, W = TEST_W;
+    const int groups = (count + W - 1) / W;
+    const size_t sizeA = (size_t)groups * W * n * n, sizeB = (size_t)groups * W * n;
+    slsb_context ctx = NULL;
+    slsb_batch batch = NULL;
+    float* LA = (float*)calloc(sizeA, sizeof(float));
+    float* LB = (float*)calloc(sizeB, sizeof(float));
+    float* LX = (float*)calloc(sizeB, sizeof(float));
+    float* X = (float*)calloc(sizeB, sizeof(float));
+    int32_t* info = (int32_t*)calloc((size_t)count, sizeof(int32_t));
+    int32_t status = SLSB_ERR_ALLOC;
+    int failed = 0;
+
+    *residual = INFINITY;
+    if (LA == NULL || LB == NULL || LX == NULL || X == NULL || info == NULL) {
+        failed += check(0, "cannot allocate");
+        goto cleanup;
+    }
+    for (int s = 0; s < count; s++) {
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                LA[layout == SLSB_LAYOUT_INTERLEAVED ? test_interleaved_a(n, W, s, i, j) : ((size_t)s * n + j) * n + i]
+                    = A[((size_t)s * n + j) * n + i];
+            }
+            LB[layout == SLSB_LAYOUT_INTERLEAVED ? test_interleaved_b(n, W, s, i) : (size_t)s * n + i]
+                = B[(size_t)s * n + i];
+        }
+    }
+
+    if (slsb_context_create(&ctx, backend, NULL) != SLSB_SUCCESS
+        || slsb_batch_create(&batch, ctx, n, count, SLSB_MEMORY_HOST, layout, W) != SLSB_SUCCESS) {
+        failed += check(0, "slsb_context_create or slsb_batch_create");
+        goto cleanup;
+    }
+    status = slsb_solve(batch, LA, LB, LX, info);
+    if (status != (singular >= 0 ? SLSB_SINGULAR : SLSB_SUCCESS)) {
+        printf("Error in: testSlsb, slsb_solve returned %d: %s\n", status, slsb_status_string(status));
+        failed++;
+        goto cleanup;
+    }
+    for (int s = 0; s < count; s++) {
+        if ((info[s] > 0) != (s == singular)) {
+            printf("Error in: testSlsb, info[%d] = %d\n", s, info[s]);
+            failed++;
+            goto cleanup;
+        }
+        for (int i = 0; i < n; i++) {
+            X[(size_t)s * n + i] = LX[layout == SLSB_LAYOUT_INTERLEAVED ? test_interleaved_b(n, W, s, i)
+                                                                         : (size_t)s * n + i];
+        }
+    }
+    *residual = test_residual(n, count, A, B, X, singular);
+    failed += check(*residual < TEST_RESIDUAL_TOL, "residual");
+
+cleanup:
+    if (batch != NULL) {
+        slsb_batch_destroy(batch);
+    }
+    if (ctx != NULL) {
+        slsb_context_destroy(ctx);
+    }
+    free(LA);
+    free(LB);
+    free(LX);
+    free(X);
+    free(info);
+    return failed;
+}
+
+static int test_solve(void)
+{
+    const int n = TEST_N, count = TEST_COUNT;
+    float* A = (float*)malloc((size_t)count * n * n * sizeof(float));
+    float* B = (float*)malloc((size_t)count * n * sizeof(float));
+    int64_t gpus = 0;
+    double residual[4] = { 0.0, 0.0, 0.0, 0.0 };
+    int failed = 0;
+
+    if (!test_built(n)) {
+        printf("solve   skipped: order %d is not built\n", n);
+        free(A);
+        free(B);
+        return 0;
+    }
+    if (A == NULL || B == NULL) {
+        failed += check(0, "cannot allocate");
+    }
+    else {
+        test_fill(n, count, A, B, -1);
+        failed += test_solve_one(SLSB_BACKEND_CPU, SLSB_LAYOUT_PACKED, A, B, -1, &residual[0]);
+        failed += test_solve_one(SLSB_BACKEND_CPU, SLSB_LAYOUT_INTERLEAVED, A, B, -1, &residual[1]);
+        test_fill(n, count, A, B, 17);
+        failed += test_solve_one(SLSB_BACKEND_CPU, SLSB_LAYOUT_PACKED, A, B, 17, &residual[2]);
+        if (slsb_query(SLSB_CAP_GPU_COUNT, &gpus) == SLSB_SUCCESS && gpus > 0) {
+            test_fill(n, count, A, B, -1);
+            failed += test_solve_one(SLSB_BACKEND_GPU, SLSB_LAYOUT_PACKED, A, B, -1, &residual[3]);
+        }
+    }
+    printf("solve   %s: n %d, %d systems, residuals %.1e (packed) %.1e (interleaved %d) %.1e (singular) %s\n",
+           failed ? "FAILED" : "ok", n, count, residual[0], residual[1], TEST_W, residual[2],
+           gpus > 0 ? "and GPU" : "no GPU");
+    free(A);
+    free(B);
+    return failed;
+}
+
+int main(void)
+{
+    int failed = 0;
+    failed += test_version();
+    failed += test_query();
+    failed += test_errors();
+    failed += test_solve();
+    return failed;
+}
@@ -0,0 +1,655 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "npy_batched.h"
+#include "stream_batched.h"
+#include "archive_batched.h"
+
+/*
+    Tests of the file solvers, run by `make check`:
+
+        npy     a small batch written with npy_batched_create, read back
+                header and data unchanged, solved by npy_batched_solve in
+                Fortran and in C order (the same X, a small residual)
+        stream  the same batch through stream_batched_solve with chunks
+                of a few systems, so that it takes several chunks and a
+                partial last one: X bitwise equal to the npy solve
+        resume  a checkpointed stream stopped after a few chunks, refused
+                with another chunk size, then resumed: X bitwise equal to
+                the npy solve; and a checkpoint refused once B has changed
+        archive the batch and a batch of order 4 packed into an archive
+                with interleaved IDs, its segments and index read back,
+                solved by ID range and by order, verified: X bitwise equal
+                to the npy solves; a corrupted segment fails the
+                verification, and an aborted packing is no archive
+        alias   an output that is A, by its name or through a link, is
+                refused and leaves A intact; a failed solve leaves an
+                existing X as it was, and no temporary file
+
+    The files go to a directory made under $TMPDIR (or /tmp), removed at
+    the end. Prints one line per test, after the messages of the solves
+    that are meant to fail; the exit code is the number of failed tests.
+*/
+
+#define TEST_N        8
+#define TEST_BATCH    1003  // not a multiple of the chunk systems
+#define TEST_CHUNK_BYTES    (64 * 1024)    // 7 chunks of the batch at n 8
+#define TEST_RESIDUAL_TOL   1e-4
+
+static char testDir[256];
+
+static void test_path(char* path, size_t len, const char* name)
+{
+    snprintf(path, len, "%s/%s", testDir, name);
+}
+
+// Diagonally dominant systems of order n, column-major packed as
+// cpuLinearSolverBatched takes them.
+static void test_fill(int n, long long batch, float* A, float* B)
+{
+    unsigned int seed = 12345;
+    for (long long s = 0; s < batch; s++) {
+        for (int j = 0; j < n; j++) {
+            for (int i = 0; i < n; i++) {
+                seed = seed * 1103515245u + 12345u;
+                float v = (float)((seed >> 8) & 0xffff) / 65536.0f - 0.5f;
+                A[s * n * n + j * n + i] = (i == j) ? v + (float)n : v;
+            }
+            seed = seed * 1103515245u + 12345u;
+            B[s * n + j] = (float)((seed >> 8) & 0xffff) / 65536.0f;
+        }
+    }
+}
+
+// Writes a float32 array with npy_batched_create. 0, or -1 with a message.
+static int test_write(const char* path, int fortran, int ndim, const long long* shape, const float* data,
+                      size_t bytes)
+{
+    npy_array a;
+    if (npy_batched_create(path, NPY_FLOAT32, fortran, ndim, shape, &a) != 0) {
+        return -1;
+    }
+    if (a.bytes != bytes) {
+        printf("Error in: test_write, %s has %zu bytes of data, expected %zu\n", path, a.bytes, bytes);
+        npy_batched_close(&a);
+        return -1;
+    }
+    memcpy(a.data, data, bytes);
+    npy_batched_close(&a);
+    return 0;
+}
+
+// Reads the data of path into data, checking the header. 0, or -1 with a message.
+static int test_read(const char* path, int fortran, int ndim, const long long* shape, float* data, size_t bytes)
+{
+    npy_array a;
+    if (npy_batched_open(path, 0, &a) != 0) {
+        return -1;
+    }
+    int resCode = 0;
+    if (a.dtype != NPY_FLOAT32 || a.fortran != fortran || a.ndim != ndim || a.bytes != bytes) {
+        resCode = -1;
+    }
+    for (int d = 0; resCode == 0 && d < ndim; d++) {
+        if (a.shape[d] != shape[d]) {
+            resCode = -1;
+        }
+    }
+    if (resCode != 0) {
+        printf("Error in: test_read, %s has not the header it was written with\n", path);
+    } else {
+        memcpy(data, a.data, bytes);
+    }
+    npy_batched_close(&a);
+    return resCode;
+}
+
+// Largest |A x - b| of the column-major batch.
+static double test_residual(int n, long long batch, const float* A, const float* B, const float* X)
+{
+    double worst = 0.0;
+    for (long long s = 0; s < batch; s++) {
+        for (int i = 0; i < n; i++) {
+            double r = -(double)B[s * n + i];
+            for (int j = 0; j < n; j++) {
+                r += (double)A[s * n * n + j * n + i] * X[s * n + j];
+            }
+            worst = fmax(worst, fabs(r));
+        }
+    }
+    return worst;
+}
+
+static int test_npy(const float* A, const float* B, float* X)
+{
+    const int n = TEST_N;
+    const long long batch = TEST_BATCH;
+    const size_t bytesA = (size_t)batch * n * n * sizeof(float);
+    const size_t bytesB = (size_t)batch * n * sizeof(float);
+    char pathA[300], pathB[300], pathX[300], pathAC[300], pathBC[300], pathXC[300];
+    test_path(pathA, sizeof(pathA), "A.npy");
+    test_path(pathB, sizeof(pathB), "B.npy");
+    test_path(pathX, sizeof(pathX), "X.npy");
+    test_path(pathAC, sizeof(pathAC), "AC.npy");
+    test_path(pathBC, sizeof(pathBC), "BC.npy");
+    test_path(pathXC, sizeof(pathXC), "XC.npy");
+
+    int failed = 0;
+    long long singular = -1;
+    double residual = 0.0;
+    float* back = (float*)malloc(bytesA);
+    float* AT = (float*)malloc(bytesA);
+    float* XC = (float*)malloc(bytesB);
+    if (back == NULL || AT == NULL || XC == NULL) {
+        printf("Error in: test_npy, cannot allocate\n");
+        failed = 1;
+        goto cleanup;
+    }
+
+    {
+        // Fortran order: (N, N, batch) and (N, batch)
+        const long long shapeA[3] = {n, n, batch};
+        const long long shapeB[2] = {n, batch};
+        if (test_write(pathA, 1, 3, shapeA, A, bytesA) != 0 || test_write(pathB, 1, 2, shapeB, B, bytesB) != 0
+            || test_read(pathA, 1, 3, shapeA, back, bytesA) != 0) {
+            failed = 1;
+            goto cleanup;
+        }
+        if (memcmp(back, A, bytesA) != 0) {
+            printf("Error in: test_npy, %s does not read back as written\n", pathA);
+            failed = 1;
+            goto cleanup;
+        }
+        if (npy_batched_solve(pathA, pathB, pathX, &singular) != 0 || singular != 0
+            || test_read(pathX, 1, 2, shapeB, X, bytesB) != 0) {
+            printf("Error in: test_npy, Fortran order solve failed (%lld singular)\n", singular);
+            failed = 1;
+            goto cleanup;
+        }
+        residual = test_residual(n, batch, A, B, X);
+        if (!(residual < TEST_RESIDUAL_TOL)) {
+            printf("Error in: test_npy, residual %g\n", residual);
+            failed = 1;
+            goto cleanup;
+        }
+    }
+    {
+        // C order: (batch, N, N) row-major systems and (batch, N)
+        const long long shapeA[3] = {batch, n, n};
+        const long long shapeB[2] = {batch, n};
+        for (long long s = 0; s < batch; s++) {
+            for (int j = 0; j < n; j++) {
+                for (int i = 0; i < n; i++) {
+                    AT[s * n * n + i * n + j] = A[s * n * n + j * n + i];
+                }
+            }
+        }
+        if (test_write(pathAC, 0, 3, shapeA, AT, bytesA) != 0 || test_write(pathBC, 0, 2, shapeB, B, bytesB) != 0
+            || npy_batched_solve(pathAC, pathBC, pathXC, &singular) != 0 || singular != 0
+            || test_read(pathXC, 0, 2, shapeB, XC, bytesB) != 0) {
+            printf("Error in: test_npy, C order solve failed\n");
+            failed = 1;
+            goto cleanup;
+        }
+        if (memcmp(XC, X, bytesB) != 0) {
+            printf("Error in: test_npy, C order X differs from Fortran order X\n");
+            failed = 1;
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    printf("npy     %s: n %d, batch %lld, residual %.2e\n", failed ? "FAILED" : "ok", n, batch, residual);
+    free(back);
+    free(AT);
+    free(XC);
+    return failed;
+}
+
+// X of npy_batched_solve is the reference: the chunks are solved by the same
+// solver, system by system, so the result does not depend on the chunking.
+static int test_stream(const float* X, int rowMajor)
+{
+    const int n = TEST_N;
+    const long long batch = TEST_BATCH;
+    const size_t bytesB = (size_t)batch * n * sizeof(float);
+    char pathA[300], pathB[300], pathX[300];
+    test_path(pathA, sizeof(pathA), rowMajor ? "AC.npy" : "A.npy");
+    test_path(pathB, sizeof(pathB), rowMajor ? "BC.npy" : "B.npy");
+    test_path(pathX, sizeof(pathX), "XS.npy");
+
+    int failed = 0;
+    stream_stats st;
+    memset(&st, 0, sizeof(st));
+    float* XS = (float*)malloc(bytesB);
+    if (XS == NULL) {
+        printf("Error in: test_stream, cannot allocate\n");
+        failed = 1;
+        goto cleanup;
+    }
+
+    {
+        stream_config cfg;
+        stream_batched_defaults(&cfg);
+        cfg.chunkBytes = TEST_CHUNK_BYTES;
+        cfg.buffers = 2;
+        const long long shapeB[2] = {rowMajor ? batch : n, rowMajor ? n : batch};
+        if (stream_batched_solve(pathA, pathB, pathX, &cfg, &st) != 0
+            || test_read(pathX, !rowMajor, 2, shapeB, XS, bytesB) != 0) {
+            printf("Error in: test_stream, stream solve failed\n");
+            failed = 1;
+            goto cleanup;
+        }
+        if (st.chunks < 2 || st.systems != batch || st.singular != 0) {
+            printf("Error in: test_stream, %lld chunks, %lld systems, %lld singular\n", st.chunks, st.systems,
+                   st.singular);
+            failed = 1;
+            goto cleanup;
+        }
+        if (memcmp(XS, X, bytesB) != 0) {
+            printf("Error in: test_stream, X differs from the npy solve\n");
+            failed = 1;
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    printf("stream  %s: %s order, %lld chunks of %d systems, io %s\n", failed ? "FAILED" : "ok",
+           rowMajor ? "C" : "Fortran", st.chunks, st.chunkSystems, st.io != NULL ? st.io : "-");
+    free(XS);
+    return failed;
+}
+
+// Stops a checkpointed stream partway and resumes it.
+static int test_resume(const float* X)
+{
+    const int n = TEST_N;
+    const long long batch = TEST_BATCH;
+    const size_t bytesB = (size_t)batch * n * sizeof(float);
+    const long long shapeB[2] = {n, batch};
+    char pathA[300], pathB[300], pathX[300], pathPart[300], pathCkp[300];
+    test_path(pathA, sizeof(pathA), "A.npy");
+    test_path(pathB, sizeof(pathB), "B.npy");
+    test_path(pathX, sizeof(pathX), "XK.npy");
+    test_path(pathPart, sizeof(pathPart), "XK.npy.part");
+    test_path(pathCkp, sizeof(pathCkp), "XK.ckp");
+
+    int failed = 0;
+    long long chunks = 0;
+    stream_stats st;
+    stream_config cfg;
+    memset(&st, 0, sizeof(st));
+    stream_batched_defaults(&cfg);
+    cfg.chunkBytes = TEST_CHUNK_BYTES;
+    cfg.buffers = 2;
+    cfg.checkpoint = pathCkp;
+    float* XK = (float*)malloc(bytesB);
+    if (XK == NULL) {
+        printf("Error in: test_resume, cannot allocate\n");
+        failed = 1;
+        goto cleanup;
+    }
+
+    // stopped after 3 chunks: X in progress and a checkpoint, no X yet
+    cfg.maxChunks = 3;
+    if (stream_batched_solve(pathA, pathB, pathX, &cfg, &st) != 1 || st.chunks != 3 || st.checkpoints < 1
+        || access(pathX, F_OK) == 0 || access(pathPart, F_OK) != 0 || access(pathCkp, F_OK) != 0) {
+        printf("Error in: test_resume, the solve did not stop after 3 chunks with a checkpoint\n");
+        failed = 1;
+        goto cleanup;
+    }
+
+    // another chunk size makes other chunks: refused, the checkpoint stays
+    cfg.maxChunks = 0;
+    cfg.chunkBytes = 2 * TEST_CHUNK_BYTES;
+    if (stream_batched_solve(pathA, pathB, pathX, &cfg, NULL) >= 0 || access(pathCkp, F_OK) != 0
+        || access(pathPart, F_OK) != 0) {
+        printf("Error in: test_resume, a checkpoint of another chunk size was used\n");
+        failed = 1;
+        goto cleanup;
+    }
+
+    // resumed: the 3 chunks are not solved again, X as without the stop
+    cfg.chunkBytes = TEST_CHUNK_BYTES;
+    if (stream_batched_solve(pathA, pathB, pathX, &cfg, &st) != 0 || st.resumedChunks != 3
+        || test_read(pathX, 1, 2, shapeB, XK, bytesB) != 0) {
+        printf("Error in: test_resume, the resumed solve failed\n");
+        failed = 1;
+        goto cleanup;
+    }
+    chunks = st.resumedChunks + st.chunks;
+    if (st.chunks < 1 || memcmp(XK, X, bytesB) != 0) {
+        printf("Error in: test_resume, X of the resumed solve differs from the npy solve\n");
+        failed = 1;
+        goto cleanup;
+    }
+    if (access(pathCkp, F_OK) == 0 || access(pathPart, F_OK) == 0) {
+        printf("Error in: test_resume, the checkpoint or X in progress remained\n");
+        failed = 1;
+        goto cleanup;
+    }
+
+    // stopped again, then B is written anew (same data, another
+    // modification time): the checkpoint is not of these inputs any more
+    unlink(pathX);
+    cfg.maxChunks = 3;
+    if (stream_batched_solve(pathA, pathB, pathX, &cfg, NULL) != 1) {
+        printf("Error in: test_resume, the second solve did not stop\n");
+        failed = 1;
+        goto cleanup;
+    }
+    {
+        const struct timespec past[2] = {{1000000000, 0}, {1000000000, 0}};
+        if (utimensat(AT_FDCWD, pathB, past, 0) != 0) {
+            printf("Error in: test_resume, cannot set the time of %s\n", pathB);
+            failed = 1;
+            goto cleanup;
+        }
+    }
+    cfg.maxChunks = 0;
+    if (stream_batched_solve(pathA, pathB, pathX, &cfg, NULL) >= 0 || access(pathX, F_OK) == 0) {
+        printf("Error in: test_resume, a checkpoint of other inputs was used\n");
+        failed = 1;
+        goto cleanup;
+    }
+
+cleanup:
+    printf("resume  %s: %lld chunks, 3 before the stop\n", failed ? "FAILED" : "ok", chunks);
+    free(XK);
+    return failed;
+}
+
+#define TEST_N4      4
+#define TEST_BATCH4  300
+
+// X of system slots [first, first + count) of the segment of order n.
+static const float* test_archive_x(const archive_batched* ar, int n, unsigned long long first)
+{
+    for (uint32_t k = 0; k < ar->header->segments; k++) {
+        if (ar->segment[k].n == (uint32_t)n) {
+            return (const float*)((const char*)ar->map + ar->segment[k].offset_x) + first * n;
+        }
+    }
+    return NULL;
+}
+
+// Packs the batch of order TEST_N (IDs 0-499 and 800-1302) and one of order
+// TEST_N4 (IDs 500-799), then reads and solves it as slsbSolve does.
+static int test_archive(const float* A, const float* B, const float* X)
+{
+    const int n = TEST_N, n4 = TEST_N4;
+    const long long batch = TEST_BATCH, batch4 = TEST_BATCH4, split = 500;
+    const size_t bytesB4 = (size_t)batch4 * n4 * sizeof(float);
+    char pathA4[300], pathB4[300], pathX4[300], pathAr[300];
+    test_path(pathA4, sizeof(pathA4), "A4.npy");
+    test_path(pathB4, sizeof(pathB4), "B4.npy");
+    test_path(pathX4, sizeof(pathX4), "X4.npy");
+    test_path(pathAr, sizeof(pathAr), "T.slsb");
+
+    int failed = 0, segment = -1;
+    long long solved = 0, singular = 0;
+    unsigned long long slot = 0;
+    long long capacity[33] = { 0 };
+    archive_writer* w = NULL;
+    archive_batched ar;
+    memset(&ar, 0, sizeof(ar));
+    ar.fd = -1;
+    float* A4 = (float*)malloc((size_t)batch4 * n4 * n4 * sizeof(float));
+    float* B4 = (float*)malloc(bytesB4);
+    float* X4 = (float*)malloc(bytesB4);
+    if (A4 == NULL || B4 == NULL || X4 == NULL) {
+        printf("Error in: test_archive, cannot allocate\n");
+        failed = 1;
+        goto cleanup;
+    }
+
+    // the reference X of order 4, from the npy solve
+    test_fill(n4, batch4, A4, B4);
+    {
+        const long long shapeA[3] = {n4, n4, batch4};
+        const long long shapeB[2] = {n4, batch4};
+        if (test_write(pathA4, 1, 3, shapeA, A4, (size_t)batch4 * n4 * n4 * sizeof(float)) != 0
+            || test_write(pathB4, 1, 2, shapeB, B4, bytesB4) != 0
+            || npy_batched_solve(pathA4, pathB4, pathX4, NULL) != 0
+            || test_read(pathX4, 1, 2, shapeB, X4, bytesB4) != 0) {
+            printf("Error in: test_archive, npy solve of order %d failed\n", n4);
+            failed = 1;
+            goto cleanup;
+        }
+    }
+
+    // pack
+    capacity[n] = batch;
+    capacity[n4] = batch4;
+    if (archive_batched_create(pathAr, capacity, &w) != 0
+        || archive_batched_append(w, n, A, B, split, 0) != 0
+        || archive_batched_append(w, n4, A4, B4, batch4, split) != 0
+        || archive_batched_append(w, n, A + split * n * n, B + split * n, batch - split, split + batch4) != 0) {
+        failed = 1;
+        goto cleanup;
+    }
+    {
+        archive_writer* last = w;
+        w = NULL;
+        if (archive_batched_finish(last) != 0) {
+            failed = 1;
+            goto cleanup;
+        }
+    }
+
+    // info: segments, runs, lookup of an ID
+    if (archive_batched_open(pathAr, 1, &ar) != 0) {
+        failed = 1;
+        goto cleanup;
+    }
+    if (ar.header->systems != (uint64_t)(batch + batch4) || ar.header->segments != 2 || ar.header->index_runs != 3
+        || archive_batched_find(&ar, split + 150, &segment, &slot) != 0 || ar.segment[segment].n != (uint32_t)n4
+        || slot != 150 || archive_batched_find(&ar, batch + batch4, &segment, &slot) == 0) {
+        printf("Error in: test_archive, the segments or the index are not as packed\n");
+        failed = 1;
+        goto cleanup;
+    }
+
+    // --verify, then --ids 0-799 --n 8: the first run of order 8 only
+    if (archive_batched_verify(&ar) != 0
+        || archive_batched_solve(&ar, 0, split + batch4 - 1, 1ULL << n, &solved, &singular) != 0
+        || solved != split || singular != 0) {
+        printf("Error in: test_archive, solve by IDs failed (%lld solved)\n", solved);
+        failed = 1;
+        goto cleanup;
+    }
+    if (memcmp(test_archive_x(&ar, n, 0), X, (size_t)split * n * sizeof(float)) != 0
+        || test_archive_x(&ar, n, split)[0] != 0.0f) {
+        printf("Error in: test_archive, X of the solve by IDs is wrong\n");
+        failed = 1;
+        goto cleanup;
+    }
+
+    // --n 4, then everything
+    if (archive_batched_solve(&ar, 0, ~0ULL, 1ULL << n4, &solved, &singular) != 0 || solved != batch4
+        || memcmp(test_archive_x(&ar, n4, 0), X4, bytesB4) != 0) {
+        printf("Error in: test_archive, solve of order %d failed (%lld solved)\n", n4, solved);
+        failed = 1;
+        goto cleanup;
+    }
+    if (archive_batched_solve(&ar, 0, ~0ULL, ~0ULL, &solved, &singular) != 0 || solved != batch + batch4
+        || memcmp(test_archive_x(&ar, n, 0), X, (size_t)batch * n * sizeof(float)) != 0) {
+        printf("Error in: test_archive, solve of the whole archive failed (%lld solved)\n", solved);
+        failed = 1;
+        goto cleanup;
+    }
+
+    // a flipped bit of A of the second segment fails the verification
+    ((char*)ar.map + ar.segment[1].offset_a)[100] ^= 1;
+    if (archive_batched_verify(&ar) == 0) {
+        printf("Error in: test_archive, a corrupted segment passed the verification\n");
+        failed = 1;
+        goto cleanup;
+    }
+    archive_batched_close(&ar);
+
+    // an aborted packing has no header
+    if (archive_batched_create(pathAr, capacity, &w) != 0 || archive_batched_append(w, n, A, B, split, 0) != 0) {
+        failed = 1;
+        goto cleanup;
+    }
+    archive_batched_abort(w);
+    w = NULL;
+    if (archive_batched_open(pathAr, 0, &ar) == 0) {
+        printf("Error in: test_archive, an aborted packing opens as an archive\n");
+        failed = 1;
+        goto cleanup;
+    }
+
+cleanup:
+    printf("archive %s: n %d and %d, %lld systems\n", failed ? "FAILED" : "ok", n, n4, batch + batch4);
+    if (w != NULL) {
+        archive_batched_abort(w);
+    }
+    archive_batched_close(&ar);
+    free(A4);
+    free(B4);
+    free(X4);
+    return failed;
+}
+
+// Files of the test directory that are temporary outputs, "<name>.npy.XXXXXX".
+static int test_leftovers()
+{
+    int count = 0;
+    DIR* dir = opendir(testDir);
+    if (dir != NULL) {
+        struct dirent* e;
+        while ((e = readdir(dir)) != NULL) {
+            count += strstr(e->d_name, ".npy.") != NULL;
+        }
+        closedir(dir);
+    }
+    return count;
+}
+
+// Solves that must be refused, with the files they must not change.
+static int test_alias(const float* A, const float* X)
+{
+    const int n = TEST_N;
+    const long long batch = TEST_BATCH;
+    const size_t bytesA = (size_t)batch * n * n * sizeof(float);
+    const size_t bytesB = (size_t)batch * n * sizeof(float);
+    const long long shapeA[3] = {n, n, batch};
+    const long long shapeB[2] = {n, batch};
+    char pathA[300], pathB[300], pathL[300], pathX[300];
+    test_path(pathA, sizeof(pathA), "A.npy");
+    test_path(pathB, sizeof(pathB), "B.npy");
+    test_path(pathL, sizeof(pathL), "AL.npy");
+    test_path(pathX, sizeof(pathX), "XS.npy");
+
+    int failed = 0;
+    stream_config cfg;
+    stream_batched_defaults(&cfg);
+    cfg.chunkBytes = TEST_CHUNK_BYTES;
+    cfg.buffers = 2;
+    float* back = (float*)malloc(bytesA);
+    if (back == NULL) {
+        printf("Error in: test_alias, cannot allocate\n");
+        failed = 1;
+        goto cleanup;
+    }
+    if (link(pathA, pathL) != 0) {
+        printf("Error in: test_alias, cannot link %s to %s\n", pathL, pathA);
+        failed = 1;
+        goto cleanup;
+    }
+
+    // the messages of the refused solves are expected
+    if (stream_batched_solve(pathA, pathB, pathA, &cfg, NULL) == 0
+        || stream_batched_solve(pathA, pathB, pathL, &cfg, NULL) == 0
+        || npy_batched_solve(pathA, pathB, pathA, NULL) == 0
+        || npy_batched_solve(pathA, pathB, pathL, NULL) == 0) {
+        printf("Error in: test_alias, a solve into A was not refused\n");
+        failed = 1;
+        goto cleanup;
+    }
+    if (test_read(pathA, 1, 3, shapeA, back, bytesA) != 0 || memcmp(back, A, bytesA) != 0) {
+        printf("Error in: test_alias, A was changed\n");
+        failed = 1;
+        goto cleanup;
+    }
+
+    // A is no B: the solves fail on the shapes, and XS of test_stream stays
+    if (stream_batched_solve(pathA, pathA, pathX, &cfg, NULL) == 0
+        || npy_batched_solve(pathA, pathA, pathX, NULL) == 0) {
+        printf("Error in: test_alias, a solve of mismatched files did not fail\n");
+        failed = 1;
+        goto cleanup;
+    }
+    if (test_read(pathX, 1, 2, shapeB, back, bytesB) != 0 || memcmp(back, X, bytesB) != 0) {
+        printf("Error in: test_alias, a failed solve changed X\n");
+        failed = 1;
+        goto cleanup;
+    }
+    if (test_leftovers() != 0) {
+        printf("Error in: test_alias, a failed solve left its temporary output\n");
+        failed = 1;
+        goto cleanup;
+    }
+
+cleanup:
+    printf("alias   %s\n", failed ? "FAILED" : "ok");
+    free(back);
+    return failed;
+}
+
+int main()
+{
+    const char* tmp = getenv("TMPDIR");
+    snprintf(testDir, sizeof(testDir), "%s/slsbTestXXXXXX", (tmp != NULL && tmp[0] != '\0') ? tmp : "/tmp");
+    if (mkdtemp(testDir) == NULL) {
+        printf("Error in: main, cannot create %s\n", testDir);
+        return 1;
+    }
+
+    const size_t bytesA = (size_t)TEST_BATCH * TEST_N * TEST_N * sizeof(float);
+    const size_t bytesB = (size_t)TEST_BATCH * TEST_N * sizeof(float);
+    float* A = (float*)malloc(bytesA);
+    float* B = (float*)malloc(bytesB);
+    float* X = (float*)malloc(bytesB);
+    int failed = 0;
+    if (A == NULL || B == NULL || X == NULL) {
+        printf("Error in: main, cannot allocate\n");
+        failed = 1;
+    } else {
+        test_fill(TEST_N, TEST_BATCH, A, B);
+        failed += test_npy(A, B, X);
+        if (failed == 0) {
+            failed += test_stream(X, 1);
+            failed += test_stream(X, 0);
+            failed += test_archive(A, B, X);
+            failed += test_alias(A, X);
+            failed += test_resume(X);
+        }
+    }
+
+    // everything the tests made, and any temporary file a solve left behind
+    DIR* dir = opendir(testDir);
+    if (dir != NULL) {
+        struct dirent* e;
+        while ((e = readdir(dir)) != NULL) {
+            char path[600];
+            if (strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0) {
+                snprintf(path, sizeof(path), "%s/%s", testDir, e->d_name);
+                unlink(path);
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(testDir);
+    free(A);
+    free(B);
+    free(X);
+    return failed;
+}
@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cuda_runtime.h>
+#include "utils.h"
+#include "flops.h"
+#include "operation_batched.h"
+#include "smallsq_dispatch.h"
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+/*
+    Offline tuning of the launch tables.
+
+    For every n in [1, 32] this tool sweeps
+      - on the GPU, if one is present: the ntcol of the smallsq factorization
+        kernels (every value with ceilpow2(n)*ntcol <= 1024), timing
+        linearDecompSLU_batched on a device resident batch;
+      - on the CPU: every CPU_VARIANT_* and OpenMP chunk size of the CPU engine,
+        timing cpu_solve_batched (cpuLinearSolverBatchedVariant without
+        instrumentation);
+    and writes the winners as constexpr tables in a header that replaces
+    src/tunedTables_batched.h, plus a report of every measurement. The ntcol
+    table is tied to the GPU name, magma_get_sgetrf_batched_ntcol uses it on
+    that GPU only.
+
+    Build and run from Release/ (or Debug/):
+        make tuneTables
+        ./tuneTables -o ../src/tunedTables_batched.h -r tuneTables_report.txt
+    then rebuild the library. Options:
+        -o <file>  generated header, default tunedTables_batched.h
+        -r <file>  report, default tuneTables_report.txt
+        -b <n>     systems per measurement, default cpu_tune_batch_count(n):
+                   CPU_TUNE_LLC_MULTIPLE last level caches, bounded in bytes
+        -t <n>     timed repetitions per candidate (fastest kept), default 5
+*/
+
+#define TUNE_MAX_N   32
+
+static const char* tune_variant_name(int variant)
+{
+    switch (variant) {
+        case CPU_VARIANT_SCALAR:   return "scalar";
+        case CPU_VARIANT_GATHER4:  return "gather4";
+        case CPU_VARIANT_GATHER8:  return "gather8";
+        case CPU_VARIANT_GATHER16: return "gather16";
+        default:                   return "unknown";
+    }
+}
+
+// Sweeps ntcol for size n, returns the best one (0 on error).
+static int tune_gpu_size(FILE* report, int n, int batchCount, int reps, const float* h_A)
+{
+    magma_int_t ldda = magma_roundup(n, 32);
+    float *d_A0 = NULL, *d_A = NULL;
+    magma_int_t *dipiv = NULL, *dinfo_array = NULL;
+    float **dA_array = NULL;
+    magma_int_t **dipiv_array = NULL;
+    cudaStream_t stream;
+    double best = -1.0;
+    int best_ntcol = 0;
+    magma_int_t resCode = 0;
+
+    cudaStreamCreate(&stream);
+
+    resCode = magma_smalloc(&d_A0, ldda * n * batchCount);
+    if (resCode != 0) {printf("Error in: d_A0 malloc\n"); goto cleanup;}
+    resCode = magma_smalloc(&d_A, ldda * n * batchCount);
+    if (resCode != 0) {printf("Error in: d_A malloc\n"); goto cleanup;}
+    resCode = magma_imalloc(&dipiv, n * batchCount);
+    if (resCode != 0) {printf("Error in: dipiv malloc\n"); goto cleanup;}
+    resCode = magma_imalloc(&dinfo_array, batchCount);
+    if (resCode != 0) {printf("Error in: dinfo_array malloc\n"); goto cleanup;}
+    resCode = magma_malloc((void**)&dA_array, batchCount * sizeof(float*));
+    if (resCode != 0) {printf("Error in: dA_array malloc\n"); goto cleanup;}
+    resCode = magma_malloc((void**)&dipiv_array, batchCount * sizeof(magma_int_t*));
+    if (resCode != 0) {printf("Error in: dipiv_array malloc\n"); goto cleanup;}
+
+    resCode = cublasSetMatrixAsync(n, n * batchCount, sizeof(float), h_A, n, d_A0, ldda, stream);
+    if (resCode != 0) {printf("Error in: A copy\n"); goto cleanup;}
+    magma_sset_pointer(dA_array, d_A, ldda, 0, 0, ldda * n, batchCount, stream);
+    magma_iset_pointer(dipiv_array, dipiv, 1, 0, 0, n, batchCount, stream);
+
+    for (int ntcol = 1; ntcol <= 32 && magma_ceilpow2(n) * ntcol <= 1024; ntcol++) {
+        double time = -1.0;
+        magma_set_sgetrf_batched_ntcol(ntcol);
+        for (int r = -1; r < reps; r++) {   // r = -1 is the warm up
+            cudaMemcpyAsync(d_A, d_A0, sizeof(float) * ldda * n * batchCount,
+                            cudaMemcpyDeviceToDevice, stream);
+            cudaStreamSynchronize(stream);
+            double t = magma_wtime();
+            linearDecompSLU_batched(n, n, dA_array, ldda, dipiv_array, dinfo_array, batchCount, stream);
+            resCode = cudaStreamSynchronize(stream);
+            t = magma_wtime() - t;
+            if (resCode != 0) {printf("Error in: linearDecompSLU_batched, ntcol %d\n", ntcol); goto cleanup;}
+            if (r >= 0 && (time < 0 || t < time)) {
+                time = t;
+            }
+        }
+        fprintf(report, "gpu  n %2d  ntcol %2d  %10.3f us  %8.2f GFLOP/s\n", n, ntcol,
+                time * 1e6, batchCount * FLOPS_SGETRF(n, n) / time / 1e9);
+        if (best < 0 || time < best) {
+            best = time;
+            best_ntcol = ntcol;
+        }
+    }
+
+cleanup:
+    magma_set_sgetrf_batched_ntcol(0);
+    magma_free(d_A0);
+    magma_free(d_A);
+    magma_free(dipiv);
+    magma_free(dinfo_array);
+    magma_free(dA_array);
+    magma_free(dipiv_array);
+    cudaStreamDestroy(stream);
+    return resCode == 0 ? best_ntcol : 0;
+}
+
+// Sweeps the CPU variants and chunks for size n.
+static void tune_cpu_size(FILE* report, int n, int batchCount, int reps,
+                          float* h_A, float* h_B, float* h_X, int* h_info,
+                          int* best_variant, int* best_chunk)
+{
+    double best = -1.0;
+    *best_variant = CPU_VARIANT_SCALAR;
+    *best_chunk   = 0;
+
+    for (int variant = CPU_VARIANT_SCALAR; variant <= CPU_VARIANT_GATHER16; variant++) {
+        for (int c = 0; c < CPU_TUNE_NCHUNKS; c++) {
+            double time = -1.0;
+            for (int r = -1; r < reps; r++) {
+                double t = magma_wtime();
+                cpu_solve_batched(n, variant, cpu_tune_chunks[c], h_A, h_B, h_X, h_info, batchCount);
+                t = magma_wtime() - t;
+                if (r >= 0 && (time < 0 || t < time)) {
+                    time = t;
+                }
+            }
+            fprintf(report, "cpu  n %2d  %-8s chunk %3d  %10.3f us  %8.2f GFLOP/s\n", n,
+                    tune_variant_name(variant), cpu_tune_chunks[c], time * 1e6,
+                    batchCount * (FLOPS_SGETRF(n, n) + FLOPS_SGETRS(n, 1)) / time / 1e9);
+            if (best < 0 || time < best) {
+                best = time;
+                *best_variant = variant;
+                *best_chunk   = cpu_tune_chunks[c];
+            }
+        }
+    }
+}
+
+static void tune_write_table(FILE* f, const char* type, const char* name, const int* values)
+{
+    fprintf(f, "constexpr %s %s[32] =\n    {", type, name);
+    for (int i = 0; i < TUNE_MAX_N; i++) {
+        fprintf(f, "%d%s", values[i], i + 1 < TUNE_MAX_N ? ", " : "};\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* header_path = "tunedTables_batched.h";
+    const char* report_path = "tuneTables_report.txt";
+    int fixedBatch = 0;         // -b, else sized per n
+    int batchCount = 0;
+    int reps = CPU_TUNE_REPS;
+    int ngpu = 0, arch = 0, threads = 1;
+    int ntcol[TUNE_MAX_N], variant[TUNE_MAX_N], chunk[TUNE_MAX_N];
+    char cpu_model[256], gpu_name[256] = "";
+    float *h_A = NULL, *h_B = NULL, *h_X = NULL;
+    int *h_info = NULL;
+    int failed = 0;
+    FILE *report, *header;
+    time_t now = time(NULL);
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if      (strcmp(argv[i], "-o") == 0) header_path = argv[i+1];
+        else if (strcmp(argv[i], "-r") == 0) report_path = argv[i+1];
+        else if (strcmp(argv[i], "-b") == 0) fixedBatch  = atoi(argv[i+1]);
+        else if (strcmp(argv[i], "-t") == 0) reps        = atoi(argv[i+1]);
+        else {
+            printf("Usage: tuneTables [-o header] [-r report] [-b batchCount] [-t repetitions]\n");
+            return 1;
+        }
+    }
+    if (fixedBatch < 0 || reps < 1) {
+        printf("Usage: tuneTables [-o header] [-r report] [-b batchCount] [-t repetitions]\n");
+        return 1;
+    }
+
+    report = fopen(report_path, "w");
+    if (report == NULL) {
+        printf("Error in: cannot open %s\n", report_path);
+        return 1;
+    }
+
+    magma_init();
+    if (cudaGetDeviceCount(&ngpu) != cudaSuccess) {
+        ngpu = 0;
+    }
+    if (ngpu > 0) {
+        cudaDeviceProp prop;
+        cudaGetDeviceProperties(&prop, 0);
+        snprintf(gpu_name, sizeof(gpu_name), "%s", prop.name);
+        arch = magma_getdevice_arch();
+    }
+#if defined(_OPENMP)
+    threads = omp_get_max_threads();
+#endif
+    cpu_tune_model(cpu_model, sizeof(cpu_model));
+
+    fprintf(report, "tuneTables report, %s", ctime(&now));
+    fprintf(report, "gpu: %s (arch %d)\n", ngpu > 0 ? gpu_name : "none", arch);
+    fprintf(report, "cpu: %s, %d threads\n", cpu_model, threads);
+    if (fixedBatch > 0) {
+        fprintf(report, "batchCount %d, fastest of %d runs\n\n", fixedBatch, reps);
+    }
+    else {
+        fprintf(report, "batchCount of %d last level caches, fastest of %d runs\n\n",
+                CPU_TUNE_LLC_MULTIPLE, reps);
+    }
+
+    for (int n = 1; n <= TUNE_MAX_N; n++) {
+        // without a GPU the table is written untuned (arch 0), any value does
+        ntcol[n-1] = (ngpu > 0) ? (int)magma_get_sgetrf_batched_ntcol(n, n) : 1;
+        variant[n-1] = CPU_VARIANT_SCALAR;
+        chunk[n-1] = 0;
+        if (!smallsq_size_instantiated(n)) {
+            continue;
+        }
+
+        batchCount = fixedBatch > 0 ? fixedBatch : cpu_tune_batch_count(n);
+        if (magma_smalloc_cpu(&h_A, (size_t)n * n * batchCount) != 0
+            || magma_smalloc_cpu(&h_B, (size_t)n * batchCount) != 0
+            || magma_smalloc_cpu(&h_X, (size_t)n * batchCount) != 0
+            || magma_malloc_cpu((void**)&h_info, sizeof(int) * batchCount) != 0) {
+            printf("Error in: host malloc\n");
+            failed = 1;
+            break;      // the buffers already allocated are freed below
+        }
+        cpu_tune_fill(h_A, h_B, n, batchCount);
+
+        if (ngpu > 0) {
+            int best = tune_gpu_size(report, n, batchCount, reps, h_A);
+            if (best > 0) {
+                ntcol[n-1] = best;
+            }
+        }
+        tune_cpu_size(report, n, batchCount, reps, h_A, h_B, h_X, h_info, &variant[n-1], &chunk[n-1]);
+        fprintf(report, "best n %2d: ntcol %d, cpu %s chunk %d\n\n", n, ntcol[n-1],
+                tune_variant_name(variant[n-1]), chunk[n-1]);
+        printf("n = %2d: ntcol %2d, cpu %s chunk %d\n", n, ntcol[n-1],
+               tune_variant_name(variant[n-1]), chunk[n-1]);
+
+        magma_free_cpu(h_A);
+        magma_free_cpu(h_B);
+        magma_free_cpu(h_X);
+        magma_free_cpu(h_info);
+        h_A = h_B = h_X = NULL;
+        h_info = NULL;
+    }
+    magma_free_cpu(h_A);
+    magma_free_cpu(h_B);
+    magma_free_cpu(h_X);
+    magma_free_cpu(h_info);
+    fclose(report);
+    if (failed) {
+        // the sizes left are not measured, keep the current header
+        magma_finalize();
+        return 1;
+    }
+
+    header = fopen(header_path, "w");
+    if (header == NULL) {
+        printf("Error in: cannot open %s\n", header_path);
+        magma_finalize();
+        return 1;
+    }
+    fprintf(header, "#ifndef TUNEDTABLES_BATCHED_H\n#define TUNEDTABLES_BATCHED_H\n\n");
+    fprintf(header, "/*\n    Tuned launch tables, generated by tools/tuneTables.cpp on %s", ctime(&now));
+    if (fixedBatch > 0) {
+        fprintf(header, "    (batchCount %d, fastest of %d runs). Do not edit by hand.\n*/\n\n", fixedBatch, reps);
+    }
+    else {
+        fprintf(header, "    (batches of %d last level caches, fastest of %d runs). Do not edit by hand.\n*/\n\n",
+                CPU_TUNE_LLC_MULTIPLE, reps);
+    }
+    fprintf(header, "#include \"magma_types.h\"\n\n");
+    fprintf(header, "// compute capability and name of the GPU the ntcol table was measured on,\n"
+                    "// 0 if none; the table is used on GPUs of that name only\n");
+    fprintf(header, "#define TUNED_SGETRF_NTCOL_ARCH  %d\n", ngpu > 0 ? arch : 0);
+    fprintf(header, "#define TUNED_SGETRF_NTCOL_GPU   \"%s\"\n\n", gpu_name);
+    tune_write_table(header, "magma_int_t", "tuned_sgetrf_batched_ntcol", ntcol);
+    fprintf(header, "\n#define TUNED_CPU_MODEL    \"%s\"\n", cpu_model);
+    fprintf(header, "#define TUNED_CPU_THREADS  %d\n\n", threads);
+    tune_write_table(header, "int", "tuned_cpu_variant", variant);
+    tune_write_table(header, "int", "tuned_cpu_chunk", chunk);
+    fprintf(header, "\n#endif //TUNEDTABLES_BATCHED_H\n");
+    fclose(header);
+
+    printf("tables written to %s, report to %s\n", header_path, report_path);
+    magma_finalize();
+    return 0;
+}